@@ -0,0 +1,172 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cstring>
+#include <stdexcept>
+#include "BufferPool.hpp"
+#include "Global.hpp"
+
+using namespace kanzi;
+
+BufferPool::BufferPool(int64 maxRetained)
+{
+    _maxRetained = maxRetained;
+    _retained = 0;
+    _hits = 0;
+    _misses = 0;
+}
+
+BufferPool::~BufferPool()
+{
+    clear();
+}
+
+// Smallest class that can hold 'size' bytes (-1 if too big to be pooled)
+int BufferPool::ceilClass(int size)
+{
+    if (size <= MIN_SIZE)
+        return 0;
+
+    const int log = Global::_log2(uint32(size));
+    const int shift = log - 2;
+    const int sub = (size - (1 << log) + (1 << shift) - 1) >> shift;
+    const int idx = ((log - LOG_MIN_SIZE) << 2) + sub;
+    return (idx < NB_CLASSES) ? idx : -1;
+}
+
+// Largest class that a buffer of 'capacity' bytes can serve (-1 if too small)
+int BufferPool::floorClass(int capacity)
+{
+    if (capacity < MIN_SIZE)
+        return -1;
+
+    const int log = Global::_log2(uint32(capacity));
+    const int sub = (capacity - (1 << log)) >> (log - 2);
+    const int idx = ((log - LOG_MIN_SIZE) << 2) + sub;
+    return (idx < NB_CLASSES) ? idx : NB_CLASSES - 1;
+}
+
+byte* BufferPool::acquire(int size, int& capacity) THROW
+{
+    if (size < 0)
+        throw invalid_argument("Invalid buffer size (must be at least 0)");
+
+    const int idx = ceilClass(size);
+
+    if (idx < 0) {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _misses++;
+        }
+
+        capacity = size;
+        return new byte[size];
+    }
+
+    capacity = classSize(idx);
+
+    {
+        lock_guard<mutex> lock(_mutex);
+
+        if (_free[idx].empty() == false) {
+            byte* buf = _free[idx].back();
+            _free[idx].pop_back();
+            _retained -= capacity;
+            _hits++;
+            return buf;
+        }
+
+        _misses++;
+    }
+
+    return new byte[capacity];
+}
+
+void BufferPool::release(byte* buffer, int capacity)
+{
+    if (buffer == nullptr)
+        return;
+
+    const int idx = floorClass(capacity);
+
+    if (idx >= 0) {
+        lock_guard<mutex> lock(_mutex);
+        const int size = classSize(idx);
+
+        if ((_maxRetained < 0) || (_retained + size <= _maxRetained)) {
+            _free[idx].push_back(buffer);
+            _retained += size;
+            return;
+        }
+    }
+
+    delete[] buffer;
+}
+
+void BufferPool::reserve(SliceArray<byte>& sa, int size, int keep) THROW
+{
+    if (sa._length >= size)
+        return;
+
+    int capacity;
+    byte* buf = acquire(size, capacity);
+
+    if (keep > 0)
+        memcpy(&buf[0], &sa._array[0], keep);
+
+    release(sa._array, sa._length);
+    sa._array = buf;
+    sa._length = capacity;
+}
+
+void BufferPool::release(SliceArray<byte>& sa)
+{
+    release(sa._array, sa._length);
+    sa._array = new byte[0];
+    sa._length = 0;
+    sa._index = 0;
+}
+
+void BufferPool::clear()
+{
+    lock_guard<mutex> lock(_mutex);
+
+    for (int i = 0; i < NB_CLASSES; i++) {
+        for (uint j = 0; j < _free[i].size(); j++)
+            delete[] _free[i][j];
+
+        _free[i].clear();
+    }
+
+    _retained = 0;
+}
+
+uint64 BufferPool::hits()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _hits;
+}
+
+uint64 BufferPool::misses()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _misses;
+}
+
+int64 BufferPool::retained()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _retained;
+}
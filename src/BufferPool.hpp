@@ -0,0 +1,89 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BufferPool_
+#define _BufferPool_
+
+#include <mutex>
+#include <vector>
+#include "SliceArray.hpp"
+#include "types.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+
+   // Recycle the block buffers of the compressed streams. A pool can be shared
+   // by several streams (see Context), so that the buffers released by a stream
+   // are reused by the next one instead of being reallocated for each file.
+   // Buffers are sorted in size classes: 4 classes per power of 2 from 4 KB
+   // (at most 25% of unused capacity). A buffer is returned with the capacity
+   // of its class. Buffers larger than the largest class are not pooled.
+   // All methods are thread safe.
+   class BufferPool
+   {
+   public:
+       static const int MIN_SIZE = 4096;
+
+       // maxRetained: max number of bytes kept in the pool (-1 means no limit).
+       // Released buffers that do not fit are deallocated.
+       BufferPool(int64 maxRetained = -1);
+
+       ~BufferPool();
+
+       // Return a buffer of at least 'size' bytes. Its capacity is stored in 'capacity'.
+       byte* acquire(int size, int& capacity) THROW;
+
+       // Give back a buffer obtained from acquire() or allocated with new[].
+       // The buffer must not be used after this call.
+       void release(byte* buffer, int capacity);
+
+       // Make sure that the slice can hold 'size' bytes. If the buffer is
+       // replaced, the first 'keep' bytes are copied to the new buffer.
+       void reserve(SliceArray<byte>& sa, int size, int keep = 0) THROW;
+
+       // Give back the buffer of the slice and leave it empty
+       void release(SliceArray<byte>& sa);
+
+       // Deallocate all the pooled buffers
+       void clear();
+
+       uint64 hits();
+
+       uint64 misses();
+
+       // Number of bytes currently held by the pool
+       int64 retained();
+
+   private:
+       static const int LOG_MIN_SIZE = 12;
+       static const int NB_CLASSES = (30 - LOG_MIN_SIZE + 1) * 4;
+
+       mutex _mutex;
+       vector<byte*> _free[NB_CLASSES];
+       int64 _maxRetained;
+       int64 _retained;
+       uint64 _hits;
+       uint64 _misses;
+
+       static int ceilClass(int size);
+
+       static int floorClass(int size);
+
+       static int classSize(int idx) { return (4 + (idx & 3)) << ((idx >> 2) + LOG_MIN_SIZE - 2); }
+   };
+}
+#endif
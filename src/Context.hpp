@@ -14,6 +14,7 @@ limitations under the License.
 #ifndef _Context_
 #define _Context_
 
+#include <cstdlib>
 #include <map>
 #include <sstream>
 #include <string>
@@ -21,15 +22,21 @@ limitations under the License.
 
 using namespace std;
 
+class ThreadPool;
+
 namespace kanzi
 {
 
+	class BufferPool;
+	class CodecCache;
+	class Dictionary;
+
 	class Context
 	{
 	public:
-		Context() {};
+		Context(ThreadPool* pool = nullptr) { _pool = pool; _buffers = nullptr; _codecs = nullptr; _dictionary = nullptr; };
 		Context(Context& ctx);
-		Context(map<string, string>& ctx);
+		Context(map<string, string>& ctx, ThreadPool* pool = nullptr);
 		~Context() {};
 
 		bool has(const string& key);
@@ -40,8 +47,29 @@ namespace kanzi
 		void putLong(const string& key, int64 value);
 		void putString(const string& key, const string& value);
 
+		// Optional pool of worker threads shared by the tasks (not owned)
+		ThreadPool* getPool() const { return _pool; }
+		void setPool(ThreadPool* pool) { _pool = pool; }
+
+		// Optional pool of block buffers shared by the streams (not owned)
+		BufferPool* getBufferPool() const { return _buffers; }
+		void setBufferPool(BufferPool* buffers) { _buffers = buffers; }
+
+		// Optional cache of transforms and entropy models reused by the streams
+		// (not owned). A cache must not be shared by encoding and decoding streams.
+		CodecCache* getCodecCache() const { return _codecs; }
+		void setCodecCache(CodecCache* codecs) { _codecs = codecs; }
+
+		// Optional shared dictionary of the LZ, ROLZ and TEXT transforms (not owned)
+		const Dictionary* getDictionary() const { return _dictionary; }
+		void setDictionary(const Dictionary* dictionary) { _dictionary = dictionary; }
+
 	private:
 		map<string, string> _map;
+		ThreadPool* _pool;
+		BufferPool* _buffers;
+		CodecCache* _codecs;
+		const Dictionary* _dictionary;
 
 	};
 
@@ -49,12 +77,20 @@ namespace kanzi
 	inline Context::Context(Context& ctx)
 		: _map(ctx._map)
 	{
+		_pool = ctx._pool;
+		_buffers = ctx._buffers;
+		_codecs = ctx._codecs;
+		_dictionary = ctx._dictionary;
 	}
 
 
-	inline Context::Context(map<string, string>& ctx)
+	inline Context::Context(map<string, string>& ctx, ThreadPool* pool)
 		: _map(ctx)
 	{
+		_pool = pool;
+		_buffers = nullptr;
+		_codecs = nullptr;
+		_dictionary = nullptr;
 	}
 
 
@@ -71,11 +107,7 @@ namespace kanzi
 		if (it == _map.end())
 			return defValue;
 
-		stringstream ss;
-		int res;
-		ss << it->second.c_str();
-		ss >> res;
-		return res;
+		return atoi(it->second.c_str());
 	}
 
 
@@ -86,11 +118,7 @@ namespace kanzi
 		if (it == _map.end())
 			return defValue;
 
-		stringstream ss;
-		int64 res;
-		ss << it->second.c_str();
-		ss >> res;
-		return res;
+		return int64(atoll(it->second.c_str()));
 	}
 
 
@@ -103,16 +131,12 @@ namespace kanzi
 
 	inline void Context::putInt(const string& key, int value)
 	{
-		stringstream ss;
-		ss << value;
-		_map[key] = ss.str();
+		_map[key] = to_string(value);
 	}
 
 	inline void Context::putLong(const string& key, int64 value)
 	{
-		stringstream ss;
-		ss << value;
-		_map[key] = ss.str();
+		_map[key] = to_string(value);
 	}
 
 	inline void Context::putString(const string& key, const string& value)
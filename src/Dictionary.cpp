@@ -0,0 +1,207 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "Dictionary.hpp"
+#include "Memory.hpp"
+#include "io/IOException.hpp"
+#include "util/XXHash32.hpp"
+
+using namespace kanzi;
+
+Dictionary::Dictionary(const byte data[], int length) THROW
+{
+    if ((length < MIN_SIZE) || (length > MAX_SIZE)) {
+        stringstream ss;
+        ss << "The dictionary size must be in [" << MIN_SIZE << ".." << MAX_SIZE << "], got " << length;
+        throw invalid_argument(ss.str());
+    }
+
+    _data = new byte[length];
+    _size = length;
+    memcpy(&_data[0], &data[0], size_t(length));
+    XXHash32 hash(MAGIC);
+    _id = uint32(hash.hash(_data, _size));
+}
+
+Dictionary* Dictionary::load(istream& is) THROW
+{
+    byte header[12];
+    is.read(reinterpret_cast<char*>(&header[0]), 12);
+
+    if (is.gcount() != 12)
+        throw IOException("Cannot read dictionary header", Error::ERR_READ_FILE);
+
+    if (BigEndian::readInt32(&header[0]) != MAGIC)
+        throw IOException("Invalid dictionary file", Error::ERR_INVALID_FILE);
+
+    const uint32 id = uint32(BigEndian::readInt32(&header[4]));
+    const int size = BigEndian::readInt32(&header[8]);
+
+    if ((size < MIN_SIZE) || (size > MAX_SIZE))
+        throw IOException("Invalid dictionary file, incorrect size", Error::ERR_INVALID_FILE);
+
+    vector<byte> data(size);
+    is.read(reinterpret_cast<char*>(&data[0]), size);
+
+    if (is.gcount() != size)
+        throw IOException("Cannot read dictionary content", Error::ERR_READ_FILE);
+
+    Dictionary* dict = new Dictionary(&data[0], size);
+
+    if (dict->getId() != id) {
+        delete dict;
+        throw IOException("Invalid dictionary file, corrupted content", Error::ERR_CRC_CHECK);
+    }
+
+    return dict;
+}
+
+void Dictionary::save(ostream& os) const THROW
+{
+    byte header[12];
+    BigEndian::writeInt32(&header[0], MAGIC);
+    BigEndian::writeInt32(&header[4], int32(_id));
+    BigEndian::writeInt32(&header[8], _size);
+    os.write(reinterpret_cast<const char*>(&header[0]), 12);
+    os.write(reinterpret_cast<const char*>(&_data[0]), _size);
+
+    if (os.good() == false)
+        throw IOException("Cannot write dictionary", Error::ERR_WRITE_FILE);
+}
+
+// Simplified COVER algorithm (Liao, Petri, Moffat, Wirth, "Effective
+// Construction of Relative Lempel-Ziv Dictionaries"): the samples are split
+// in epochs, one segment is selected per epoch. The score of a segment is the
+// sum of the number of samples containing each of its d-mers. The d-mers of a
+// selected segment no longer count (they are in the dictionary already).
+Dictionary* Dictionary::train(const byte samples[], const int sizes[], int nbSamples, int maxSize) THROW
+{
+    if ((maxSize < MIN_SIZE) || (maxSize > MAX_SIZE)) {
+        stringstream ss;
+        ss << "The dictionary size must be in [" << MIN_SIZE << ".." << MAX_SIZE << "], got " << maxSize;
+        throw invalid_argument(ss.str());
+    }
+
+    int64 total64 = 0;
+
+    for (int i = 0; i < nbSamples; i++)
+        total64 += int64(sizes[i]);
+
+    if (total64 < MIN_SIZE) {
+        stringstream ss;
+        ss << "Not enough data to train a dictionary: at least " << MIN_SIZE << " bytes of samples required";
+        throw invalid_argument(ss.str());
+    }
+
+    if (total64 > int64(1 << 30))
+        throw invalid_argument("Too much data to train a dictionary: at most 1 GB of samples");
+
+    const int total = int(total64);
+
+    if (total <= maxSize)
+        return new Dictionary(samples, total);
+
+    const int shift = 64 - HASH_LOG;
+    const uint64 prime = 0x9E3779B185EBCA87ULL;
+    vector<uint32> freqs(1 << HASH_LOG, 0);
+    vector<int> lastSample(1 << HASH_LOG, -1);
+    int start = 0;
+
+    // Count the samples containing each d-mer
+    for (int s = 0; s < nbSamples; s++) {
+        const int end = start + sizes[s] - DMER_SIZE;
+
+        for (int i = start; i <= end; i++) {
+            const uint32 h = uint32((uint64(LittleEndian::readLong64(&samples[i])) * prime) >> shift);
+
+            if (lastSample[h] != s) {
+                lastSample[h] = s;
+                freqs[h]++;
+            }
+        }
+
+        start += sizes[s];
+    }
+
+    // A d-mer found in a single sample is only worth something if there is
+    // a single sample
+    const uint32 minFreq = (nbSamples > 1) ? 2 : 1;
+    const int nbDmers = SEGMENT_SIZE - DMER_SIZE + 1;
+    const int maxSegments = maxSize / SEGMENT_SIZE;
+    const int epochSize = max(total / maxSegments, SEGMENT_SIZE);
+    vector<pair<uint64, int> > segments; // score, offset
+
+    for (int epoch = 0; epoch + SEGMENT_SIZE <= total; epoch += epochSize) {
+        const int end = min(epoch + epochSize, total);
+
+        if (end - epoch < SEGMENT_SIZE)
+            break;
+
+        uint64 score = 0;
+
+        for (int i = epoch; i < epoch + nbDmers; i++) {
+            const uint32 f = freqs[uint32((uint64(LittleEndian::readLong64(&samples[i])) * prime) >> shift)];
+            score += (f >= minFreq) ? f : 0;
+        }
+
+        uint64 bestScore = score;
+        int bestPos = epoch;
+
+        // Slide the segment over the epoch
+        for (int p = epoch + 1; p + SEGMENT_SIZE <= end; p++) {
+            const uint32 fIn = freqs[uint32((uint64(LittleEndian::readLong64(&samples[p + nbDmers - 1])) * prime) >> shift)];
+            const uint32 fOut = freqs[uint32((uint64(LittleEndian::readLong64(&samples[p - 1])) * prime) >> shift)];
+            score += (fIn >= minFreq) ? fIn : 0;
+            score -= (fOut >= minFreq) ? fOut : 0;
+
+            if (score > bestScore) {
+                bestScore = score;
+                bestPos = p;
+            }
+        }
+
+        if (bestScore == 0)
+            continue;
+
+        segments.push_back(pair<uint64, int>(bestScore, bestPos));
+
+        for (int i = bestPos; i < bestPos + nbDmers; i++)
+            freqs[uint32((uint64(LittleEndian::readLong64(&samples[i])) * prime) >> shift)] = 0;
+    }
+
+    // Keep the best segments, in increasing order of score
+    sort(segments.begin(), segments.end());
+    const int nbSegments = min(int(segments.size()), maxSegments);
+
+    if (nbSegments * SEGMENT_SIZE < MIN_SIZE) {
+        // Nothing in common between the samples: use the most recent data
+        return new Dictionary(&samples[total - maxSize], maxSize);
+    }
+
+    vector<byte> data(nbSegments * SEGMENT_SIZE);
+    int idx = 0;
+
+    for (int i = int(segments.size()) - nbSegments; i < int(segments.size()); i++) {
+        memcpy(&data[idx], &samples[segments[i].second], SEGMENT_SIZE);
+        idx += SEGMENT_SIZE;
+    }
+
+    return new Dictionary(&data[0], idx);
+}
@@ -0,0 +1,78 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _Dictionary_
+#define _Dictionary_
+
+#include <iostream>
+#include "types.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+
+   // Shared dictionary: content typical of the data to compress (EG. built
+   // from sample files by 'kanzi --train'). The LZ, ROLZ and TEXT transforms
+   // process each block as if it followed the dictionary, so that a small
+   // block (EG. one message) compresses like the end of a bigger one.
+   // A stream records the id of its dictionary and the same dictionary must
+   // be provided to decompress it (see Context::setDictionary()).
+   class Dictionary
+   {
+   public:
+       static const int MIN_SIZE = 256;
+       static const int MAX_SIZE = 1 << 20;
+
+       // Copy the content. Throw invalid_argument if the size is not in
+       // [MIN_SIZE..MAX_SIZE].
+       Dictionary(const byte data[], int length) THROW;
+
+       ~Dictionary() { delete[] _data; }
+
+       const byte* getData() const { return _data; }
+
+       int getSize() const { return _size; }
+
+       // Hash of the content
+       uint32 getId() const { return _id; }
+
+       // Read a dictionary file. Throw an IOException if it is invalid.
+       static Dictionary* load(istream& is) THROW;
+
+       void save(ostream& os) const THROW;
+
+       // Build a dictionary of at most 'maxSize' bytes from the concatenated
+       // samples (of sizes 'sizes'). The segments that occur in the most
+       // samples are selected, the most frequent ones last (closest to the
+       // data).
+       static Dictionary* train(const byte samples[], const int sizes[], int nbSamples, int maxSize) THROW;
+
+   private:
+       static const int MAGIC = 0x4B4E5A44; // "KNZD"
+       static const int DMER_SIZE = 8; // length of the strings counted in the samples
+       static const int SEGMENT_SIZE = 128; // length of the strings copied to the dictionary
+       static const int HASH_LOG = 22;
+
+       byte* _data;
+       int _size;
+       uint32 _id;
+
+       Dictionary(const Dictionary&);
+
+       Dictionary& operator=(const Dictionary&);
+   };
+}
+#endif
@@ -14,43 +14,46 @@ limitations under the License.
 */
 
 #include <sstream>
-#include <ctime>
+#include <chrono>
 #include <cstdio>
 #include "Event.hpp"
 
 using namespace kanzi;
 
-Event::Event(Event::Type type, int id, int64 size, clock_t evtTime)
+Event::Event(Event::Type type, int id, int64 size, int64 evtTime)
     : _type(type)
     , _time(evtTime)
+    , _threadId(currentThreadId())
     , _msg()
 {
     _id = id;
     _size = size;
     _hash = 0;
-    _hashing = false;
+    _hashType = NO_HASH;
 }
 
-Event::Event(Event::Type type, int id, const string& msg, clock_t evtTime)
+Event::Event(Event::Type type, int id, const string& msg, int64 evtTime)
     : _type(type)
     , _time(evtTime)
+    , _threadId(currentThreadId())
     , _msg(msg)
 {
     _id = id;
     _size = 0;
     _hash = 0;
-    _hashing = false;
+    _hashType = NO_HASH;
 }
 
-Event::Event(Event::Type type, int id, int64 size, int hash, bool hashing, clock_t evtTime)
+Event::Event(Event::Type type, int id, int64 size, uint64 hash, HashType hashType, int64 evtTime, int threadId)
     : _type(type)
     , _time(evtTime)
+    , _threadId(threadId)
     , _msg()
 {
     _id = id;
     _size = size;
     _hash = hash;
-    _hashing = hashing;
+    _hashType = hashType;
 }
 
 string Event::toString() const
@@ -66,10 +69,16 @@ string Event::toString() const
 
     ss << ", \"size\":" << getSize();
     ss << ", \"time\":" << getTime();
+    ss << ", \"thread\":" << getThreadId();
 
-    if (_hashing == true) {
+    if (_hashType == SIZE_32) {
         char buf[32];
-        sprintf(buf, "%08X", getHash());
+        sprintf(buf, "%08X", uint32(getHash()));
+        ss << ", \"hash\":" << buf;
+    }
+    else if (_hashType == SIZE_64) {
+        char buf[32];
+        sprintf(buf, "%016llX", (unsigned long long)getHash());
         ss << ", \"hash\":" << buf;
     }
 
@@ -77,6 +86,23 @@ string Event::toString() const
     return ss.str();
 }
 
+int64 Event::now()
+{
+    return int64(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+int Event::currentThreadId()
+{
+#ifdef CONCURRENCY_ENABLED
+    static atomic_int counter(0);
+    static thread_local int id = counter.fetch_add(1);
+    return id;
+#else
+    return 0;
+#endif
+}
+
 string Event::getTypeAsString() const
 {
     switch (_type) {
@@ -104,6 +130,9 @@ string Event::getTypeAsString() const
     case DECOMPRESSION_END:
         return "DECOMPRESSION_END";
 
+    case AFTER_HEADER_DECODING:
+        return "AFTER_HEADER_DECODING";
+
     default:
         return "Unknown Type";
     }
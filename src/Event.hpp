@@ -16,7 +16,7 @@ limitations under the License.
 #ifndef _Event_
 #define _Event_
 
-#include <time.h>
+#include <string>
 #include "types.hpp"
 #include "concurrent.hpp"
 
@@ -39,11 +39,21 @@ namespace kanzi
               AFTER_HEADER_DECODING
           };
 
-          Event(Type type, int id, const string& msg, clock_t evtTime);
+          enum HashType {
+              NO_HASH,
+              SIZE_32,
+              SIZE_64
+          };
+
+          // The event time is in nanoseconds (see now()). The thread id is the
+          // one of the calling thread unless provided (event emitted on behalf
+          // of another thread).
+          Event(Type type, int id, const string& msg, int64 evtTime);
 
-          Event(Type type, int id, int64 size, clock_t evtTime);
+          Event(Type type, int id, int64 size, int64 evtTime);
 
-          Event(Type type, int id, int64 size, int hash, bool hashing, clock_t evtTime);
+          Event(Type type, int id, int64 size, uint64 hash, HashType hashType, int64 evtTime,
+              int threadId = currentThreadId());
 
           ~Event() {}
 
@@ -55,19 +65,33 @@ namespace kanzi
 
           string getTypeAsString() const;
 
-          clock_t getTime() const { return _time; }
+          // Monotonic wall clock time in nanoseconds (origin unspecified)
+          int64 getTime() const { return _time; }
+
+          int getThreadId() const { return _threadId; }
 
-          int getHash() const { return (_hashing) ? _hash : 0; }
+          uint64 getHash() const { return (_hashType != NO_HASH) ? _hash : 0; }
+
+          HashType getHashType() const { return _hashType; }
 
           string toString() const;
 
+          // Monotonic wall clock time in nanoseconds. Unlike clock(), it does
+          // not depend on the CPU time used by the other threads.
+          static int64 now();
+
+          // Small integer identifying the calling thread (0 for the first
+          // thread asking for it)
+          static int currentThreadId();
+
       private:
           int _id;
           int64 _size;
-          int _hash;
+          uint64 _hash;
           Event::Type _type;
-          bool _hashing;
-          clock_t _time;
+          HashType _hashType;
+          int64 _time;
+          int _threadId;
           string _msg;
       };
 }
@@ -0,0 +1,634 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define KANZI_EXPORTS
+
+#include <algorithm>
+#include <cstdlib>
+#include <istream>
+#include <map>
+#include <sstream>
+#include <new>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include "libkanzi.h"
+#include "../BitStreamException.hpp"
+#include "../Context.hpp"
+#include "../Dictionary.hpp"
+#include "../Error.hpp"
+#include "../entropy/EntropyCodecFactory.hpp"
+#include "../function/FunctionFactory.hpp"
+#include "../io/CompressedInputStream.hpp"
+#include "../io/CompressedOutputStream.hpp"
+#include "../io/IOException.hpp"
+#include "../io/MemoryCodec.hpp"
+
+using namespace kanzi;
+using namespace std;
+
+struct kanzi_params
+{
+    // Same keys and values as the context built by BlockCompressor
+    map<string, string> _map;
+    const Dictionary* _dictionary; // not owned
+
+    kanzi_params();
+};
+
+struct kanzi_dictionary
+{
+    Dictionary* _dict;
+
+    kanzi_dictionary(Dictionary* dict) : _dict(dict) {}
+
+    ~kanzi_dictionary() { delete _dict; }
+};
+
+namespace
+{
+    thread_local string lastError;
+
+    const int STREAM_BUFFER_SIZE = 65536;
+
+    // Levels of the kanzi tool (see BlockCompressor::getTransformAndCodec)
+    const char* const LEVEL_TRANSFORMS[] = {
+        "NONE", "TEXT+LZ", "TEXT+ROLZ", "TEXT+ROLZX", "TEXT+BWT+RANK+ZRLT",
+        "TEXT+BWT+SRT+ZRLT", "LZP+TEXT+BWT", "X86+RLT+TEXT", "X86+RLT+TEXT"
+    };
+
+    const char* const LEVEL_CODECS[] = {
+        "NONE", "HUFFMAN", "NONE", "NONE", "ANS0", "FPAQ", "CM", "TPAQ", "TPAQX"
+    };
+
+    int fail(int code, const string& msg)
+    {
+        lastError = msg;
+        return code;
+    }
+
+    // Translate an exception thrown by the library into an error code
+    int fail(const exception& e, int defaultCode)
+    {
+        int code = defaultCode;
+
+        if (dynamic_cast<const IOException*>(&e) != nullptr)
+            code = static_cast<const IOException&>(e).error();
+        else if (dynamic_cast<const invalid_argument*>(&e) != nullptr)
+            code = Error::ERR_INVALID_PARAM;
+        else if (dynamic_cast<const bad_alloc*>(&e) != nullptr)
+            code = Error::ERR_UNKNOWN;
+
+        return fail(code, e.what());
+    }
+
+    bool parseBool(const string& value, string& res)
+    {
+        string str = value;
+        transform(str.begin(), str.end(), str.begin(), ::toupper);
+
+        if ((str == STR_TRUE) || (str == "1"))
+            res = STR_TRUE;
+        else if ((str == STR_FALSE) || (str == "0"))
+            res = STR_FALSE;
+        else
+            return false;
+
+        return true;
+    }
+
+    bool parseLong(const string& value, int64 minValue, int64 maxValue, int64& res)
+    {
+        if ((value.length() == 0) || (value.length() > 18))
+            return false;
+
+        for (size_t i = 0; i < value.length(); i++) {
+            if ((value[i] < '0') || (value[i] > '9'))
+                return false;
+        }
+
+        res = int64(atoll(value.c_str()));
+        return (res >= minValue) && (res <= maxValue);
+    }
+
+    // Adapter of the write callback to the ostream expected by the
+    // compressed stream. The bitstream already buffers its output.
+    class CallbackOutputBuffer : public streambuf
+    {
+    public:
+        kanzi_write_fn _write;
+        void* _opaque;
+        bool _failed;
+
+        CallbackOutputBuffer(kanzi_write_fn write, void* opaque)
+            : _write(write), _opaque(opaque), _failed(false) {}
+
+    protected:
+        streamsize xsputn(const char* data, streamsize length)
+        {
+            if ((_failed == true) || (_write(_opaque, (const uint8_t*) data, size_t(length)) != 0)) {
+                _failed = true;
+                return 0;
+            }
+
+            return length;
+        }
+
+        int_type overflow(int_type c)
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()) == true)
+                return traits_type::not_eof(c);
+
+            const char b = traits_type::to_char_type(c);
+            return (xsputn(&b, 1) == 1) ? c : traits_type::eof();
+        }
+    };
+
+    // Adapter of the read callback to the istream expected by the
+    // compressed stream
+    class CallbackInputBuffer : public streambuf
+    {
+    public:
+        kanzi_read_fn _read;
+        void* _opaque;
+        bool _failed;
+
+        CallbackInputBuffer(kanzi_read_fn read, void* opaque)
+            : _read(read), _opaque(opaque), _failed(false)
+        {
+            setg(_buffer, _buffer, _buffer);
+        }
+
+    protected:
+        int_type underflow()
+        {
+            if (gptr() < egptr())
+                return traits_type::to_int_type(*gptr());
+
+            if (_failed == true)
+                return traits_type::eof();
+
+            const int64_t n = _read(_opaque, (uint8_t*) _buffer, sizeof(_buffer));
+
+            if ((n < 0) || (n > int64_t(sizeof(_buffer)))) {
+                _failed = true;
+                return traits_type::eof();
+            }
+
+            if (n == 0)
+                return traits_type::eof();
+
+            setg(_buffer, _buffer, _buffer + n);
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        char _buffer[STREAM_BUFFER_SIZE];
+    };
+}
+
+kanzi_params::kanzi_params()
+{
+    _map["transform"] = "BWT+RANK+ZRLT";
+    _map["codec"] = "ANS0";
+    _map["extra"] = STR_FALSE;
+    _map["blockSize"] = to_string(CompressionParams::DEFAULT_BLOCK_SIZE);
+    _map["jobs"] = "1";
+    _map["checksum"] = STR_FALSE;
+    _map["skipBlocks"] = STR_FALSE;
+    _map["dedup"] = STR_FALSE;
+    _map["releaseBuffers"] = STR_FALSE;
+    _map["maxMemory"] = "0";
+    _map["flushInterval"] = "0";
+    _dictionary = nullptr;
+}
+
+struct kanzi_cstream
+{
+    CallbackOutputBuffer _buffer;
+    ostream _os;
+    CompressedOutputStream* _cos;
+
+    kanzi_cstream(kanzi_write_fn write, void* opaque)
+        : _buffer(write, opaque), _os(&_buffer), _cos(nullptr) {}
+
+    ~kanzi_cstream() { delete _cos; }
+
+    int fail(const exception& e)
+    {
+        if (_buffer._failed == true)
+            return ::fail(Error::ERR_WRITE_FILE, "Write callback failed");
+
+        return ::fail(e, Error::ERR_PROCESS_BLOCK);
+    }
+};
+
+struct kanzi_dstream
+{
+    CallbackInputBuffer _buffer;
+    istream _is;
+    CompressedInputStream* _cis;
+
+    kanzi_dstream(kanzi_read_fn read, void* opaque)
+        : _buffer(read, opaque), _is(&_buffer), _cis(nullptr) {}
+
+    ~kanzi_dstream() { delete _cis; }
+
+    int fail(const exception& e)
+    {
+        if (_buffer._failed == true)
+            return ::fail(Error::ERR_READ_FILE, "Read callback failed");
+
+        return ::fail(e, Error::ERR_PROCESS_BLOCK);
+    }
+};
+
+namespace
+{
+    // Only the single shot API has a memory codec view of the parameters
+    CompressionParams toCompressionParams(const kanzi_params* params)
+    {
+        if (params == nullptr)
+            return CompressionParams();
+
+        Context ctx(const_cast<map<string, string>&>(params->_map));
+        const string str = ctx.getString("checksum");
+        CompressionParams cp(ctx.getString("transform"), ctx.getString("codec"),
+            ctx.getInt("blockSize"), (str == "64") ? 64 : ((str == "32") ? 32 : 0));
+        cp._dictionary = params->_dictionary;
+        return cp;
+    }
+}
+
+int kanzi_version(void)
+{
+    return (KANZI_VERSION_MAJOR << 16) | KANZI_VERSION_MINOR;
+}
+
+const char* kanzi_last_error(void)
+{
+    return lastError.c_str();
+}
+
+kanzi_params* kanzi_params_create(void)
+{
+    try {
+        return new kanzi_params();
+    }
+    catch (exception& e) {
+        fail(e, Error::ERR_UNKNOWN);
+        return nullptr;
+    }
+}
+
+void kanzi_params_free(kanzi_params* params)
+{
+    delete params;
+}
+
+int kanzi_params_set(kanzi_params* params, const char* name, const char* value)
+{
+    if ((params == nullptr) || (name == nullptr) || (value == nullptr))
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    try {
+        const string key = name;
+        const string val = value;
+        map<string, string>& m = params->_map;
+        string str;
+        int64 n;
+
+        if (key == "level") {
+            if (parseLong(val, 0, 8, n) == false)
+                return fail(Error::ERR_INVALID_PARAM, "Invalid compression level (must be in [0..8]): " + val);
+
+            m["transform"] = LEVEL_TRANSFORMS[n];
+            m["codec"] = LEVEL_CODECS[n];
+            m["extra"] = (n == 8) ? STR_TRUE : STR_FALSE;
+        }
+        else if (key == "transform") {
+            // Throw invalid_argument if unknown. Curate input (EG. NONE+NONE+xxxx => xxxx)
+            m["transform"] = FunctionFactory<byte>::getName(FunctionFactory<byte>::getType(value));
+        }
+        else if (key == "entropy") {
+            str = val;
+            transform(str.begin(), str.end(), str.begin(), ::toupper);
+            EntropyCodecFactory::getType(str.c_str());
+            m["codec"] = str;
+            m["extra"] = (str == "TPAQX") ? STR_TRUE : STR_FALSE;
+        }
+        else if (key == "blockSize") {
+            if ((parseLong(val, 1024, 1024 * 1024 * 1024, n) == false) || ((n & -16) != n))
+                return fail(Error::ERR_BLOCK_SIZE, "Invalid block size (must be a multiple of 16 in [1024..1073741824]): " + val);
+
+            m["blockSize"] = val;
+        }
+        else if (key == "jobs") {
+            if (parseLong(val, 1, 64, n) == false)
+                return fail(Error::ERR_INVALID_PARAM, "Invalid number of jobs (must be in [1..64]): " + val);
+
+            m["jobs"] = val;
+        }
+        else if (key == "checksum") {
+            // Size of the block checksums, "true" means 32 bits
+            if ((val == "32") || (val == "64"))
+                str = val;
+            else if (parseBool(val, str) == false)
+                return fail(Error::ERR_INVALID_PARAM, "Invalid value for checksum (must be 32, 64, true or false): " + val);
+            else if (str == STR_TRUE)
+                str = "32";
+
+            m["checksum"] = str;
+        }
+        else if ((key == "skipBlocks") || (key == "dedup") || (key == "releaseBuffers")) {
+            if (parseBool(val, str) == false)
+                return fail(Error::ERR_INVALID_PARAM, "Invalid value for " + key + " (must be true or false): " + val);
+
+            m[key] = str;
+        }
+        else if (key == "maxMemory") {
+            if (parseLong(val, 0, int64(1) << 60, n) == false)
+                return fail(Error::ERR_INVALID_PARAM, "Invalid memory budget: " + val);
+
+            m["maxMemory"] = val;
+        }
+        else if (key == "flushInterval") {
+            if (parseLong(val, 0, 1 << 30, n) == false)
+                return fail(Error::ERR_INVALID_PARAM, "Invalid flush interval: " + val);
+
+            m["flushInterval"] = val;
+        }
+        else {
+            return fail(Error::ERR_INVALID_PARAM, "Unknown parameter: " + key);
+        }
+    }
+    catch (exception& e) {
+        return fail(e, Error::ERR_INVALID_PARAM);
+    }
+
+    return KANZI_OK;
+}
+
+int kanzi_params_set_dictionary(kanzi_params* params, const kanzi_dictionary* dict)
+{
+    if (params == nullptr)
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    params->_dictionary = (dict != nullptr) ? dict->_dict : nullptr;
+    return KANZI_OK;
+}
+
+kanzi_dictionary* kanzi_dictionary_load(const uint8_t* data, size_t length)
+{
+    if (data == nullptr) {
+        fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+        return nullptr;
+    }
+
+    try {
+        istringstream is(string((const char*) data, length));
+        return new kanzi_dictionary(Dictionary::load(is));
+    }
+    catch (exception& e) {
+        fail(e, Error::ERR_INVALID_FILE);
+        return nullptr;
+    }
+}
+
+void kanzi_dictionary_free(kanzi_dictionary* dict)
+{
+    delete dict;
+}
+
+kanzi_cstream* kanzi_cstream_create(const kanzi_params* params, kanzi_write_fn write, void* opaque)
+{
+    if ((params == nullptr) || (write == nullptr)) {
+        fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+        return nullptr;
+    }
+
+    kanzi_cstream* cs = nullptr;
+
+    try {
+        cs = new kanzi_cstream(write, opaque);
+        Context ctx(const_cast<map<string, string>&>(params->_map));
+        ctx.setDictionary(params->_dictionary);
+        cs->_cos = new CompressedOutputStream(cs->_os, ctx);
+        return cs;
+    }
+    catch (exception& e) {
+        fail(e, Error::ERR_CREATE_COMPRESSOR);
+        delete cs;
+        return nullptr;
+    }
+}
+
+int kanzi_cstream_write(kanzi_cstream* cs, const uint8_t* data, size_t length)
+{
+    if ((cs == nullptr) || ((data == nullptr) && (length != 0)))
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    try {
+        // CompressedOutputStream::write() takes at most 2 GB
+        while (length > 0) {
+            const size_t chunk = min(length, size_t(1) << 30);
+            cs->_cos->write((const char*) data, streamsize(chunk));
+            data += chunk;
+            length -= chunk;
+        }
+    }
+    catch (exception& e) {
+        return cs->fail(e);
+    }
+
+    return KANZI_OK;
+}
+
+int kanzi_cstream_flush(kanzi_cstream* cs)
+{
+    if (cs == nullptr)
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    try {
+        cs->_cos->flush();
+    }
+    catch (exception& e) {
+        return cs->fail(e);
+    }
+
+    return (cs->_buffer._failed == true) ? fail(Error::ERR_WRITE_FILE, "Write callback failed") : KANZI_OK;
+}
+
+int kanzi_cstream_poll(kanzi_cstream* cs, int* delay)
+{
+    if (cs == nullptr)
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    try {
+        const int d = cs->_cos->poll();
+
+        if (delay != nullptr)
+            *delay = d;
+    }
+    catch (exception& e) {
+        return cs->fail(e);
+    }
+
+    return (cs->_buffer._failed == true) ? fail(Error::ERR_WRITE_FILE, "Write callback failed") : KANZI_OK;
+}
+
+int kanzi_cstream_close(kanzi_cstream* cs)
+{
+    if (cs == nullptr)
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    try {
+        cs->_cos->close();
+    }
+    catch (exception& e) {
+        return cs->fail(e);
+    }
+
+    return (cs->_buffer._failed == true) ? fail(Error::ERR_WRITE_FILE, "Write callback failed") : KANZI_OK;
+}
+
+void kanzi_cstream_free(kanzi_cstream* cs)
+{
+    // The destructor of the compressed stream closes it and ignores failures
+    delete cs;
+}
+
+kanzi_dstream* kanzi_dstream_create(const kanzi_params* params, kanzi_read_fn read, void* opaque)
+{
+    if (read == nullptr) {
+        fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+        return nullptr;
+    }
+
+    kanzi_dstream* ds = nullptr;
+
+    try {
+        ds = new kanzi_dstream(read, opaque);
+        map<string, string> m;
+
+        if (params != nullptr) {
+            m["jobs"] = params->_map.at("jobs");
+            m["maxMemory"] = params->_map.at("maxMemory");
+            m["releaseBuffers"] = params->_map.at("releaseBuffers");
+        }
+
+        Context ctx(m);
+
+        if (params != nullptr)
+            ctx.setDictionary(params->_dictionary);
+
+        ds->_cis = new CompressedInputStream(ds->_is, ctx);
+        return ds;
+    }
+    catch (exception& e) {
+        fail(e, Error::ERR_CREATE_DECOMPRESSOR);
+        delete ds;
+        return nullptr;
+    }
+}
+
+int64_t kanzi_dstream_read(kanzi_dstream* ds, uint8_t* data, size_t length)
+{
+    if ((ds == nullptr) || ((data == nullptr) && (length != 0)))
+        return -fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    int64_t res = 0;
+
+    try {
+        // CompressedInputStream::read() takes at most 2 GB
+        while (length > 0) {
+            const size_t chunk = min(length, size_t(1) << 30);
+            ds->_cis->read((char*) data, streamsize(chunk));
+            const size_t n = size_t(ds->_cis->gcount());
+            res += int64_t(n);
+
+            if (n < chunk)
+                break;
+
+            data += chunk;
+            length -= chunk;
+        }
+    }
+    catch (exception& e) {
+        return -ds->fail(e);
+    }
+
+    // A failed callback looks like the end of the data to the bitstream
+    if (ds->_buffer._failed == true)
+        return -fail(Error::ERR_READ_FILE, "Read callback failed");
+
+    return res;
+}
+
+void kanzi_dstream_free(kanzi_dstream* ds)
+{
+    delete ds;
+}
+
+size_t kanzi_compress_bound(const kanzi_params* params, size_t length)
+{
+    try {
+        return MemoryCodec::getMaxEncodedLength(length, toCompressionParams(params));
+    }
+    catch (exception& e) {
+        fail(e, Error::ERR_INVALID_PARAM);
+        return 0;
+    }
+}
+
+int kanzi_compress_buffer(const kanzi_params* params, const uint8_t* src, size_t srcLength,
+    uint8_t* dst, size_t dstCapacity, size_t* dstLength)
+{
+    if (dstLength == nullptr)
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    try {
+        *dstLength = MemoryCodec::compress((const byte*) src, srcLength, (byte*) dst, dstCapacity,
+            toCompressionParams(params));
+    }
+    catch (exception& e) {
+        return fail(e, Error::ERR_PROCESS_BLOCK);
+    }
+
+    return KANZI_OK;
+}
+
+int kanzi_decompress_buffer(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t dstCapacity,
+    size_t* dstLength)
+{
+    return kanzi_decompress_buffer_dict(nullptr, src, srcLength, dst, dstCapacity, dstLength);
+}
+
+int kanzi_decompress_buffer_dict(const kanzi_dictionary* dict, const uint8_t* src, size_t srcLength,
+    uint8_t* dst, size_t dstCapacity, size_t* dstLength)
+{
+    if (dstLength == nullptr)
+        return fail(Error::ERR_MISSING_PARAM, "Invalid null argument");
+
+    try {
+        *dstLength = MemoryCodec::decompress((const byte*) src, srcLength, (byte*) dst, dstCapacity,
+            (dict != nullptr) ? dict->_dict : nullptr);
+    }
+    catch (exception& e) {
+        return fail(e, Error::ERR_PROCESS_BLOCK);
+    }
+
+    return KANZI_OK;
+}
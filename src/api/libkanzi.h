@@ -0,0 +1,183 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+ C interface of the Kanzi library, for embedding in C programs and for
+ bindings of other languages.
+ All objects are opaque handles created and released by the library. No
+ C++ exception crosses this interface: every function reports failures
+ through its return value and kanzi_last_error() describes the last one.
+ The functions returning an int return KANZI_OK (0) on success or one of
+ the KANZI_ERR_* codes (same values as the exit codes of the kanzi tool).
+ Only the functions declared here are exported by the shared library.
+*/
+
+#ifndef _libkanzi_
+#define _libkanzi_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) || defined(WIN32)
+   #if defined(KANZI_EXPORTS)
+      #define KANZI_API __declspec(dllexport)
+   #elif defined(KANZI_DLL)
+      #define KANZI_API __declspec(dllimport)
+   #else
+      #define KANZI_API
+   #endif
+#elif defined(__GNUC__) && (__GNUC__ >= 4)
+   #define KANZI_API __attribute__((visibility("default")))
+#else
+   #define KANZI_API
+#endif
+
+#define KANZI_VERSION_MAJOR 1
+#define KANZI_VERSION_MINOR 7
+
+#define KANZI_OK                      0
+#define KANZI_ERR_MISSING_PARAM       1
+#define KANZI_ERR_BLOCK_SIZE          2
+#define KANZI_ERR_INVALID_CODEC       3
+#define KANZI_ERR_CREATE_COMPRESSOR   4
+#define KANZI_ERR_CREATE_DECOMPRESSOR 5
+#define KANZI_ERR_READ_FILE          11
+#define KANZI_ERR_WRITE_FILE         12
+#define KANZI_ERR_PROCESS_BLOCK      13
+#define KANZI_ERR_INVALID_FILE       15
+#define KANZI_ERR_STREAM_VERSION     16
+#define KANZI_ERR_CREATE_STREAM      17
+#define KANZI_ERR_INVALID_PARAM      18
+#define KANZI_ERR_CRC_CHECK          19
+#define KANZI_ERR_UNKNOWN           127
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   typedef struct kanzi_params kanzi_params;
+   typedef struct kanzi_cstream kanzi_cstream;
+   typedef struct kanzi_dstream kanzi_dstream;
+   typedef struct kanzi_dictionary kanzi_dictionary;
+
+   /* Sink of the compressed data: must consume the 'length' bytes and
+      return 0, or return a non zero value to report a failure. */
+   typedef int (*kanzi_write_fn)(void* opaque, const uint8_t* data, size_t length);
+
+   /* Source of the compressed data: return the number of bytes copied to
+      'data' (at most 'length'), 0 at the end of the data or a negative value
+      to report a failure. */
+   typedef int64_t (*kanzi_read_fn)(void* opaque, uint8_t* data, size_t length);
+
+   /* Version of the library as (major << 16) | minor */
+   KANZI_API int kanzi_version(void);
+
+   /* Message of the last failure of the calling thread ("" if none) */
+   KANZI_API const char* kanzi_last_error(void);
+
+
+   /* Compression parameters. The defaults are the ones of the kanzi tool
+      (BWT+RANK+ZRLT transform, ANS0 entropy codec, 1 MB blocks, 1 job, no
+      checksum). */
+   KANZI_API kanzi_params* kanzi_params_create(void);
+
+   KANZI_API void kanzi_params_free(kanzi_params* params);
+
+   /* Set one parameter by name. Accepted names and values:
+        "level"         0 to 8, sets "transform" and "entropy"
+        "transform"     EG. "BWT+RANK+ZRLT" or "NONE"
+        "entropy"       EG. "ANS0", "HUFFMAN", "CM" or "NONE"
+        "blockSize"     bytes, multiple of 16 in [1024..1073741824]
+        "jobs"          number of concurrent tasks (>= 1)
+        "checksum"      "32" or "64" (bits per block), "true" (32) or "false"
+        "skipBlocks"    "true" or "false"
+        "dedup"         "true" or "false" (streaming compression only)
+        "releaseBuffers" "true" or "false", release the BWT and BWTS buffers
+                        between blocks (EX: for streams open for a long time).
+                        The peak memory of a block is unchanged.
+        "maxMemory"     bytes (0 for no limit)
+        "flushInterval" milliseconds (0 to disable) */
+   KANZI_API int kanzi_params_set(kanzi_params* params, const char* name, const char* value);
+
+   /* Use a shared dictionary (NULL for none) for the LZ, ROLZ and TEXT
+      transforms. The dictionary is not copied: it must outlive the streams
+      and calls using these parameters. */
+   KANZI_API int kanzi_params_set_dictionary(kanzi_params* params, const kanzi_dictionary* dict);
+
+
+   /* Dictionary built by 'kanzi --train': 'data' is the content of the
+      dictionary file. Returns NULL on failure. */
+   KANZI_API kanzi_dictionary* kanzi_dictionary_load(const uint8_t* data, size_t length);
+
+   KANZI_API void kanzi_dictionary_free(kanzi_dictionary* dict);
+
+
+   /* Streaming compression. The parameters are copied and the handle can
+      be used after 'params' is freed. Returns NULL on failure. */
+   KANZI_API kanzi_cstream* kanzi_cstream_create(const kanzi_params* params,
+      kanzi_write_fn write, void* opaque);
+
+   KANZI_API int kanzi_cstream_write(kanzi_cstream* cs, const uint8_t* data, size_t length);
+
+   /* Emit the pending data as a complete block (see CompressedOutputStream::flush()) */
+   KANZI_API int kanzi_cstream_flush(kanzi_cstream* cs);
+
+   /* With "flushInterval", flush the pending data once older than the interval
+      (see CompressedOutputStream::poll()). kanzi_cstream_write() only checks
+      the interval when called: an idle producer must call this function
+      periodically, from the thread using the stream. If 'delay' is not NULL,
+      it is set to the delay (in ms) before the next call is needed, or -1 if
+      no data is pending. */
+   KANZI_API int kanzi_cstream_poll(kanzi_cstream* cs, int* delay);
+
+   /* Emit the last block and the end of stream marker */
+   KANZI_API int kanzi_cstream_close(kanzi_cstream* cs);
+
+   /* Release the stream (closed first if needed, ignoring failures) */
+   KANZI_API void kanzi_cstream_free(kanzi_cstream* cs);
+
+
+   /* Streaming decompression. Only "jobs", "maxMemory", "releaseBuffers" and the dictionary
+      are used from 'params', which may be NULL. Returns NULL on failure. */
+   KANZI_API kanzi_dstream* kanzi_dstream_create(const kanzi_params* params,
+      kanzi_read_fn read, void* opaque);
+
+   /* Return the number of decompressed bytes copied to 'data' (less than
+      'length' only at the end of the stream), or -(error code) on failure. */
+   KANZI_API int64_t kanzi_dstream_read(kanzi_dstream* ds, uint8_t* data, size_t length);
+
+   KANZI_API void kanzi_dstream_free(kanzi_dstream* ds);
+
+
+   /* Single shot compression of memory buffers (see MemoryCodec). "jobs",
+      "skipBlocks", "dedup", "maxMemory" and "flushInterval" do not apply. */
+   KANZI_API size_t kanzi_compress_bound(const kanzi_params* params, size_t length);
+
+   /* On success, '*dstLength' is set to the size of the compressed data.
+      'params' may be NULL (default parameters). */
+   KANZI_API int kanzi_compress_buffer(const kanzi_params* params, const uint8_t* src,
+      size_t srcLength, uint8_t* dst, size_t dstCapacity, size_t* dstLength);
+
+   KANZI_API int kanzi_decompress_buffer(const uint8_t* src, size_t srcLength,
+      uint8_t* dst, size_t dstCapacity, size_t* dstLength);
+
+   /* Same as above for data compressed with a dictionary */
+   KANZI_API int kanzi_decompress_buffer_dict(const kanzi_dictionary* dict, const uint8_t* src,
+      size_t srcLength, uint8_t* dst, size_t dstCapacity, size_t* dstLength);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -20,26 +20,74 @@ limitations under the License.
 #include <stdlib.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <time.h>
 #include <sys/stat.h>
 #include "BlockCompressor.hpp"
 #include "InfoPrinter.hpp"
+#include "TraceWriter.hpp"
 #include "../util.hpp"
+#include "../BufferPool.hpp"
+#include "../Dictionary.hpp"
 #include "../SliceArray.hpp"
 #include "../Error.hpp"
+#include "../entropy/EntropyCodecFactory.hpp"
 #include "../function/FunctionFactory.hpp"
 #include "../io/IOException.hpp"
 #include "../io/IOUtil.hpp"
+#include "../io/MemoryBudget.hpp"
 #include "../io/NullOutputStream.hpp"
 #include "../io/NullOutputStream.hpp"
+#include "../transform/SuffixSorter.hpp"
 
 #ifdef CONCURRENCY_ENABLED
 #include <future>
 #endif
 
+#if !defined(WIN32) && !defined(_WIN32)
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
 using namespace kanzi;
 
+#if !defined(WIN32) && !defined(_WIN32)
+// Read at most 'length' bytes from STDIN, returning as soon as some data is
+// available. Flush the compressed stream if no data arrives within 'interval'
+// ms while some data is pending. Return the number of bytes read (0 at EOF).
+static int readStdIn(byte* buf, int length, int interval, CompressedOutputStream& cos) THROW
+{
+    struct pollfd pfd;
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    int timeout = interval;
+
+    while (true) {
+        const int r = poll(&pfd, 1, timeout);
+
+        if (r == 0) {
+            // Idle producer: emit the pending data, then wait for more
+            cos.flush();
+            timeout = -1;
+            continue;
+        }
+
+        if ((r < 0) && (errno == EINTR))
+            continue;
+
+        const ssize_t n = read(STDIN_FILENO, buf, size_t(length));
+
+        if (n >= 0)
+            return int(n);
+
+        if (errno != EINTR)
+            throw IOException("Cannot read from STDIN", Error::ERR_READ_FILE);
+    }
+}
+#endif
+
 BlockCompressor::BlockCompressor(map<string, string>& args) THROW
 {
     map<string, string>::iterator it;
@@ -128,12 +176,97 @@ BlockCompressor::BlockCompressor(map<string, string>& args) THROW
     it = args.find("checksum");
 
     if (it == args.end()) {
-        _checksum = false;
+        _checksum = 0;
+    }
+    else {
+        // Size of the block checksums ("true" means 32 bits)
+        string str = it->second;
+        transform(str.begin(), str.end(), str.begin(), ::toupper);
+        _checksum = (str == "64") ? 64 : (((str == STR_TRUE) || (str == "32")) ? 32 : 0);
+        args.erase(it);
+    }
+
+    it = args.find("index");
+
+    if (it == args.end()) {
+        _index = false;
+    }
+    else {
+        string str = it->second;
+        transform(str.begin(), str.end(), str.begin(), ::toupper);
+        _index = str == STR_TRUE;
+        args.erase(it);
+    }
+
+    it = args.find("dedup");
+
+    if (it == args.end()) {
+        _dedup = false;
+    }
+    else {
+        string str = it->second;
+        transform(str.begin(), str.end(), str.begin(), ::toupper);
+        _dedup = str == STR_TRUE;
+        args.erase(it);
+    }
+
+    if ((_dedup == true) && (_index == true))
+        throw invalid_argument("Block deduplication and block index cannot be combined");
+
+    it = args.find("maxMemory");
+
+    if (it == args.end()) {
+        _maxMemory = 0;
+    }
+    else {
+        _maxMemory = int64(atoll(it->second.c_str()));
+        args.erase(it);
+    }
+
+    it = args.find("flushInterval");
+
+    if (it == args.end()) {
+        _flushInterval = 0;
+    }
+    else {
+        _flushInterval = atoi(it->second.c_str());
+        args.erase(it);
+    }
+
+    it = args.find("suffixSorter");
+
+    if (it == args.end()) {
+        _suffixSorter = "DIVSUFSORT";
+    }
+    else {
+        // Throw an invalid_argument for an unknown engine
+        _suffixSorter = SuffixSorter::getName(SuffixSorter::getType(it->second.c_str()));
+        args.erase(it);
+    }
+
+    it = args.find("dictionary");
+
+    if (it != args.end()) {
+        _dictName = it->second;
+        args.erase(it);
+    }
+
+    it = args.find("trace");
+
+    if (it != args.end()) {
+        _traceName = it->second;
+        args.erase(it);
+    }
+
+    it = args.find("mmap");
+
+    if (it == args.end()) {
+        _mmap = false;
     }
     else {
         string str = it->second;
         transform(str.begin(), str.end(), str.begin(), ::toupper);
-        _checksum = str == STR_TRUE;
+        _mmap = str == STR_TRUE;
         args.erase(it);
     }
 
@@ -213,6 +346,58 @@ int BlockCompressor::compress(uint64& outputSize)
        ss.str(string());
     }
 
+    // Fit the blocks processed concurrently in the memory budget (if any):
+    // fewer blocks in flight first, then smaller blocks if one does not fit.
+    int nbWorkers = _jobs;
+    string budgetPlan;
+
+    if (_maxMemory > 0) {
+        int64 footprint;
+        int64 fixed;
+        const int blockSize = _blockSize;
+
+        try {
+            const uint64 transformType = FunctionFactory<byte>::getType(_transform.c_str());
+            const uint32 entropyType = uint32(EntropyCodecFactory::getType(_codec.c_str()));
+            footprint = MemoryBudget::blockFootprint(transformType, entropyType, _blockSize, false);
+            fixed = MemoryBudget::streamFootprint(_blockSize, _dedup);
+
+            while ((footprint + fixed > _maxMemory) && (_blockSize > MIN_BUDGET_BLOCK_SIZE)) {
+                _blockSize = ((_blockSize >> 1) + 15) & -16;
+                footprint = MemoryBudget::blockFootprint(transformType, entropyType, _blockSize, false);
+                fixed = MemoryBudget::streamFootprint(_blockSize, _dedup);
+            }
+        }
+        catch (invalid_argument& e) {
+            cerr << e.what() << endl;
+            return Error::ERR_INVALID_CODEC;
+        }
+
+        if (footprint + fixed > _maxMemory) {
+            cerr << "The memory budget (" << (_maxMemory >> 20) << " MB) is too low for this codec, at least "
+                 << ((footprint + fixed + (1 << 20) - 1) >> 20) << " MB are required" << endl;
+            return Error::ERR_INVALID_PARAM;
+        }
+
+        if (_blockSize != blockSize) {
+            ss << "Warning: block size reduced from " << blockSize << " to " << _blockSize
+               << " bytes to fit the memory budget";
+            log.println(ss.str().c_str(), _verbosity > 0);
+            ss.str(string());
+        }
+
+        nbWorkers = MemoryBudget::maxJobs(_maxMemory, fixed, footprint, _jobs);
+        ss << "Memory budget set to " << (_maxMemory >> 20) << " MB: about "
+           << ((footprint + (1 << 20) - 1) >> 20) << " MB per block, "
+           << nbWorkers << " block" << ((nbWorkers > 1) ? "s" : "") << " in flight";
+
+        if (_dedup == true)
+            ss << ", " << ((fixed - MemoryBudget::BASE_FOOTPRINT) >> 20) << " MB of deduplication window";
+
+        budgetPlan = ss.str();
+        ss.str(string());
+    }
+
     ss << "Block size set to " << _blockSize << " bytes";
     log.println(ss.str().c_str(), printFlag);
     ss.str(string());
@@ -222,9 +407,67 @@ int BlockCompressor::compress(uint64& outputSize)
     ss << "Overwrite set to " << (_overwrite ? "true" : "false");
     log.println(ss.str().c_str(), printFlag);
     ss.str(string());
-    ss << "Checksum set to " << (_checksum ? "true" : "false");
+
+    if (_checksum != 0)
+        ss << "Checksum set to " << _checksum << " bits";
+    else
+        ss << "Checksum set to false";
+
     log.println(ss.str().c_str(), printFlag);
     ss.str(string());
+    ss << "Block index set to " << (_index ? "true" : "false");
+    log.println(ss.str().c_str(), printFlag);
+    ss.str(string());
+    ss << "Block deduplication set to " << (_dedup ? "true" : "false");
+    log.println(ss.str().c_str(), printFlag);
+    ss.str(string());
+    ss << "Memory mapped input set to " << (_mmap ? "true" : "false");
+    log.println(ss.str().c_str(), printFlag);
+    ss.str(string());
+    ss << "Suffix sorter set to " << _suffixSorter;
+    log.println(ss.str().c_str(), printFlag);
+    ss.str(string());
+
+    if (budgetPlan.length() > 0)
+        log.println(budgetPlan.c_str(), printFlag);
+
+    if (_flushInterval > 0) {
+        ss << "Flush interval set to " << _flushInterval << " ms";
+        log.println(ss.str().c_str(), printFlag);
+        ss.str(string());
+    }
+
+    // One dictionary shared by the streams of all the files
+    unique_ptr<Dictionary> dict;
+
+    if (_dictName.length() > 0) {
+        ifstream is(_dictName.c_str(), ifstream::in | ifstream::binary);
+
+        if (is.is_open() == false) {
+            cerr << "Cannot open dictionary file '" << _dictName << "'" << endl;
+            return Error::ERR_OPEN_FILE;
+        }
+
+        try {
+            dict.reset(Dictionary::load(is));
+        }
+        catch (exception& e) {
+            cerr << "Cannot load dictionary file '" << _dictName << "': " << e.what() << endl;
+            return Error::ERR_OPEN_FILE;
+        }
+
+        ss << "Dictionary set to " << _dictName << " (" << dict->getSize() << " bytes)";
+        log.println(ss.str().c_str(), printFlag);
+        ss.str(string());
+
+        try {
+            if (FunctionFactory<byte>::usesDictionary(FunctionFactory<byte>::getType(_transform.c_str())) == false)
+                log.println("Warning: the dictionary is ignored (no LZ, ROLZ or TEXT transform)", _verbosity > 0);
+        }
+        catch (invalid_argument&) {
+            // Reported by the compression tasks
+        }
+    }
 
     if (printFlag == true) {
         string etransform = _transform;
@@ -246,13 +489,13 @@ int BlockCompressor::compress(uint64& outputSize)
     string outputName = _outputName;
     transform(outputName.begin(), outputName.end(), outputName.begin(), ::toupper);
 
-    if ((_jobs > 1) && (outputName.compare("STDOUT") == 0)) {
-        cerr << "Cannot output to STDOUT with multiple jobs" << endl;
-        return Error::ERR_CREATE_FILE;
-    }
+    // The blocks of a stream are written in order whatever the number of
+    // jobs, but the streams of several files sent to STDOUT must not be
+    // interleaved: the files are then processed one after the other.
+    const bool toStdOut = outputName.compare("STDOUT") == 0;
 
     // Limit verbosity level when files are processed concurrently
-    if ((_jobs > 1) && (nbFiles > 1) && (_verbosity > 1)) {
+    if ((_jobs > 1) && (nbFiles > 1) && (toStdOut == false) && (_verbosity > 1)) {
         log.println("Warning: limiting verbosity to 1 due to concurrent processing of input files.\n", _verbosity > 1);
         _verbosity = 1;
     }
@@ -262,6 +505,24 @@ int BlockCompressor::compress(uint64& outputSize)
     if (_verbosity > 2)
         addListener(listener);
 
+    unique_ptr<TraceWriter> trace;
+
+    if (_traceName.length() > 0) {
+        try {
+            trace.reset(new TraceWriter(_traceName));
+        }
+        catch (IOException& e) {
+            cerr << e.what() << endl;
+            return Error::ERR_CREATE_FILE;
+        }
+
+        addListener(*trace);
+        ss.str(string());
+        ss << "Trace file set to " << _traceName;
+        log.println(ss.str().c_str(), printFlag);
+        ss.str(string());
+    }
+
     int res = 0;
     uint64 read = 0;
     uint64 written = 0;
@@ -334,11 +595,32 @@ int BlockCompressor::compress(uint64& outputSize)
     ss << _blockSize;
     ctx["blockSize"] = ss.str();
     ctx["skipBlocks"] = (_skipBlocks == true) ? STR_TRUE : STR_FALSE;
-    ctx["checksum"] = (_checksum == true) ? STR_TRUE : STR_FALSE;
+    ctx["checksum"] = (_checksum != 0) ? to_string(_checksum) : STR_FALSE;
+    ctx["index"] = (_index == true) ? STR_TRUE : STR_FALSE;
+    ctx["dedup"] = (_dedup == true) ? STR_TRUE : STR_FALSE;
+    ctx["mmap"] = (_mmap == true) ? STR_TRUE : STR_FALSE;
+    ss.str(string());
+    ss << _maxMemory;
+    ctx["maxMemory"] = ss.str();
+    ss.str(string());
+    ss << _flushInterval;
+    ctx["flushInterval"] = ss.str();
+    ctx["suffixSorter"] = _suffixSorter;
     ctx["codec"] = _codec;
     ctx["transform"] = _transform;
     ctx["extra"] = (_codec == "TPAQX") ? STR_TRUE : STR_FALSE;
 
+    ThreadPool* pool = nullptr;
+
+#ifdef CONCURRENCY_ENABLED
+    // One pool of workers shared by the block tasks of all the files
+    if (_jobs > 1)
+        pool = new ThreadPool(_jobs);
+#endif
+
+    // One pool of block buffers shared by the streams of all the files
+    BufferPool buffers;
+
     // Run the task(s)
     if (nbFiles == 1) {
         string oName = formattedOutName;
@@ -363,7 +645,9 @@ int BlockCompressor::compress(uint64& outputSize)
         ss.str(string());
         ss << _jobs;
         ctx["jobs"] = ss.str();
-        Context context(ctx);
+        Context context(ctx, pool);
+        context.setBufferPool(&buffers);
+        context.setDictionary(dict.get());
         FileCompressTask<FileCompressResult> task(context, _listeners);
         FileCompressResult fcr = task.run();
         res = fcr._code;
@@ -377,7 +661,21 @@ int BlockCompressor::compress(uint64& outputSize)
     else {
         vector<FileCompressTask<FileCompressResult>*> tasks;
         int* jobsPerTask = new int[nbFiles];
-        Global::computeJobsPerTask(jobsPerTask, _jobs, nbFiles);
+
+        if (toStdOut == true) {
+            // One file at a time, with all the jobs
+            for (int i = 0; i < nbFiles; i++)
+                jobsPerTask[i] = _jobs;
+        }
+        else if (nbWorkers < min(_jobs, nbFiles)) {
+            // Fewer files at a time (memory budget), with more jobs each
+            for (int i = 0; i < nbFiles; i++)
+                jobsPerTask[i] = max(_jobs / nbWorkers, 1);
+        }
+        else {
+            Global::computeJobsPerTask(jobsPerTask, _jobs, nbFiles);
+        }
+
         int n = 0;
         sortFilesByPathAndSize(files, false);
 
@@ -393,17 +691,24 @@ int BlockCompressor::compress(uint64& outputSize)
                 oName = formattedOutName + iName.substr(formattedInName.size()) + ".knz";
             }
 
-            Context taskCtx(ctx);
+            Context taskCtx(ctx, pool);
+            taskCtx.setBufferPool(&buffers);
+            taskCtx.setDictionary(dict.get());
             taskCtx.putLong("fileSize", files[i]._size);
             taskCtx.putString("inputName", iName);
             taskCtx.putString("outputName", oName);
             taskCtx.putInt("jobs", jobsPerTask[n++]);
+
+            // Share the memory budget between the files processed concurrently
+            if ((_maxMemory > 0) && (toStdOut == false))
+                taskCtx.putLong("maxMemory", _maxMemory / min(nbWorkers, nbFiles));
+
             ss.str(string());
             FileCompressTask<FileCompressResult>* task = new FileCompressTask<FileCompressResult>(taskCtx, _listeners);
             tasks.push_back(task);
         }
 
-        bool doConcurrent = _jobs > 1;
+        bool doConcurrent = (nbWorkers > 1) && (toStdOut == false);
 
 #ifdef CONCURRENCY_ENABLED
         if (doConcurrent) {
@@ -411,14 +716,15 @@ int BlockCompressor::compress(uint64& outputSize)
             vector<future<FileCompressResult> > results;
             BoundedConcurrentQueue<FileCompressTask<FileCompressResult>*> queue(nbFiles, &tasks[0]);
 
-            // Create one worker per job and run it. A worker calls several tasks sequentially.
-            for (int i = 0; i < _jobs; i++) {
+            // Create one worker per job (bounded by the memory budget) and run it.
+            // A worker calls several tasks sequentially.
+            for (int i = 0; i < nbWorkers; i++) {
                 workers.push_back(new FileCompressWorker<FileCompressTask<FileCompressResult>*, FileCompressResult>(&queue));
                 results.push_back(async(launch::async, &FileCompressWorker<FileCompressTask<FileCompressResult>*, FileCompressResult>::run, workers[i]));
             }
 
             // Wait for results
-            for (int i = 0; i < _jobs; i++) {
+            for (int i = 0; i < nbWorkers; i++) {
                 FileCompressResult fcr = results[i].get();
                 res = fcr._code;
                 read += fcr._read;
@@ -431,7 +737,7 @@ int BlockCompressor::compress(uint64& outputSize)
                 }
             }
 
-            for (int i = 0; i < _jobs; i++)
+            for (int i = 0; i < nbWorkers; i++)
                 delete workers[i];
         }
 #endif
@@ -456,6 +762,19 @@ int BlockCompressor::compress(uint64& outputSize)
             delete tasks[i];
     }
 
+#ifdef CONCURRENCY_ENABLED
+    if (pool != nullptr)
+        delete pool;
+#endif
+
+    if (_verbosity > 2) {
+        ss.str(string());
+        ss << "Buffer pool: " << buffers.hits() << " hits, " << buffers.misses() << " misses, ";
+        ss << (buffers.retained() >> 10) << " KB retained";
+        log.println(ss.str().c_str(), true);
+        ss.str(string());
+    }
+
     stopClock.stop();
 
     if (nbFiles > 1) {
@@ -488,6 +807,11 @@ int BlockCompressor::compress(uint64& outputSize)
     if (_verbosity > 2)
         removeListener(listener);
 
+    if (trace != nullptr) {
+        removeListener(*trace);
+        trace->close();
+    }
+
     outputSize += written;
     return res;
 }
@@ -577,6 +901,7 @@ FileCompressTask<T>::FileCompressTask(Context& ctx, vector<Listener*>& listeners
 {
     _listeners = listeners;
     _is = nullptr;
+    _mapped = nullptr;
     _cos = nullptr;
 }
 
@@ -685,15 +1010,29 @@ T FileCompressTask<T>::run()
             _is = &cin;
         }
         else {
-            ifstream* ifs = new ifstream(inputName.c_str(), ifstream::in | ifstream::binary);
+            str = _ctx.getString("mmap");
 
-            if (!*ifs) {
-                stringstream sserr;
-                sserr << "Cannot open input file '" << inputName << "'";
-                return T(Error::ERR_OPEN_FILE, 0, 0, sserr.str().c_str());
+            if (str == STR_TRUE) {
+                try {
+                    _mapped = new MappedFile(inputName);
+                }
+                catch (IOException&) {
+                    // Not a mappable file: read it
+                    _mapped = nullptr;
+                }
             }
 
-            _is = ifs;
+            if (_mapped == nullptr) {
+                ifstream* ifs = new ifstream(inputName.c_str(), ifstream::in | ifstream::binary);
+
+                if (!*ifs) {
+                    stringstream sserr;
+                    sserr << "Cannot open input file '" << inputName << "'";
+                    return T(Error::ERR_OPEN_FILE, 0, 0, sserr.str().c_str());
+                }
+
+                _is = ifs;
+            }
         }
     }
     catch (exception& e) {
@@ -708,36 +1047,64 @@ T FileCompressTask<T>::run()
     log.println(ss.str().c_str(), printFlag);
     log.println("\n", verbosity > 3);
     int64 read = 0;
-    byte* buf = new byte[DEFAULT_BUFFER_SIZE];
+    byte* buf = (_mapped == nullptr) ? new byte[DEFAULT_BUFFER_SIZE] : nullptr;
     SliceArray<byte> sa(buf, DEFAULT_BUFFER_SIZE, 0);
     int len;
 
     if (_listeners.size() > 0) {
-        Event evt(Event::COMPRESSION_START, -1, int64(0), clock());
+        Event evt(Event::COMPRESSION_START, -1, int64(0), Event::now());
         BlockCompressor::notifyListeners(_listeners, evt);
     }
 
     Clock stopClock;
 
     try {
-        while (true) {
-            try {
-                _is->read(reinterpret_cast<char*>(&sa._array[0]), sa._length);
-                len = (*_is) ? sa._length : int(_is->gcount());
-            }
-            catch (exception& e) {
-                stringstream sserr;
-                sserr << "Failed to read block from file '" << inputName << "': ";
-                sserr << e.what() << endl;
-                return T(Error::ERR_READ_FILE, read, _cos->getWritten(), sserr.str().c_str());
+        if (_mapped != nullptr) {
+            // Encode the blocks straight from the mapped pages
+            const byte* data = _mapped->data();
+            const int64 size = _mapped->size();
+            const int64 blockSize = int64(_ctx.getInt("blockSize"));
+
+            while (read < size) {
+                const int64 n = (size - read < blockSize) ? size - read : blockSize;
+                _mapped->willNeed(read + n, blockSize);
+                _cos->writeBorrowed(&data[read], n);
+                read += n;
             }
+        }
+        else {
+#if !defined(WIN32) && !defined(_WIN32)
+            // Read STDIN as the data comes to bound the latency of the flushes
+            const int flushInterval = (_is == &cin) ? _ctx.getInt("flushInterval", 0) : 0;
+#endif
 
-            if (len <= 0)
-                break;
+            while (true) {
+                try {
+#if !defined(WIN32) && !defined(_WIN32)
+                    if (flushInterval > 0) {
+                        len = readStdIn(&sa._array[0], sa._length, flushInterval, *_cos);
+                    }
+                    else
+#endif
+                    {
+                        _is->read(reinterpret_cast<char*>(&sa._array[0]), sa._length);
+                        len = (*_is) ? sa._length : int(_is->gcount());
+                    }
+                }
+                catch (exception& e) {
+                    stringstream sserr;
+                    sserr << "Failed to read block from file '" << inputName << "': ";
+                    sserr << e.what() << endl;
+                    return T(Error::ERR_READ_FILE, read, _cos->getWritten(), sserr.str().c_str());
+                }
 
-            // Just write block to the compressed output stream !
-            read += len;
-            _cos->write(reinterpret_cast<const char*>(&sa._array[0]), len);
+                if (len <= 0)
+                    break;
+
+                // Just write block to the compressed output stream !
+                read += len;
+                _cos->write(reinterpret_cast<const char*>(&sa._array[0]), len);
+            }
         }
     }
     catch (IOException& ioe) {
@@ -828,7 +1195,7 @@ T FileCompressTask<T>::run()
     log.println("", verbosity > 1);
 
     if (_listeners.size() > 0) {
-        Event evt(Event::COMPRESSION_END, -1, int64(_cos->getWritten()), clock());
+        Event evt(Event::COMPRESSION_END, -1, int64(_cos->getWritten()), Event::now());
         BlockCompressor::notifyListeners(_listeners, evt);
     }
 
@@ -871,6 +1238,12 @@ void FileCompressTask<T>::dispose()
         exit(Error::ERR_WRITE_FILE);
     }
 
+    // The blocks have been encoded: the mapping can go
+    if (_mapped != nullptr) {
+        delete _mapped;
+        _mapped = nullptr;
+    }
+
     if (_is != &cin) {
         ifstream* ifs = dynamic_cast<ifstream*>(_is);
 
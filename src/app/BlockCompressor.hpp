@@ -22,6 +22,7 @@ limitations under the License.
 #include "../InputStream.hpp"
 #include "../Listener.hpp"
 #include "../io/CompressedOutputStream.hpp"
+#include "../io/MappedFile.hpp"
 
 namespace kanzi {
 
@@ -82,6 +83,7 @@ namespace kanzi {
    private:
 	   Context _ctx;
        InputStream* _is;
+       MappedFile* _mapped; // input file if memory mapped
        CompressedOutputStream* _cos;
        vector<Listener*> _listeners;
    };
@@ -106,10 +108,14 @@ namespace kanzi {
        static const int DEFAULT_BLOCK_SIZE = 1024 * 1024;
        static const int DEFAULT_CONCURRENCY = 1;
        static const int MAX_CONCURRENCY = 64;  
+       static const int MIN_BUDGET_BLOCK_SIZE = 64 * 1024; // smallest block size chosen to fit a memory budget
 
        int _verbosity;
        bool _overwrite;
-       bool _checksum;
+       int _checksum; // size of the block checksums in bits (0 if none)
+       bool _index;
+       bool _dedup;
+       bool _mmap;
        bool _skipBlocks;
        string _inputName;
        string _outputName;
@@ -118,6 +124,11 @@ namespace kanzi {
        int _blockSize;
        int _level; // command line compression level
        int _jobs;
+       int64 _maxMemory; // memory budget in bytes (0 means no limit)
+       int _flushInterval; // auto flush period in ms (0 means no auto flush)
+       string _suffixSorter; // suffix array engine of BWT and BWTS
+       string _dictName; // shared dictionary file (empty if none)
+       string _traceName; // Chrome trace file (empty if none)
        vector<Listener*> _listeners;
 
        static void notifyListeners(vector<Listener*>& listeners, const Event& evt);
@@ -21,18 +21,22 @@ limitations under the License.
 #include <stdlib.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <time.h>
 #include <sys/stat.h>
 #include "BlockDecompressor.hpp"
 #include "InfoPrinter.hpp"
+#include "TraceWriter.hpp"
+#include "../BufferPool.hpp"
+#include "../Dictionary.hpp"
 #include "../SliceArray.hpp"
 #include "../util.hpp"
 #include "../Error.hpp"
 #include "../io/IOException.hpp"
 #include "../io/IOUtil.hpp"
 #include "../io/NullOutputStream.hpp"
-#include "../io/NullOutputStream.hpp"
+#include "../io/NullPositionalWriter.hpp"
 
 #ifdef CONCURRENCY_ENABLED
 #include <future>
@@ -54,6 +58,50 @@ BlockDecompressor::BlockDecompressor(map<string, string>& args)
         args.erase(it);
     }
 
+    it = args.find("pwrite");
+
+    if (it == args.end()) {
+        _pwrite = false;
+    }
+    else {
+        _pwrite = it->second == STR_TRUE;
+        args.erase(it);
+    }
+
+    it = args.find("test");
+
+    if (it == args.end()) {
+        _test = false;
+    }
+    else {
+        _test = it->second == STR_TRUE;
+        args.erase(it);
+    }
+
+    it = args.find("maxMemory");
+
+    if (it == args.end()) {
+        _maxMemory = 0;
+    }
+    else {
+        _maxMemory = int64(atoll(it->second.c_str()));
+        args.erase(it);
+    }
+
+    it = args.find("dictionary");
+
+    if (it != args.end()) {
+        _dictName = it->second;
+        args.erase(it);
+    }
+
+    it = args.find("trace");
+
+    if (it != args.end()) {
+        _traceName = it->second;
+        args.erase(it);
+    }
+
     it = args.find("inputName");
     _inputName = it->second;
     args.erase(it);
@@ -107,34 +155,79 @@ int BlockDecompressor::decompress(uint64& inputSize)
     vector<FileData> files;
     uint64 read = 0;
     Clock stopClock;
+    int nbFiles = 1;
+    Printer log(&cout);
+    bool printFlag = _verbosity > 2;
+    stringstream ss;
+    string str = _inputName;
+    transform(str.begin(), str.end(), str.begin(), ::toupper);
+    bool isStdIn = str.compare(0, 5, "STDIN") == 0;
 
-    try {
-        createFileList(_inputName, files);
-    }
-    catch (IOException& e) {
-        cerr << e.what() << endl;
-        return Error::ERR_OPEN_FILE;
-    }
+    if (isStdIn == false) {
+        try {
+            createFileList(_inputName, files);
+        }
+        catch (IOException& e) {
+            cerr << e.what() << endl;
+            return Error::ERR_OPEN_FILE;
+        }
+
+        if (files.size() == 0) {
+            cerr << "Cannot access input file '" << _inputName << "'" << endl;
+            return Error::ERR_OPEN_FILE;
+        }
 
-    if (files.size() == 0) {
-        cerr << "Cannot access input file '" << _inputName << "'" << endl;
-        return Error::ERR_OPEN_FILE;
+        nbFiles = int(files.size());
+        string strFiles = (nbFiles > 1) ? " files" : " file";
+        ss << nbFiles << strFiles << ((_test == true) ? " to test\n" : " to decompress\n");
+        log.println(ss.str().c_str(), _verbosity > 0);
+        ss.str(string());
     }
 
-    int nbFiles = int(files.size());
-    Printer log(&cout);
-    bool printFlag = _verbosity > 2;
-    stringstream ss;
-    string strFiles = (nbFiles > 1) ? " files" : " file";
-    ss << nbFiles << strFiles << " to decompress\n";
-    log.println(ss.str().c_str(), _verbosity > 0);
-    ss.str(string());
     ss << "Verbosity set to " << _verbosity;
     log.println(ss.str().c_str(), printFlag);
     ss.str(string());
     ss << "Overwrite set to " << (_overwrite ? "true" : "false");
     log.println(ss.str().c_str(), printFlag);
     ss.str(string());
+    ss << "Positional output set to " << (_pwrite ? "true" : "false");
+    log.println(ss.str().c_str(), printFlag);
+    ss.str(string());
+    ss << "Test mode set to " << (_test ? "true" : "false");
+    log.println(ss.str().c_str(), printFlag);
+    ss.str(string());
+
+    if (_maxMemory > 0) {
+        // The plan depends on the codecs of each stream (see the stream headers)
+        ss << "Memory budget set to " << (_maxMemory >> 20) << " MB";
+        log.println(ss.str().c_str(), printFlag);
+        ss.str(string());
+    }
+
+    // One dictionary shared by the streams of all the files
+    unique_ptr<Dictionary> dict;
+
+    if (_dictName.length() > 0) {
+        ifstream is(_dictName.c_str(), ifstream::in | ifstream::binary);
+
+        if (is.is_open() == false) {
+            cerr << "Cannot open dictionary file '" << _dictName << "'" << endl;
+            return Error::ERR_OPEN_FILE;
+        }
+
+        try {
+            dict.reset(Dictionary::load(is));
+        }
+        catch (exception& e) {
+            cerr << "Cannot load dictionary file '" << _dictName << "': " << e.what() << endl;
+            return Error::ERR_OPEN_FILE;
+        }
+
+        ss << "Dictionary set to " << _dictName << " (" << dict->getSize() << " bytes)";
+        log.println(ss.str().c_str(), printFlag);
+        ss.str(string());
+    }
+
     ss << "Using " << _jobs << " job" << ((_jobs > 1) ? "s" : "");
     log.println(ss.str().c_str(), printFlag);
     ss.str(string());
@@ -142,13 +235,25 @@ int BlockDecompressor::decompress(uint64& inputSize)
     string outputName = _outputName;
     transform(outputName.begin(), outputName.end(), outputName.begin(), ::toupper);
 
-    if ((_jobs > 1) && (outputName.compare("STDOUT") == 0)) {
-        cerr << "Cannot output to STDOUT with multiple jobs" << endl;
-        return Error::ERR_CREATE_FILE;
+    if (_test == true) {
+        // Nothing is written: the blocks are decoded, verified and discarded
+        if ((_outputName.length() > 0) && (outputName.compare(0, 4, "NONE") != 0)) {
+            ss << "Warning: ignoring output '" << _outputName << "' in test mode";
+            log.println(ss.str().c_str(), _verbosity > 0);
+            ss.str(string());
+        }
+
+        _outputName = "NONE";
+        outputName = "NONE";
     }
 
+    // The blocks of a stream are written in order whatever the number of
+    // jobs, but the streams of several files sent to STDOUT must not be
+    // interleaved: the files are then processed one after the other.
+    const bool toStdOut = outputName.compare("STDOUT") == 0;
+
     // Limit verbosity level when files are processed concurrently
-    if ((_jobs > 1) && (nbFiles > 1) && (_verbosity > 1)) {
+    if ((_jobs > 1) && (nbFiles > 1) && (toStdOut == false) && (_verbosity > 1)) {
         log.println("Warning: limiting verbosity to 1 due to concurrent processing of input files.\n", _verbosity > 1);
         _verbosity = 1;
     }
@@ -158,61 +263,80 @@ int BlockDecompressor::decompress(uint64& inputSize)
     if (_verbosity > 2)
         addListener(listener);
 
+    unique_ptr<TraceWriter> trace;
+
+    if (_traceName.length() > 0) {
+        try {
+            trace.reset(new TraceWriter(_traceName));
+        }
+        catch (IOException& e) {
+            cerr << e.what() << endl;
+            return Error::ERR_CREATE_FILE;
+        }
+
+        addListener(*trace);
+        ss.str(string());
+        ss << "Trace file set to " << _traceName;
+        log.println(ss.str().c_str(), printFlag);
+        ss.str(string());
+    }
+
     int res = 0;
-    bool inputIsDir;
+    bool inputIsDir = false;
     string formattedOutName = _outputName;
     string formattedInName = _inputName;
     string upperOutputName = _outputName;
     transform(upperOutputName.begin(), upperOutputName.end(), upperOutputName.begin(), ::toupper);
     bool specialOutput = (upperOutputName.compare(0, 4, "NONE") == 0) || (upperOutputName.compare(0, 6, "STDOUT") == 0);
-    struct stat buffer;
-
-    // Need to strip path separator at the end to make 'stat()' happy
-    if ((formattedInName.size() != 0) && (formattedInName[formattedInName.size() - 1] == PATH_SEPARATOR)) {
-        formattedInName = formattedInName.substr(0, formattedInName.size() - 1);
-    }
 
-    if ((formattedOutName.size() != 0) && (formattedOutName[formattedOutName.size() - 1] == PATH_SEPARATOR)) {
-        formattedOutName = formattedOutName.substr(0, formattedOutName.size() - 1);
-    }
+    if (isStdIn == false) {
+        struct stat buffer;
 
-    if (stat(formattedInName.c_str(), &buffer) != 0) {
-        cerr << "Cannot access input file '" << formattedInName << "'" << endl;
-        return Error::ERR_OPEN_FILE;
-    }
-
-    if ((buffer.st_mode & S_IFDIR) != 0) {
-        inputIsDir = true;
-
-        if (formattedInName[formattedInName.size() - 1] == '.') {
+        // Need to strip path separator at the end to make 'stat()' happy
+        if ((formattedInName.size() != 0) && (formattedInName[formattedInName.size() - 1] == PATH_SEPARATOR)) {
             formattedInName = formattedInName.substr(0, formattedInName.size() - 1);
         }
 
-        if ((formattedInName.size() != 0) && (formattedInName[formattedInName.size() - 1] != PATH_SEPARATOR)) {
-            formattedInName += PATH_SEPARATOR;
+        if ((formattedOutName.size() != 0) && (formattedOutName[formattedOutName.size() - 1] == PATH_SEPARATOR)) {
+            formattedOutName = formattedOutName.substr(0, formattedOutName.size() - 1);
+        }
+
+        if (stat(formattedInName.c_str(), &buffer) != 0) {
+            cerr << "Cannot access input file '" << formattedInName << "'" << endl;
+            return Error::ERR_OPEN_FILE;
         }
 
-        if ((formattedOutName.size() != 0) && (specialOutput == false)) {
-            if (stat(formattedOutName.c_str(), &buffer) != 0) {
-                cerr << "Output must be an existing directory (or 'NONE')" << endl;
-                return Error::ERR_OPEN_FILE;
+        if ((buffer.st_mode & S_IFDIR) != 0) {
+            inputIsDir = true;
+
+            if (formattedInName[formattedInName.size() - 1] == '.') {
+                formattedInName = formattedInName.substr(0, formattedInName.size() - 1);
             }
 
-            if ((buffer.st_mode & S_IFDIR) == 0) {
-                cerr << "Output must be a directory (or 'NONE')" << endl;
-                return Error::ERR_CREATE_FILE;
+            if ((formattedInName.size() != 0) && (formattedInName[formattedInName.size() - 1] != PATH_SEPARATOR)) {
+                formattedInName += PATH_SEPARATOR;
             }
 
-            formattedOutName += PATH_SEPARATOR;
-        }
-    }
-    else {
-        inputIsDir = false;
+            if ((formattedOutName.size() != 0) && (specialOutput == false)) {
+                if (stat(formattedOutName.c_str(), &buffer) != 0) {
+                    cerr << "Output must be an existing directory (or 'NONE')" << endl;
+                    return Error::ERR_OPEN_FILE;
+                }
 
-        if ((formattedOutName.size() != 0) && (specialOutput == false)) {
-            if ((stat(formattedOutName.c_str(), &buffer) != 0) && ((buffer.st_mode & S_IFDIR) != 0)) {
-                cerr << "Output must be a file (or 'NONE')" << endl;
-                return Error::ERR_CREATE_FILE;
+                if ((buffer.st_mode & S_IFDIR) == 0) {
+                    cerr << "Output must be a directory (or 'NONE')" << endl;
+                    return Error::ERR_CREATE_FILE;
+                }
+
+                formattedOutName += PATH_SEPARATOR;
+            }
+        }
+        else {
+            if ((formattedOutName.size() != 0) && (specialOutput == false)) {
+                if ((stat(formattedOutName.c_str(), &buffer) != 0) && ((buffer.st_mode & S_IFDIR) != 0)) {
+                    cerr << "Output must be a file (or 'NONE')" << endl;
+                    return Error::ERR_CREATE_FILE;
+                }
             }
         }
     }
@@ -222,41 +346,77 @@ int BlockDecompressor::decompress(uint64& inputSize)
     ss << _verbosity;
     ctx["verbosity"] = ss.str();
     ctx["overwrite"] = (_overwrite == true) ? STR_TRUE : STR_FALSE;
+    ctx["pwrite"] = (_pwrite == true) ? STR_TRUE : STR_FALSE;
+    ctx["test"] = (_test == true) ? STR_TRUE : STR_FALSE;
+    ss.str(string());
+    ss << _maxMemory;
+    ctx["maxMemory"] = ss.str();
+
+    ThreadPool* pool = nullptr;
+
+#ifdef CONCURRENCY_ENABLED
+    // One pool of workers shared by the block tasks of all the files
+    if (_jobs > 1)
+        pool = new ThreadPool(_jobs);
+#endif
+
+    // One pool of block buffers shared by the streams of all the files
+    BufferPool buffers;
+
+    // Number of files that failed (all the files are processed in test mode)
+    int failed = 0;
 
     // Run the task(s)
     if (nbFiles == 1) {
         string oName = formattedOutName;
-        string iName = files[0]._fullPath;
+        string iName = "STDIN";
 
-        if (oName.length() == 0) {
-            oName = iName + ".bak";
-        }
-        else if ((inputIsDir == true) && (specialOutput == false)) {
-            oName = formattedOutName + iName.substr(formattedInName.size()) + ".bak";
+        if (isStdIn == false) {
+            iName = files[0]._fullPath;
+            ss.str(string());
+            ss << files[0]._size;
+            ctx["fileSize"] = ss.str();
+
+            if (oName.length() == 0) {
+                oName = iName + ".bak";
+            }
+            else if ((inputIsDir == true) && (specialOutput == false)) {
+                oName = formattedOutName + iName.substr(formattedInName.size()) + ".bak";
+            }
         }
 
-        ss.str(string());
-        ss << files[0]._size;
-        ctx["fileSize"] = ss.str();
         ctx["inputName"] = iName;
         ctx["outputName"] = oName;
         ss.str(string());
         ss << _jobs;
         ctx["jobs"] = ss.str();
-		Context context(ctx);
+		Context context(ctx, pool);
+		context.setBufferPool(&buffers);
+		context.setDictionary(dict.get());
 		FileDecompressTask<FileDecompressResult> task(context, _listeners);
         FileDecompressResult fdr = task.run();
         res = fdr._code;
         read = fdr._read;
+        failed = fdr._failed;
 
-        if (res != 0) {
+        // In test mode, the task reports the failure
+        if ((res != 0) && (_test == false)) {
             cerr << fdr._errMsg << endl;
         }
     }
     else {
         vector<FileDecompressTask<FileDecompressResult>*> tasks;
         int* jobsPerTask = new int[nbFiles];
-        Global::computeJobsPerTask(jobsPerTask, _jobs, nbFiles);
+
+        if (toStdOut == true) {
+            // One file at a time, with all the jobs
+            for (int i = 0; i < nbFiles; i++)
+                jobsPerTask[i] = _jobs;
+        }
+        else {
+            Global::computeJobsPerTask(jobsPerTask, _jobs, nbFiles);
+        }
+
         int n = 0;
 		sortFilesByPathAndSize(files, false);
 
@@ -272,17 +432,25 @@ int BlockDecompressor::decompress(uint64& inputSize)
                 oName = formattedOutName + iName.substr(formattedInName.size()) + ".bak";
             }
 
-			Context taskCtx(ctx);
+			Context taskCtx(ctx, pool);
+			taskCtx.setBufferPool(&buffers);
+			taskCtx.setDictionary(dict.get());
 			taskCtx.putLong("fileSize", files[i]._size);
 			taskCtx.putString("inputName", iName);
 			taskCtx.putString("outputName", oName);
-			taskCtx.putInt("jobs", jobsPerTask[n++]);
+			taskCtx.putInt("jobs", jobsPerTask[n]);
+
+            // Share the memory budget between the files processed concurrently
+            if ((_maxMemory > 0) && (toStdOut == false))
+                taskCtx.putLong("maxMemory", _maxMemory * jobsPerTask[n] / _jobs);
+
+            n++;
             ss.str(string());
             FileDecompressTask<FileDecompressResult>* task = new FileDecompressTask<FileDecompressResult>(taskCtx, _listeners);
             tasks.push_back(task);
         }
 
-        bool doConcurrent = _jobs > 1;
+        bool doConcurrent = (_jobs > 1) && (toStdOut == false);
 
 #ifdef CONCURRENCY_ENABLED
         if (doConcurrent) {
@@ -292,15 +460,24 @@ int BlockDecompressor::decompress(uint64& inputSize)
 
             // Create one worker per job and run it. A worker calls several tasks sequentially.
             for (int i = 0; i < _jobs; i++) {
-                workers.push_back(new FileDecompressWorker<FileDecompressTask<FileDecompressResult>*, FileDecompressResult>(&queue));
+                workers.push_back(new FileDecompressWorker<FileDecompressTask<FileDecompressResult>*, FileDecompressResult>(&queue, _test == false));
                 results.push_back(async(launch::async, &FileDecompressWorker<FileDecompressTask<FileDecompressResult>*, FileDecompressResult>::run, workers[i]));
             }
 
             // Wait for results
             for (int i = 0; i < _jobs; i++) {
                 FileDecompressResult fdr = results[i].get();
-                res = fdr._code;
                 read += fdr._read;
+                failed += fdr._failed;
+
+                if (_test == true) {
+                    if (fdr._code != 0)
+                        res = fdr._code;
+
+                    continue;
+                }
+
+                res = fdr._code;
 
                 if (res != 0) {
                     cerr << fdr._errMsg << endl;
@@ -317,8 +494,17 @@ int BlockDecompressor::decompress(uint64& inputSize)
         if (!doConcurrent) {
             for (uint i = 0; i < tasks.size(); i++) {
                 FileDecompressResult fdr = tasks[i]->run();
-                res = fdr._code;
                 read += fdr._read;
+                failed += fdr._failed;
+
+                if (_test == true) {
+                    if (fdr._code != 0)
+                        res = fdr._code;
+
+                    continue;
+                }
+
+                res = fdr._code;
 
                 if (res != 0) {
                     cerr << fdr._errMsg << endl;
@@ -333,6 +519,19 @@ int BlockDecompressor::decompress(uint64& inputSize)
             delete tasks[i];
     }
 
+#ifdef CONCURRENCY_ENABLED
+    if (pool != nullptr)
+        delete pool;
+#endif
+
+    if (_verbosity > 2) {
+        ss.str(string());
+        ss << "Buffer pool: " << buffers.hits() << " hits, " << buffers.misses() << " misses, ";
+        ss << (buffers.retained() >> 10) << " KB retained";
+        log.println(ss.str().c_str(), true);
+        ss.str(string());
+    }
+
     stopClock.stop();
 
     if (nbFiles > 1) {
@@ -352,14 +551,32 @@ int BlockDecompressor::decompress(uint64& inputSize)
 
         log.println(ss.str().c_str(), _verbosity > 0);
         ss.str(string());
-        ss << "Total output size: " << read << " byte" << ((read > 1) ? "s" : "");
+        ss << ((_test == true) ? "Total decoded size: " : "Total output size: ") << read << " byte" << ((read > 1) ? "s" : "");
         log.println(ss.str().c_str(), _verbosity > 0);
         ss.str(string());
+
+        if (_test == true) {
+            if (delta > 0) {
+                double b2KB = double(1000) / double(1024);
+                ss << "Throughput (KB/s): " << uint(read * b2KB / delta);
+                log.println(ss.str().c_str(), _verbosity > 0);
+                ss.str(string());
+            }
+
+            ss << "Files tested: " << nbFiles << ", passed: " << (nbFiles - failed) << ", failed: " << failed;
+            log.println(ss.str().c_str(), _verbosity > 0);
+            ss.str(string());
+        }
     }
 
     if (_verbosity > 2)
         removeListener(listener);
 
+    if (trace != nullptr) {
+        removeListener(*trace);
+        trace->close();
+    }
+
     inputSize += read;
     return res;
 }
@@ -395,6 +612,7 @@ FileDecompressTask<T>::FileDecompressTask(Context& ctx, vector<Listener*>& liste
 {
     _listeners = listeners;
     _os = nullptr;
+    _writer = nullptr;
     _cis = nullptr;
 }
 
@@ -417,10 +635,31 @@ FileDecompressTask<T>::~FileDecompressTask()
     }
     catch (exception&) {
     }
+
+    if (_writer != nullptr) {
+        delete _writer;
+        _writer = nullptr;
+    }
 }
 
 template <class T>
 T FileDecompressTask<T>::run()
+{
+    T res = decode();
+
+    // In test mode, report each file that failed (and carry on)
+    if ((res._code != 0) && (string(_ctx.getString("test")) == STR_TRUE)) {
+        Printer log(&cerr);
+        stringstream ss;
+        ss << "Testing " << _ctx.getString("inputName") << ": FAILED (" << res._errMsg << ")";
+        log.println(ss.str().c_str(), true);
+    }
+
+    return res;
+}
+
+template <class T>
+T FileDecompressTask<T>::decode()
 {
     Printer log(&cout);
 	int verbosity = _ctx.getInt("verbosity");
@@ -436,22 +675,31 @@ T FileDecompressTask<T>::run()
     ss.str(string());
 	string strOverwrite = _ctx.getString("overwrite");
     bool overwrite = strOverwrite == STR_TRUE;
+	string strPwrite = _ctx.getString("pwrite");
+    bool pwrite = strPwrite == STR_TRUE;
+	string strTest = _ctx.getString("test");
+    bool test = strTest == STR_TRUE;
 
     int64 read = 0;
     printFlag = verbosity > 1;
-    ss << "\nDecoding " << inputName << " ...";
+    ss << ((test == true) ? "\nTesting " : "\nDecoding ") << inputName << " ...";
     log.println(ss.str().c_str(), printFlag);
     log.println("\n", verbosity > 3);
 
     if (_listeners.size() > 0) {
-        Event evt(Event::DECOMPRESSION_START, -1, int64(0), clock());
+        Event evt(Event::DECOMPRESSION_START, -1, int64(0), Event::now());
         BlockDecompressor::notifyListeners(_listeners, evt);
     }
 
     string str = outputName;
     transform(str.begin(), str.end(), str.begin(), ::toupper);
 
-    if (str.compare(0, 4, "NONE") == 0) {
+    if (test == true) {
+        // The decoding tasks decode and verify the blocks in parallel, the
+        // output is discarded (no copy to the stream buffer)
+        _writer = new NullPositionalWriter();
+    }
+    else if (str.compare(0, 4, "NONE") == 0) {
         _os = new NullOutputStream();
     }
     else if (str.compare(0, 6, "STDOUT") == 0) {
@@ -482,9 +730,34 @@ T FileDecompressTask<T>::run()
                 }
             }
 
-            _os = new ofstream(outputName.c_str(), ofstream::out | ofstream::binary);
+            if (pwrite == true) {
+                // The decoding tasks write their blocks directly to the file
+                try {
+                    _writer = new PositionalWriter(outputName);
+                }
+                catch (IOException&) {
+                    if (overwrite == false)
+                        throw;
+
+                    // Attempt to create the full folder hierarchy to file
+                    string parentDir = outputName;
+                    size_t idx = outputName.find_last_of(PATH_SEPARATOR);
+
+                    if (idx != string::npos) {
+                        parentDir = parentDir.substr(0, idx);
+                    }
+
+                    if (mkdirAll(parentDir) != 0)
+                        throw;
 
-            if (!*_os) {
+                    _writer = new PositionalWriter(outputName);
+                }
+            }
+            else {
+                _os = new ofstream(outputName.c_str(), ofstream::out | ofstream::binary);
+            }
+
+            if ((_writer == nullptr) && (!*_os)) {
                 if (overwrite == true) {
                     // Attempt to create the full folder hierarchy to file
                     string parentDir = outputName;
@@ -559,31 +832,38 @@ T FileDecompressTask<T>::run()
         SliceArray<byte> sa(buf, DEFAULT_BUFFER_SIZE, 0);
         int decoded = 0;
 
-        // Decode next block
-        do {
-            _cis->read((char*)&sa._array[0], sa._length);
-            decoded = int(_cis->gcount());
+        if (_writer != nullptr) {
+            // Decode all blocks, each block is written by its decoding task
+            read = int64(_cis->decodeTo(*_writer));
+            _writer->close(read);
+        }
+        else {
+            // Decode next block
+            do {
+                _cis->read((char*)&sa._array[0], sa._length);
+                decoded = int(_cis->gcount());
 
-            if (decoded < 0) {
-                delete[] buf;
-                stringstream sserr;
-                sserr << "Reached end of stream";
-                return T(Error::ERR_READ_FILE, _cis->getRead(), sserr.str().c_str());
-            }
+                if (decoded < 0) {
+                    delete[] buf;
+                    stringstream sserr;
+                    sserr << "Reached end of stream";
+                    return T(Error::ERR_READ_FILE, _cis->getRead(), sserr.str().c_str());
+                }
 
-            try {
-                if (decoded > 0) {
-                    _os->write((const char*)&sa._array[0], decoded);
-                    read += decoded;
+                try {
+                    if (decoded > 0) {
+                        _os->write((const char*)&sa._array[0], decoded);
+                        read += decoded;
+                    }
                 }
-            }
-            catch (exception& e) {
-                delete[] buf;
-                stringstream sserr;
-                sserr << "Failed to write decompressed block to file '" << outputName << "': " << e.what();
-                return T(Error::ERR_READ_FILE, _cis->getRead(), sserr.str().c_str());
-            }
-        } while (decoded == sa._length);
+                catch (exception& e) {
+                    delete[] buf;
+                    stringstream sserr;
+                    sserr << "Failed to write decompressed block to file '" << outputName << "': " << e.what();
+                    return T(Error::ERR_READ_FILE, _cis->getRead(), sserr.str().c_str());
+                }
+            } while (decoded == sa._length);
+        }
     }
     catch (IOException& e) {
         // Close streams to ensure all data are flushed
@@ -667,7 +947,7 @@ T FileDecompressTask<T>::run()
         ss << " bytes in " << buffer;
     }
 
-    log.println(ss.str().c_str(), verbosity == 1);
+    log.println(ss.str().c_str(), (verbosity == 1) && (test == false));
 
     if (delta > 0) {
         double b2KB = double(1000) / double(1024);
@@ -676,10 +956,28 @@ T FileDecompressTask<T>::run()
         log.println(ss.str().c_str(), printFlag);
     }
 
+    if (test == true) {
+        const int checksumSize = _cis->getChecksumSize();
+        ss.str(string());
+        ss << "Testing " << inputName << ": OK (" << _cis->getRead() << " => " << read << " bytes in " << buffer;
+
+        if (delta > 0) {
+            double b2KB = double(1000) / double(1024);
+            ss << ", " << uint(read * b2KB / delta) << " KB/s";
+        }
+
+        if (checksumSize == 0)
+            ss << ", no checksum)";
+        else
+            ss << ", " << checksumSize << " bit checksums)";
+
+        log.println(ss.str().c_str(), verbosity > 0);
+    }
+
     log.println("", verbosity > 1);
 
     if (_listeners.size() > 0) {
-        Event evt(Event::DECOMPRESSION_END, -1, int64(_cis->getRead()), clock());
+        Event evt(Event::DECOMPRESSION_END, -1, int64(_cis->getRead()), Event::now());
         BlockDecompressor::notifyListeners(_listeners, evt);
     }
 
@@ -721,23 +1019,25 @@ R FileDecompressWorker<T, R>::run()
 {
     int res = 0;
     uint64 read = 0;
+    int failed = 0;
     string errMsg;
 
-    while (res == 0) {
+    while ((res == 0) || (_stopOnError == false)) {
         T* task = _queue->get();
 
         if (task == nullptr)
             break;
 
         R result = (*task)->run();
-        res = result._code;
         read += result._read;
+        failed += result._failed;
 
-        if (res != 0) {
+        if (result._code != 0) {
+            res = result._code;
             errMsg += result._errMsg;
         }
     }
 
-    return R(res, read, errMsg);
+    return R(res, read, errMsg, failed);
 }
 #endif
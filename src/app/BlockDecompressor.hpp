@@ -22,6 +22,7 @@ limitations under the License.
 #include "../OutputStream.hpp"
 #include "../Listener.hpp"
 #include "../io/CompressedInputStream.hpp"
+#include "../io/PositionalWriter.hpp"
 
 namespace kanzi {
    class FileDecompressResult {
@@ -29,12 +30,14 @@ namespace kanzi {
        int _code;
        uint64 _read;
        string _errMsg;
+       int _failed; // number of files that failed
 
        FileDecompressResult()
        {
            _code = 0;
            _read = 0;
            _errMsg = "";
+           _failed = 0;
        }
 
        FileDecompressResult(int code, uint64 read, const string& errMsg)
@@ -42,6 +45,15 @@ namespace kanzi {
            _code = code;
            _read = read;
            _errMsg = errMsg;
+           _failed = (code == 0) ? 0 : 1;
+       }
+
+       FileDecompressResult(int code, uint64 read, const string& errMsg, int failed)
+       {
+           _code = code;
+           _read = read;
+           _errMsg = errMsg;
+           _failed = failed;
        }
 
        ~FileDecompressResult() {}
@@ -51,7 +63,12 @@ namespace kanzi {
    template <class T, class R>
    class FileDecompressWorker : public Task<R> {
    public:
-       FileDecompressWorker(BoundedConcurrentQueue<T>* queue) { _queue = queue; }
+       // If stopOnError is false (test mode), all the files are processed
+       FileDecompressWorker(BoundedConcurrentQueue<T>* queue, bool stopOnError = true)
+       {
+           _queue = queue;
+           _stopOnError = stopOnError;
+       }
 
        ~FileDecompressWorker() {}
 
@@ -59,6 +76,7 @@ namespace kanzi {
 
    private:
        BoundedConcurrentQueue<T>* _queue;
+       bool _stopOnError;
    };
 #endif
 
@@ -78,8 +96,11 @@ namespace kanzi {
    private:
        Context _ctx;
        OutputStream* _os;
+       PositionalWriter* _writer; // output written by the decoding tasks (pwrite, test)
        CompressedInputStream* _cis;
        vector<Listener*> _listeners;
+
+       T decode();
    };
 
    class BlockDecompressor {
@@ -105,10 +126,15 @@ namespace kanzi {
 
        int _verbosity;
        bool _overwrite;
+       bool _pwrite;
+       bool _test; // decode and verify without writing any output
        string _inputName;
        string _outputName;
        int _blockSize;
        int _jobs;
+       int64 _maxMemory; // memory budget in bytes (0 means no limit)
+       string _dictName; // shared dictionary file (empty if none)
+       string _traceName; // Chrome trace file (empty if none)
        vector<Listener*> _listeners;
 
        static void notifyListeners(vector<Listener*>& listeners, const Event& evt);
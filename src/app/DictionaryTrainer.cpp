@@ -0,0 +1,244 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <sys/stat.h>
+#include "DictionaryTrainer.hpp"
+#include "../Dictionary.hpp"
+#include "../Error.hpp"
+#include "../util.hpp"
+#include "../io/IOException.hpp"
+#include "../io/IOUtil.hpp"
+
+using namespace kanzi;
+
+DictionaryTrainer::DictionaryTrainer(map<string, string>& args) THROW
+{
+    map<string, string>::iterator it;
+    it = args.find("overwrite");
+
+    if (it == args.end()) {
+        _overwrite = false;
+    }
+    else {
+        _overwrite = it->second == STR_TRUE;
+        args.erase(it);
+    }
+
+    it = args.find("inputName");
+    _inputName = it->second;
+    args.erase(it);
+    it = args.find("outputName");
+    _outputName = it->second;
+    args.erase(it);
+    it = args.find("dictSize");
+
+    if (it == args.end()) {
+        _dictSize = DEFAULT_DICT_SIZE;
+    }
+    else {
+        _dictSize = atoi(it->second.c_str());
+        args.erase(it);
+    }
+
+    if ((_dictSize < Dictionary::MIN_SIZE) || (_dictSize > Dictionary::MAX_SIZE)) {
+        stringstream ss;
+        ss << "Invalid dictionary size: " << _dictSize << " (must be in [" << Dictionary::MIN_SIZE
+           << ".." << Dictionary::MAX_SIZE << "])";
+        throw invalid_argument(ss.str());
+    }
+
+    it = args.find("verbose");
+    _verbosity = atoi(it->second.c_str());
+    args.erase(it);
+
+    // Training is single threaded
+    it = args.find("jobs");
+
+    if (it != args.end())
+        args.erase(it);
+
+    if ((_verbosity > 0) && (args.size() > 0)) {
+        Printer log(&cout);
+
+        for (it = args.begin(); it != args.end(); it++) {
+            stringstream ss;
+            ss << "Ignoring invalid option [" << it->first << "]";
+            log.println(ss.str().c_str(), _verbosity > 0);
+        }
+    }
+}
+
+int DictionaryTrainer::train()
+{
+    vector<FileData> files;
+    Clock stopClock;
+    Printer log(&cout);
+    stringstream ss;
+    string str = _inputName;
+    transform(str.begin(), str.end(), str.begin(), ::toupper);
+
+    if (str.compare(0, 5, "STDIN") == 0) {
+        cerr << "The samples must be files (not 'stdin')" << endl;
+        return Error::ERR_INVALID_PARAM;
+    }
+
+    str = _outputName;
+    transform(str.begin(), str.end(), str.begin(), ::toupper);
+
+    if ((_outputName.length() == 0) || (str.compare(0, 4, "NONE") == 0) || (str.compare(0, 6, "STDOUT") == 0)) {
+        cerr << "Missing name of the dictionary file (-o)" << endl;
+        return Error::ERR_MISSING_PARAM;
+    }
+
+    try {
+        createFileList(_inputName, files);
+    }
+    catch (IOException& e) {
+        cerr << e.what() << endl;
+        return Error::ERR_OPEN_FILE;
+    }
+
+    if (files.size() == 0) {
+        cerr << "Cannot access input file '" << _inputName << "'" << endl;
+        return Error::ERR_OPEN_FILE;
+    }
+
+    struct stat buffer;
+
+    if (stat(_outputName.c_str(), &buffer) == 0) {
+        if ((buffer.st_mode & S_IFDIR) != 0) {
+            cerr << "The output file is a directory" << endl;
+            return Error::ERR_OUTPUT_IS_DIR;
+        }
+
+        if (_overwrite == false) {
+            cerr << "File '" << _outputName << "' exists and the 'force' command "
+                 << "line option has not been provided" << endl;
+            return Error::ERR_OVERWRITE_FILE;
+        }
+    }
+
+    // Same order whatever the file system: same dictionary
+    sortFilesByPathAndSize(files, false);
+    vector<byte> samples;
+    vector<int> sizes;
+    int nbFiles = 0;
+
+    for (size_t i = 0; i < files.size(); i++) {
+        const int64 remaining = MAX_TRAINING_SIZE - int64(samples.size());
+        const int length = int(min(files[i]._size, remaining));
+
+        if (length <= 0) {
+            if (remaining <= 0) {
+                ss << "Warning: the training data is limited to " << (MAX_TRAINING_SIZE >> 20)
+                   << " MB, ignoring " << (files.size() - i) << " file(s)";
+                log.println(ss.str().c_str(), _verbosity > 0);
+                ss.str(string());
+                break;
+            }
+
+            continue;
+        }
+
+        ifstream is(files[i]._fullPath.c_str(), ifstream::in | ifstream::binary);
+
+        if (is.is_open() == false) {
+            cerr << "Cannot open input file '" << files[i]._fullPath << "'" << endl;
+            return Error::ERR_OPEN_FILE;
+        }
+
+        const size_t offset = samples.size();
+        samples.resize(offset + size_t(length));
+        is.read(reinterpret_cast<char*>(&samples[offset]), length);
+
+        if (is.gcount() != length) {
+            cerr << "Cannot read input file '" << files[i]._fullPath << "'" << endl;
+            return Error::ERR_READ_FILE;
+        }
+
+        for (int n = 0; n < length; n += MAX_SAMPLE_SIZE)
+            sizes.push_back(min(length - n, int(MAX_SAMPLE_SIZE)));
+
+        nbFiles++;
+    }
+
+    if (samples.size() < size_t(Dictionary::MIN_SIZE)) {
+        cerr << "Not enough data to train a dictionary: at least " << Dictionary::MIN_SIZE
+             << " bytes of samples required" << endl;
+        return Error::ERR_INVALID_PARAM;
+    }
+
+    unique_ptr<Dictionary> dict;
+
+    try {
+        dict.reset(Dictionary::train(&samples[0], &sizes[0], int(sizes.size()), _dictSize));
+    }
+    catch (exception& e) {
+        cerr << "Cannot train the dictionary: " << e.what() << endl;
+        return Error::ERR_INVALID_PARAM;
+    }
+
+    ofstream os(_outputName.c_str(), ofstream::out | ofstream::binary);
+
+    if (!os) {
+        if (_overwrite == true) {
+            // Attempt to create the full folder hierarchy to file
+            string parentDir = _outputName;
+            size_t idx = _outputName.find_last_of(PATH_SEPARATOR);
+
+            if (idx != string::npos)
+                parentDir = parentDir.substr(0, idx);
+
+            if (mkdirAll(parentDir) == 0)
+                os.open(_outputName.c_str(), ofstream::out | ofstream::binary);
+        }
+
+        if (!os) {
+            cerr << "Cannot open output file '" << _outputName << "' for writing" << endl;
+            return Error::ERR_CREATE_FILE;
+        }
+    }
+
+    try {
+        dict->save(os);
+        os.close();
+    }
+    catch (exception& e) {
+        cerr << e.what() << endl;
+        return Error::ERR_WRITE_FILE;
+    }
+
+    stopClock.stop();
+    ss << nbFiles << " file" << ((nbFiles > 1) ? "s" : "") << " (" << samples.size() << " bytes, "
+       << sizes.size() << " sample" << ((sizes.size() > 1) ? "s" : "") << ") used for training";
+    log.println(ss.str().c_str(), _verbosity > 0);
+    ss.str(string());
+    ss << "Dictionary: " << dict->getSize() << " bytes, id " << hex << dict->getId() << dec;
+    log.println(ss.str().c_str(), _verbosity > 0);
+    ss.str(string());
+    ss << "Training time: " << int64(stopClock.elapsed()) << " ms";
+    log.println(ss.str().c_str(), _verbosity > 0);
+    ss.str(string());
+    ss << "Output file: " << _outputName;
+    log.println(ss.str().c_str(), _verbosity > 0);
+    return 0;
+}
@@ -0,0 +1,49 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _DictionaryTrainer_
+#define _DictionaryTrainer_
+
+#include <map>
+#include <string>
+#include "../types.hpp"
+
+using namespace std;
+
+namespace kanzi {
+
+   // Build a shared dictionary from sample files ('kanzi --train'). Each
+   // file (or each chunk of a big file) is one sample.
+   class DictionaryTrainer {
+   public:
+       DictionaryTrainer(map<string, string>& m) THROW;
+
+       ~DictionaryTrainer() {}
+
+       int train();
+
+   private:
+       static const int DEFAULT_DICT_SIZE = 64 * 1024;
+       static const int MAX_SAMPLE_SIZE = 128 * 1024; // bigger files are split
+       static const int64 MAX_TRAINING_SIZE = int64(1) << 30; // samples read at most
+
+       int _verbosity;
+       bool _overwrite;
+       string _inputName;
+       string _outputName;
+       int _dictSize;
+   };
+}
+#endif
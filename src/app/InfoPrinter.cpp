@@ -51,7 +51,7 @@ void InfoPrinter::processEvent(const Event& evt)
 
         // Register initial block size
         BlockInfo* bi = new BlockInfo();
-        _clock12.start();
+        bi->_time1 = evt.getTime();
 
         if (_type == InfoPrinter::ENCODING)
             bi->_stage0Size = evt.getSize();
@@ -84,13 +84,12 @@ void InfoPrinter::processEvent(const Event& evt)
 
         if (_type == InfoPrinter::DECODING)
             bi->_stage0Size = evt.getSize();
-        
-        _clock12.stop();
-        _clock23.start();
+
+        bi->_time2 = evt.getTime();
 
         if (_level >= 5) {
             stringstream ss;
-            ss << evt.toString() << " [" << int64(_clock12.elapsed())  << " ms]";
+            ss << evt.toString() << " [" << ((bi->_time2 - bi->_time1) / 1000000) << " ms]";
             _os << ss.str() << endl;
         }
     }
@@ -109,8 +108,7 @@ void InfoPrinter::processEvent(const Event& evt)
             bi = it->second;
         }
 
-        _clock23.stop();
-        _clock34.start();
+        bi->_time3 = evt.getTime();
         bi->_stage1Size = evt.getSize();
 
         if (_level >= 5) {
@@ -140,7 +138,7 @@ void InfoPrinter::processEvent(const Event& evt)
         }
 
         int64 stage2Size = evt.getSize();
-        _clock34.stop();
+        const int64 time4 = evt.getTime();
         stringstream ss;
 
         if (_level >= 5) {
@@ -150,8 +148,8 @@ void InfoPrinter::processEvent(const Event& evt)
         // Display block info
         if (_level >= 4) {
             ss << "Block " << currentBlockId << ": " << bi->_stage0Size << " => ";
-            ss << bi->_stage1Size << " [" << int64(_clock12.elapsed()) << " ms] => " << stage2Size;
-            ss << " [" << int64(_clock34.elapsed()) << " ms]";
+            ss << bi->_stage1Size << " [" << ((bi->_time2 - bi->_time1) / 1000000) << " ms] => " << stage2Size;
+            ss << " [" << ((time4 - bi->_time3) / 1000000) << " ms]";
 
             // Add compression ratio for encoding
             if (_type == InfoPrinter::ENCODING) {
@@ -163,9 +161,14 @@ void InfoPrinter::processEvent(const Event& evt)
             }
 
             // Optionally add hash
-            if (evt.getHash() != 0) {
+            if (evt.getHashType() == Event::SIZE_32) {
+                char buf[32];
+                sprintf(buf, " [%08X]", uint32(evt.getHash()));
+                ss << buf;
+            }
+            else if (evt.getHashType() == Event::SIZE_64) {
                 char buf[32];
-                sprintf(buf, " [%08X]", evt.getHash());
+                sprintf(buf, " [%016llX]", (unsigned long long)evt.getHash());
                 ss << buf;
             }
 
@@ -36,6 +36,11 @@ namespace kanzi
    public:
        int64 _stage0Size;
        int64 _stage1Size;
+       // Event times (ns) of the start of stage 1, end of stage 1 and start
+       // of stage 2. Per block since several blocks may be processed at once.
+       int64 _time1;
+       int64 _time2;
+       int64 _time3;
    };
 
    // An implementation of Listener to display block information (verbose option
@@ -62,9 +67,6 @@ namespace kanzi
        Event::Type _thresholds[6];
        InfoPrinter::Type _type;
        int _level;
-       Clock _clock12;
-       Clock _clock23;
-       Clock _clock34;
    };
 }
 #endif
@@ -18,7 +18,9 @@ limitations under the License.
 
 #include "BlockCompressor.hpp"
 #include "BlockDecompressor.hpp"
+#include "DictionaryTrainer.hpp"
 #include "../util.hpp"
+#include "../Dictionary.hpp"
 #include "../Error.hpp"
 
 using namespace kanzi;
@@ -56,6 +58,17 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
     string strBlockSize = "";
     string strOverwrite = STR_FALSE;
     string strChecksum = STR_FALSE;
+    string strIndex = STR_FALSE;
+    string strDedup = STR_FALSE;
+    string strMmap = STR_FALSE;
+    string strPwrite = STR_FALSE;
+    string strTest = STR_FALSE;
+    string strMaxMemory = "";
+    string strFlushInterval = "";
+    string strSuffixSorter = "";
+    string strDictionary = "";
+    string strTrace = "";
+    string strDictSize = "";
     string strSkip = STR_FALSE;
     string codec;
     string transf;
@@ -86,6 +99,11 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
                 return Error::ERR_INVALID_PARAM;
             }
 
+            if (mode == "t") {
+                cerr << "Both compression and training options were provided." << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
             mode = "c";
             continue;
         }
@@ -96,7 +114,40 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
                 return Error::ERR_INVALID_PARAM;
             }
 
+            if (mode == "t") {
+                cerr << "Both decompression and training options were provided." << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            mode = "d";
+            continue;
+        }
+
+        // Test mode: decompression without output
+        if (arg == "--test") {
+            if (mode == "c") {
+                cerr << "Both compression and test options were provided." << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            if (mode == "t") {
+                cerr << "Both test and training options were provided." << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
             mode = "d";
+            strTest = STR_TRUE;
+            continue;
+        }
+
+        if (arg == "--train") {
+            if ((mode == "c") || (mode == "d")) {
+                cerr << "Both training and " << ((mode == "c") ? "compression" : "decompression")
+                     << " options were provided." << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            mode = "t";
             continue;
         }
 
@@ -216,13 +267,13 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
 
             if (mode.compare(0, 1, "c") != 0) {
                 log.println("        optional name of the output file or directory (defaults to", true);
-                log.println("        <inputName.knz>) or 'none' or 'stdout'. 'stdout' is not valid", true);
-                log.println("        when the number of jobs is greater than 1.\n", true);
+                log.println("        <inputName.knz>) or 'none' or 'stdout'. Several files sent to", true);
+                log.println("        'stdout' are processed one after the other.\n", true);
             }
             else if (mode.compare(0, 1, "d") != 0) {
                 log.println("        optional name of the output file or directory (defaults to", true);
-                log.println("        <inputName.knz>) or 'none' or 'stdout'. 'stdout' is not valid", true);
-                log.println("        when the number of jobs is greater than 1.\n", true);
+                log.println("        <inputName.knz>) or 'none' or 'stdout'. Several files sent to", true);
+                log.println("        'stdout' are processed one after the other.\n", true);
             }
             else {
                 log.println("        optional name of the output file or 'none' or 'stdout'.\n", true);
@@ -248,17 +299,77 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
                 log.println("                  [MTFT|RANK|SRT|TEXT|X86]", true);
                 log.println("        EX: BWT+RANK or BWTS+MTFT (default is BWT+RANK+ZRLT)\n", true);
 				log.println("", true);
-                log.println("   -x, --checksum", true);
-                log.println("        enable block checksum\n", true);
+                log.println("   -x, -x32, -x64, --checksum=<size>", true);
+                log.println("        enable block checksum (32 or 64 bits, default is 32) and", true);
+                log.println("        a digest of the whole stream\n", true);
+				log.println("", true);
+                log.println("   -n, --index", true);
+                log.println("        append a block index to allow random access reads\n", true);
+				log.println("", true);
+                log.println("   --dedup", true);
+                log.println("        encode a block identical to a recent block as a reference to it", true);
+                log.println("        (EX: backups, VM images). Not compatible with --index.\n", true);
+				log.println("", true);
+                log.println("   -m, --mmap", true);
+                log.println("        read the input files through memory mappings (local files only)\n", true);
 				log.println("", true);
                 log.println("   -s, --skip", true);
                 log.println("        copy blocks with high entropy instead of compressing them.\n", true);
+				log.println("", true);
+                log.println("   --flush-interval=<ms>", true);
+                log.println("        emit the pending data as a complete block when it is older than", true);
+                log.println("        the interval (EX: to stream logs from STDIN with a bounded latency).\n", true);
+				log.println("", true);
+                log.println("   --suffix-sorter=<name>", true);
+                log.println("        suffix array construction of BWT and BWTS [DivSufSort|SAIS|SAIS_LowMem]", true);
+                log.println("        (default is DivSufSort). SAIS is linear in the worst case (EX: highly", true);
+                log.println("        repetitive data). The compressed data does not depend on it.\n", true);
+            }
+
+            if (mode.compare(0, 1, "c") != 0) {
+                log.println("   -p, --pwrite", true);
+                log.println("        let the jobs write the decoded blocks directly to the output file", true);
+                log.println("        (local files only, ignored for 'none' and 'stdout').\n", true);
+				log.println("", true);
+                log.println("   --test", true);
+                log.println("        decode the input file(s) in parallel and verify the checksums and", true);
+                log.println("        the stream digest (if any) without writing any output. Reports", true);
+                log.println("        the result of each file. Implies -d.\n", true);
+				log.println("", true);
             }
 
             log.println("   -j, --jobs=<jobs>", true);
             log.println("        maximum number of jobs the program may start concurrently", true);
             log.println("        (default is 1, maximum is 64).\n", true);
             log.println("", true);
+            log.println("   --max-memory=<size>", true);
+            log.println("        approximate memory budget (EX: 512m or 2g). The number of blocks", true);
+            log.println("        processed concurrently is reduced to fit (and the block size", true);
+            log.println("        when compressing, down to 64 KB). Fail if the budget is too low.\n", true);
+            log.println("", true);
+
+            if (mode.compare(0, 1, "t") != 0) {
+                log.println("   --trace=<file>", true);
+                log.println("        write the timeline of the processing of the blocks (transform and", true);
+                log.println("        entropy stages per thread) to the file in the Chrome trace format", true);
+                log.println("        (EX: load it in chrome://tracing or ui.perfetto.dev).\n", true);
+                log.println("", true);
+                log.println("   --dictionary=<file>", true);
+                log.println("        shared dictionary built by --train, primes the LZ, ROLZ and TEXT", true);
+                log.println("        transforms (EX: many small files of the same kind). The same", true);
+                log.println("        dictionary must be provided to decompress.\n", true);
+                log.println("", true);
+            }
+
+            if ((mode.compare(0, 1, "c") != 0) && (mode.compare(0, 1, "d") != 0)) {
+                log.println("   --train", true);
+                log.println("        build a dictionary from the sample file(s) provided with -i and", true);
+                log.println("        write it to the file provided with -o.\n", true);
+                log.println("", true);
+                log.println("   --dict-size=<size>", true);
+                log.println("        maximum size of the trained dictionary (default 64 KB, max 1 MB).\n", true);
+                log.println("", true);
+            }
 
             if (mode.compare(0, 1, "d") != 0) {
                 log.println("EX. kanzi -c -i foo.txt -o none -b 4m -l 4 -v 3\n", true);
@@ -270,12 +381,19 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
             if (mode.compare(0, 1, "c") != 0) {
                 log.println("EX. kanzi -d -i foo.knz -f -v 2 -j 2\n", true);
                 log.println("EX. kanzi --decompress --input=foo.knz --force --verbose=2 --jobs=2\n", true);
+                log.println("EX. kanzi --test -i backups -j 4\n", true);
+            }
+
+            if ((mode.compare(0, 1, "c") != 0) && (mode.compare(0, 1, "d") != 0)) {
+                log.println("EX. kanzi --train -i samples -o my.dict --dict-size=64k", true);
+                log.println("    kanzi -c -i msg.json -l 2 --dictionary=my.dict\n", true);
             }
 
             return 0;
         }
 
-        if ((arg == "--compress") || (arg == "-c") || (arg == "--decompress") || (arg == "-d")) {
+        if ((arg == "--compress") || (arg == "-c") || (arg == "--decompress") || (arg == "-d")
+            || (arg == "--test") || (arg == "--train")) {
             if (ctx != -1) {
                 stringstream ss;
                 ss << "Warning: ignoring option [" << CMD_LINE_ARGS[ctx] << "] with no value.";
@@ -317,7 +435,69 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
                 log.println(ss.str().c_str(), verbose > 0);
             }
 
-            strChecksum = STR_TRUE;
+            strChecksum = "32";
+            ctx = -1;
+            continue;
+        }
+
+        if ((arg.compare(0, 11, "--checksum=") == 0) || (arg == "-x32") || (arg == "-x64")) {
+            string name = (arg.compare(0, 11, "--checksum=") == 0) ? arg.substr(11) : arg.substr(2);
+            name = trim(name);
+
+            if ((name != "32") && (name != "64")) {
+                cerr << "Invalid checksum size provided on command line: " << arg << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            strChecksum = name;
+            ctx = -1;
+            continue;
+        }
+
+        if ((arg == "--index") || (arg == "-n")) {
+            if (ctx != -1) {
+                stringstream ss;
+                ss << "Warning: ignoring option [" << CMD_LINE_ARGS[ctx] << "] with no value.";
+                log.println(ss.str().c_str(), verbose > 0);
+            }
+
+            strIndex = STR_TRUE;
+            ctx = -1;
+            continue;
+        }
+
+        if (arg == "--dedup") {
+            if (ctx != -1) {
+                stringstream ss;
+                ss << "Warning: ignoring option [" << CMD_LINE_ARGS[ctx] << "] with no value.";
+                log.println(ss.str().c_str(), verbose > 0);
+            }
+
+            strDedup = STR_TRUE;
+            ctx = -1;
+            continue;
+        }
+
+        if ((arg == "--mmap") || (arg == "-m")) {
+            if (ctx != -1) {
+                stringstream ss;
+                ss << "Warning: ignoring option [" << CMD_LINE_ARGS[ctx] << "] with no value.";
+                log.println(ss.str().c_str(), verbose > 0);
+            }
+
+            strMmap = STR_TRUE;
+            ctx = -1;
+            continue;
+        }
+
+        if ((arg == "--pwrite") || (arg == "-p")) {
+            if (ctx != -1) {
+                stringstream ss;
+                ss << "Warning: ignoring option [" << CMD_LINE_ARGS[ctx] << "] with no value.";
+                log.println(ss.str().c_str(), verbose > 0);
+            }
+
+            strPwrite = STR_TRUE;
             ctx = -1;
             continue;
         }
@@ -429,6 +609,147 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
             continue;
         }
 
+        if (arg.compare(0, 13, "--max-memory=") == 0) {
+            string name = arg.substr(13);
+            name = trim(name);
+            transform(name.begin(), name.end(), name.begin(), ::toupper);
+            char lastChar = (name.length() == 0) ? ' ' : name[name.length() - 1];
+            int64 scale = 1;
+
+            // Process K or M or G suffix
+            if ('K' == lastChar)
+                scale = 1024;
+            else if ('M' == lastChar)
+                scale = 1024 * 1024;
+            else if ('G' == lastChar)
+                scale = 1024 * 1024 * 1024;
+
+            if (scale != 1)
+                name = name.substr(0, name.length() - 1);
+
+            bool valid = name.length() > 0;
+
+            for (uint n = 0; n < name.length(); n++)
+                valid &= (name[n] >= '0') && (name[n] <= '9');
+
+            const int64 mem = (valid == true) ? scale * int64(atoll(name.c_str())) : 0;
+
+            if (mem <= 0) {
+                cerr << "Invalid memory budget provided on command line: " << arg << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            stringstream ss;
+            ss << mem;
+            strMaxMemory = ss.str();
+            ctx = -1;
+            continue;
+        }
+
+        if (arg.compare(0, 17, "--flush-interval=") == 0) {
+            string name = arg.substr(17);
+            name = trim(name);
+            bool valid = name.length() > 0;
+
+            for (uint n = 0; n < name.length(); n++)
+                valid &= (name[n] >= '0') && (name[n] <= '9');
+
+            const int interval = ((valid == true) && (name.length() < 10)) ? atoi(name.c_str()) : 0;
+
+            if (interval <= 0) {
+                cerr << "Invalid flush interval provided on command line: " << arg << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            stringstream ss;
+            ss << interval;
+            strFlushInterval = ss.str();
+            ctx = -1;
+            continue;
+        }
+
+        if (arg.compare(0, 16, "--suffix-sorter=") == 0) {
+            string name = arg.substr(16);
+            name = trim(name);
+            transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+            if ((name != "DIVSUFSORT") && (name != "SAIS") && (name != "SAIS_LOWMEM")) {
+                cerr << "Invalid suffix sorter provided on command line: " << arg << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            strSuffixSorter = name;
+            ctx = -1;
+            continue;
+        }
+
+        if (arg.compare(0, 8, "--trace=") == 0) {
+            string name = arg.substr(8);
+            name = trim(name);
+
+            if (name.length() == 0) {
+                cerr << "Invalid trace file name provided on command line: " << arg << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            strTrace = name;
+            ctx = -1;
+            continue;
+        }
+
+        if (arg.compare(0, 13, "--dictionary=") == 0) {
+            string name = arg.substr(13);
+            name = trim(name);
+
+            if (name.length() == 0) {
+                cerr << "Invalid dictionary file name provided on command line: " << arg << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            if (strDictionary != "")
+                cerr << "Warning: ignoring duplicate dictionary: " << name << endl;
+            else
+                strDictionary = name;
+
+            ctx = -1;
+            continue;
+        }
+
+        if (arg.compare(0, 12, "--dict-size=") == 0) {
+            string name = arg.substr(12);
+            name = trim(name);
+            transform(name.begin(), name.end(), name.begin(), ::toupper);
+            char lastChar = (name.length() == 0) ? ' ' : name[name.length() - 1];
+            int scale = 1;
+
+            // Process K or M suffix
+            if ('K' == lastChar)
+                scale = 1024;
+            else if ('M' == lastChar)
+                scale = 1024 * 1024;
+
+            if (scale != 1)
+                name = name.substr(0, name.length() - 1);
+
+            bool valid = (name.length() > 0) && (name.length() < 8);
+
+            for (uint n = 0; n < name.length(); n++)
+                valid &= (name[n] >= '0') && (name[n] <= '9');
+
+            const int64 size = (valid == true) ? scale * int64(atoi(name.c_str())) : 0;
+
+            if ((size < Dictionary::MIN_SIZE) || (size > Dictionary::MAX_SIZE)) {
+                cerr << "Invalid dictionary size provided on command line: " << arg << endl;
+                return Error::ERR_INVALID_PARAM;
+            }
+
+            stringstream ss;
+            ss << size;
+            strDictSize = ss.str();
+            ctx = -1;
+            continue;
+        }
+
         if ((arg.compare(0, 8, "--block=") == 0) || (ctx == ARG_IDX_BLOCK)) {
             string name = (arg.compare(0, 8, "--block=") == 0) ? arg.substr(8) : arg;
             name = trim(name);
@@ -520,7 +841,7 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
     }
 
     if (inputName.length() == 0) {
-        cerr << "Need help? \nfull information : -h \nabout compress : -h -c \nabout decompress : -h -d" << endl;
+        cerr << "Need help? \nfull information : -h \nabout compress : -h -c \nabout decompress : -h -d \nabout training : -h --train" << endl;
         return Error::ERR_MISSING_PARAM;
     }
 
@@ -565,12 +886,45 @@ int processCommandLine(int argc, const char* argv[], map<string, string>& map)
     if (transf.length() > 0)
         map["transform"] = transf;
 
-    if (strChecksum == STR_TRUE)
+    if (strChecksum != STR_FALSE)
         map["checksum"] = strChecksum;
 
+    if (strIndex == STR_TRUE)
+        map["index"] = strIndex;
+
+    if (strDedup == STR_TRUE)
+        map["dedup"] = strDedup;
+
+    if (strMmap == STR_TRUE)
+        map["mmap"] = strMmap;
+
+    if (strPwrite == STR_TRUE)
+        map["pwrite"] = strPwrite;
+
+    if (strTest == STR_TRUE)
+        map["test"] = strTest;
+
+    if (strMaxMemory.length() > 0)
+        map["maxMemory"] = strMaxMemory;
+
+    if (strFlushInterval.length() > 0)
+        map["flushInterval"] = strFlushInterval;
+
+    if (strSuffixSorter.length() > 0)
+        map["suffixSorter"] = strSuffixSorter;
+
     if (strSkip == STR_TRUE)
         map["skipBlocks"] = strSkip;
 
+    if (strDictionary.length() > 0)
+        map["dictionary"] = strDictionary;
+
+    if (strTrace.length() > 0)
+        map["trace"] = strTrace;
+
+    if (strDictSize.length() > 0)
+        map["dictSize"] = strDictSize;
+
     map["jobs"] = strTasks;
     return 0;
 }
@@ -619,6 +973,18 @@ int main(int argc, const char* argv[])
         }
     }
 
+    if (mode == "t") {
+        try {
+            DictionaryTrainer dt(args);
+            int code = dt.train();
+            exit(code);
+        }
+        catch (exception& e) {
+            cerr << "Could not create the dictionary trainer: " << e.what() << endl;
+            exit(Error::ERR_INVALID_PARAM);
+        }
+    }
+
     cout << "Missing arguments: try --help or -h" << endl;
     return 1;
 }
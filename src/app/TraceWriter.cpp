@@ -0,0 +1,183 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cstdio>
+#include <sstream>
+#include "TraceWriter.hpp"
+#include "../Error.hpp"
+#include "../io/IOException.hpp"
+
+using namespace kanzi;
+
+static const int STAGE_FILE = 0;
+static const int STAGE_TRANSFORM = 1;
+static const int STAGE_ENTROPY = 2;
+
+TraceWriter::TraceWriter(const string& fileName) THROW
+    : _os(fileName.c_str(), ofstream::out | ofstream::binary)
+{
+    if (!_os)
+        throw IOException("Cannot open trace file '" + fileName + "' for writing", Error::ERR_CREATE_FILE);
+
+    _origin = Event::now();
+    _first = true;
+    _closed = false;
+    _os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+void TraceWriter::close()
+{
+#ifdef CONCURRENCY_ENABLED
+    lock_guard<mutex> lock(_mutex);
+#endif
+
+    if (_closed == true)
+        return;
+
+    _closed = true;
+    _os << "\n]}\n";
+    _os.close();
+}
+
+void TraceWriter::processEvent(const Event& evt)
+{
+    switch (evt.getType()) {
+    case Event::COMPRESSION_START:
+    case Event::DECOMPRESSION_START:
+        begin(evt, STAGE_FILE);
+        break;
+
+    case Event::COMPRESSION_END:
+        end(evt, STAGE_FILE, "compress");
+        break;
+
+    case Event::DECOMPRESSION_END:
+        end(evt, STAGE_FILE, "decompress");
+        break;
+
+    case Event::BEFORE_TRANSFORM:
+        begin(evt, STAGE_TRANSFORM);
+        break;
+
+    case Event::AFTER_TRANSFORM:
+        end(evt, STAGE_TRANSFORM, "transform");
+        break;
+
+    case Event::BEFORE_ENTROPY:
+        begin(evt, STAGE_ENTROPY);
+        break;
+
+    case Event::AFTER_ENTROPY:
+        end(evt, STAGE_ENTROPY, "entropy");
+        break;
+
+    case Event::AFTER_HEADER_DECODING: {
+        // Instant event, the message is the description of the stream
+        const string msg = evt.toString();
+        stringstream ss;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.3f", double(evt.getTime() - _origin) / 1000.0);
+        ss << "{\"name\":\"header\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << evt.getThreadId()
+           << ",\"ts\":" << buf << ",\"args\":{\"info\":\"";
+
+        for (size_t i = 0; i < msg.length(); i++) {
+            const char c = msg[i];
+
+            if ((c == '"') || (c == '\\'))
+                ss << '\\' << c;
+            else if (c == '\n')
+                ss << "\\n";
+            else if (uint8(c) >= 32)
+                ss << c;
+        }
+
+        ss << "\"}}";
+        write(ss.str());
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void TraceWriter::begin(const Event& evt, int stage)
+{
+    Key key = { evt.getThreadId(), evt.getId(), stage };
+    Start start = { evt.getTime(), evt.getSize() };
+
+#ifdef CONCURRENCY_ENABLED
+    lock_guard<mutex> lock(_mutex);
+#endif
+    _pending[key] = start;
+}
+
+void TraceWriter::end(const Event& evt, int stage, const char* name)
+{
+    Key key = { evt.getThreadId(), evt.getId(), stage };
+    Start start;
+
+    {
+#ifdef CONCURRENCY_ENABLED
+        lock_guard<mutex> lock(_mutex);
+#endif
+        map<Key, Start>::iterator it = _pending.find(key);
+
+        // Start not seen (listener added in the middle of the processing)
+        if (it == _pending.end())
+            return;
+
+        start = it->second;
+        _pending.erase(it);
+    }
+
+    // Timestamps in microseconds
+    char ts[64];
+    char dur[64];
+    snprintf(ts, sizeof(ts), "%.3f", double(start._time - _origin) / 1000.0);
+    snprintf(dur, sizeof(dur), "%.3f", double(evt.getTime() - start._time) / 1000.0);
+    stringstream ss;
+    ss << "{\"name\":\"" << name << "\",\"cat\":\"" << ((stage == STAGE_FILE) ? "file" : "block")
+       << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << evt.getThreadId() << ",\"ts\":" << ts
+       << ",\"dur\":" << dur << ",\"args\":{";
+
+    if (stage != STAGE_FILE)
+        ss << "\"block\":" << evt.getId() << ",";
+
+    // Sizes unknown before entropy decoding (-1)
+    if (start._size >= 0)
+        ss << "\"in\":" << start._size << ",";
+
+    ss << "\"out\":" << evt.getSize() << "}}";
+    write(ss.str());
+}
+
+void TraceWriter::write(const string& record)
+{
+#ifdef CONCURRENCY_ENABLED
+    lock_guard<mutex> lock(_mutex);
+#endif
+
+    if (_closed == true)
+        return;
+
+    _os << (_first ? "\n" : ",\n") << record;
+    _first = false;
+}
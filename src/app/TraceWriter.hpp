@@ -0,0 +1,90 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _TraceWriter_
+#define _TraceWriter_
+
+#include <fstream>
+#include <map>
+#include <string>
+#include "../concurrent.hpp"
+#include "../types.hpp"
+#include "../Listener.hpp"
+#ifdef CONCURRENCY_ENABLED
+#include <mutex>
+#endif
+
+using namespace std;
+
+namespace kanzi
+{
+
+   // An implementation of Listener writing the events to a file in the Chrome
+   // trace format (JSON), to be loaded in chrome://tracing or Perfetto.
+   // The transform and entropy stages of each block and the processing of
+   // each file are durations on the timeline of the thread that ran them.
+   class TraceWriter : public Listener {
+   public:
+       // Throw an IOException if the file cannot be created
+       TraceWriter(const string& fileName) THROW;
+
+       ~TraceWriter();
+
+       void processEvent(const Event& evt);
+
+       // Terminate the trace and close the file. Idempotent.
+       void close();
+
+   private:
+       // Start of a duration: thread, block id (-1 for a file) and stage
+       struct Key {
+           int _threadId;
+           int _blockId;
+           int _stage;
+
+           bool operator<(const Key& k) const
+           {
+               if (_threadId != k._threadId)
+                   return _threadId < k._threadId;
+
+               if (_blockId != k._blockId)
+                   return _blockId < k._blockId;
+
+               return _stage < k._stage;
+           }
+       };
+
+       struct Start {
+           int64 _time;
+           int64 _size;
+       };
+
+       ofstream _os;
+       map<Key, Start> _pending;
+   #ifdef CONCURRENCY_ENABLED
+       mutex _mutex;
+   #endif
+       int64 _origin; // creation time (ns), origin of the timeline
+       bool _first;
+       bool _closed;
+
+       void begin(const Event& evt, int stage);
+
+       void end(const Event& evt, int stage, const char* name);
+
+       void write(const string& record);
+   };
+}
+#endif
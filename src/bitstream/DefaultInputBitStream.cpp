@@ -75,7 +75,10 @@ uint DefaultInputBitStream::readBits(byte bits[], uint count) THROW
             memcpy(&bits[start], &_buffer[_position], _maxPosition + 1 - _position);
             start += (_maxPosition + 1 - _position);
             remaining -= ((_maxPosition + 1 - _position) << 3);
-            readFromInputStream(_bufferSize);
+
+            if (readFromInputStream(_bufferSize) <= 0)
+                throw BitStreamException("No more data to read in the bitstream",
+                    BitStreamException::END_OF_STREAM);
         }
 
         const int r = (remaining >> 6) << 3;
@@ -136,6 +139,11 @@ void DefaultInputBitStream::close() THROW
     // on readBit() or readBits()
     _availBits = 0;
     _maxPosition = -1;
+
+    // Release the buffer early (the stream may not be deleted right away)
+    delete[] _buffer;
+    _bufferSize = 8;
+    _buffer = new byte[_bufferSize];
 }
 
 int DefaultInputBitStream::readFromInputStream(uint count) THROW
@@ -150,6 +150,36 @@ void DefaultOutputBitStream::close() THROW
     _written -= 64; // adjust for method written()
 }
 
+void DefaultOutputBitStream::sync() THROW
+{
+    if (isClosed() == true)
+        throw BitStreamException("Stream closed", BitStreamException::STREAM_CLOSED);
+
+    // _position is a multiple of 8 below _bufferSize: room for _current
+    const int nbBits = 64 - _availBits;
+    const int nbBytes = nbBits >> 3;
+
+    if (nbBytes > 0) {
+        BigEndian::writeLong64(&_buffer[_position], _current);
+        _position += nbBytes;
+        _current <<= (nbBytes << 3); // nbBytes < 8
+        _availBits += (nbBytes << 3);
+    }
+
+    // Empty the buffer (_position is a multiple of 8 again)
+    flush();
+
+    try {
+        _os.flush();
+
+        if (!_os.good())
+            throw BitStreamException("Write to bitstream failed", BitStreamException::INPUT_OUTPUT);
+    }
+    catch (ios_base::failure& e) {
+        throw BitStreamException(e.what(), BitStreamException::INPUT_OUTPUT);
+    }
+}
+
 // Write buffer to underlying stream
 void DefaultOutputBitStream::flush() THROW
 {
@@ -54,6 +54,10 @@ namespace kanzi
 
        void close() THROW;
 
+       // Write the complete bytes written so far to the underlying stream and
+       // flush it. The bits of an incomplete last byte (if any) are kept.
+       void sync() THROW;
+
        // Return number of bits written so far
        uint64 written() const
        {
@@ -0,0 +1,115 @@
+/*
+Copyright 2011-2017 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include "MemoryInputBitStream.hpp"
+
+using namespace kanzi;
+
+MemoryInputBitStream::MemoryInputBitStream(const byte* buffer, int length) THROW
+{
+    if (buffer == nullptr)
+        throw invalid_argument("Invalid null buffer");
+
+    if (length < 0)
+        throw invalid_argument("Invalid buffer length (must be at least 0)");
+
+    _buffer = buffer;
+    _availBits = 0;
+    _maxPosition = length - 1;
+    _position = 0;
+    _current = 0;
+    _closed = false;
+}
+
+uint MemoryInputBitStream::readBits(byte bits[], uint count) THROW
+{
+    if (isClosed() == true)
+        throw BitStreamException("Stream closed", BitStreamException::STREAM_CLOSED);
+
+    if (count == 0)
+        return 0;
+
+    int remaining = count;
+    int start = 0;
+
+    // Byte aligned cursor ?
+    if ((_availBits & 7) == 0) {
+        // Empty _current
+        while ((_availBits > 0) && (remaining >= 8)) {
+            bits[start] = byte(readBits(8));
+            start++;
+            remaining -= 8;
+        }
+
+        // Copy internal buffer to bits array
+        const int r = min(remaining >> 3, _maxPosition + 1 - _position);
+
+        if (r > 0) {
+            memcpy(&bits[start], &_buffer[_position], r);
+            _position += r;
+            start += r;
+            remaining -= (r << 3);
+        }
+    }
+    else {
+        // Not byte aligned
+        const int r = 64 - _availBits;
+
+        while (remaining >= 64) {
+            const uint64 v = _current & (uint64(-1) >> (64 - _availBits));
+            pullCurrent();
+            _availBits -= r;
+            BigEndian::writeLong64(&bits[start], (v << r) | (_current >> _availBits));
+            start += 8;
+            remaining -= 64;
+        }
+    }
+
+    // Last bytes
+    while (remaining >= 8) {
+        bits[start] = byte(readBits(8));
+        start++;
+        remaining -= 8;
+    }
+
+    if (remaining > 0)
+        bits[start] = byte(readBits(remaining) << (8 - remaining));
+
+    return count;
+}
+
+void MemoryInputBitStream::close() THROW
+{
+    if (isClosed() == true)
+        return;
+
+    _closed = true;
+
+    // Reset fields to trigger an exception on readBit() or readBits()
+    _availBits = 0;
+    _position = 0;
+    _maxPosition = -1;
+}
+
+// Return false when the bitstream is closed or the End-Of-Stream has been reached
+bool MemoryInputBitStream::hasMoreToRead()
+{
+    if (isClosed() == true)
+        return false;
+
+    return (_position <= _maxPosition) || (_availBits > 0);
+}
@@ -0,0 +1,183 @@
+/*
+Copyright 2011-2017 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include "MemoryOutputBitStream.hpp"
+
+using namespace kanzi;
+
+MemoryOutputBitStream::MemoryOutputBitStream(uint bufferSize, BufferPool* pool) THROW
+{
+    if (bufferSize < 1024)
+        throw invalid_argument("Invalid buffer size (must be at least 1024)");
+
+    if ((bufferSize & 7) != 0)
+        throw invalid_argument("Invalid buffer size (must be a multiple of 8)");
+
+    _pool = pool;
+
+    if (_pool != nullptr) {
+        int capacity;
+        _buffer = _pool->acquire(int(bufferSize), capacity);
+        _bufferSize = uint(capacity);
+    }
+    else {
+        _bufferSize = bufferSize;
+        _buffer = new byte[_bufferSize];
+    }
+
+    reset();
+}
+
+void MemoryOutputBitStream::reset()
+{
+    _availBits = 64;
+    _position = 0;
+    _current = 0;
+    _closed = false;
+}
+
+// Grow the buffer to hold at least 'required' bytes
+void MemoryOutputBitStream::grow(uint required) THROW
+{
+    uint64 size = uint64(_bufferSize) << 1;
+
+    if (size < uint64(required))
+        size = (uint64(required) + 7) & ~uint64(7);
+
+    if (size > 0xFFFFFFF8)
+        throw BitStreamException("Memory bitstream capacity exceeded", BitStreamException::INPUT_OUTPUT);
+
+    byte* buf;
+
+    if ((_pool != nullptr) && (size <= uint64(0x7FFFFFFF))) {
+        int capacity;
+        buf = _pool->acquire(int(size), capacity);
+        size = uint64(capacity);
+    }
+    else {
+        buf = new byte[size_t(size)];
+    }
+
+    memcpy(&buf[0], &_buffer[0], _position);
+    release();
+    _buffer = buf;
+    _bufferSize = uint(size);
+}
+
+void MemoryOutputBitStream::release()
+{
+    if (_pool != nullptr)
+        _pool->release(_buffer, int(min(_bufferSize, uint(0x7FFFFFFF))));
+    else
+        delete[] _buffer;
+}
+
+uint MemoryOutputBitStream::writeBits(const byte bits[], uint count) THROW
+{
+    if (isClosed() == true)
+        throw BitStreamException("Stream closed", BitStreamException::STREAM_CLOSED);
+
+    int remaining = count;
+    int start = 0;
+
+    // Byte aligned cursor ?
+    if ((_availBits & 7) == 0) {
+        // Fill up _current
+        while ((_availBits != 64) && (remaining >= 8)) {
+            writeBits(uint64(bits[start]), 8);
+            start++;
+            remaining -= 8;
+        }
+
+        // Copy bits array to internal buffer
+        const int r = (remaining >> 6) << 3;
+
+        if (r > 0) {
+            if (_position + uint(r) > _bufferSize)
+                grow(_position + uint(r));
+
+            memcpy(&_buffer[_position], &bits[start], r);
+            start += r;
+            _position += r;
+            remaining -= (r << 3);
+        }
+    }
+    else {
+        // Not byte aligned
+        const int r = 64 - _availBits;
+
+        while (remaining >= 64) {
+            const uint64 value = uint64(BigEndian::readLong64(&bits[start]));
+            _current |= (value >> r);
+            pushCurrent();
+            _current = (value << (64 - r));
+            _availBits -= r;
+            start += 8;
+            remaining -= 64;
+        }
+    }
+
+    // Last bytes
+    while (remaining >= 8) {
+        writeBits(uint64(bits[start]), 8);
+        start++;
+        remaining -= 8;
+    }
+
+    if (remaining > 0)
+        writeBits(uint64(bits[start]) >> (8 - remaining), remaining);
+
+    return count;
+}
+
+void MemoryOutputBitStream::close() THROW
+{
+    if (isClosed() == true)
+        return;
+
+    // Push last bytes (the very last byte may be incomplete)
+    const int size = ((64 - _availBits) + 7) >> 3;
+    pushCurrent();
+    _position -= (8 - size);
+    _closed = true;
+    _availBits = 0;
+}
+
+void MemoryOutputBitStream::copyTo(OutputBitStream& obs, uint64 count) const THROW
+{
+    if (isClosed() == false)
+        throw BitStreamException("Stream not closed", BitStreamException::INVALID_STREAM);
+
+    if (count > written())
+        throw invalid_argument("Invalid bit count: " + to_string(count));
+
+    // Copy in chunks, the bit count of writeBits is limited to 32 bits
+    const uint64 chunk = uint64(1) << 30;
+    const byte* p = &_buffer[0];
+
+    while (count > 0) {
+        const uint64 n = (count < chunk) ? count : chunk;
+        obs.writeBits(p, uint(n));
+        p += (n >> 3);
+        count -= n;
+    }
+}
+
+MemoryOutputBitStream::~MemoryOutputBitStream()
+{
+    release();
+}
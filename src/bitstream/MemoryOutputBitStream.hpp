@@ -0,0 +1,143 @@
+/*
+Copyright 2011-2017 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MemoryOutputBitStream_
+#define _MemoryOutputBitStream_
+
+#include "../BufferPool.hpp"
+#include "../OutputBitStream.hpp"
+#include "../Memory.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+
+   // A bitstream writing to a growable memory buffer.
+   // Used to encode a block independently of the other blocks. The bits
+   // can be appended to another bitstream once the block is complete.
+   class MemoryOutputBitStream : public OutputBitStream
+   {
+   private:
+       byte* _buffer;
+       BufferPool* _pool; // optional, not owned
+       bool _closed;
+       uint _bufferSize;
+       uint _position; // index of current byte in buffer
+       int _availBits; // bits not consumed in _current
+       uint64 _current; // cached bits
+
+       void pushCurrent() THROW;
+
+       void grow(uint required) THROW;
+
+       void release();
+
+   public:
+       static const uint DEFAULT_BUFFER_SIZE = 65536;
+
+       // If a pool is provided (it must outlive the bitstream), the buffer is
+       // taken from the pool and given back to it.
+       MemoryOutputBitStream(uint bufferSize=DEFAULT_BUFFER_SIZE, BufferPool* pool=nullptr) THROW;
+
+       ~MemoryOutputBitStream();
+
+       void writeBit(int bit) THROW;
+
+       int writeBits(uint64 bits, uint length) THROW;
+
+       uint writeBits(const byte bits[], uint length) THROW;
+
+       // Write the last (partial) bytes to the buffer. The number of bits
+       // written is rounded up to a multiple of 8.
+       void close() THROW;
+
+       // Return number of bits written so far
+       uint64 written() const
+       {
+           if (_closed == true)
+               return uint64(_position) << 3;
+
+           // Bytes written in memory + bits written in memory
+           return (uint64(_position) << 3) + (64 - _availBits);
+       }
+
+       bool isClosed() const { return _closed; }
+
+       // Valid once the stream is closed. The last byte is padded with zeros.
+       const byte* getBuffer() const { return _buffer; }
+
+       // Reopen the stream and discard the content, keep the memory buffer
+       void reset();
+
+       // Append the first 'count' bits of the closed stream to another bitstream
+       void copyTo(OutputBitStream& obs, uint64 count) const THROW;
+   };
+
+   // Write least significant bit of the input integer. Trigger exception if stream is closed
+   inline void MemoryOutputBitStream::writeBit(int bit) THROW
+   {
+       if (_availBits <= 1) { // _availBits = 0 if stream is closed => force pushCurrent()
+           _current |= (bit & 1);
+           pushCurrent();
+       }
+       else {
+           _availBits--;
+           _current |= (uint64(bit & 1) << _availBits);
+       }
+   }
+
+   // Write 'count' (in [1..64]) bits. Trigger exception if stream is closed
+   inline int MemoryOutputBitStream::writeBits(uint64 value, uint count) THROW
+   {
+       if (count > 64)
+           throw BitStreamException("Invalid bit count: " + to_string(count) + " (must be in [1..64])");
+
+       if (int(count) < _availBits) {
+           // Enough spots available in 'current'
+           _availBits -= int(count);
+           _current |= ((value & ((uint64(1) << count) - 1)) << _availBits); // 0 <= count < _availBits <= 64
+       }
+       else {
+           // Not enough spots available in 'current'
+           const uint remaining = count - _availBits;
+           _current |= ((value & (uint64(-1) >> (64 - count))) >> remaining); // 0 < count <= 64
+           pushCurrent();
+
+           if (remaining != 0) {
+               _current = value << (64 - remaining);
+               _availBits -= int(remaining);
+           }
+       }
+
+       return count;
+   }
+
+   // Push 64 bits of current value into buffer.
+   inline void MemoryOutputBitStream::pushCurrent() THROW
+   {
+       if (_closed == true)
+           throw BitStreamException("Stream closed", BitStreamException::STREAM_CLOSED);
+
+       if (_position + 8 > _bufferSize)
+           grow(_position + 8);
+
+       BigEndian::writeLong64(&_buffer[_position], _current);
+       _availBits = 64;
+       _current = 0;
+       _position += 8;
+   }
+}
+#endif
@@ -16,6 +16,8 @@ limitations under the License.
 #ifndef _concurrent_
 #define _concurrent_
 
+#include "types.hpp"
+
 using namespace std;
 
 template <class T>
@@ -29,6 +31,18 @@ public:
 #if __cplusplus >= 201103L || _MSC_VER >= 1700
 	// C++ 11 (or partial)
 	#include <atomic>
+	#include <condition_variable>
+	#include <deque>
+	#include <exception>
+	#include <functional>
+	#include <future>
+	#include <map>
+	#include <memory>
+	#include <mutex>
+	#include <stdexcept>
+	#include <thread>
+	#include <type_traits>
+	#include <vector>
 
 	#ifndef CONCURRENCY_ENABLED
 		#ifdef __clang__
@@ -65,6 +79,184 @@ public:
 		T* _data;
 	};
 
+
+	// A pool of long lived worker threads. It avoids paying for thread creation
+	// and teardown each time a batch of block tasks is started.
+	// Tasks scheduled from outside of the pool go to a shared FIFO queue, so they
+	// start in submission order (the block decoding tasks rely on it). Tasks
+	// scheduled from a worker thread go to the local deque of this worker.
+	// An idle worker pops its own deque first (LIFO), then the shared queue and
+	// finally steals from the other workers (FIFO).
+	class ThreadPool {
+	public:
+		ThreadPool(int threads = 8) THROW;
+
+		~ThreadPool();
+
+		template <class F, class... Args>
+		future<typename invoke_result<F, Args...>::type> schedule(F&& f, Args&&... args) THROW;
+
+		int size() const { return int(_workers.size()); }
+
+	private:
+		struct WorkQueue {
+			deque<function<void()> > _tasks;
+			mutex _mutex;
+		};
+
+		vector<thread> _workers;
+		vector<WorkQueue*> _locals;
+		WorkQueue _shared;
+		mutex _mutex;
+		condition_variable _cond;
+		atomic_int _pending;
+		bool _stop;
+
+		// Identify the pool and worker running on the current thread (if any)
+		static inline thread_local ThreadPool* _currentPool = nullptr;
+		static inline thread_local int _currentWorker = -1;
+
+		void push(function<void()>&& task);
+
+		bool pop(int worker, function<void()>& task);
+
+		void work(int worker);
+	};
+
+
+	inline ThreadPool::ThreadPool(int threads) THROW
+	{
+		if ((threads <= 0) || (threads > 1024))
+			throw invalid_argument("The number of threads must be in [1..1024]");
+
+		_pending = 0;
+		_stop = false;
+
+		for (int i = 0; i < threads; i++)
+			_locals.push_back(new WorkQueue());
+
+		for (int i = 0; i < threads; i++)
+			_workers.push_back(thread(&ThreadPool::work, this, i));
+	}
+
+	inline ThreadPool::~ThreadPool()
+	{
+		{
+			unique_lock<mutex> lock(_mutex);
+			_stop = true;
+		}
+
+		_cond.notify_all();
+
+		// Pending tasks are processed before the workers exit
+		for (thread& t : _workers)
+			t.join();
+
+		for (WorkQueue* q : _locals)
+			delete q;
+	}
+
+	template <class F, class... Args>
+	future<typename invoke_result<F, Args...>::type> ThreadPool::schedule(F&& f, Args&&... args) THROW
+	{
+		typedef typename invoke_result<F, Args...>::type R;
+
+		// packaged_task is not copyable, hence the shared pointer
+		shared_ptr<packaged_task<R()> > task = make_shared<packaged_task<R()> >(
+			bind(forward<F>(f), forward<Args>(args)...));
+		future<R> res = task->get_future();
+		push([task]() { (*task)(); });
+		return res;
+	}
+
+	inline void ThreadPool::push(function<void()>&& task)
+	{
+		WorkQueue* q = (_currentPool == this) ? _locals[_currentWorker] : &_shared;
+
+		{
+			unique_lock<mutex> lock(_mutex);
+
+			if (_stop == true)
+				throw runtime_error("The thread pool has been shut down");
+		}
+
+		{
+			unique_lock<mutex> lock(q->_mutex);
+			q->_tasks.push_back(move(task));
+		}
+
+		{
+			// Increment under the pool lock to avoid missing the wake up of an idle worker
+			unique_lock<mutex> lock(_mutex);
+			_pending++;
+		}
+
+		_cond.notify_one();
+	}
+
+	inline bool ThreadPool::pop(int worker, function<void()>& task)
+	{
+		{
+			WorkQueue* q = _locals[worker];
+			unique_lock<mutex> lock(q->_mutex);
+
+			if (q->_tasks.empty() == false) {
+				task = move(q->_tasks.back());
+				q->_tasks.pop_back();
+				_pending--;
+				return true;
+			}
+		}
+
+		{
+			unique_lock<mutex> lock(_shared._mutex);
+
+			if (_shared._tasks.empty() == false) {
+				task = move(_shared._tasks.front());
+				_shared._tasks.pop_front();
+				_pending--;
+				return true;
+			}
+		}
+
+		const int n = int(_locals.size());
+
+		for (int i = 1; i < n; i++) {
+			WorkQueue* q = _locals[(worker + i) % n];
+			unique_lock<mutex> lock(q->_mutex);
+
+			if (q->_tasks.empty() == false) {
+				task = move(q->_tasks.front());
+				q->_tasks.pop_front();
+				_pending--;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	inline void ThreadPool::work(int worker)
+	{
+		_currentPool = this;
+		_currentWorker = worker;
+
+		while (true) {
+			function<void()> task;
+
+			if (pop(worker, task) == true) {
+				task();
+				continue;
+			}
+
+			unique_lock<mutex> lock(_mutex);
+			_cond.wait(lock, [this] { return (_stop == true) || (_pending.load() > 0); });
+
+			if ((_stop == true) && (_pending.load() <= 0))
+				return;
+		}
+	}
+
 #elif (__cplusplus && __cplusplus < 201103L) || (_MSC_VER && _MSC_VER < 1700)
 	// ! Stubs for NON CONCURRENT USAGE !
 	// Used to compile and provide a non concurrent version AND
@@ -115,5 +307,135 @@ public:
 #endif //   (__cplusplus && __cplusplus < 201103L) || (_MSC_VER && _MSC_VER < 1700)
 
 
+#if __cplusplus >= 201103L || _MSC_VER >= 1700
+
+	// Sequence the tasks processing consecutive blocks so that their output is
+	// committed in block order. A task calling wait() is parked until all the
+	// previous blocks have been committed. A task calling commit() for a block
+	// that is not next in line queues its action and returns immediately: the
+	// action is run later by the thread committing the missing block.
+	class OrderedCommitQueue {
+	public:
+		static const int CANCELLED = -1;
+
+		OrderedCommitQueue(int next = 1) { _next = next; }
+
+		~OrderedCommitQueue() {}
+
+		// Must not be called while tasks are using the queue
+		void reset(int next);
+
+		// Return the id of the next block to commit (or CANCELLED)
+		int next();
+
+		// Return true when it is the turn of 'blockId' and false when cancelled
+		bool wait(int blockId);
+
+		// Run the action (if any) of 'blockId' and of the queued blocks in order
+		void commit(int blockId, function<void()>&& action = nullptr);
+
+		// Release all waiting tasks and drop the queued actions
+		void cancel();
+
+		// Throw the first exception raised by a commit action (if any)
+		void check() THROW;
+
+	private:
+		map<int, function<void()> > _pending;
+		mutex _mutex;
+		condition_variable _cond;
+		int _next;
+		exception_ptr _error;
+	};
+
+
+	inline void OrderedCommitQueue::reset(int next)
+	{
+		unique_lock<mutex> lock(_mutex);
+		_pending.clear();
+		_next = next;
+		_error = nullptr;
+	}
+
+	inline int OrderedCommitQueue::next()
+	{
+		unique_lock<mutex> lock(_mutex);
+		return _next;
+	}
+
+	inline bool OrderedCommitQueue::wait(int blockId)
+	{
+		unique_lock<mutex> lock(_mutex);
+		_cond.wait(lock, [this, blockId] { return (_next == CANCELLED) || (_next == blockId); });
+		return _next == blockId;
+	}
+
+	inline void OrderedCommitQueue::commit(int blockId, function<void()>&& action)
+	{
+		unique_lock<mutex> lock(_mutex);
+
+		if (_next == CANCELLED)
+			return;
+
+		if (blockId != _next) {
+			// Not our turn, let the committer of the previous block run the action
+			_pending[blockId] = move(action);
+			return;
+		}
+
+		function<void()> task = move(action);
+
+		while (true) {
+			// Run the action outside of the lock, the other tasks keep queuing
+			lock.unlock();
+
+			try {
+				if (task != nullptr)
+					task();
+			}
+			catch (...) {
+				lock.lock();
+				_error = current_exception();
+				_next = CANCELLED;
+				_pending.clear();
+				break;
+			}
+
+			lock.lock();
+			_next++;
+			map<int, function<void()> >::iterator it = _pending.find(_next);
+
+			if (it == _pending.end())
+				break;
+
+			task = move(it->second);
+			_pending.erase(it);
+		}
+
+		lock.unlock();
+		_cond.notify_all();
+	}
+
+	inline void OrderedCommitQueue::cancel()
+	{
+		{
+			unique_lock<mutex> lock(_mutex);
+			_next = CANCELLED;
+			_pending.clear();
+		}
+
+		_cond.notify_all();
+	}
+
+	inline void OrderedCommitQueue::check() THROW
+	{
+		unique_lock<mutex> lock(_mutex);
+
+		if (_error != nullptr)
+			rethrow_exception(_error);
+	}
+#endif
+
+
 
 #endif
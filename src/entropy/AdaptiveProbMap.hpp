@@ -83,15 +83,27 @@ namespace kanzi {
 
        int get(int bit, int pr, int ctx);
 
+       // Restore the initial probabilities
+       void reset();
+
    private:
        int _index; // last p, context
        uint16* _data; // [NbCtx][33]:  p, context -> p
+       int _size; // number of contexts
    };
 
    template <int RATE>
    inline LogisticAdaptiveProbMap<RATE>::LogisticAdaptiveProbMap(int n)
    {
        _data = new uint16[33 * n];
+       _size = n;
+       reset();
+   }
+
+   template <int RATE>
+   inline void LogisticAdaptiveProbMap<RATE>::reset()
+   {
+       const int n = _size;
        _index = 0;
 
        for (int j = 0; j <= 32; j++) {
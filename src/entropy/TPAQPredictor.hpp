@@ -61,6 +61,10 @@ namespace kanzi
 
        ~TPAQPredictor();
 
+       // Restore the initial state of the model for a new block. The memory
+       // is kept unless the sizes derived from the context have changed.
+       void reset(Context* ctx = nullptr);
+
        void update(int bit);
 
        // Return the split value representing the probability of 1 in the [0..4095] range.
@@ -276,6 +280,21 @@ namespace kanzi
    TPAQPredictor<T>::TPAQPredictor(Context* ctx)
        : _sse0(256)
        , _sse1(65536)
+   {
+       _mixers = nullptr;
+       _bigStatesMap = nullptr;
+       _smallStatesMap0 = new uint8[1 << 16];
+       _smallStatesMap1 = new uint8[1 << 24];
+       _hashes = nullptr;
+       _buffer = new byte[BUFFER_SIZE];
+       _statesMask = 0;
+       _mixersMask = 0;
+       _hashMask = 0;
+       reset(ctx);
+   }
+
+   template <bool T>
+   void TPAQPredictor<T>::reset(Context* ctx)
    {
        int statesSize = 1 << 28;
        int mixersSize = 1 << 12;
@@ -326,21 +345,39 @@ namespace kanzi
        _matchLen = 0;
        _matchPos = 0;
        _hash = 0;
-       _mixers = new TPAQMixer[mixersSize];
+
+       if (_mixersMask != mixersSize - 1) {
+           delete[] _mixers;
+           _mixers = new TPAQMixer[mixersSize];
+       }
+       else {
+           for (int i = 0; i < mixersSize; i++)
+               _mixers[i] = TPAQMixer();
+       }
+
        _mixer = &_mixers[0];
-       _bigStatesMap = new uint8[statesSize];
+
+       if (_statesMask != statesSize - 1) {
+           delete[] _bigStatesMap;
+           _bigStatesMap = new uint8[statesSize];
+       }
+
        memset(_bigStatesMap, 0, statesSize);
-       _smallStatesMap0 = new uint8[1 << 16];
        memset(_smallStatesMap0, 0, 1 << 16);
-       _smallStatesMap1 = new uint8[1 << 24];
        memset(_smallStatesMap1, 0, 1 << 24);
-       _hashes = new int32[hashSize];
+
+       if (_hashMask != hashSize - 1) {
+           delete[] _hashes;
+           _hashes = new int32[hashSize];
+       }
+
        memset(_hashes, 0, sizeof(int32) * hashSize);
-       _buffer = new byte[BUFFER_SIZE];
        memset(_buffer, 0, BUFFER_SIZE);
        _statesMask = statesSize - 1;
        _mixersMask = mixersSize - 1;
        _hashMask = hashSize - 1;
+       _sse0.reset();
+       _sse1.reset();
        _cp0 = &_smallStatesMap0[0];
        _cp1 = &_smallStatesMap1[0];
        _cp2 = &_bigStatesMap[0];
@@ -5,8 +5,10 @@
 #include <fstream>
 #include <algorithm>
 #include <cstring>
+#include <memory>
 #include "../types.hpp"
 #include "../Context.hpp"
+#include "../Dictionary.hpp"
 #include "../transform/BWT.hpp"
 #include "../transform/BWTS.hpp"
 #include "../transform/SBRT.hpp"
@@ -53,6 +55,9 @@ namespace kanzi {
 
 		static TransformSequence<T>* newFunction(Context& ctx, uint64 functionType) THROW;
 
+		// True if one of the transforms uses the shared dictionary (see Context)
+		static bool usesDictionary(uint64 functionType);
+
 	private:
 		FunctionFactory() {}
 
@@ -65,6 +70,8 @@ namespace kanzi {
 		static Transform<T>* newFunctionToken(Context& ctx, uint64 functionType) THROW;
 
 		static const char* getNameToken(uint64 functionType) THROW;
+
+		static Dictionary* transformDictionary(Transform<T>& transform, const Dictionary& dict) THROW;
 	};
 
 	// The returned type contains 8 transform values
@@ -166,18 +173,77 @@ namespace kanzi {
 	{
 		Transform<T>* transforms[8];
 		int nbtr = 0;
+		const Dictionary* dict = ctx.getDictionary();
+		unique_ptr<Dictionary> transformed;
 
-		for (int i = 0; i < 8; i++) {
-			transforms[i] = nullptr;
-			const uint64 t = (functionType >> (MAX_SHIFT - ONE_SHIFT * i)) & MASK;
+		try {
+			for (int i = 0; i < 8; i++) {
+				transforms[i] = nullptr;
+				const int shift = MAX_SHIFT - ONE_SHIFT * i;
+				const uint64 t = (functionType >> shift) & MASK;
+
+				if ((t == NONE_TYPE) && (i != 0))
+					continue;
 
-			if ((t != NONE_TYPE) || (i == 0))
 				transforms[nbtr++] = newFunctionToken(ctx, t);
+
+				// The next transforms see the dictionary as output by this one
+				// (EG. word indexes after TEXT), like the blocks
+				if ((ctx.getDictionary() != nullptr) && (usesDictionary(functionType & ((uint64(1) << shift) - 1)) == true)) {
+					Dictionary* d = transformDictionary(*transforms[nbtr - 1], *ctx.getDictionary());
+
+					if (d != nullptr) {
+						transformed.reset(d);
+						ctx.setDictionary(d);
+					}
+				}
+			}
+		}
+		catch (exception&) {
+			ctx.setDictionary(dict);
+			throw;
 		}
 
+		ctx.setDictionary(dict);
 		return new TransformSequence<T>(transforms, true);
 	}
 
+	template <class T>
+	bool FunctionFactory<T>::usesDictionary(uint64 functionType)
+	{
+		for (int i = 0; i < 8; i++) {
+			const uint64 t = (functionType >> (MAX_SHIFT - ONE_SHIFT * i)) & MASK;
+
+			if ((t == LZ_TYPE) || (t == ROLZ_TYPE) || (t == ROLZX_TYPE) || (t == DICT_TYPE))
+				return true;
+		}
+
+		return false;
+	}
+
+	// Return the dictionary transformed by a new transform (primed with the
+	// dictionary if it uses it) or null if the transform does not apply.
+	template <class T>
+	Dictionary* FunctionFactory<T>::transformDictionary(Transform<T>& transform, const Dictionary& dict) THROW
+	{
+		const int size = dict.getSize();
+		Function<T>* f = dynamic_cast<Function<T>*>(&transform);
+		const int maxSize = (f != nullptr) ? max(f->getMaxEncodedLength(size), size) : size;
+		SliceArray<T> input(new T[size], size, 0);
+		SliceArray<T> output(new T[maxSize], maxSize, 0);
+		memcpy(&input._array[0], dict.getData(), size);
+		Dictionary* res = nullptr;
+
+		if ((transform.forward(input, output, size) == true) && (output._index >= Dictionary::MIN_SIZE)
+			&& (output._index <= Dictionary::MAX_SIZE)) {
+			res = new Dictionary(reinterpret_cast<const byte*>(&output._array[0]), output._index);
+		}
+
+		delete[] input._array;
+		delete[] output._array;
+		return res;
+	}
+
 	template <class T>
 	Transform<T>* FunctionFactory<T>::newFunctionToken(Context& ctx, uint64 functionType) THROW
 	{
@@ -15,6 +15,7 @@ limitations under the License.
 
 #include <sstream>
 #include "../util.hpp" // Visual Studio min/max
+#include "../Dictionary.hpp"
 #include "FunctionFactory.hpp"
 #include "LZCodec.hpp"
 
@@ -29,7 +30,7 @@ LZCodec::LZCodec(Context& ctx) THROW
 {
    int lzpType = ctx.getInt("lz", FunctionFactory<byte>::LZ_TYPE);
     _delegate = (lzpType == FunctionFactory<byte>::LZP_TYPE) ? (Function<byte>*)new LZPCodec() : 
-       (Function<byte>*)new LZXCodec();
+       (Function<byte>*)new LZXCodec(ctx);
 }
 
 bool LZCodec::forward(SliceArray<byte>& input, SliceArray<byte>& output, int count) THROW
@@ -66,6 +67,38 @@ bool LZCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int cou
     return _delegate->inverse(input, output, count);
 }
 
+LZXCodec::LZXCodec(Context& ctx)
+{
+    _hashes = new int[0];
+    _bufferSize = 0;
+    _window = nullptr;
+    _windowSize = 0;
+    _dictSize = 0;
+    _dictHashes = nullptr;
+    _lastCount = -1;
+    const Dictionary* dict = ctx.getDictionary();
+
+    // Keep a copy of the dictionary, the blocks are appended to it
+    if (dict != nullptr) {
+        _dictSize = dict->getSize();
+        _windowSize = _dictSize;
+        _window = new byte[_windowSize];
+        memcpy(&_window[0], dict->getData(), _dictSize);
+    }
+}
+
+void LZXCodec::reserveWindow(int size)
+{
+    if (_windowSize >= size)
+        return;
+
+    byte* buf = new byte[size];
+    memcpy(&buf[0], &_window[0], _dictSize);
+    delete[] _window;
+    _window = buf;
+    _windowSize = size;
+}
+
 int LZXCodec::emitLastLiterals(const byte src[], byte dst[], int litLen)
 {
     int dstIdx = 1;
@@ -103,22 +136,67 @@ bool LZXCodec::forward(SliceArray<byte>& input, SliceArray<byte>& output, int co
     if (count < MIN_LENGTH)
         return false;
 
-    const int srcEnd = count - 8;
     byte* dst = &output._array[output._index];
     byte* src = &input._array[input._index];
+    int start = 0;
     int dstIdx = 0;
 
+    if (_dictSize > 0) {
+        if (_lastCount >= _bufferSize / 4) {
+            // Faster to copy the whole table
+            _lastCount = -1;
+        }
+        else if (_lastCount >= 0) {
+            // Undo the positions of the previous block (still in the window):
+            // cheaper than a copy of the whole table for small blocks
+            for (int i = max(_dictSize - 3, 1); i < _dictSize + _lastCount - 8; i++) {
+                const int32 h = hash(&_window[i]);
+                _hashes[h] = _dictHashes[h];
+            }
+        }
+
+        // Append the block to the dictionary
+        reserveWindow(_dictSize + count);
+        memcpy(&_window[_dictSize], &src[0], count);
+        src = _window;
+        start = _dictSize;
+    }
+
+    const int srcEnd = start + count - 8;
+
     if (_bufferSize == 0) {
         _bufferSize = 1 << HASH_LOG;
         delete[] _hashes;
         _hashes = new int32[_bufferSize];
     }
 
-    memset(_hashes, 0, sizeof(int32) * _bufferSize);
+    if (start == 0) {
+        memset(_hashes, 0, sizeof(int32) * _bufferSize);
+    }
+    else {
+        // Register the positions of the dictionary. Only the last ones
+        // (hashed with bytes of the block) change from one block to the next.
+        if (_dictHashes == nullptr) {
+            _dictHashes = new int32[_bufferSize];
+            memset(_dictHashes, 0, sizeof(int32) * _bufferSize);
+
+            for (int i = 1; i < start - 3; i++)
+                _dictHashes[hash(&src[i])] = i;
+        }
+
+        if (_lastCount < 0)
+            memcpy(_hashes, _dictHashes, sizeof(int32) * _bufferSize);
+
+        _lastCount = count;
+
+        for (int i = max(start - 3, 1); i < start; i++)
+            _hashes[hash(&src[i])] = i;
+    }
+
     const int maxDist = (srcEnd < 4 * MAX_DISTANCE1) ? MAX_DISTANCE1 : MAX_DISTANCE2;
     dst[dstIdx++] = (maxDist == MAX_DISTANCE1) ? byte(0) : byte(1);
-    int srcIdx = 0;
-    int anchor = 0;
+    int srcIdx = start;
+    int anchor = start;
 
     while (srcIdx < srcEnd) {
         const int minRef = max(srcIdx - maxDist, 0);
@@ -199,7 +277,7 @@ bool LZXCodec::forward(SliceArray<byte>& input, SliceArray<byte>& output, int co
 
     // Emit last literals
     dstIdx += emitLastLiterals(&src[anchor], &dst[dstIdx], srcEnd + 8 - anchor);
-    input._index = srcEnd + 8;
+    input._index = srcEnd + 8 - start;
     output._index = dstIdx;
     return true;
 }
@@ -219,10 +297,20 @@ bool LZXCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int co
         return false;
 
     const int srcEnd = count - 8;
-    const int dstEnd = output._length - 8;
+    int dstEnd = output._length - 8;
     byte* dst = &output._array[output._index];
     byte* src = &input._array[input._index];
-    int dstIdx = 0;
+    int start = 0;
+
+    if (_dictSize > 0) {
+        // Decode the block after the dictionary (with room for the 8 byte copies)
+        reserveWindow(_dictSize + output._length + 16);
+        dst = _window;
+        start = _dictSize;
+        dstEnd += _dictSize;
+    }
+
+    int dstIdx = start;
     const int maxDist = (src[0] == byte(1)) ? MAX_DISTANCE2 : MAX_DISTANCE1;
     int srcIdx = 1;
 
@@ -241,7 +329,7 @@ bool LZXCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int co
 
                 if (srcIdx >= srcEnd + 8) {
                     input._index += srcIdx;
-                    output._index += dstIdx;
+                    output._index += (dstIdx - start);
                     return false;
                 }
 
@@ -281,7 +369,7 @@ bool LZXCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int co
         // Sanity check
         if (mEnd > dstEnd + 8) {
             input._index += srcIdx;
-            output._index += dstIdx;
+            output._index += (dstIdx - start);
             return false;
         }
 
@@ -296,7 +384,7 @@ bool LZXCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int co
         // Sanity check
         if ((dstIdx < dist) || (dist > maxDist)) {
             input._index += srcIdx;
-            output._index += dstIdx;
+            output._index += (dstIdx - start);
             return false;
         }
 
@@ -321,7 +409,14 @@ bool LZXCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int co
         dstIdx = mEnd;
     }
 
-    output._index = dstIdx;
+    if (start != 0) {
+        if (dstIdx - start > output._length - output._index)
+            return false;
+
+        memcpy(&output._array[output._index], &dst[start], dstIdx - start);
+    }
+
+    output._index = dstIdx - start;
     input._index = srcIdx;
     return srcIdx == srcEnd + 8;
 }
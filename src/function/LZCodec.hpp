@@ -55,12 +55,14 @@ namespace kanzi
    // Simple byte oriented LZ77 implementation.
    // It is a modified LZ4 with a bigger window, a bigger hash map, 3+n*8 bit 
    // literal lengths and 17 or 24 bit match lengths.
+   // With a shared dictionary (see Context), each block is encoded as if it
+   // followed the dictionary: the matches may refer to the dictionary.
    class LZXCodec : public Function<byte>
    {
    public:
-       LZXCodec() { _hashes = new int[0]; _bufferSize = 0; }
-       LZXCodec(Context&) { _hashes = new int[0]; _bufferSize = 0; }
-       ~LZXCodec() { delete[] _hashes; _bufferSize = 0; }
+       LZXCodec() { _hashes = new int[0]; _bufferSize = 0; _window = nullptr; _windowSize = 0; _dictSize = 0; _dictHashes = nullptr; _lastCount = -1; }
+       LZXCodec(Context& ctx);
+       ~LZXCodec() { delete[] _hashes; delete[] _window; delete[] _dictHashes; _bufferSize = 0; }
 
        bool forward(SliceArray<byte>& src, SliceArray<byte>& dst, int length) THROW;
 
@@ -83,6 +85,13 @@ namespace kanzi
 
       int32* _hashes;
       int _bufferSize;
+      byte* _window; // shared dictionary followed by the current block
+      int _windowSize;
+      int _dictSize;
+      int32* _dictHashes; // hash table after the dictionary positions (built once)
+      int _lastCount; // size of the last block hashed in _hashes after the dictionary (-1 if none)
+
+      void reserveWindow(int size);
 
       static int emitLength(byte block[], int len);
 
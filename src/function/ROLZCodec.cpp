@@ -18,6 +18,7 @@ limitations under the License.
 #include <sstream>
 #include <streambuf>
 #include "ROLZCodec.hpp"
+#include "../Dictionary.hpp"
 #include "../Memory.hpp"
 #include "../bitstream/DefaultInputBitStream.hpp"
 #include "../bitstream/DefaultOutputBitStream.hpp"
@@ -29,14 +30,56 @@ using namespace kanzi;
 ROLZCodec::ROLZCodec(uint logPosChecks) THROW
 {
     _delegate = new ROLZCodec1(logPosChecks);
+    _window = nullptr;
+    _windowSize = 0;
+    _dictSize = 0;
 }
 
 ROLZCodec::ROLZCodec(Context& ctx) THROW
 {
     string transform = ctx.getString("transform", "NONE");
+    const Dictionary* dict = ctx.getDictionary();
+    _window = nullptr;
+    _windowSize = 0;
+    _dictSize = 0;
+
+    // Keep a copy of the dictionary, the blocks are appended to it
+    if (dict != nullptr) {
+        _dictSize = dict->getSize();
+        _windowSize = _dictSize;
+        _window = new byte[_windowSize];
+        memcpy(&_window[0], dict->getData(), _dictSize);
+    }
 
-    _delegate = (transform.find("ROLZX") != string::npos) ? (Function<byte>*)new ROLZCodec2(LOG_POS_CHECKS2) : 
-       (Function<byte>*)new ROLZCodec1(LOG_POS_CHECKS1);
+    _delegate = (transform.find("ROLZX") != string::npos) ? (Function<byte>*)new ROLZCodec2(LOG_POS_CHECKS2, _dictSize) : 
+       (Function<byte>*)new ROLZCodec1(LOG_POS_CHECKS1, _dictSize);
+}
+
+void ROLZCodec::reserveWindow(int size)
+{
+    if (_windowSize >= size)
+        return;
+
+    byte* buf = new byte[size];
+    memcpy(&buf[0], &_window[0], _dictSize);
+    delete[] _window;
+    _window = buf;
+    _windowSize = size;
+}
+
+// Register the positions [2..end) of the buffer in the match tables, as if
+// the data had been processed (EG. the shared dictionary before a block).
+// The encoder registers the hashed positions (see findMatch()).
+void ROLZCodec::registerPositions(const byte buf[], int end, int32 counters[], int32 matches[],
+    int logPosChecks, bool hashed)
+{
+    const int32 mask = (1 << logPosChecks) - 1;
+
+    for (int i = 2; i < end; i++) {
+        const uint16 key = getKey(&buf[i - 2]);
+        counters[key]++;
+        matches[(int32(key) << logPosChecks) + (counters[key] & mask)] = (hashed == true) ? hash(&buf[i]) | int32(i) : int32(i);
+    }
 }
 
 bool ROLZCodec::forward(SliceArray<byte>& input, SliceArray<byte>& output, int count) THROW
@@ -61,7 +104,16 @@ bool ROLZCodec::forward(SliceArray<byte>& input, SliceArray<byte>& output, int c
         throw invalid_argument(ss.str());
     }
 
-    return _delegate->forward(input, output, count);
+    if (_dictSize == 0)
+        return _delegate->forward(input, output, count);
+
+    // Append the block to the dictionary
+    reserveWindow(_dictSize + count);
+    memcpy(&_window[_dictSize], &input._array[input._index], count);
+    SliceArray<byte> window(_window, _dictSize + count, 0);
+    const bool res = _delegate->forward(window, output, _dictSize + count);
+    input._index += (window._index - _dictSize);
+    return res;
 }
 
 bool ROLZCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int count) THROW
@@ -86,10 +138,34 @@ bool ROLZCodec::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int c
         throw invalid_argument(ss.str());
     }
 
-    return _delegate->inverse(input, output, count);
+    if (_dictSize == 0)
+        return _delegate->inverse(input, output, count);
+
+    if (count < 4)
+        return false;
+
+    // Decode the block after the dictionary. The size of the decoded data
+    // (dictionary included) comes first.
+    const int size = BigEndian::readInt32(&input._array[input._index]);
+
+    if ((size <= _dictSize) || (size - _dictSize > output._length - output._index))
+        return false;
+
+    // Same room after the block as in the output buffer
+    const int capacity = output._length - output._index;
+    reserveWindow(_dictSize + capacity);
+    SliceArray<byte> window(_window, _dictSize + capacity, 0);
+    const bool res = _delegate->inverse(input, window, count);
+
+    if ((window._index <= _dictSize) || (window._index - _dictSize > capacity))
+        return false;
+
+    memcpy(&output._array[output._index], &_window[_dictSize], window._index - _dictSize);
+    output._index += (window._index - _dictSize);
+    return res;
 }
 
-ROLZCodec1::ROLZCodec1(uint logPosChecks) THROW
+ROLZCodec1::ROLZCodec1(uint logPosChecks, int dictSize) THROW
 {
     if ((logPosChecks < 2) || (logPosChecks > 8)) {
         stringstream ss;
@@ -101,6 +177,7 @@ ROLZCodec1::ROLZCodec1(uint logPosChecks) THROW
     _posChecks = 1 << logPosChecks;
     _maskChecks = _posChecks - 1;
     _matches = new int32[ROLZCodec::HASH_SIZE << logPosChecks];
+    _dictSize = dictSize;
 }
 
 // return position index (_logPosChecks bits) + length (16 bits) or -1
@@ -158,7 +235,7 @@ int ROLZCodec1::findMatch(const byte buf[], const int pos, const int end)
 
 bool ROLZCodec1::forward(SliceArray<byte>& input, SliceArray<byte>& output, int count) THROW
 {
-    if (output._length < getMaxEncodedLength(count))
+    if (output._length < getMaxEncodedLength(count - _dictSize))
         return false;
 
     const int srcEnd = count - 4;
@@ -189,9 +266,15 @@ bool ROLZCodec1::forward(SliceArray<byte>& input, SliceArray<byte>& output, int
         sizeChunk = endChunk - startChunk;
         byte* buf = &src[startChunk];
         int srcIdx = 0;
+
+        if ((startChunk == 0) && (_dictSize > 0)) {
+            ROLZCodec::registerPositions(buf, _dictSize, _counters, _matches, _logPosChecks, true);
+            srcIdx = _dictSize;
+        }
+
         litBuf._array[litBuf._index++] = buf[srcIdx++];
 
-        if (startChunk + 1 < srcEnd)
+        if (startChunk + srcIdx < srcEnd)
             litBuf._array[litBuf._index++] = buf[srcIdx++];
 
         int firstLitIdx = srcIdx;
@@ -368,9 +451,15 @@ bool ROLZCodec1::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int
 
         byte* buf = &output._array[output._index];
         int dstIdx = 0;
+
+        if ((startChunk == 0) && (_dictSize > 0)) {
+            ROLZCodec::registerPositions(buf, _dictSize, _counters, _matches, _logPosChecks, false);
+            dstIdx = _dictSize;
+        }
+
         buf[dstIdx++] = litBuf._array[litBuf._index++];
 
-        if (output._index + 1 < dstEnd)
+        if (output._index + dstIdx < dstEnd)
             buf[dstIdx++] = litBuf._array[litBuf._index++];
 
         // Next chunk
@@ -570,7 +659,7 @@ int ROLZDecoder::decodeBits(int n)
     return res;
 }
 
-ROLZCodec2::ROLZCodec2(uint logPosChecks) THROW
+ROLZCodec2::ROLZCodec2(uint logPosChecks, int dictSize) THROW
 {
     if ((logPosChecks < 2) || (logPosChecks > 8)) {
         stringstream ss;
@@ -582,6 +671,7 @@ ROLZCodec2::ROLZCodec2(uint logPosChecks) THROW
     _posChecks = 1 << logPosChecks;
     _maskChecks = _posChecks - 1;
     _matches = new int32[ROLZCodec::HASH_SIZE << logPosChecks];
+    _dictSize = dictSize;
 }
 
 // return position index (_logPosChecks bits) + length (16 bits) or -1
@@ -639,7 +729,7 @@ int ROLZCodec2::findMatch(const byte buf[], const int pos, const int end)
 
 bool ROLZCodec2::forward(SliceArray<byte>& input, SliceArray<byte>& output, int count) THROW
 {
-    if (output._length < getMaxEncodedLength(count))
+    if (output._length < getMaxEncodedLength(count - _dictSize))
         return false;
 
     const int srcEnd = count - 4;
@@ -661,13 +751,18 @@ bool ROLZCodec2::forward(SliceArray<byte>& input, SliceArray<byte>& output, int
         src = &input._array[startChunk];
         srcIdx = 0;
 
+        if ((startChunk == 0) && (_dictSize > 0)) {
+            ROLZCodec::registerPositions(src, _dictSize, _counters, _matches, _logPosChecks, true);
+            srcIdx = _dictSize;
+        }
+
         // First literals
         re.setMode(LITERAL_FLAG);
         re.setContext(byte(0));
         re.encodeBits((LITERAL_FLAG << 8) | int(src[srcIdx]), 9);
         srcIdx++;
 
-        if (startChunk + 1 < srcEnd) {
+        if (startChunk + srcIdx < srcEnd) {
             re.encodeBits((LITERAL_FLAG << 8) | int(src[srcIdx]), 9);
             srcIdx++;
         }
@@ -708,7 +803,7 @@ bool ROLZCodec2::forward(SliceArray<byte>& input, SliceArray<byte>& output, int
     re.dispose();
     input._index = startChunk - sizeChunk + srcIdx;
     output._index = dstIdx;
-    return (input._index == count) && (output._index < count);
+    return (input._index == count) && (output._index < count - _dictSize);
 }
 
 bool ROLZCodec2::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int count) THROW
@@ -738,6 +833,11 @@ bool ROLZCodec2::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int
         dst = &output._array[output._index];
         int dstIdx = 0;
 
+        if ((startChunk == 0) && (_dictSize > 0)) {
+            ROLZCodec::registerPositions(dst, _dictSize, _counters, _matches, _logPosChecks, false);
+            dstIdx = _dictSize;
+        }
+
         // First literals
         rd.setMode(LITERAL_FLAG);
         rd.setContext(byte(0));
@@ -751,7 +851,7 @@ bool ROLZCodec2::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int
 
         dst[dstIdx++] = byte(val);
 
-        if (output._index + 1 < dstEnd) {
+        if (output._index + dstIdx < dstEnd) {
            val = rd.decodeBits(9);
 
            // Sanity check
@@ -113,7 +113,7 @@ namespace kanzi {
    // Use ANS to encode/decode literals and matches
    class ROLZCodec1 : public Function<byte> {
    public:
-       ROLZCodec1(uint logPosChecks) THROW;
+       ROLZCodec1(uint logPosChecks, int dictSize = 0) THROW;
 
        ~ROLZCodec1() { delete[] _matches; }
 
@@ -136,6 +136,7 @@ namespace kanzi {
        int _logPosChecks;
        int _maskChecks;
        int _posChecks;
+       int _dictSize; // the input of forward() and output of inverse() start with the dictionary
 
        int findMatch(const byte buf[], const int pos, const int end);
 
@@ -150,7 +151,7 @@ namespace kanzi {
    // Code loosely based on 'balz' by Ilya Muravyov
    class ROLZCodec2 : public Function<byte> {
    public:
-       ROLZCodec2(uint logPosChecks) THROW;
+       ROLZCodec2(uint logPosChecks, int dictSize = 0) THROW;
 
        ~ROLZCodec2() { delete[] _matches; }
 
@@ -172,10 +173,13 @@ namespace kanzi {
        int _logPosChecks;
        int _maskChecks;
        int _posChecks;
+       int _dictSize; // the input of forward() and output of inverse() start with the dictionary
 
        int findMatch(const byte buf[], const int pos, const int end);
    };
 
+   // With a shared dictionary (see Context), each block is encoded as if it
+   // followed the dictionary: the match tables start with its positions.
    class ROLZCodec : public Function<byte> {
        friend class ROLZCodec1;
        friend class ROLZCodec2;
@@ -185,7 +189,7 @@ namespace kanzi {
 
        ROLZCodec(Context& ctx) THROW;
 
-       virtual ~ROLZCodec() { delete _delegate; }
+       virtual ~ROLZCodec() { delete _delegate; delete[] _window; }
 
        bool forward(SliceArray<byte>& src, SliceArray<byte>& dst, int length) THROW;
 
@@ -207,6 +211,11 @@ namespace kanzi {
        static const int MAX_BLOCK_SIZE = 1 << 30; // 1 GB
 
        Function<byte>* _delegate;
+       byte* _window; // shared dictionary followed by the current block
+       int _windowSize;
+       int _dictSize;
+
+       void reserveWindow(int size);
 
        static uint16 getKey(const byte* p)
        {
@@ -219,6 +228,9 @@ namespace kanzi {
        }
 
        static int emitCopy(byte dst[], int dstIdx, int ref, int matchLen);
+
+       static void registerPositions(const byte buf[], int end, int32 counters[], int32 matches[],
+           int logPosChecks, bool hashed);
    };
 
    inline int ROLZCodec::emitCopy(byte dst[], int dstIdx, int ref, int matchLen)
@@ -18,6 +18,7 @@ limitations under the License.
 #include <stdexcept>
 #include <sstream>
 #include "TextCodec.hpp"
+#include "../Dictionary.hpp"
 #include "../Global.hpp"
 
 using namespace kanzi;
@@ -367,9 +368,12 @@ TextCodec1::TextCodec1()
     _dictSize = 1 << 13;
     _dictMap = nullptr;
     _dictList = nullptr;
+    _dictCapacity = 0;
     _hashMask = (1 << _logHashSize) - 1;
     _staticDictSize = TextCodec::STATIC_DICT_WORDS;
     _isCRLF = false;
+    _sharedDict = nullptr;
+    _sharedDictSize = 0;
 }
 
 TextCodec1::TextCodec1(Context& ctx)
@@ -394,9 +398,19 @@ TextCodec1::TextCodec1(Context& ctx)
     _dictSize = 1 << 13;
     _dictMap = nullptr;
     _dictList = nullptr;
+    _dictCapacity = 0;
     _hashMask = (1 << _logHashSize) - 1;
     _staticDictSize = TextCodec::STATIC_DICT_WORDS;
     _isCRLF = false;
+    _sharedDict = nullptr;
+    _sharedDictSize = 0;
+    const Dictionary* dict = ctx.getDictionary();
+
+    if (dict != nullptr) {
+        _sharedDictSize = dict->getSize();
+        _sharedDict = new byte[_sharedDictSize];
+        memcpy(&_sharedDict[0], dict->getData(), _sharedDictSize);
+    }
 }
 
 void TextCodec1::reset(int count)
@@ -406,6 +420,12 @@ void TextCodec1::reset(int count)
     _dictSize = 1 << (log - 4);
     const int mapSize = 1 << _logHashSize;
 
+    if (_dictCapacity < _dictSize) {
+        // The codec is reused for a bigger block
+        delete[] _dictList;
+        _dictList = nullptr;
+    }
+
     if (_dictMap == nullptr)
         _dictMap = new DictEntry*[mapSize];
 
@@ -414,6 +434,7 @@ void TextCodec1::reset(int count)
 
     if (_dictList == nullptr) {
         _dictList = new DictEntry[_dictSize];
+        _dictCapacity = _dictSize;
         const int nbEntries = min(TextCodec::STATIC_DICT_WORDS, _dictSize);
         memcpy(static_cast<void*>(&_dictList[0]), &TextCodec::STATIC_DICTIONARY[0], nbEntries * sizeof(DictEntry));
 
@@ -456,7 +477,7 @@ bool TextCodec1::forward(SliceArray<byte>& input, SliceArray<byte>& output, int
     const int dstEnd = getMaxEncodedLength(count);
     const int dstEnd4 = dstEnd - 4;
     int emitAnchor = 0; // never less than 0
-    int words = _staticDictSize;
+    int words = addSharedWords(_staticDictSize);
 
     // DOS encoded end of line (CR+LF) ?
     _isCRLF = int(mode & TextCodec::MASK_CRLF) != 0;
@@ -603,6 +624,7 @@ bool TextCodec1::expandDictionary()
 
     delete[] _dictList;
     _dictList = newDict;
+    _dictCapacity = _dictSize * 2;
 
     // Reset map (values must point to addresses of new DictEntry items)
     for (int i = 0; i < _dictSize; i++) {
@@ -613,6 +635,46 @@ bool TextCodec1::expandDictionary()
     return true;
 }
 
+// Add the words of the shared dictionary (if any) to the dynamic dictionary,
+// before the words of the block. Return the next word index.
+int TextCodec1::addSharedWords(int words)
+{
+    const byte* src = _sharedDict;
+    int delimAnchor = -1; // previous delimiter
+
+    for (int srcIdx = 0; srcIdx < _sharedDictSize; srcIdx++) {
+        if (TextCodec::isText(src[srcIdx]))
+            continue;
+
+        const int length = srcIdx - delimAnchor - 1;
+
+        if ((length > 2) && (length <= TextCodec::MAX_WORD_LENGTH) && TextCodec::isDelimiter(src[srcIdx])
+            && ((length > 3) || (words < TextCodec::THRESHOLD2))) {
+            int32 h1 = TextCodec::HASH1;
+
+            for (int i = delimAnchor + 1; i < srcIdx; i++)
+                h1 = h1 * TextCodec::HASH1 ^ int32(src[i]) * TextCodec::HASH2;
+
+            // Skip known words and hash collisions
+            if (_dictMap[h1 & _hashMask] == nullptr) {
+                DictEntry* pe = &_dictList[words];
+                pe->_ptr = &src[delimAnchor + 1];
+                pe->_hash = h1;
+                pe->_data = (length << 24) | words;
+                _dictMap[h1 & _hashMask] = pe;
+                words++;
+
+                if ((words >= _dictSize) && (expandDictionary() == false))
+                    return _staticDictSize;
+            }
+        }
+
+        delimAnchor = srcIdx;
+    }
+
+    return words;
+}
+
 int TextCodec1::emitSymbols(byte src[], byte dst[], const int srcEnd, const int dstEnd)
 {
     int dstIdx = 0;
@@ -698,7 +760,7 @@ bool TextCodec1::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int
     const int srcEnd = count;
     const int dstEnd = output._length;
     int delimAnchor = TextCodec::isText(src[srcIdx]) ? srcIdx - 1 : srcIdx; // previous delimiter
-    int words = _staticDictSize;
+    int words = addSharedWords(_staticDictSize);
     bool wordRun = false;
     _isCRLF = int(src[srcIdx++] & TextCodec::MASK_CRLF) != 0;
 
@@ -833,9 +895,12 @@ TextCodec2::TextCodec2()
     _dictSize = 1 << 13;
     _dictMap = nullptr;
     _dictList = nullptr;
+    _dictCapacity = 0;
     _hashMask = (1 << _logHashSize) - 1;
     _staticDictSize = TextCodec::STATIC_DICT_WORDS;
     _isCRLF = false;
+    _sharedDict = nullptr;
+    _sharedDictSize = 0;
 }
 
 TextCodec2::TextCodec2(Context& ctx)
@@ -860,9 +925,19 @@ TextCodec2::TextCodec2(Context& ctx)
     _dictSize = 1 << 13;
     _dictMap = nullptr;
     _dictList = nullptr;
+    _dictCapacity = 0;
     _hashMask = (1 << _logHashSize) - 1;
     _staticDictSize = TextCodec::STATIC_DICT_WORDS;
     _isCRLF = false;
+    _sharedDict = nullptr;
+    _sharedDictSize = 0;
+    const Dictionary* dict = ctx.getDictionary();
+
+    if (dict != nullptr) {
+        _sharedDictSize = dict->getSize();
+        _sharedDict = new byte[_sharedDictSize];
+        memcpy(&_sharedDict[0], dict->getData(), _sharedDictSize);
+    }
 }
 
 void TextCodec2::reset(int count)
@@ -872,6 +947,12 @@ void TextCodec2::reset(int count)
     _dictSize = 1 << (log - 4);
     const int mapSize = 1 << _logHashSize;
 
+    if (_dictCapacity < _dictSize) {
+        // The codec is reused for a bigger block
+        delete[] _dictList;
+        _dictList = nullptr;
+    }
+
     if (_dictMap == nullptr)
         _dictMap = new DictEntry*[mapSize];
 
@@ -880,6 +961,7 @@ void TextCodec2::reset(int count)
 
     if (_dictList == nullptr) {
         _dictList = new DictEntry[_dictSize];
+        _dictCapacity = _dictSize;
         const int nbEntries = min(TextCodec::STATIC_DICT_WORDS, _dictSize);
         memcpy(static_cast<void*>(&_dictList[0]), &TextCodec::STATIC_DICTIONARY[0], nbEntries * sizeof(DictEntry));
     }
@@ -914,7 +996,7 @@ bool TextCodec2::forward(SliceArray<byte>& input, SliceArray<byte>& output, int
     const int dstEnd = getMaxEncodedLength(count);
     const int dstEnd3 = dstEnd - 3;
     int emitAnchor = 0; // never less than 0
-    int words = _staticDictSize;
+    int words = addSharedWords(_staticDictSize);
 
     // DOS encoded end of line (CR+LF) ?
     _isCRLF = (mode & TextCodec::MASK_CRLF) != byte(0);
@@ -1060,6 +1142,7 @@ bool TextCodec2::expandDictionary()
 
     delete[] _dictList;
     _dictList = newDict;
+    _dictCapacity = _dictSize * 2;
 
     // Reset map (values must point to addresses of new DictEntry items)
     for (int i = 0; i < _dictSize; i++) {
@@ -1070,6 +1153,46 @@ bool TextCodec2::expandDictionary()
     return true;
 }
 
+// Add the words of the shared dictionary (if any) to the dynamic dictionary,
+// before the words of the block. Return the next word index.
+int TextCodec2::addSharedWords(int words)
+{
+    const byte* src = _sharedDict;
+    int delimAnchor = -1; // previous delimiter
+
+    for (int srcIdx = 0; srcIdx < _sharedDictSize; srcIdx++) {
+        if (TextCodec::isText(src[srcIdx]))
+            continue;
+
+        const int length = srcIdx - delimAnchor - 1;
+
+        if ((length > 2) && (length <= TextCodec::MAX_WORD_LENGTH) && TextCodec::isDelimiter(src[srcIdx])
+            && ((length > 3) || (words < TextCodec::THRESHOLD2))) {
+            int32 h1 = TextCodec::HASH1;
+
+            for (int i = delimAnchor + 1; i < srcIdx; i++)
+                h1 = h1 * TextCodec::HASH1 ^ int32(src[i]) * TextCodec::HASH2;
+
+            // Skip known words and hash collisions
+            if (_dictMap[h1 & _hashMask] == nullptr) {
+                DictEntry* pe = &_dictList[words];
+                pe->_ptr = &src[delimAnchor + 1];
+                pe->_hash = h1;
+                pe->_data = (length << 24) | words;
+                _dictMap[h1 & _hashMask] = pe;
+                words++;
+
+                if ((words >= _dictSize) && (expandDictionary() == false))
+                    return _staticDictSize;
+            }
+        }
+
+        delimAnchor = srcIdx;
+    }
+
+    return words;
+}
+
 int TextCodec2::emitSymbols(byte src[], byte dst[], const int srcEnd, const int dstEnd)
 {
 // Work around incorrect warning by GCC 7.x.x with C++17
@@ -1190,7 +1313,7 @@ bool TextCodec2::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int
     const int srcEnd = count;
     const int dstEnd = output._length;
     int delimAnchor = TextCodec::isText(src[srcIdx]) ? srcIdx - 1 : srcIdx; // previous delimiter
-    int words = _staticDictSize;
+    int words = addSharedWords(_staticDictSize);
     bool wordRun = false;
     _isCRLF = (src[srcIdx++] & TextCodec::MASK_CRLF) != byte(0);
 
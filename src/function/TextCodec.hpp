@@ -48,6 +48,7 @@ namespace kanzi {
         {
             if (_dictList != nullptr) delete[] _dictList;
             if (_dictMap != nullptr) delete[] _dictMap;
+            if (_sharedDict != nullptr) delete[] _sharedDict;
         }
 
         bool forward(SliceArray<byte>& src, SliceArray<byte>& dst, int length);
@@ -64,11 +65,15 @@ namespace kanzi {
         byte _escapes[2];
         int _staticDictSize;
         int _dictSize;
+        int _dictCapacity; // number of entries allocated in _dictList
         int _logHashSize;
         int32 _hashMask;
         bool _isCRLF; // EOL = CR + LF
+        byte* _sharedDict; // copy of the shared dictionary (if any)
+        int _sharedDictSize;
 
         bool expandDictionary();
+        int addSharedWords(int words);
         inline void reset(int count);
         inline int emitWordIndex(byte dst[], int val);
         inline int emitSymbols(byte src[], byte dst[], const int srcEnd, const int dstEnd);
@@ -85,6 +90,7 @@ namespace kanzi {
         {
             if (_dictList != nullptr) delete[] _dictList;
             if (_dictMap != nullptr) delete[] _dictMap;
+            if (_sharedDict != nullptr) delete[] _sharedDict;
         }
 
         bool forward(SliceArray<byte>& src, SliceArray<byte>& dst, int length);
@@ -100,18 +106,23 @@ namespace kanzi {
         DictEntry* _dictList;
         int _staticDictSize;
         int _dictSize;
+        int _dictCapacity; // number of entries allocated in _dictList
         int _logHashSize;
         int32 _hashMask;
         bool _isCRLF; // EOL = CR + LF
+        byte* _sharedDict; // copy of the shared dictionary (if any)
+        int _sharedDictSize;
 
         bool expandDictionary();
+        int addSharedWords(int words);
         inline void reset(int count);
         inline int emitWordIndex(byte dst[], int val, int mask);
         inline int emitSymbols(byte src[], byte dst[], const int srcEnd, const int dstEnd);
     };
 
     // Simple one-pass text codec that replaces words with indexes.
-    // Generates a dynamic dictionary.
+    // Generates a dynamic dictionary. With a shared dictionary (see Context),
+    // the dynamic dictionary of each block starts with its words.
     class TextCodec : public Function<byte> {
         friend class TextCodec1;
         friend class TextCodec2;
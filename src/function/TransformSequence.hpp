@@ -33,6 +33,15 @@ namespace kanzi
 
        bool forward(SliceArray<T>& input, SliceArray<T>& output, int length);
 
+       // Same as forward() but, if the transformed data ends up in the input
+       // buffer, the arrays of input and output are exchanged instead of copying
+       // the data. Both arrays must be owned by the caller (allocated with new[]).
+       // If a scratch buffer is provided, it holds the intermediate data in
+       // place of the input, which is only read (it may be read-only memory).
+       // The arrays of scratch and output may then be exchanged instead.
+       bool forward(SliceArray<T>& input, SliceArray<T>& output, int length, bool swapArrays,
+           SliceArray<T>* scratch = nullptr);
+
        bool inverse(SliceArray<T>& input, SliceArray<T>& output, int length);
 
        // Required encoding output buffer size
@@ -84,6 +93,13 @@ namespace kanzi
 
    template <class T>
    bool TransformSequence<T>::forward(SliceArray<T>& input, SliceArray<T>& output, int count) THROW
+   {
+       return forward(input, output, count, false);
+   }
+
+   template <class T>
+   bool TransformSequence<T>::forward(SliceArray<T>& input, SliceArray<T>& output, int count, bool swapArrays,
+       SliceArray<T>* scratch) THROW
    {
        if (!SliceArray<byte>::isValid(input))
            throw invalid_argument("Invalid input block");
@@ -117,26 +133,45 @@ namespace kanzi
             const int savedIIdx = in->_index;
             const int savedOIdx = out->_index;
 
+            // Some transforms use all the room available in the output buffer.
+            // Show them the same room whatever the actual buffer capacity
+            // (pooled buffers may be bigger) so that the output is the same.
+            const int end = (out->_length - savedOIdx > requiredSize) ? savedOIdx + requiredSize : out->_length;
+            SliceArray<T> sa(out->_array, end, savedOIdx);
+
             // Apply forward transform
-            if (_transforms[i]->forward(*in, *out, count) == false) {
+            if (_transforms[i]->forward(*in, sa, count) == false) {
                 // Transform failed. Either it does not apply to this type
                 // of data or a recoverable error occured => revert
                 in->_index = savedIIdx;
-                out->_index = savedOIdx;
                 continue;
             }
 
             _skipFlags &= ~byte(1 << (7 - i));
-            count = out->_index - savedOIdx;
+            count = sa._index - savedOIdx;
             in->_index = savedIIdx;
-            out->_index = savedOIdx;
             swap(in, out);
             swaps++;
+
+            // Do not write to the input if there is a scratch buffer
+            if ((out == &input) && (scratch != nullptr))
+                out = scratch;
+       }
+
+       if ((swaps & 1) == 0) {
+           // The data is in the input (or scratch) buffer
+           const bool owned = (scratch == nullptr) || (in == scratch);
+
+           if ((swapArrays == true) && (owned == true) && (in->_index == output._index)) {
+               // The data is at the same index in the other array
+               swap(in->_array, output._array);
+               swap(in->_length, output._length);
+           }
+           else {
+               memcpy(&output._array[output._index], &in->_array[in->_index], count);
+           }
        }
 
-       if ((swaps & 1) == 0)
-           memcpy(&output._array[output._index], &in->_array[in->_index], count);
-     
        input._index += blockSize;
        output._index += count;
        return _skipFlags != SKIP_MASK;
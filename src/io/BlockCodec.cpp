@@ -0,0 +1,389 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cstring>
+#include <sstream>
+#include "BlockCodec.hpp"
+#include "../BufferPool.hpp"
+#include "../Error.hpp"
+#include "../entropy/EntropyCodecFactory.hpp"
+#include "../function/FunctionFactory.hpp"
+
+using namespace kanzi;
+
+// Block layout: mode + transformed entropy coded data
+// mode | 0b10000000 => copy block
+//      | 0b0yy00000 => size(size(block))-1
+//      | 0b000y0000 => 1 if more than 4 transforms
+//  case 4 transforms or less
+//      | 0b0000yyyy => transform sequence skip flags (1 means skip)
+//  case more than 4 transforms
+//      | 0b00000000
+//      then 0byyyyyyyy => transform sequence skip flags (1 means skip)
+//  case duplicate block (since version 10, copy block with more than 4 transforms)
+//      | 0b10010000
+//      then size of block, distance to the duplicated block (32 bits)
+// The block size is followed by the block checksum (if any), 64 bits if
+// so specified in the header (since version 10), else 32 bits.
+// Since version 10, each block is padded to a byte boundary and prefixed
+// with its length in bytes (32 bits). The end block has a length of 0.
+BlockResult BlockCodec::encode(CodecSet& codecs, Context& ctx, SliceArray<byte>& input,
+    SliceArray<byte>& output, SliceArray<byte>* scratch, int length,
+    uint64 transformType, uint32 entropyType, bool copy, uint64 checksum,
+    int checksumSize, OutputBitStream& obs, int blockId, vector<Listener*>* listeners)
+{
+    const Event::HashType hashType = (checksumSize == 32) ? Event::SIZE_32 : ((checksumSize == 64) ? Event::SIZE_64 : Event::NO_HASH);
+    BlockResult res;
+    res._checksum = checksum;
+    EntropyEncoder* ee = nullptr;
+
+    try {
+        byte mode = byte(0);
+
+        if (copy == true) {
+            transformType = FunctionFactory<byte>::NONE_TYPE;
+            entropyType = EntropyCodecFactory::NONE_TYPE;
+            mode |= COPY_BLOCK_MASK;
+        }
+
+        ctx.putInt("size", length);
+        TransformSequence<byte>* transform = codecs.getTransform(ctx, transformType);
+        const int nbFunctions = transform->getNbFunctions();
+        ctx.getBufferPool()->reserve(output, transform->getMaxEncodedLength(length));
+
+        // Forward transform (ignore error, encode skipFlags)
+        output._index = 0;
+
+        // input._length is at least length
+        // If the transformed data ends up in the input (or scratch) buffer,
+        // the buffers are exchanged instead of copied. Borrowed data is left
+        // untouched if there is a scratch buffer.
+        transform->forward(input, output, length, true, scratch);
+        const byte skipFlags = transform->getSkipFlags();
+        const int postTransformLength = output._index;
+
+        if (postTransformLength < 0) {
+            res._error = Error::ERR_WRITE_FILE;
+            res._msg = "Invalid transform size";
+            return res;
+        }
+
+        ctx.putInt("size", postTransformLength);
+        int dataSize = 0;
+
+        for (uint64 n = 0xFF; n < uint64(postTransformLength); n <<= 8)
+            dataSize++;
+
+        if (dataSize > 3) {
+            res._error = Error::ERR_WRITE_FILE;
+            res._msg = "Invalid block data length";
+            return res;
+        }
+
+        // Record size of 'block size' - 1 in bytes
+        mode |= byte((dataSize & 0x03) << 5);
+        dataSize++;
+
+        if (listeners != nullptr) {
+            // Notify after transform
+            Event evt(Event::AFTER_TRANSFORM, blockId,
+                int64(postTransformLength), checksum, hashType, Event::now());
+
+            notifyListeners(listeners, evt);
+        }
+
+        // Write block 'header' (mode + compressed length)
+        if (((mode & COPY_BLOCK_MASK) != byte(0)) || (nbFunctions <= 4)) {
+            mode |= byte(skipFlags >> 4);
+            obs.writeBits(uint64(mode), 8);
+        }
+        else {
+            mode |= TRANSFORMS_MASK;
+            obs.writeBits(uint64(mode), 8);
+            obs.writeBits(uint64(skipFlags), 8);
+        }
+
+        obs.writeBits(postTransformLength, 8 * dataSize);
+
+        // Write checksum (32 or 64 bits)
+        if (hashType != Event::NO_HASH)
+            obs.writeBits(checksum, checksumSize);
+
+        if (listeners != nullptr) {
+            // Notify before entropy
+            Event evt(Event::BEFORE_ENTROPY, blockId,
+                int64(postTransformLength), checksum, hashType, Event::now());
+
+            notifyListeners(listeners, evt);
+        }
+
+        // Each block is encoded separately
+        // Rebuild the entropy encoder to reset block statistics
+        ee = codecs.newEncoder(obs, ctx, short(entropyType));
+
+        // Entropy encode block
+        if (ee->encode(output._array, 0, postTransformLength) != postTransformLength) {
+            delete ee;
+            res._error = Error::ERR_PROCESS_BLOCK;
+            res._msg = "Entropy coding failed";
+            return res;
+        }
+
+        // Dispose before processing statistics. Dispose may write to the bitstream
+        delete ee;
+        return res;
+    }
+    catch (exception& e) {
+        if (ee != nullptr)
+            delete ee;
+
+        res._error = Error::ERR_PROCESS_BLOCK;
+        res._msg = e.what();
+        return res;
+    }
+}
+
+void BlockCodec::encodeReference(OutputBitStream& obs, int length, int distance,
+    uint64 checksum, int checksumSize) THROW
+{
+    // Duplicate block: no transform, no entropy coding
+    int dataSize = 0;
+
+    for (uint64 n = 0xFF; n < uint64(length); n <<= 8)
+        dataSize++;
+
+    const byte mode = DEDUP_BLOCK_MASK | byte((dataSize & 0x03) << 5);
+    obs.writeBits(uint64(mode), 8);
+    obs.writeBits(length, 8 * (dataSize + 1));
+    obs.writeBits(distance, 32);
+
+    if (checksumSize != 0)
+        obs.writeBits(checksum, checksumSize);
+}
+
+BlockResult BlockCodec::decode(CodecSet& codecs, Context& ctx, InputBitStream& ibs,
+    SliceArray<byte>& buffer, SliceArray<byte>& output, int bufferSize,
+    uint64 transformType, uint32 entropyType, XXHash32* hasher32, XXHash64* hasher64,
+    const DedupWindow* window, OrderedCommitQueue* commitQueue, int blockId,
+    vector<Listener*>* listeners)
+{
+    BlockResult res;
+
+    // Shared bitstream (version 9): park until the previous block has been
+    // read from the bitstream. Skip if either all data have been processed
+    // or an error occurred.
+    if ((commitQueue != nullptr) && (commitQueue->wait(blockId) == false))
+        return res;
+
+    const Event::HashType hashType = (hasher32 != nullptr) ? Event::SIZE_32 : ((hasher64 != nullptr) ? Event::SIZE_64 : Event::NO_HASH);
+    EntropyDecoder* ed = nullptr;
+
+    try {
+        // Extract block header directly from bitstream
+        const uint64 read = ibs.read();
+        const byte mode = byte(ibs.readBits(8));
+        byte skipFlags = byte(0);
+
+        if ((window != nullptr) && ((mode & DEDUP_BLOCK_MASK) == DEDUP_BLOCK_MASK))
+            return decodeReference(ibs, mode, output, bufferSize, hashType, *window, blockId, listeners);
+
+        if ((mode & COPY_BLOCK_MASK) != byte(0)) {
+            transformType = FunctionFactory<byte>::NONE_TYPE;
+            entropyType = EntropyCodecFactory::NONE_TYPE;
+        }
+        else {
+            if ((mode & TRANSFORMS_MASK) != byte(0))
+                skipFlags = byte(ibs.readBits(8));
+            else
+                skipFlags = (mode << 4) | byte(0x0F);
+        }
+
+        const int dataSize = 1 + (int(mode >> 5) & 0x03);
+        const int length = dataSize << 3;
+        const uint64 mask = (uint64(1) << length) - 1;
+        const int preTransformLength = int(ibs.readBits(length) & mask);
+
+        if (preTransformLength == 0) {
+            // Last block is empty, return success and cancel pending tasks
+            if (commitQueue != nullptr)
+                commitQueue->cancel();
+
+            return res;
+        }
+
+        if ((preTransformLength < 0) || (preTransformLength > MAX_BLOCK_SIZE)) {
+            // Error => cancel concurrent decoding tasks
+            if (commitQueue != nullptr)
+                commitQueue->cancel();
+
+            stringstream ss;
+            ss << "Invalid compressed block length: " << preTransformLength;
+            res._error = Error::ERR_READ_FILE;
+            res._msg = ss.str();
+            return res;
+        }
+
+        // Extract checksum from bit stream (if any)
+        if (hashType != Event::NO_HASH)
+            res._checksum = ibs.readBits((hashType == Event::SIZE_32) ? 32 : 64);
+
+        if (listeners != nullptr) {
+            // Notify before entropy (block size in bitstream is unknown)
+            Event evt(Event::BEFORE_ENTROPY, blockId, int64(-1), res._checksum, hashType, Event::now());
+            notifyListeners(listeners, evt);
+        }
+
+        if (bufferSize < preTransformLength + EXTRA_BUFFER_SIZE)
+            bufferSize = preTransformLength + EXTRA_BUFFER_SIZE;
+
+        ctx.getBufferPool()->reserve(buffer, bufferSize);
+        const int savedIdx = output._index;
+        ctx.putInt("size", preTransformLength);
+
+        // Each block is decoded separately
+        // Rebuild the entropy decoder to reset block statistics
+        ed = codecs.newDecoder(ibs, ctx, short(entropyType));
+
+        // Block entropy decode
+        if (ed->decode(buffer._array, 0, preTransformLength) != preTransformLength) {
+            // Error => cancel concurrent decoding tasks
+            if (commitQueue != nullptr)
+                commitQueue->cancel();
+
+            delete ed;
+            res._error = Error::ERR_PROCESS_BLOCK;
+            res._msg = "Entropy decoding failed";
+            return res;
+        }
+
+        delete ed;
+        ed = nullptr;
+
+        if (listeners != nullptr) {
+            // Notify after entropy (block size set to size in bitstream)
+            Event evt(Event::AFTER_ENTROPY, blockId,
+                int64((ibs.read() - read) / 8), res._checksum, hashType, Event::now());
+
+            notifyListeners(listeners, evt);
+        }
+
+        // After completion of the entropy decoding, commit the block.
+        // It unfreezes the task processing the next block (if any)
+        if (commitQueue != nullptr)
+            commitQueue->commit(blockId);
+
+        if (listeners != nullptr) {
+            // Notify before transform (block size after entropy decoding)
+            Event evt(Event::BEFORE_TRANSFORM, blockId,
+                int64(preTransformLength), res._checksum, hashType, Event::now());
+
+            notifyListeners(listeners, evt);
+        }
+
+        TransformSequence<byte>* transform = codecs.getTransform(ctx, transformType);
+        transform->setSkipFlags(skipFlags);
+        buffer._index = 0;
+
+        // Inverse transform (keep the buffer length to reuse it for the next block)
+        if (transform->inverse(buffer, output, preTransformLength) == false) {
+            res._error = Error::ERR_PROCESS_BLOCK;
+            res._msg = "Transform inverse failed";
+            return res;
+        }
+
+        res._decoded = output._index - savedIdx;
+
+        // Verify checksum
+        if (hashType != Event::NO_HASH) {
+            const uint64 checksum2 = (hasher32 != nullptr) ? uint64(uint32(hasher32->hash(&output._array[savedIdx], res._decoded)))
+                : hasher64->hash(&output._array[savedIdx], res._decoded);
+
+            if (checksum2 != res._checksum) {
+                stringstream ss;
+                ss << "Corrupted bitstream: expected checksum " << hex << res._checksum << ", found " << hex << checksum2;
+                res._error = Error::ERR_CRC_CHECK;
+                res._msg = ss.str();
+            }
+        }
+
+        return res;
+    }
+    catch (exception& e) {
+        // Make sure to unfreeze next block
+        if ((commitQueue != nullptr) && (commitQueue->next() == blockId))
+            commitQueue->commit(blockId);
+
+        if (ed != nullptr)
+            delete ed;
+
+        res._decoded = 0;
+        res._error = Error::ERR_PROCESS_BLOCK;
+        res._msg = e.what();
+        return res;
+    }
+}
+
+// Copy the duplicated block from the window (version 10+, the block is
+// read from its own bitstream)
+BlockResult BlockCodec::decodeReference(InputBitStream& ibs, byte mode, SliceArray<byte>& output,
+    int bufferSize, Event::HashType hashType, const DedupWindow& window, int blockId,
+    vector<Listener*>* listeners) THROW
+{
+    BlockResult res;
+    const int dataSize = 1 + (int(mode >> 5) & 0x03);
+    const int length = int(ibs.readBits(8 * dataSize));
+    const int distance = int(ibs.readBits(32));
+    res._checksum = (hashType != Event::NO_HASH) ? ibs.readBits((hashType == Event::SIZE_32) ? 32 : 64) : 0;
+    const int refId = blockId - distance;
+    int refLength = 0;
+    const byte* ref = (distance > 0) ? window.get(refId, refLength) : nullptr;
+
+    if ((ref == nullptr) || (refLength != length) || (length > bufferSize)
+        || (length > output._length - output._index)) {
+        stringstream ss;
+        ss << "Invalid reference to block " << refId << " in block " << blockId;
+        res._error = Error::ERR_INVALID_FILE;
+        res._msg = ss.str();
+        return res;
+    }
+
+    // The duplicated block has been verified when decoded (if checksum)
+    memcpy(&output._array[output._index], ref, size_t(length));
+    output._index += length;
+
+    if (listeners != nullptr) {
+        // Same events as a decoded block (nothing is entropy decoded)
+        Event evt1(Event::BEFORE_ENTROPY, blockId, int64(-1), res._checksum, hashType, Event::now());
+        notifyListeners(listeners, evt1);
+        Event evt2(Event::AFTER_ENTROPY, blockId,
+            int64(ibs.read() >> 3), res._checksum, hashType, Event::now());
+        notifyListeners(listeners, evt2);
+        Event evt3(Event::BEFORE_TRANSFORM, blockId,
+            int64(length), res._checksum, hashType, Event::now());
+        notifyListeners(listeners, evt3);
+    }
+
+    res._decoded = length;
+    res._reference = refId;
+    return res;
+}
+
+void BlockCodec::notifyListeners(vector<Listener*>* listeners, const Event& evt)
+{
+    vector<Listener*>::iterator it;
+
+    for (it = listeners->begin(); it != listeners->end(); it++)
+        (*it)->processEvent(evt);
+}
@@ -0,0 +1,108 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BlockCodec_
+#define _BlockCodec_
+
+#include <string>
+#include <vector>
+#include "../concurrent.hpp"
+#include "../Context.hpp"
+#include "../InputBitStream.hpp"
+#include "../Listener.hpp"
+#include "../OutputBitStream.hpp"
+#include "../SliceArray.hpp"
+#include "../util/XXHash32.hpp"
+#include "../util/XXHash64.hpp"
+#include "CodecCache.hpp"
+#include "DedupWindow.hpp"
+
+namespace kanzi
+{
+
+   class BlockResult
+   {
+   public:
+       int _error; // 0 = OK
+       string _msg;
+       int _decoded; // size of the decoded block
+       uint64 _checksum; // block checksum (0 if none)
+       int _reference; // id of the block duplicated (0 if none)
+
+       BlockResult()
+           : _msg()
+       {
+           _error = 0;
+           _decoded = 0;
+           _checksum = 0;
+           _reference = 0;
+       }
+
+       ~BlockResult() {}
+   };
+
+   // The encoding and decoding of one block of the bitstream (block header,
+   // then transformed and entropy coded data), shared by the streams and
+   // MemoryCodec so that the block format is defined in one place.
+   // The listeners (if not null) receive the events of the block.
+   class BlockCodec
+   {
+   public:
+       static const byte COPY_BLOCK_MASK = byte(0x80);
+       static const byte TRANSFORMS_MASK = byte(0x10);
+       static const byte DEDUP_BLOCK_MASK = byte(0x90); // reference to a previous block
+       static const int SMALL_BLOCK_SIZE = 15; // smaller blocks are copied
+       static const int EXTRA_BUFFER_SIZE = 256;
+       static const int MAX_DEDUP_BLOCK_LENGTH = 17; // mode, size, distance, checksum
+       static const int MAX_BLOCK_SIZE = 1024 * 1024 * 1024;
+
+       // Transform and entropy code 'length' bytes of 'input' (from its index)
+       // to the bitstream. If 'copy' is true, the block is stored instead.
+       // The transformed data goes to 'output'. The intermediate data goes to
+       // 'scratch' if not null, else to the input.
+       // The checksum of the block (checksumSize bits) is written if checksumSize is not 0.
+       static BlockResult encode(CodecSet& codecs, Context& ctx, SliceArray<byte>& input,
+           SliceArray<byte>& output, SliceArray<byte>* scratch, int length,
+           uint64 transformType, uint32 entropyType, bool copy, uint64 checksum,
+           int checksumSize, OutputBitStream& obs, int blockId = 0,
+           vector<Listener*>* listeners = nullptr);
+
+       // Encode a block equal to the block encoded 'distance' blocks before
+       static void encodeReference(OutputBitStream& obs, int length, int distance,
+           uint64 checksum, int checksumSize) THROW;
+
+       // Decode a block from the bitstream and inverse transform it to 'output'
+       // (from its index). The entropy decoded data goes to 'buffer', which is
+       // made at least 'bufferSize' bytes long. The checksum of the block (if
+       // any hasher) is verified.
+       // A reference to a previous block is copied from the window (if not null).
+       // With a bitstream shared by several blocks (version 9), the decoding
+       // waits for the previous block to be read from the commit queue (if not
+       // null), then commits the block once read.
+       static BlockResult decode(CodecSet& codecs, Context& ctx, InputBitStream& ibs,
+           SliceArray<byte>& buffer, SliceArray<byte>& output, int bufferSize,
+           uint64 transformType, uint32 entropyType, XXHash32* hasher32, XXHash64* hasher64,
+           const DedupWindow* window, OrderedCommitQueue* commitQueue, int blockId = 0,
+           vector<Listener*>* listeners = nullptr);
+
+   private:
+       static BlockResult decodeReference(InputBitStream& ibs, byte mode, SliceArray<byte>& output,
+           int bufferSize, Event::HashType hashType, const DedupWindow& window, int blockId,
+           vector<Listener*>* listeners) THROW;
+
+       static void notifyListeners(vector<Listener*>* listeners, const Event& evt);
+   };
+}
+#endif
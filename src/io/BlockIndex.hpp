@@ -0,0 +1,61 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BlockIndex_
+#define _BlockIndex_
+
+#include "../types.hpp"
+
+namespace kanzi
+{
+
+   // Location of a block in a compressed stream.
+   // The optional block index is written after the end block (and the
+   // stream digest, if any):
+   // nbEntries (32 bits) then for each block:
+   // offset (64 bits), compressed offset (64 bits), size (32 bits),
+   // compressed size (32 bits). The stream ends with the offset of the
+   // index (64 bits) and the index type (32 bits).
+   // All offsets are in bytes from the start of the stream header.
+   class BlockIndexEntry
+   {
+   public:
+       static const int INDEX_TYPE = 0x4B494458; // "KIDX"
+       static const int ENTRY_SIZE = 24; // bytes
+       static const int TRAILER_SIZE = 12; // bytes
+
+       uint64 _offset; // offset of the block in the uncompressed data
+       uint64 _compressedOffset; // offset of the block length in the stream
+       uint32 _size; // uncompressed block size
+       uint32 _compressedSize; // block size in the stream (without length)
+
+       BlockIndexEntry()
+       {
+           _offset = 0;
+           _compressedOffset = 0;
+           _size = 0;
+           _compressedSize = 0;
+       }
+
+       BlockIndexEntry(uint64 offset, uint64 compressedOffset, uint32 size, uint32 compressedSize)
+       {
+           _offset = offset;
+           _compressedOffset = compressedOffset;
+           _size = size;
+           _compressedSize = compressedSize;
+       }
+   };
+}
+#endif
@@ -0,0 +1,168 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include "CodecCache.hpp"
+#include "../entropy/EntropyCodecFactory.hpp"
+#include "../function/FunctionFactory.hpp"
+
+using namespace kanzi;
+
+CodecSet::CodecSet()
+{
+    _transform = nullptr;
+    _copyTransform = nullptr;
+    _predictor = nullptr;
+    _predictorType = EntropyCodecFactory::NONE_TYPE;
+}
+
+CodecSet::~CodecSet()
+{
+    if (_transform != nullptr)
+        delete _transform;
+
+    if (_copyTransform != nullptr)
+        delete _copyTransform;
+
+    if (_predictor != nullptr)
+        delete _predictor;
+}
+
+TransformSequence<byte>* CodecSet::getTransform(Context& ctx, uint64 transformType) THROW
+{
+    // Copy blocks do not replace the cached transforms
+    if (transformType == FunctionFactory<byte>::NONE_TYPE) {
+        if (_copyTransform == nullptr)
+            _copyTransform = FunctionFactory<byte>::newFunction(ctx, transformType);
+
+        return _copyTransform;
+    }
+
+    // The transforms read these values when they are created
+    string key = to_string(transformType);
+    key += ":";
+    key += ctx.getString("blockSize");
+    key += ":";
+    key += ctx.getString("jobs", "1");
+    key += ":";
+    key += ctx.getString("suffixSorter");
+    key += ":";
+    key += ctx.getString("releaseBuffers");
+    key += ":";
+    key += ctx.getString("codec");
+    key += ":";
+    key += ctx.getString("extra");
+
+    if (ctx.getDictionary() != nullptr) {
+        key += ":";
+        key += to_string(ctx.getDictionary()->getId());
+        key += ":";
+        key += to_string(ctx.getDictionary()->getSize());
+    }
+
+    if ((_transform == nullptr) || (key != _transformKey)) {
+        if (_transform != nullptr)
+            delete _transform;
+
+        _transform = nullptr;
+        _transform = FunctionFactory<byte>::newFunction(ctx, transformType);
+        _transformKey = key;
+    }
+
+    return _transform;
+}
+
+// Only the TPAQ models are big enough to be worth keeping
+Predictor* CodecSet::getPredictor(Context& ctx, short entropyType) THROW
+{
+    if ((entropyType != EntropyCodecFactory::TPAQ_TYPE) && (entropyType != EntropyCodecFactory::TPAQX_TYPE))
+        return nullptr;
+
+    if (entropyType != _predictorType) {
+        if (_predictor != nullptr)
+            delete _predictor;
+
+        _predictor = nullptr;
+        _predictorType = EntropyCodecFactory::NONE_TYPE;
+
+        if (entropyType == EntropyCodecFactory::TPAQ_TYPE)
+            _predictor = new TPAQPredictor<false>(&ctx);
+        else
+            _predictor = new TPAQPredictor<true>(&ctx);
+
+        _predictorType = entropyType;
+    }
+    else if (entropyType == EntropyCodecFactory::TPAQ_TYPE) {
+        static_cast<TPAQPredictor<false>*>(_predictor)->reset(&ctx);
+    }
+    else {
+        static_cast<TPAQPredictor<true>*>(_predictor)->reset(&ctx);
+    }
+
+    return _predictor;
+}
+
+EntropyEncoder* CodecSet::newEncoder(OutputBitStream& obs, Context& ctx, short entropyType) THROW
+{
+    Predictor* predictor = getPredictor(ctx, entropyType);
+
+    if (predictor == nullptr)
+        return EntropyCodecFactory::newEncoder(obs, ctx, entropyType);
+
+    return new BinaryEntropyEncoder(obs, predictor, false);
+}
+
+EntropyDecoder* CodecSet::newDecoder(InputBitStream& ibs, Context& ctx, short entropyType) THROW
+{
+    Predictor* predictor = getPredictor(ctx, entropyType);
+
+    if (predictor == nullptr)
+        return EntropyCodecFactory::newDecoder(ibs, ctx, entropyType);
+
+    return new BinaryEntropyDecoder(ibs, predictor, false);
+}
+
+
+CodecSet* CodecCache::acquire()
+{
+    lock_guard<mutex> lock(_mutex);
+
+    if (_available.empty() == false) {
+        CodecSet* codecs = _available.back();
+        _available.pop_back();
+        return codecs;
+    }
+
+    CodecSet* codecs = new CodecSet();
+    _all.push_back(codecs);
+    return codecs;
+}
+
+void CodecCache::release(CodecSet* codecs)
+{
+    lock_guard<mutex> lock(_mutex);
+    _available.push_back(codecs);
+}
+
+void CodecCache::clear()
+{
+    lock_guard<mutex> lock(_mutex);
+
+    for (uint i = 0; i < _all.size(); i++)
+        delete _all[i];
+
+    _all.clear();
+    _available.clear();
+}
@@ -0,0 +1,85 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _CodecCache_
+#define _CodecCache_
+
+#include <string>
+#include <vector>
+#include "../concurrent.hpp"
+#include "../Context.hpp"
+#include "../EntropyDecoder.hpp"
+#include "../EntropyEncoder.hpp"
+#include "../InputBitStream.hpp"
+#include "../OutputBitStream.hpp"
+#include "../Predictor.hpp"
+#include "../function/TransformSequence.hpp"
+
+namespace kanzi
+{
+
+   // The transforms and entropy models used to process one block at a time.
+   // They are kept from one block to the next so that their memory (BWT
+   // buffers, text dictionaries, TPAQ tables, ...) is not reallocated and
+   // page faulted for each block. Only the model state is reset.
+   class CodecSet
+   {
+   public:
+       CodecSet();
+
+       ~CodecSet();
+
+       // Return a transform sequence owned by the set (do not delete)
+       TransformSequence<byte>* getTransform(Context& ctx, uint64 transformType) THROW;
+
+       // Return a new entropy coder. A cached predictor may be used (owned by the set)
+       EntropyEncoder* newEncoder(OutputBitStream& obs, Context& ctx, short entropyType) THROW;
+
+       EntropyDecoder* newDecoder(InputBitStream& ibs, Context& ctx, short entropyType) THROW;
+
+   private:
+       TransformSequence<byte>* _transform;
+       TransformSequence<byte>* _copyTransform; // for copy blocks
+       string _transformKey;
+       Predictor* _predictor;
+       short _predictorType;
+
+       Predictor* getPredictor(Context& ctx, short entropyType) THROW;
+   };
+
+   // A set of codecs is acquired by a task for the duration of a block, so
+   // there are never more sets than concurrent tasks. The sets are deleted
+   // with the cache.
+   class CodecCache
+   {
+   public:
+       CodecCache() {}
+
+       ~CodecCache() { clear(); }
+
+       CodecSet* acquire();
+
+       void release(CodecSet* codecs);
+
+       // Delete all the sets. Must not be called while tasks are using the cache.
+       void clear();
+
+   private:
+       mutex _mutex;
+       vector<CodecSet*> _all;
+       vector<CodecSet*> _available;
+   };
+}
+#endif
@@ -16,9 +16,11 @@ limitations under the License.
 #include <sstream>
 #include <iomanip>
 #include "CompressedInputStream.hpp"
+#include "MemoryBudget.hpp"
 #include "IOException.hpp"
 #include "../Error.hpp"
 #include "../bitstream/DefaultInputBitStream.hpp"
+#include "../bitstream/MemoryInputBitStream.hpp"
 #include "../entropy/EntropyCodecFactory.hpp"
 #include "../function/FunctionFactory.hpp"
 
@@ -28,7 +30,7 @@ limitations under the License.
 
 using namespace kanzi;
 
-CompressedInputStream::CompressedInputStream(InputStream& is, int tasks)
+CompressedInputStream::CompressedInputStream(InputStream& is, int tasks, ThreadPool* pool, BufferPool* buffers)
     : InputStream(is.rdbuf())
     , _is(is)
 {
@@ -51,15 +53,43 @@ CompressedInputStream::CompressedInputStream(InputStream& is, int tasks)
     _closed = false;
     _maxIdx = 0;
     _gcount = 0;
+    _start = is.tellg();
     _ibs = new DefaultInputBitStream(is, DEFAULT_BUFFER_SIZE);
+    _bitstreamVersion = BITSTREAM_FORMAT_VERSION;
+    _endOfStream = false;
+    _hasIndex = false;
+    _blockIndex = nullptr;
+    _window = nullptr;
+    _pendingLength = 0;
+    _writer = nullptr;
+    _writeOffset = 0;
     _jobs = tasks;
+    _maxBlocks = tasks;
+    _pool = pool;
+    _deallocatePool = false;
+    _bufferPool = buffers;
+    _deallocateBufferPool = false;
+    _codecs = new CodecCache();
+    _deallocateCodecs = true;
     _sa = new SliceArray<byte>(new byte[0], 0, 0);
-    _hasher = nullptr;
+    _hasher32 = nullptr;
+    _hasher64 = nullptr;
+    _streamDigest = 0;
+    _hasDigest = false;
+    _verifyDigest = true;
     _nbInputBlocks = 0;
     _buffers = new SliceArray<byte>*[2 * _jobs];
 
     for (int i = 0; i < 2 * _jobs; i++)
         _buffers[i] = new SliceArray<byte>(new byte[0], 0, 0);
+
+    if (_bufferPool == nullptr) {
+        _bufferPool = new BufferPool();
+        _deallocateBufferPool = true;
+    }
+
+    // The tasks get the buffer pool from their copy of the context
+    _ctx.setBufferPool(_bufferPool);
 }
 
 CompressedInputStream::CompressedInputStream(InputStream& is, Context& ctx)
@@ -88,15 +118,48 @@ CompressedInputStream::CompressedInputStream(InputStream& is, Context& ctx)
     _closed = false;
     _maxIdx = 0;
     _gcount = 0;
+    _start = is.tellg();
     _ibs = new DefaultInputBitStream(is, DEFAULT_BUFFER_SIZE);
+    _bitstreamVersion = BITSTREAM_FORMAT_VERSION;
+    _endOfStream = false;
+    _hasIndex = false;
+    _blockIndex = nullptr;
+    _window = nullptr;
+    _pendingLength = 0;
+    _writer = nullptr;
+    _writeOffset = 0;
     _jobs = tasks;
+    _maxBlocks = tasks;
+    _pool = ctx.getPool();
+    _deallocatePool = false;
+    _bufferPool = ctx.getBufferPool();
+    _deallocateBufferPool = false;
+    _codecs = ctx.getCodecCache();
+    _deallocateCodecs = false;
     _sa = new SliceArray<byte>(new byte[0], 0, 0);
-    _hasher = nullptr;
+    _hasher32 = nullptr;
+    _hasher64 = nullptr;
+    _streamDigest = 0;
+    _hasDigest = false;
+    _verifyDigest = true;
     _nbInputBlocks = 0;
     _buffers = new SliceArray<byte>*[2 * _jobs];
 
     for (int i = 0; i < 2 * _jobs; i++)
         _buffers[i] = new SliceArray<byte>(new byte[0], 0, 0);
+
+    if (_bufferPool == nullptr) {
+        _bufferPool = new BufferPool();
+        _deallocateBufferPool = true;
+    }
+
+    if (_codecs == nullptr) {
+        _codecs = new CodecCache();
+        _deallocateCodecs = true;
+    }
+
+    // The tasks get the buffer pool from their copy of the context
+    _ctx.setBufferPool(_bufferPool);
 }
 
 CompressedInputStream::~CompressedInputStream()
@@ -109,81 +172,123 @@ CompressedInputStream::~CompressedInputStream()
     }
 
     for (int i = 0; i < 2 * _jobs; i++) {
-        delete[] _buffers[i]->_array;
+        _bufferPool->release(_buffers[i]->_array, _buffers[i]->_length);
         delete _buffers[i];
     }
 
     delete[] _buffers;
     delete _ibs;
-    delete[] _sa->_array;
+    _bufferPool->release(_sa->_array, _sa->_length);
     delete _sa;
 
-    if (_hasher != nullptr) {
-        delete _hasher;
-        _hasher = nullptr;
+    if (_hasher32 != nullptr) {
+        delete _hasher32;
+        _hasher32 = nullptr;
     }
-}
-
-void CompressedInputStream::readHeader() THROW
-{
-    // Read stream type
-    const int32 type = int32(_ibs->readBits(32));
 
-    // Sanity check
-    if (type != BITSTREAM_TYPE) {
-        stringstream ss;
-        throw IOException("Invalid stream type", Error::ERR_INVALID_FILE);
+    if (_hasher64 != nullptr) {
+        delete _hasher64;
+        _hasher64 = nullptr;
     }
 
-    // Read stream version
-    int version = int(_ibs->readBits(5));
+    if (_blockIndex != nullptr) {
+        delete _blockIndex;
+        _blockIndex = nullptr;
+    }
 
-    // Sanity check
-    if (version != BITSTREAM_FORMAT_VERSION) {
-        stringstream ss;
-        ss << "Invalid bitstream, cannot read this version of the stream: " << version;
-        throw IOException(ss.str(), Error::ERR_STREAM_VERSION);
+    if (_window != nullptr) {
+        delete _window;
+        _window = nullptr;
     }
 
-    // Read block checksum
-    if (_ibs->readBit() == 1)
-        _hasher = new XXHash32(BITSTREAM_TYPE);
+    if (_deallocateBufferPool == true)
+        delete _bufferPool;
 
-    // Read entropy codec
-    _entropyType = uint32(_ibs->readBits(5));
+    if (_deallocateCodecs == true)
+        delete _codecs;
+
+#ifdef CONCURRENCY_ENABLED
+    if (_deallocatePool == true)
+        delete _pool;
+#endif
+}
+
+void CompressedInputStream::readHeader() THROW
+{
+    StreamHeader header;
+    header.read(*_ibs);
+    _bitstreamVersion = header._version;
+    _entropyType = header._entropyType;
     _ctx.putString("codec", EntropyCodecFactory::getName(_entropyType));
     _ctx.putString("extra", _entropyType == EntropyCodecFactory::TPAQX_TYPE ? STR_TRUE : STR_FALSE);
-
-    // Read transform: 8*6 bits
-    _transformType = _ibs->readBits(48);
+    _transformType = header._transformType;
     _ctx.putString("transform", FunctionFactory<byte>::getName(_transformType));
-
-    // Read block size
-    _blockSize = int(_ibs->readBits(28)) << 4;
+    _blockSize = header._blockSize;
     _ctx.putInt("blockSize", _blockSize);
 
-    if ((_blockSize < MIN_BITSTREAM_BLOCK_SIZE) || (_blockSize > MAX_BITSTREAM_BLOCK_SIZE)) {
-        stringstream ss;
-        ss << "Invalid bitstream, incorrect block size: " << _blockSize;
-        throw IOException(ss.str(), Error::ERR_BLOCK_SIZE);
-    }
-
 #ifdef CONCURRENCY_ENABLED
     if (uint64(_blockSize) * uint64(_jobs) >= uint64(1 << 31))
         _jobs = (1 << 31) / _blockSize;
 #endif
 
-    // Read number of blocks in input. 0 means 'unknown' and 63 means 63 or more.
-    _nbInputBlocks = uint8(_ibs->readBits(6));
+    // Bound the number of blocks decoded concurrently by the memory budget
+    // (if any). The jobs are still used by the transforms within each block.
+    const int64 maxMemory = _ctx.getLong("maxMemory", 0);
+    const int64 footprint = MemoryBudget::blockFootprint(_transformType, _entropyType, _blockSize, true);
+    const int64 fixed = MemoryBudget::streamFootprint(_blockSize, header._dedup);
+    _maxBlocks = MemoryBudget::maxJobs(maxMemory, fixed, footprint, _jobs);
+    _nbInputBlocks = uint8(header._nbInputBlocks);
+    _hasIndex = header._index;
+
+    if (header._dedup == true)
+        _window = new DedupWindow(_blockSize);
+
+    if (header._dictionary == true) {
+        const uint32 id = header._dictionaryId;
+        const Dictionary* dict = _ctx.getDictionary();
+
+        if (dict == nullptr) {
+            stringstream ss;
+            ss << "The bitstream requires a dictionary (id " << std::hex << id << ")";
+            throw IOException(ss.str(), Error::ERR_MISSING_PARAM);
+        }
+
+        if (dict->getId() != id) {
+            stringstream ss;
+            ss << "Invalid dictionary: the bitstream requires id " << std::hex << id << ", got " << dict->getId();
+            throw IOException(ss.str(), Error::ERR_INVALID_PARAM);
+        }
+    }
+    else {
+        // The transforms must not use a dictionary the encoder did not use
+        _ctx.setDictionary(nullptr);
+    }
 
-    // Read reserved bits
-    _ibs->readBits(3);
+    if (header._checksum == 32)
+        _hasher32 = new XXHash32(BITSTREAM_TYPE);
+    else if (header._checksum == 64)
+        _hasher64 = new XXHash64(BITSTREAM_TYPE);
 
     if (_listeners.size() > 0) {
         stringstream ss;
-        ss << "Checksum set to " << (_hasher != nullptr ? "true" : "false") << endl;
+        if (_hasher32 != nullptr)
+            ss << "Checksum set to 32 bits" << endl;
+        else if (_hasher64 != nullptr)
+            ss << "Checksum set to 64 bits" << endl;
+        else
+            ss << "Checksum set to false" << endl;
+
         ss << "Block size set to " << _blockSize << " bytes" << endl;
 
+        if (_ctx.getDictionary() != nullptr)
+            ss << "Using dictionary " << std::hex << _ctx.getDictionary()->getId() << std::dec << endl;
+
+        if (maxMemory > 0) {
+            ss << "Memory budget set to " << (maxMemory >> 20) << " MB: about "
+               << ((footprint + (1 << 20) - 1) >> 20) << " MB per block, "
+               << _maxBlocks << " block" << ((_maxBlocks > 1) ? "s" : "") << " decoded concurrently" << endl;
+        }
+
         try {
             string w1 = EntropyCodecFactory::getName(_entropyType);
 
@@ -214,7 +319,7 @@ void CompressedInputStream::readHeader() THROW
 
         // Protect against future concurrent modification of the list of block listeners
         vector<Listener*> blockListeners(_listeners);
-        Event evt(Event::AFTER_HEADER_DECODING, 0, ss.str(), clock());
+        Event evt(Event::AFTER_HEADER_DECODING, 0, ss.str(), Event::now());
         CompressedInputStream::notifyListeners(blockListeners, evt);
     }
 }
@@ -331,24 +436,231 @@ istream& CompressedInputStream::read(char* data, streamsize length) THROW
     return *this;
 }
 
+uint64 CompressedInputStream::decodeTo(PositionalWriter& writer) THROW
+{
+    if (_closed.load() == true) {
+        setstate(ios::badbit);
+        throw ios_base::failure("Stream closed");
+    }
+
+    try {
+        if (!_initialized.exchange(true, memory_order_acquire))
+            readHeader();
+
+        uint64 offset = 0;
+
+        // Data decoded but not read yet
+        if (_sa->_index < _maxIdx) {
+            writer.write(&_sa->_array[_sa->_index], _maxIdx - _sa->_index, 0);
+            offset = uint64(_maxIdx - _sa->_index);
+        }
+
+        _sa->_index = 0;
+        _maxIdx = 0;
+
+        if ((_hasIndex == true) && (_start != streampos(-1)) && (_endOfStream == false)) {
+            // The block index gives the size of the output. The input stream
+            // is moved back afterwards (the bitstream has buffered data ahead).
+            const streampos pos = _is.tellg();
+
+            try {
+                if (_blockIndex == nullptr)
+                    readIndex();
+            }
+            catch (IOException&) {
+                // Ignore, the index is only used as a hint here
+            }
+
+            _is.clear();
+            _is.seekg(pos);
+
+            if (_is.fail())
+                throw IOException("Cannot seek in input stream", Error::ERR_READ_FILE);
+
+            const int blockId = _blockId.load();
+
+            if ((_blockIndex != nullptr) && (blockId < int(_blockIndex->size()))) {
+                const BlockIndexEntry& last = _blockIndex->back();
+                const uint64 end = last._offset + last._size;
+                writer.preallocate(int64(offset + end - (*_blockIndex)[blockId]._offset));
+            }
+        }
+
+        _writer = &writer;
+        _writeOffset = offset;
+
+        while (processBlock() > 0) {
+        }
+
+        _writer = nullptr;
+        return _writeOffset;
+    }
+    catch (exception&) {
+        _writer = nullptr;
+        setstate(ios::badbit);
+        throw;
+    }
+}
+
 streampos CompressedInputStream::tellg()
 {
     return _is.tellg();
 }
 
-istream& CompressedInputStream::seekp(streampos) THROW
+istream& CompressedInputStream::seekp(streampos pos) THROW
+{
+    return seekg(pos);
+}
+
+istream& CompressedInputStream::seekg(streampos pos) THROW
+{
+    if (_closed.load() == true) {
+        setstate(ios::badbit);
+        throw ios_base::failure("Stream closed");
+    }
+
+    try {
+        if (!_initialized.exchange(true, memory_order_acquire))
+            readHeader();
+
+        if ((_hasIndex == false) || (_start == streampos(-1)))
+            throw IOException("Not supported: no block index or input not seekable", Error::ERR_READ_FILE);
+
+        // A reference block needs the blocks decoded before it
+        if (_window != nullptr)
+            throw IOException("Not supported: deduplicated blocks", Error::ERR_READ_FILE);
+
+        if (pos < 0)
+            throw IOException("Invalid position", Error::ERR_INVALID_PARAM);
+
+        if (_blockIndex == nullptr)
+            readIndex();
+
+        const uint64 offset = uint64(streamoff(pos));
+        const vector<BlockIndexEntry>& index = *_blockIndex;
+
+        // Find the last block starting at or before the position
+        int lo = 0;
+        int hi = int(index.size()) - 1;
+
+        while (lo < hi) {
+            const int mid = (lo + hi + 1) >> 1;
+
+            if (index[mid]._offset <= offset)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        _sa->_index = 0;
+        _maxIdx = 0;
+        clear();
+
+        if ((index.size() == 0) || (offset >= index[lo]._offset + index[lo]._size)) {
+            // At or past the end of the data
+            _endOfStream = true;
+            _blockId = int(index.size());
+            return *this;
+        }
+
+        // Restart reading from the block (the bitstream buffers data ahead)
+        _is.clear();
+        _is.seekg(_start + streamoff(index[lo]._compressedOffset));
+
+        if (_is.fail())
+            throw IOException("Cannot seek in input stream", Error::ERR_READ_FILE);
+
+        delete _ibs;
+        _ibs = new DefaultInputBitStream(_is, DEFAULT_BUFFER_SIZE);
+        _blockId = lo;
+
+        // The digest covers the whole stream
+        _verifyDigest = false;
+        _endOfStream = false;
+        _maxIdx = processBlock(1);
+        const int skip = int(offset - index[lo]._offset);
+
+        if (skip > _maxIdx)
+            throw IOException("Invalid block index", Error::ERR_INVALID_FILE);
+
+        _sa->_index = skip;
+        return *this;
+    }
+    catch (IOException& e) {
+        setstate(ios::badbit);
+        throw ios_base::failure(e.what());
+    }
+    catch (exception& e) {
+        setstate(ios::badbit);
+        throw ios_base::failure(e.what());
+    }
+}
+
+// Load the block index located from the trailer at the end of the input stream
+void CompressedInputStream::readIndex() THROW
 {
-    setstate(ios::badbit);
-    throw ios_base::failure("Not supported");
+    byte buf[BlockIndexEntry::TRAILER_SIZE];
+    _is.clear();
+    _is.seekg(-BlockIndexEntry::TRAILER_SIZE, ios::end);
+    const streampos end = _is.tellg() + streamoff(BlockIndexEntry::TRAILER_SIZE);
+    _is.read(reinterpret_cast<char*>(&buf[0]), BlockIndexEntry::TRAILER_SIZE);
+
+    if ((_is.gcount() != BlockIndexEntry::TRAILER_SIZE)
+        || (int32(BigEndian::readInt32(&buf[8])) != BlockIndexEntry::INDEX_TYPE))
+        throw IOException("Invalid block index trailer", Error::ERR_INVALID_FILE);
+
+    const uint64 indexOffset = uint64(BigEndian::readLong64(&buf[0]));
+    const uint64 indexEnd = uint64(streamoff(end - _start)) - BlockIndexEntry::TRAILER_SIZE;
+
+    if (indexOffset + 4 > indexEnd)
+        throw IOException("Invalid block index offset", Error::ERR_INVALID_FILE);
+
+    _is.seekg(_start + streamoff(indexOffset));
+    _is.read(reinterpret_cast<char*>(&buf[0]), 4);
+    const uint64 nbEntries = uint64(uint32(BigEndian::readInt32(&buf[0])));
+
+    if ((_is.gcount() != 4) || (indexOffset + 4 + nbEntries * BlockIndexEntry::ENTRY_SIZE != indexEnd))
+        throw IOException("Invalid block index size", Error::ERR_INVALID_FILE);
+
+    vector<BlockIndexEntry>* index = new vector<BlockIndexEntry>(size_t(nbEntries));
+    byte entry[BlockIndexEntry::ENTRY_SIZE];
+
+    for (uint64 i = 0; i < nbEntries; i++) {
+        _is.read(reinterpret_cast<char*>(&entry[0]), BlockIndexEntry::ENTRY_SIZE);
+
+        if (_is.gcount() != BlockIndexEntry::ENTRY_SIZE) {
+            delete index;
+            throw IOException("Cannot read block index", Error::ERR_READ_FILE);
+        }
+
+        BlockIndexEntry& e = (*index)[size_t(i)];
+        e._offset = uint64(BigEndian::readLong64(&entry[0]));
+        e._compressedOffset = uint64(BigEndian::readLong64(&entry[8]));
+        e._size = uint32(BigEndian::readInt32(&entry[16]));
+        e._compressedSize = uint32(BigEndian::readInt32(&entry[20]));
+
+        if ((e._size > uint32(_blockSize)) || ((i > 0) && (e._offset != (*index)[size_t(i - 1)]._offset + (*index)[size_t(i - 1)]._size))) {
+            delete index;
+            throw IOException("Invalid block index entry", Error::ERR_INVALID_FILE);
+        }
+    }
+
+    _blockIndex = index;
 }
 
-int CompressedInputStream::processBlock() THROW
+// Decode up to 'maxBlocks' blocks (at most one per task)
+int CompressedInputStream::processBlock(int maxBlocks) THROW
 {
     vector<DecodingTask<DecodingTaskResult>*> tasks;
+    vector<InputBitStream*> blockStreams;
+    int* jobsPerTask = nullptr;
 
     if (!_initialized.exchange(true, memory_order_acquire))
         readHeader();
 
+    if (_endOfStream == true)
+        return 0;
+
     try {
         // Add a padding area to manage any block with header or temporarily expanded
         const int blkSize = max(_blockSize + EXTRA_BUFFER_SIZE, _blockSize + (_blockSize >> 4));
@@ -358,8 +670,9 @@ int CompressedInputStream::processBlock() THROW
         int decoded = 0;
         _sa->_index = 0;
         const int firstBlockId = _blockId.load();
-        int nbTasks = _jobs;
-        int* jobsPerTask;
+        int nbTasks = min(min(_jobs, _maxBlocks), maxBlocks);
+        _commitQueue.reset(firstBlockId + 1);
+        _writeQueue.reset(firstBlockId + 1);
 
         // Assign optimal number of tasks and jobs per task
         if (nbTasks > 1) {
@@ -386,13 +699,81 @@ int CompressedInputStream::processBlock() THROW
             _buffers[2 * jobId]->_index = 0;
             _buffers[2 * jobId + 1]->_index = 0;
 
-            if (_buffers[2 * jobId]->_length < blkSize + 1024) {
-                // Lazy instantiation of input buffers this.buffers[2*jobId]
-                // Output buffers this.buffers[2*jobId+1] are lazily instantiated
-                // by the decoding tasks.
-                delete[] _buffers[2 * jobId]->_array;
-                _buffers[2 * jobId]->_array = new byte[blkSize + 1024];
-                _buffers[2 * jobId]->_length = blkSize + 1024;
+            // Lazy instantiation of input buffers this.buffers[2*jobId]
+            // Output buffers this.buffers[2*jobId+1] are lazily instantiated
+            // by the decoding tasks.
+            _bufferPool->reserve(*_buffers[2 * jobId], blkSize + 1024);
+
+            InputBitStream* ibs = _ibs;
+            OrderedCommitQueue* commitQueue = &_commitQueue;
+
+            if (_bitstreamVersion >= 10) {
+                // Read the whole block from the shared bitstream. It is then
+                // decoded independently of the other blocks.
+                // A reference block may have been read by the previous call.
+                const uint64 blockLength = (_pendingLength > 0) ? uint64(_pendingLength) : _ibs->readBits(32);
+
+                if (blockLength == 0) {
+                    // End block, followed by the stream digest (if block checksums)
+                    if ((_hasher32 != nullptr) || (_hasher64 != nullptr)) {
+                        _streamDigest = _ibs->readBits(64);
+                        _hasDigest = true;
+                    }
+
+                    _endOfStream = true;
+                    break;
+                }
+
+                if (blockLength > 2 * uint64(blkSize)) {
+                    stringstream ss;
+                    ss << "Invalid compressed block length: " << blockLength;
+                    throw IOException(ss.str(), Error::ERR_READ_FILE); // deallocate in catch block
+                }
+
+                // The entropy decoder reads from the input buffer and the
+                // inverse transform overwrites it once the block is decoded.
+                _bufferPool->reserve(*_buffers[2 * jobId], int(blockLength));
+
+                byte* p = &_buffers[2 * jobId]->_array[0];
+
+                if (_pendingLength > 0) {
+                    memcpy(p, &_pendingBlock[0], size_t(_pendingLength));
+                    _pendingLength = 0;
+                }
+                else {
+                    // Read in chunks, the bit count of readBits is limited to 32 bits
+                    for (uint64 n = blockLength; n > 0; ) {
+                        const uint64 chunk = (n < (uint64(1) << 27)) ? n : uint64(1) << 27;
+                        _ibs->readBits(p, uint(chunk << 3));
+                        p += chunk;
+                        n -= chunk;
+                    }
+
+                    p = &_buffers[2 * jobId]->_array[0];
+
+                    // The tasks only read the window, which is updated after
+                    // them. A reference to a block decoded by a task of this
+                    // call is left to the next call.
+                    if ((_window != nullptr) && (jobId > 0) && (blockLength <= uint64(MAX_DEDUP_BLOCK_LENGTH))
+                        && ((p[0] & BlockCodec::DEDUP_BLOCK_MASK) == BlockCodec::DEDUP_BLOCK_MASK)) {
+                        const int dataSize = 1 + (int(p[0] >> 5) & 0x03);
+
+                        if (blockLength >= uint64(1 + dataSize + 4)) {
+                            const int distance = BigEndian::readInt32(&p[1 + dataSize]);
+
+                            if ((distance > 0) && (distance <= jobId)) {
+                                memcpy(&_pendingBlock[0], p, size_t(blockLength));
+                                _pendingLength = int(blockLength);
+                                nbTasks = jobId;
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                ibs = new MemoryInputBitStream(_buffers[2 * jobId]->_array, int(blockLength));
+                blockStreams.push_back(ibs);
+                commitQueue = nullptr;
             }
 
             Context copyCtx(_ctx);
@@ -400,64 +781,78 @@ int CompressedInputStream::processBlock() THROW
 
             DecodingTask<DecodingTaskResult>* task = new DecodingTask<DecodingTaskResult>(_buffers[2 * jobId],
                 _buffers[2 * jobId + 1], blkSize, _transformType,
-                _entropyType, firstBlockId + jobId + 1, _ibs, _hasher, &_blockId,
-                blockListeners, copyCtx);
+                _entropyType, firstBlockId + jobId + 1, ibs, _hasher32, _hasher64, _window, commitQueue,
+                _codecs, _writer, &_writeQueue, &_writeOffset, blockListeners, copyCtx);
             tasks.push_back(task);
         }
 
         delete[] jobsPerTask;
+        jobsPerTask = nullptr;
 
         if (tasks.size() == 1) {
             // Synchronous call
             DecodingTask<DecodingTaskResult>* task = tasks.back();
             tasks.pop_back();
             DecodingTaskResult res = task->run();
+            delete task;
 
             if (res._error != 0)
                 throw IOException(res._msg, res._error); // deallocate in catch block
 
-            delete task;
             decoded += res._decoded;
             const int size = _sa->_index + decoded;
 
             if (size > nbTasks * _blockSize)
                 throw IOException("Invalid data", Error::ERR_PROCESS_BLOCK); // deallocate in catch code
 
-            if (_sa->_length < size) {
-                _sa->_length = size;
-                delete[] _sa->_array;
-                _sa->_array = new byte[_sa->_length];
+            // The block has already been written by the task if there is a writer
+            if (_writer == nullptr) {
+                _bufferPool->reserve(*_sa, size);
+                memcpy(&_sa->_array[_sa->_index], &res._data[0], res._decoded);
+                _sa->_index += res._decoded;
             }
 
-            memcpy(&_sa->_array[_sa->_index], &res._data[0], res._decoded);
-            _sa->_index += res._decoded;
+            updateWindow(res);
+            updateDigest(res);
 
             if (blockListeners.size() > 0) {
                 // Notify after transform ... in block order !
                 Event evt(Event::AFTER_TRANSFORM, res._blockId,
-                    int64(res._decoded), res._checksum, _hasher != nullptr, res._completionTime);
+                    int64(res._decoded), res._checksum, (_hasher32 != nullptr) ? Event::SIZE_32 :
+                    ((_hasher64 != nullptr) ? Event::SIZE_64 : Event::NO_HASH), res._completionTime,
+                    res._threadId);
 
                 CompressedInputStream::notifyListeners(blockListeners, evt);
             }
         }
 #ifdef CONCURRENCY_ENABLED
-        else {
+        else if (tasks.size() > 1) {
             vector<future<DecodingTaskResult> > futures;
             vector<DecodingTaskResult> results;
 
-            // Register task futures and launch tasks in parallel
+            if (_pool == nullptr) {
+                // Lazy creation of a pool reused by all subsequent blocks
+                _pool = new ThreadPool(_jobs);
+                _deallocatePool = true;
+            }
+
+            // Register task futures and launch tasks in parallel.
+            // The pool starts the tasks in submission order, so a parked task
+            // always waits for a task that has already started.
             for (uint i = 0; i < tasks.size(); i++) {
-                futures.push_back(async(&DecodingTask<DecodingTaskResult>::run, tasks[i]));
+                futures.push_back(_pool->schedule(&DecodingTask<DecodingTaskResult>::run, tasks[i]));
             }
 
-            // Wait for tasks completion and check results
-            for (uint i = 0; i < futures.size(); i++) {
-                DecodingTaskResult status = futures[i].get();
-                results.push_back(status);
-                decoded += status._decoded;
+            // Wait for all the tasks to complete before checking the results
+            // since the tasks are deallocated on error.
+            for (uint i = 0; i < futures.size(); i++)
+                results.push_back(futures[i].get());
 
-                if (status._error != 0)
-                    throw IOException(status._msg, status._error); // deallocate in catch block
+            for (uint i = 0; i < results.size(); i++) {
+                decoded += results[i]._decoded;
+
+                if (results[i]._error != 0)
+                    throw IOException(results[i]._msg, results[i]._error); // deallocate in catch block
             }
 
             const int size = _sa->_index + decoded;
@@ -465,21 +860,27 @@ int CompressedInputStream::processBlock() THROW
             if (size > nbTasks * _blockSize)
                 throw IOException("Invalid data", Error::ERR_PROCESS_BLOCK); // deallocate in catch code
 
-            if (_sa->_length < size) {
-                _sa->_length = size;
-                delete[] _sa->_array;
-                _sa->_array = new byte[_sa->_length];
-            }
+            // The blocks have already been written by the tasks if there is a writer
+            if (_writer == nullptr)
+                _bufferPool->reserve(*_sa, size);
 
             for (uint i = 0; i < results.size(); i++) {
                 DecodingTaskResult res = results[i];
-                memcpy(&_sa->_array[_sa->_index], &res._data[0], res._decoded);
-                _sa->_index += res._decoded;
+
+                if (_writer == nullptr) {
+                    memcpy(&_sa->_array[_sa->_index], &res._data[0], res._decoded);
+                    _sa->_index += res._decoded;
+                }
+
+                updateWindow(res);
+                updateDigest(res);
 
                 if (blockListeners.size() > 0) {
                     // Notify after transform ... in block order !
                     Event evt(Event::AFTER_TRANSFORM, res._blockId,
-                        int64(res._decoded), res._checksum, _hasher != nullptr, res._completionTime);
+                        int64(res._decoded), res._checksum, (_hasher32 != nullptr) ? Event::SIZE_32 :
+                        ((_hasher64 != nullptr) ? Event::SIZE_64 : Event::NO_HASH), res._completionTime,
+                        res._threadId);
 
                     CompressedInputStream::notifyListeners(blockListeners, evt);
                 }
@@ -491,6 +892,23 @@ int CompressedInputStream::processBlock() THROW
 
         tasks.clear();
 #endif
+
+        // All the blocks have been decoded: check the stream digest
+        if ((_endOfStream == true) && (_hasDigest == true)) {
+            _hasDigest = false;
+
+            if ((_verifyDigest == true) && (_digest.value() != _streamDigest)) {
+                stringstream ss;
+                ss << "Corrupted bitstream: expected stream digest " << std::hex << _streamDigest
+                   << ", found " << _digest.value() << std::dec;
+                throw IOException(ss.str(), Error::ERR_CRC_CHECK);
+            }
+        }
+
+        for (InputBitStream* ibs : blockStreams)
+            delete ibs;
+
+        _blockId += nbTasks;
         _sa->_index = 0;
         return decoded;
     }
@@ -499,17 +917,65 @@ int CompressedInputStream::processBlock() THROW
             delete *it;
 
         tasks.clear();
+
+        for (InputBitStream* ibs : blockStreams)
+            delete ibs;
+
+        if (jobsPerTask != nullptr)
+            delete[] jobsPerTask;
+
         throw e;
     }
+    catch (BitStreamException& e) {
+        // EX: truncated stream
+        for (vector<DecodingTask<DecodingTaskResult>*>::iterator it = tasks.begin(); it != tasks.end(); it++)
+            delete *it;
+
+        tasks.clear();
+
+        for (InputBitStream* ibs : blockStreams)
+            delete ibs;
+
+        if (jobsPerTask != nullptr)
+            delete[] jobsPerTask;
+
+        throw IOException(e.what(), Error::ERR_READ_FILE);
+    }
     catch (exception& e) {
         for (vector<DecodingTask<DecodingTaskResult>*>::iterator it = tasks.begin(); it != tasks.end(); it++)
             delete *it;
 
         tasks.clear();
+
+        for (InputBitStream* ibs : blockStreams)
+            delete ibs;
+
+        if (jobsPerTask != nullptr)
+            delete[] jobsPerTask;
+
         throw IOException(e.what(), Error::ERR_UNKNOWN);
     }
 }
 
+// Chain the block checksum to the stream digest, in block order
+void CompressedInputStream::updateDigest(const DecodingTaskResult& res)
+{
+    if ((_hasher32 != nullptr) || (_hasher64 != nullptr))
+        _digest.add(res._checksum);
+}
+
+// Apply the operations of the encoder to the window, in block order
+void CompressedInputStream::updateWindow(const DecodingTaskResult& res)
+{
+    if (_window == nullptr)
+        return;
+
+    if (res._reference != 0)
+        _window->touch(res._reference);
+    else if (res._decoded > 0)
+        _window->add(res._blockId, res._data, res._decoded, 0);
+}
+
 void CompressedInputStream::close() THROW
 {
     if (_closed.exchange(true, memory_order_acquire))
@@ -522,18 +988,17 @@ void CompressedInputStream::close() THROW
         throw IOException(e.what(), e.error());
     }
 
-    // Release resources
+    // Release resources (the buffers can be reused by another stream)
     // Force error on any subsequent write attempt
-    delete[] _sa->_array;
-    _sa->_array = new byte[0];
-    _sa->_length = 0;
+    _bufferPool->release(*_sa);
     _sa->_index = -1;
 
-    for (int i = 0; i < 2 * _jobs; i++) {
-        delete[] _buffers[i]->_array;
-        _buffers[i]->_array = new byte[0];
-        _buffers[i]->_length = 0;
-    }
+    for (int i = 0; i < 2 * _jobs; i++)
+        _bufferPool->release(*_buffers[i]);
+
+    // A shared cache keeps the codecs for the next stream
+    if (_deallocateCodecs == true)
+        _codecs->clear();
 }
 
 // Return the number of bytes read so far
@@ -553,9 +1018,10 @@ void CompressedInputStream::notifyListeners(vector<Listener*>& listeners, const
 template <class T>
 DecodingTask<T>::DecodingTask(SliceArray<byte>* iBuffer, SliceArray<byte>* oBuffer, int blockSize,
     uint64 transformType, uint32 entropyType, int blockId,
-    InputBitStream* ibs, XXHash32* hasher,
-    atomic_int* processedBlockId, vector<Listener*>& listeners,
-    Context& ctx)
+    InputBitStream* ibs, XXHash32* hasher32, XXHash64* hasher64, const DedupWindow* window,
+    OrderedCommitQueue* commitQueue, CodecCache* codecs,
+    PositionalWriter* writer, OrderedCommitQueue* writeQueue, uint64* writeOffset,
+    vector<Listener*>& listeners, Context& ctx)
     : _ctx(ctx)
 {
     _blockLength = blockSize;
@@ -565,167 +1031,69 @@ DecodingTask<T>::DecodingTask(SliceArray<byte>* iBuffer, SliceArray<byte>* oBuff
     _entropyType = entropyType;
     _blockId = blockId;
     _ibs = ibs;
-    _hasher = hasher;
+    _hasher32 = hasher32;
+    _hasher64 = hasher64;
+    _window = window;
     _listeners = listeners;
-    _processedBlockId = processedBlockId;
+    _commitQueue = commitQueue;
+    _codecs = codecs;
+    _writer = writer;
+    _writeQueue = writeQueue;
+    _writeOffset = writeOffset;
 }
 
-// Decode mode + transformed entropy coded data
-// mode | 0b10000000 => copy block
-//      | 0b0yy00000 => size(size(block))-1
-//      | 0b000y0000 => 1 if more than 4 transforms
-//  case 4 transforms or less
-//      | 0b0000yyyy => transform sequence skip flags (1 means skip)
-//  case more than 4 transforms
-//      | 0b00000000
-//      then 0byyyyyyyy => transform sequence skip flags (1 means skip)
 template <class T>
 T DecodingTask<T>::run() THROW
 {
-    int taskId = _processedBlockId->load();
-
-    // Lock free synchronization
-    while ((taskId != CompressedInputStream::CANCEL_TASKS_ID) && (taskId != _blockId - 1)) {
-        taskId = _processedBlockId->load();
-    }
-
-    // Skip, either all data have been processed or an error occurred
-    if (taskId == CompressedInputStream::CANCEL_TASKS_ID) {
-        return T(*_data, _blockId, 0, 0, 0, "");
-    }
-
-    int checksum1 = 0;
-    EntropyDecoder* ed = nullptr;
-
-    try {
-        // Extract block header directly from bitstream
-        uint64 read = _ibs->read();
-        byte mode = byte(_ibs->readBits(8));
-        byte skipFlags = byte(0);
-
-        if ((mode & CompressedInputStream::COPY_BLOCK_MASK) != byte(0)) {
-            _transformType = FunctionFactory<byte>::NONE_TYPE;
-            _entropyType = EntropyCodecFactory::NONE_TYPE;
-        }
-        else {
-            if ((mode & CompressedInputStream::TRANSFORMS_MASK) != byte(0))
-                skipFlags = byte(_ibs->readBits(8));
-            else
-                skipFlags = (mode << 4) | byte(0x0F);
-        }
-
-        int dataSize = 1 + (int(mode >> 5) & 0x03);
-        int length = dataSize << 3;
-        uint64 mask = (uint64(1) << length) - 1;
-        int preTransformLength = int(_ibs->readBits(length) & mask);
-
-        if (preTransformLength == 0) {
-            // Last block is empty, return success and cancel pending tasks
-            _processedBlockId->store(CompressedInputStream::CANCEL_TASKS_ID);
-            return T(*_data, _blockId, 0, checksum1, 0, "");
-        }
-
-        if ((preTransformLength < 0) || (preTransformLength > CompressedInputStream::MAX_BITSTREAM_BLOCK_SIZE)) {
-            // Error => cancel concurrent decoding tasks
-            _processedBlockId->store(CompressedInputStream::CANCEL_TASKS_ID);
-            stringstream ss;
-            ss << "Invalid compressed block length: " << preTransformLength;
-            return T(*_data, _blockId, 0, checksum1, Error::ERR_READ_FILE, ss.str());
-        }
-
-        // Extract checksum from bit stream (if any)
-        if (_hasher != nullptr)
-            checksum1 = int(_ibs->readBits(32));
-
-        if (_listeners.size() > 0) {
-            // Notify before entropy (block size in bitstream is unknown)
-            Event evt(Event::BEFORE_ENTROPY, _blockId, int64(-1), checksum1, _hasher != nullptr, clock());
-            CompressedInputStream::notifyListeners(_listeners, evt);
-        }
-
-        const int bufferSize = (_blockLength >= preTransformLength + CompressedInputStream::EXTRA_BUFFER_SIZE) ? _blockLength : preTransformLength + CompressedInputStream::EXTRA_BUFFER_SIZE;
-
-        if (_buffer->_length < bufferSize) {
-            _buffer->_length = bufferSize;
-            delete[] _buffer->_array;
-            _buffer->_array = new byte[_buffer->_length];
-        }
-
-        const int savedIdx = _data->_index;
-        _ctx.putInt("size", preTransformLength);
-
-        // Each block is decoded separately
-        // Rebuild the entropy decoder to reset block statistics
-        ed = EntropyCodecFactory::newDecoder(*_ibs, _ctx, _entropyType);
-
-        // Block entropy decode
-        if (ed->decode(_buffer->_array, 0, preTransformLength) != preTransformLength) {
-            // Error => cancel concurrent decoding tasks
-            _processedBlockId->store(CompressedInputStream::CANCEL_TASKS_ID);
-            return T(*_data, _blockId, 0, checksum1, Error::ERR_PROCESS_BLOCK,
-                "Entropy decoding failed");
-        }
-
-        delete ed;
-        ed = nullptr;
-
-        if (_listeners.size() > 0) {
-            // Notify after entropy (block size set to size in bitstream)
-            Event evt(Event::AFTER_ENTROPY, _blockId,
-                int64((_ibs->read() - read) / 8), checksum1, _hasher != nullptr, clock());
-
-            CompressedInputStream::notifyListeners(_listeners, evt);
-        }
-
-        // After completion of the entropy decoding, increment the block id.
-        // It unfreezes the task processing the next block (if any)
-        (*_processedBlockId)++;
+    // Reuse the transforms and entropy models of a previous block
+    CodecSet* codecs = _codecs->acquire();
+    T res = decode(*codecs);
+    _codecs->release(codecs);
 
-        if (_listeners.size() > 0) {
-            // Notify before transform (block size after entropy decoding)
-            Event evt(Event::BEFORE_TRANSFORM, _blockId,
-                int64(preTransformLength), checksum1, _hasher != nullptr, clock());
-
-            CompressedInputStream::notifyListeners(_listeners, evt);
-        }
+    if (_writer != nullptr)
+        write(res);
 
-        TransformSequence<byte>* transform = FunctionFactory<byte>::newFunction(_ctx, _transformType);
-        transform->setSkipFlags(skipFlags);
-        _buffer->_index = 0;
-
-        // Inverse transform
-        _buffer->_length = preTransformLength;
-        bool res = transform->inverse(*_buffer, *_data, _buffer->_length);
-        delete transform;
-
-        if (res == false) {
-            return T(*_data, _blockId, 0, checksum1, Error::ERR_PROCESS_BLOCK,
-                "Transform inverse failed");
-        }
+    return res;
+}
 
-        const int decoded = _data->_index - savedIdx;
+// Write the decoded block to its position in the output. The offsets are
+// assigned in block order (each block waits for the previous block to be
+// decoded) but the blocks are written concurrently.
+template <class T>
+void DecodingTask<T>::write(T& res)
+{
+    if (res._error != 0) {
+        // Release the tasks waiting for their offset
+        _writeQueue->cancel();
+        return;
+    }
 
-        // Verify checksum
-        if (_hasher != nullptr) {
-            const int checksum2 = _hasher->hash(&_data->_array[savedIdx], decoded);
+    // A previous block failed (the error is reported by its own task)
+    if (_writeQueue->wait(_blockId) == false)
+        return;
 
-            if (checksum2 != checksum1) {
-                stringstream ss;
-                ss << "Corrupted bitstream: expected checksum " << hex << checksum1 << ", found " << hex << checksum2;
-                return T(*_data, _blockId, decoded, checksum1, Error::ERR_CRC_CHECK, ss.str());
-            }
-        }
+    const uint64 offset = *_writeOffset;
+    *_writeOffset += uint64(res._decoded);
+    _writeQueue->commit(_blockId);
 
-        return T(*_data, _blockId, decoded, checksum1, 0, "");
+    try {
+        _writer->write(&res._data[0], res._decoded, int64(offset));
     }
-    catch (exception& e) {
-        // Make sure to unfreeze next block
-        if (_processedBlockId->load() == _blockId - 1)
-            (*_processedBlockId)++;
-
-        if (ed != nullptr)
-            delete ed;
-
-        return T(*_data, _blockId, 0, checksum1, Error::ERR_PROCESS_BLOCK, e.what());
+    catch (IOException& e) {
+        _writeQueue->cancel();
+        res._error = e.error();
+        res._msg = e.what();
     }
 }
+
+// Decode the block (see BlockCodec for the layout) from the bitstream
+template <class T>
+T DecodingTask<T>::decode(CodecSet& codecs) THROW
+{
+    vector<Listener*>* listeners = (_listeners.size() > 0) ? &_listeners : nullptr;
+    BlockResult res = BlockCodec::decode(codecs, _ctx, *_ibs, *_buffer, *_data, _blockLength,
+        _transformType, _entropyType, _hasher32, _hasher64, _window, _commitQueue, _blockId, listeners);
+    T result(*_data, _blockId, res._decoded, res._checksum, res._error, res._msg);
+    result._reference = res._reference;
+    return result;
+}
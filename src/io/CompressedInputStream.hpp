@@ -18,6 +18,7 @@ limitations under the License.
 
 #include <string>
 #include <vector>
+#include "../BufferPool.hpp"
 #include "../concurrent.hpp"
 #include "../Context.hpp"
 #include "../Listener.hpp"
@@ -26,6 +27,14 @@ limitations under the License.
 #include "../InputBitStream.hpp"
 #include "../SliceArray.hpp"
 #include "../util/XXHash32.hpp"
+#include "../util/XXHash64.hpp"
+#include "BlockCodec.hpp"
+#include "BlockIndex.hpp"
+#include "CodecCache.hpp"
+#include "DedupWindow.hpp"
+#include "PositionalWriter.hpp"
+#include "StreamDigest.hpp"
+#include "StreamHeader.hpp"
 
 namespace kanzi
 {
@@ -37,29 +46,35 @@ namespace kanzi
        byte* _data;
        int _error; // 0 = OK
        string _msg;
-       int _checksum;
-       clock_t _completionTime;
+       uint64 _checksum;
+       int _reference; // id of the block duplicated (0 if none)
+       int64 _completionTime; // see Event::now()
+       int _threadId; // thread of the decoding task
 
        DecodingTaskResult()
            : _blockId(-1)
            , _msg()
-           , _completionTime(clock())
+           , _completionTime(Event::now())
+           , _threadId(Event::currentThreadId())
        {
           _data = nullptr;
           _decoded = 0;
           _error = 0;
           _checksum = 0;
+          _reference = 0;
        }
 
-       DecodingTaskResult(SliceArray<byte>& data, int blockId, int decoded, int checksum, int error, const string& msg)
+       DecodingTaskResult(SliceArray<byte>& data, int blockId, int decoded, uint64 checksum, int error, const string& msg)
            : _msg(msg)
-           , _completionTime(clock())
+           , _completionTime(Event::now())
+           , _threadId(Event::currentThreadId())
        {
            _data = data._array;
            _blockId = blockId;
            _error = error;
            _decoded = decoded;
            _checksum = checksum;
+           _reference = 0;
        }
 
        DecodingTaskResult(const DecodingTaskResult& result)
@@ -70,15 +85,20 @@ namespace kanzi
            _error = result._error;
            _decoded = result._decoded;
            _checksum = result._checksum;
+           _reference = result._reference;
            _completionTime = result._completionTime;
+           _threadId = result._threadId;
        }
 
        ~DecodingTaskResult() {}
    };
 
    // A task used to decode a block
-   // Several tasks may run in parallel. The transforms can be computed concurrently
-   // but the entropy decoding is sequential since all tasks share the same bitstream.
+   // Several tasks may run in parallel. Up to version 9, the transforms can be
+   // computed concurrently but the entropy decoding is sequential since all tasks
+   // share the same bitstream. A task waiting for its turn to read the bitstream
+   // is parked. Since version 10, each block is read from the bitstream first
+   // (the block length is known), so the entropy decoding is concurrent too.
    template <class T>
    class DecodingTask : public Task<T> {
    private:
@@ -89,17 +109,32 @@ namespace kanzi
        uint32 _entropyType;
        int _blockId;
        InputBitStream* _ibs;
-       XXHash32* _hasher;
-       atomic_int* _processedBlockId;
+       XXHash32* _hasher32;
+       XXHash64* _hasher64;
+       const DedupWindow* _window;
+       OrderedCommitQueue* _commitQueue;
+       CodecCache* _codecs;
+       PositionalWriter* _writer;
+       OrderedCommitQueue* _writeQueue;
+       uint64* _writeOffset;
        vector<Listener*> _listeners;
 	   Context _ctx;
 
+       T decode(CodecSet& codecs) THROW;
+
+       void write(T& res);
+
    public:
+       // If writer is not null, the task writes the decoded block to it at
+       // the offset following the previous block (see writeQueue).
+       // The window (if any) is only read: it holds the blocks duplicated by
+       // the reference blocks.
        DecodingTask(SliceArray<byte>* iBuffer, SliceArray<byte>* oBuffer, int blockSize,
            uint64 transformType, uint32 entropyType, int blockId,
-           InputBitStream* ibs, XXHash32* hasher,
-           atomic_int* processedBlockId, vector<Listener*>& listeners,
-		   Context& ctx);
+           InputBitStream* ibs, XXHash32* hasher32, XXHash64* hasher64, const DedupWindow* window,
+           OrderedCommitQueue* commitQueue, CodecCache* codecs,
+           PositionalWriter* writer, OrderedCommitQueue* writeQueue, uint64* writeOffset,
+           vector<Listener*>& listeners, Context& ctx);
 
        ~DecodingTask(){};
 
@@ -110,46 +145,79 @@ namespace kanzi
        friend class DecodingTask<DecodingTaskResult>;
 
    private:
-       static const int BITSTREAM_TYPE = 0x4B414E5A; // "KANZ"
-       static const int BITSTREAM_FORMAT_VERSION = 9;
+       static const int BITSTREAM_TYPE = StreamHeader::BITSTREAM_TYPE;
+       static const int BITSTREAM_FORMAT_VERSION = StreamHeader::BITSTREAM_FORMAT_VERSION;
        static const int DEFAULT_BUFFER_SIZE = 256 * 1024;
-       static const int EXTRA_BUFFER_SIZE = 256;
-       static const byte COPY_BLOCK_MASK = byte(0x80);
-       static const byte TRANSFORMS_MASK = byte(0x10);
-       static const int MIN_BITSTREAM_BLOCK_SIZE = 1024;
-       static const int MAX_BITSTREAM_BLOCK_SIZE = 1024 * 1024 * 1024;
-       static const int CANCEL_TASKS_ID = -1;
+       static const int EXTRA_BUFFER_SIZE = BlockCodec::EXTRA_BUFFER_SIZE;
+       static const int MAX_DEDUP_BLOCK_LENGTH = BlockCodec::MAX_DEDUP_BLOCK_LENGTH;
        static const int MAX_CONCURRENCY = 64;
 
        int _blockSize;
        uint8 _nbInputBlocks;
-       XXHash32* _hasher;
+       XXHash32* _hasher32;
+       XXHash64* _hasher64;
+       StreamDigest _digest; // block checksums in block order
+       uint64 _streamDigest; // digest read after the end block
+       bool _hasDigest; // stream digest read and not verified yet (version 10+)
+       bool _verifyDigest; // false once the stream has been repositioned
        SliceArray<byte>* _sa; // for all blocks
        SliceArray<byte>** _buffers; // per block
        uint32 _entropyType;
        uint64 _transformType;
        InputBitStream* _ibs;
        InputStream& _is;
+       int _bitstreamVersion;
+       bool _endOfStream; // end block read (version 10+)
+       bool _hasIndex; // block index after the end block (version 10+)
+       vector<BlockIndexEntry>* _blockIndex; // lazily loaded
+       DedupWindow* _window; // null if the blocks are not deduplicated (version 10+)
+       byte _pendingBlock[MAX_DEDUP_BLOCK_LENGTH]; // reference block read ahead
+       int _pendingLength;
+       streampos _start; // position of the header in the input stream
        atomic_bool _initialized;
        atomic_bool _closed;
        atomic_int _blockId;
+       OrderedCommitQueue _commitQueue;
+       CodecCache* _codecs; // transforms and entropy models reused by the tasks
+       bool _deallocateCodecs; // cache created by the stream ?
+       PositionalWriter* _writer; // not null during decodeTo()
+       OrderedCommitQueue _writeQueue; // assigns the output offsets in block order
+       uint64 _writeOffset; // output offset of the next block
        int _maxIdx;
        int _jobs;
+       int _maxBlocks; // max number of blocks decoded concurrently
+       ThreadPool* _pool;
+       bool _deallocatePool; // pool created by the stream ?
+       BufferPool* _bufferPool;
+       bool _deallocateBufferPool; // buffer pool created by the stream ?
        vector<Listener*> _listeners;
        streamsize _gcount;
 	   Context _ctx;
 
        void readHeader() THROW;
 
-       int processBlock() THROW;
+       int processBlock(int maxBlocks = MAX_CONCURRENCY) THROW;
+
+       void readIndex() THROW;
+
+       void updateWindow(const DecodingTaskResult& res);
+
+       void updateDigest(const DecodingTaskResult& res);
 
        int _get();
 
        static void notifyListeners(vector<Listener*>& listeners, const Event& evt);
 
    public:
-       CompressedInputStream(InputStream& is, int jobs);
-
+       // The optional thread pool and buffer pool (not owned) may be shared by
+       // several streams. If no thread pool is provided, the stream creates its
+       // own pool when jobs > 1. If no buffer pool is provided, the stream
+       // creates its own pool.
+       CompressedInputStream(InputStream& is, int jobs, ThreadPool* pool = nullptr,
+           BufferPool* buffers = nullptr);
+
+       // The thread pool, buffer pool and codec cache (if any) are provided
+       // by the context
        CompressedInputStream(InputStream& is, Context& ctx);
 
        ~CompressedInputStream();
@@ -160,10 +228,22 @@ namespace kanzi
 
        streampos tellg();
 
+       // Random access in the uncompressed data. Requires a seekable input
+       // stream and a compressed stream written with a block index. Only the
+       // block containing the new position is decoded.
+       // Since the stream is repositioned, getRead() restarts from 0.
+       istream& seekg(streampos pos) THROW;
+
        istream& seekp(streampos pos) THROW;
 
        istream& read(char* s, streamsize n) THROW;
 
+       // Decode all the remaining data to the writer and return the number
+       // of bytes written. Each decoding task writes its own block at its
+       // offset in the output, so no copy to the stream buffer is needed.
+       // If the stream has a block index, the output file is preallocated.
+       uint64 decodeTo(PositionalWriter& writer) THROW;
+
        int get() THROW;
 
        int peek() THROW;
@@ -173,6 +253,13 @@ namespace kanzi
        void close() THROW;
 
        uint64 getRead();
+
+       // Size in bits of the block checksums (0 if none). Valid once the
+       // header has been read.
+       int getChecksumSize() const
+       {
+           return (_hasher32 != nullptr) ? 32 : ((_hasher64 != nullptr) ? 64 : 0);
+       }
    };
 }
 #endif
\ No newline at end of file
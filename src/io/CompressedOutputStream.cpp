@@ -15,6 +15,7 @@ limitations under the License.
 
 #include <sstream>
 #include "CompressedOutputStream.hpp"
+#include "MemoryBudget.hpp"
 #include "IOException.hpp"
 #include "../Error.hpp"
 #include "../bitstream/DefaultOutputBitStream.hpp"
@@ -28,7 +29,14 @@ limitations under the License.
 
 using namespace kanzi;
 
-CompressedOutputStream::CompressedOutputStream(OutputStream& os, const string& entropyCodec, const string& transform, int bSize, int tasks, bool checksum)
+CompressedOutputStream::CompressedOutputStream(OutputStream& os, const string& entropyCodec, const string& transform,
+         int bSize, int tasks, bool checksum, ThreadPool* pool, BufferPool* buffers)
+    : CompressedOutputStream(os, entropyCodec, transform, bSize, tasks, (checksum == true) ? 32 : 0, pool, buffers)
+{
+}
+
+CompressedOutputStream::CompressedOutputStream(OutputStream& os, const string& entropyCodec, const string& transform,
+         int bSize, int tasks, int checksum, ThreadPool* pool, BufferPool* buffers)
     : OutputStream(os.rdbuf())
     , _os(os)
 {
@@ -58,6 +66,9 @@ CompressedOutputStream::CompressedOutputStream(OutputStream& os, const string& e
     if ((bSize & -16) != bSize)
         throw invalid_argument("The block size must be a multiple of 16");
 
+    if ((checksum != 0) && (checksum != 32) && (checksum != 64))
+        throw invalid_argument("The checksum size must be 0, 32 or 64 bits");
+
 #ifdef CONCURRENCY_ENABLED
     if (uint64(bSize) * uint64(tasks) >= uint64(1 << 31))
         tasks = (1 << 31) / bSize;
@@ -71,13 +82,54 @@ CompressedOutputStream::CompressedOutputStream(OutputStream& os, const string& e
     _obs = new DefaultOutputBitStream(os, DEFAULT_BUFFER_SIZE);
     _entropyType = EntropyCodecFactory::getType(entropyCodec.c_str());
     _transformType = FunctionFactory<byte>::getType(transform.c_str());
-    _hasher = (checksum == true) ? new XXHash32(BITSTREAM_TYPE) : nullptr;
+    _hasher32 = (checksum == 32) ? new XXHash32(BITSTREAM_TYPE) : nullptr;
+    _hasher64 = (checksum == 64) ? new XXHash64(BITSTREAM_TYPE) : nullptr;
     _jobs = tasks;
-    _sa = new SliceArray<byte>(new byte[0], 0);
-    _buffers = new SliceArray<byte>*[2 * _jobs];
+    _pool = pool;
+    _deallocatePool = false;
+    _bufferPool = buffers;
+    _deallocateBufferPool = false;
+    _codecs = new CodecCache();
+    _deallocateCodecs = true;
+    _blockIndex = nullptr;
+    _dedup = nullptr;
+    _offset = 0;
+    _flushInterval = 0;
+
+    // The transforms and codecs read their parameters from the context.
+    // Provide the same values as the decoder (taken from the header).
+    _ctx.putString("codec", EntropyCodecFactory::getName(_entropyType));
+    _ctx.putString("transform", FunctionFactory<byte>::getName(_transformType));
+    _ctx.putString("extra", (_entropyType == EntropyCodecFactory::TPAQX_TYPE) ? STR_TRUE : STR_FALSE);
+    _ctx.putInt("blockSize", _blockSize);
+
+    if (_bufferPool == nullptr) {
+        _bufferPool = new BufferPool();
+        _deallocateBufferPool = true;
+    }
+
+    // The tasks get the buffer pool from their copy of the context
+    _ctx.setBufferPool(_bufferPool);
+
+    _maxBlocks = _jobs;
 
-    for (int i = 0; i < 2 * _jobs; i++)
+    // The blocks in flight share the jobs (used by the transforms)
+    _ctx.putInt("jobs", (_jobs / _maxBlocks > 1) ? _jobs / _maxBlocks : 1);
+
+    // Up to _maxBlocks blocks in flight while the next block is being filled
+    _nbSlots = (_maxBlocks == 1) ? 1 : _maxBlocks + 1;
+    _buffers = new SliceArray<byte>*[2 * _nbSlots];
+
+    for (int i = 0; i < 2 * _nbSlots; i++)
         _buffers[i] = new SliceArray<byte>(new byte[0], 0, 0);
+
+    _bitstreams = new MemoryOutputBitStream*[_nbSlots];
+
+    // Lazily instantiated (the buffers are taken from the pool)
+    for (int i = 0; i < _nbSlots; i++)
+        _bitstreams[i] = nullptr;
+
+    _sa = _buffers[0];
 }
 
 CompressedOutputStream::CompressedOutputStream(OutputStream& os, Context& ctx)
@@ -117,6 +169,15 @@ CompressedOutputStream::CompressedOutputStream(OutputStream& os, Context& ctx)
     if ((bSize & -16) != bSize)
         throw invalid_argument("The block size must be a multiple of 16");
 
+    const int flushInterval = ctx.getInt("flushInterval", 0);
+
+    if (flushInterval < 0)
+        throw invalid_argument("The flush interval must be at least 0");
+
+    // A deduplicated block cannot be decoded alone (see seekg())
+    if ((string(ctx.getString("dedup")) == STR_TRUE) && (string(ctx.getString("index")) == STR_TRUE))
+        throw invalid_argument("Block deduplication and block index cannot be combined");
+
 #ifdef CONCURRENCY_ENABLED
     if (uint64(bSize) * uint64(tasks) >= uint64(1 << 31))
         tasks = (1 << 31) / bSize;
@@ -139,15 +200,65 @@ CompressedOutputStream::CompressedOutputStream(OutputStream& os, Context& ctx)
     _obs = new DefaultOutputBitStream(os, DEFAULT_BUFFER_SIZE);
     _entropyType = EntropyCodecFactory::getType(entropyCodec.c_str());
     _transformType = FunctionFactory<byte>::getType(transform.c_str());
+    // Block checksum size: "32" (or "true") or "64" bits
     string str = ctx.getString("checksum");
-    bool checksum = str == STR_TRUE;
-    _hasher = (checksum == true) ? new XXHash32(BITSTREAM_TYPE) : nullptr;
+    _hasher32 = ((str == STR_TRUE) || (str == "32")) ? new XXHash32(BITSTREAM_TYPE) : nullptr;
+    _hasher64 = (str == "64") ? new XXHash64(BITSTREAM_TYPE) : nullptr;
     _jobs = tasks;
-    _sa = new SliceArray<byte>(new byte[0], 0);
-    _buffers = new SliceArray<byte>*[2 * _jobs];
+    _pool = ctx.getPool();
+    _deallocatePool = false;
+    _bufferPool = ctx.getBufferPool();
+    _deallocateBufferPool = false;
+    _codecs = ctx.getCodecCache();
+    _deallocateCodecs = false;
+    str = ctx.getString("index");
+    _blockIndex = (str == STR_TRUE) ? new vector<BlockIndexEntry>() : nullptr;
+    str = ctx.getString("dedup");
+    _dedup = (str == STR_TRUE) ? new DedupWindow(_blockSize) : nullptr;
+    _offset = 0;
+    _flushInterval = flushInterval;
+
+    if (_bufferPool == nullptr) {
+        _bufferPool = new BufferPool();
+        _deallocateBufferPool = true;
+    }
+
+    if (_codecs == nullptr) {
+        _codecs = new CodecCache();
+        _deallocateCodecs = true;
+    }
+
+    // The tasks get the buffer pool from their copy of the context
+    _ctx.setBufferPool(_bufferPool);
+
+    // Do not require the dictionary to decode if no transform uses it
+    if (FunctionFactory<byte>::usesDictionary(_transformType) == false)
+        _ctx.setDictionary(nullptr);
+
+    // Bound the number of blocks in flight by the memory budget (if any).
+    // The jobs are still used by the transforms within each block.
+    const int64 footprint = MemoryBudget::blockFootprint(_transformType, _entropyType, _blockSize, false);
+    const int64 fixed = MemoryBudget::streamFootprint(_blockSize, _dedup != nullptr);
+    _maxBlocks = MemoryBudget::maxJobs(ctx.getLong("maxMemory", 0), fixed, footprint, _jobs);
 
-    for (int i = 0; i < 2 * _jobs; i++)
+    // The blocks in flight share the jobs (used by the transforms)
+    const int blocks = ((_nbInputBlocks > 0) && (_nbInputBlocks < _maxBlocks)) ? _nbInputBlocks : _maxBlocks;
+    _ctx.putInt("jobs", (_jobs / blocks > 1) ? _jobs / blocks : 1);
+
+    // Up to _maxBlocks blocks in flight while the next block is being filled
+    _nbSlots = (_maxBlocks == 1) ? 1 : _maxBlocks + 1;
+    _buffers = new SliceArray<byte>*[2 * _nbSlots];
+
+    for (int i = 0; i < 2 * _nbSlots; i++)
         _buffers[i] = new SliceArray<byte>(new byte[0], 0, 0);
+
+    _bitstreams = new MemoryOutputBitStream*[_nbSlots];
+
+    // Lazily instantiated (the buffers are taken from the pool)
+    for (int i = 0; i < _nbSlots; i++)
+        _bitstreams[i] = nullptr;
+
+    _sa = _buffers[0];
 }
 
 CompressedOutputStream::~CompressedOutputStream()
@@ -159,47 +270,94 @@ CompressedOutputStream::~CompressedOutputStream()
         // Ignore and continue
     }
 
-    for (int i = 0; i < 2 * _jobs; i++) {
-        delete[] _buffers[i]->_array;
+#ifdef CONCURRENCY_ENABLED
+    // Make sure that no task is still using the buffers
+    for (uint i = 0; i < _futures.size(); i++) {
+        _futures[i].wait();
+        delete _tasks[i];
+    }
+#endif
+
+    for (int i = 0; i < 2 * _nbSlots; i++) {
+        _bufferPool->release(_buffers[i]->_array, _buffers[i]->_length);
         delete _buffers[i];
     }
 
     delete[] _buffers;
+
+    for (int i = 0; i < _nbSlots; i++) {
+        if (_bitstreams[i] != nullptr)
+            delete _bitstreams[i];
+    }
+
+    delete[] _bitstreams;
     delete _obs;
-    delete[] _sa->_array;
-    delete _sa;
 
-    if (_hasher != nullptr) {
-        delete _hasher;
-        _hasher = nullptr;
+    if (_hasher32 != nullptr) {
+        delete _hasher32;
+        _hasher32 = nullptr;
     }
-}
 
-void CompressedOutputStream::writeHeader() THROW
-{
-    if (_obs->writeBits(BITSTREAM_TYPE, 32) != 32)
-        throw IOException("Cannot write bitstream type to header", Error::ERR_WRITE_FILE);
+    if (_hasher64 != nullptr) {
+        delete _hasher64;
+        _hasher64 = nullptr;
+    }
 
-    if (_obs->writeBits(BITSTREAM_FORMAT_VERSION, 5) != 5)
-        throw IOException("Cannot write bitstream version to header", Error::ERR_WRITE_FILE);
+    if (_blockIndex != nullptr) {
+        delete _blockIndex;
+        _blockIndex = nullptr;
+    }
 
-    if (_obs->writeBits((_hasher != nullptr) ? 1 : 0, 1) != 1)
-        throw IOException("Cannot write checksum to header", Error::ERR_WRITE_FILE);
+    if (_dedup != nullptr) {
+        delete _dedup;
+        _dedup = nullptr;
+    }
 
-    if (_obs->writeBits(_entropyType, 5) != 5)
-        throw IOException("Cannot write entropy type to header", Error::ERR_WRITE_FILE);
+    if (_deallocateBufferPool == true)
+        delete _bufferPool;
 
-    if (_obs->writeBits(_transformType, 48) != 48)
-        throw IOException("Cannot write transform types to header", Error::ERR_WRITE_FILE);
+    if (_deallocateCodecs == true)
+        delete _codecs;
+
+#ifdef CONCURRENCY_ENABLED
+    if (_deallocatePool == true)
+        delete _pool;
+#endif
+}
 
-    if (_obs->writeBits(_blockSize >> 4, 28) != 28)
-        throw IOException("Cannot write block size to header", Error::ERR_WRITE_FILE);
+void CompressedOutputStream::writeHeader() THROW
+{
+    StreamHeader header;
+    header._checksum = (_hasher32 != nullptr) ? 32 : ((_hasher64 != nullptr) ? 64 : 0);
+    header._entropyType = _entropyType;
+    header._transformType = _transformType;
+    header._blockSize = _blockSize;
+    header._nbInputBlocks = _nbInputBlocks;
+    header._index = _blockIndex != nullptr;
+    header._dedup = _dedup != nullptr;
+    const Dictionary* dict = _ctx.getDictionary();
+    header._dictionary = dict != nullptr;
+    header._dictionaryId = (dict != nullptr) ? dict->getId() : 0;
+    header.write(*_obs);
+}
 
-    if (_obs->writeBits(_nbInputBlocks, 6) != 6)
-        throw IOException("Cannot write number of blocks to header", Error::ERR_WRITE_FILE);
+// Write the block index after the end block (and the digest). The trailer (index offset +
+// index type) lets a reader locate the index from the end of the stream.
+void CompressedOutputStream::writeIndex() THROW
+{
+    const uint64 indexOffset = _obs->written() >> 3;
+    _obs->writeBits(uint64(_blockIndex->size()), 32);
+
+    for (uint i = 0; i < _blockIndex->size(); i++) {
+        const BlockIndexEntry& e = (*_blockIndex)[i];
+        _obs->writeBits(e._offset, 64);
+        _obs->writeBits(e._compressedOffset, 64);
+        _obs->writeBits(e._size, 32);
+        _obs->writeBits(e._compressedSize, 32);
+    }
 
-    if (_obs->writeBits(uint64(0), 3) != 3)
-        throw IOException("Cannot write reserved bits to header", Error::ERR_WRITE_FILE);
+    _obs->writeBits(indexOffset, 64);
+    _obs->writeBits(BlockIndexEntry::INDEX_TYPE, 32);
 }
 
 bool CompressedOutputStream::addListener(Listener& bl)
@@ -232,10 +390,15 @@ ostream& CompressedOutputStream::write(const char* data, streamsize length) THRO
     int off = 0;
 
     while (remaining > 0) {
-        // Limit to number of available bytes in buffer
-        const int lenChunk = (_sa->_index + remaining < _sa->_length) ? remaining : _sa->_length - _sa->_index;
+        // Limit to number of available bytes in block
+        const int avail = min(_sa->_length, _blockSize) - _sa->_index;
+        const int lenChunk = (remaining < avail) ? remaining : avail;
 
         if (lenChunk > 0) {
+            // First pending byte: the auto flush delay starts now
+            if (_sa->_index == 0)
+                _flushClock.start();
+
             // Process a chunk of in-buffer data. No access to bitstream required
             memcpy(&_sa->_array[_sa->_index], &data[off], lenChunk);
             _sa->_index += lenChunk;
@@ -252,15 +415,29 @@ ostream& CompressedOutputStream::write(const char* data, streamsize length) THRO
         remaining--;
     }
 
+    if (_flushInterval > 0)
+        poll();
+
     return *this;
 }
 
 ostream& CompressedOutputStream::put(char c) THROW
 {
+    if (_closed.load() == true)
+        throw ios_base::failure("Stream closed");
+
     try {
-        // If the buffer is full, time to encode
-        if (_sa->_index >= _sa->_length)
-            processBlock(false);
+        // If the block is full, time to encode
+        if (_sa->_index >= _blockSize)
+            processBlock();
+
+        if (_sa->_index >= _sa->_length) {
+            // Lazy instantiation of the block buffer
+            _bufferPool->reserve(*_sa, _blockSize, _sa->_index);
+        }
+
+        if (_sa->_index == 0)
+            _flushClock.start();
 
         _sa->_array[_sa->_index++] = byte(c);
         return *this;
@@ -271,10 +448,114 @@ ostream& CompressedOutputStream::put(char c) THROW
     }
 }
 
-ostream& CompressedOutputStream::flush()
+ostream& CompressedOutputStream::writeBlock(byte* data, int length) THROW
 {
-    // Let the bitstream of the entropy encoder flush itself when needed
-    return *this;
+    if (data == nullptr)
+        throw invalid_argument("Invalid null block");
+
+    if ((length < 0) || (length > _blockSize)) {
+        stringstream ss;
+        ss << "Invalid block length: " << length << " (must be in [0.." << _blockSize << "])";
+        throw invalid_argument(ss.str());
+    }
+
+    if (_closed.load() == true) {
+        delete[] data;
+        throw ios_base::failure("Stream closed");
+    }
+
+    try {
+        processBlock();
+    }
+    catch (exception& e) {
+        delete[] data;
+        setstate(ios::badbit);
+        throw ios_base::failure(e.what());
+    }
+
+    try {
+        // The block becomes the input buffer of the current slot
+        _bufferPool->release(_sa->_array, _sa->_length);
+        _sa->_array = data;
+        _sa->_length = length;
+        _sa->_index = length;
+        processBlock();
+        return *this;
+    }
+    catch (exception& e) {
+        setstate(ios::badbit);
+        throw ios_base::failure(e.what());
+    }
+}
+
+ostream& CompressedOutputStream::writeBorrowed(const byte* data, int64 length) THROW
+{
+    if ((data == nullptr) && (length != 0))
+        throw invalid_argument("Invalid null data");
+
+    if (length < 0)
+        throw invalid_argument("Invalid data length (must be at least 0)");
+
+    if (_closed.load() == true)
+        throw ios_base::failure("Stream closed");
+
+    try {
+        processBlock();
+
+        while (length > 0) {
+            const int n = (length < int64(_blockSize)) ? int(length) : _blockSize;
+            processBlock(data, n);
+            data += n;
+            length -= n;
+        }
+
+        return *this;
+    }
+    catch (exception& e) {
+        setstate(ios::badbit);
+        throw ios_base::failure(e.what());
+    }
+}
+
+ostream& CompressedOutputStream::flush() THROW
+{
+    if (_closed.load() == true)
+        return *this;
+
+    try {
+        processBlock();
+
+#ifdef CONCURRENCY_ENABLED
+        // All the blocks must be in the shared bitstream
+        waitForBlocks(0);
+#endif
+
+        // Blocks are byte aligned: no bits are left behind in the bitstream
+        if (_initialized.load() == true)
+            _obs->sync();
+
+        return *this;
+    }
+    catch (exception& e) {
+        setstate(ios::badbit);
+        throw ios_base::failure(e.what());
+    }
+}
+
+// Flush if the oldest data waiting in the block being filled is too old
+int CompressedOutputStream::poll() THROW
+{
+    if ((_flushInterval <= 0) || (_closed.load() == true) || (_sa->_index == 0))
+        return -1;
+
+    _flushClock.stop();
+    const double elapsed = _flushClock.elapsed();
+
+    if (elapsed < double(_flushInterval))
+        return _flushInterval - int(elapsed);
+
+    flush();
+    return -1;
 }
 
 void CompressedOutputStream::close() THROW
@@ -282,13 +563,28 @@ void CompressedOutputStream::close() THROW
     if (_closed.exchange(true, memory_order_acquire))
         return;
 
-    if (_sa->_index > 0)
-        processBlock(true);
+    processBlock();
+
+#ifdef CONCURRENCY_ENABLED
+    waitForBlocks(0);
+#endif
 
     try {
-        // Write end block of size 0
-        _obs->writeBits(uint64(COPY_BLOCK_MASK), 8);
-        _obs->writeBits(uint64(0), 8);
+        // Write the header even if the stream is empty (the empty stream is
+        // decodable and the index is located from the header)
+        if (!_initialized.exchange(true, memory_order_acquire))
+            writeHeader();
+
+        // Write end block (block length of 0)
+        _obs->writeBits(uint64(0), 32);
+
+        // Then the digest of the block checksums (if any)
+        if ((_hasher32 != nullptr) || (_hasher64 != nullptr))
+            _obs->writeBits(_digest.value(), 64);
+
+        if (_blockIndex != nullptr)
+            writeIndex();
+
         _obs->close();
     }
     catch (exception& e) {
@@ -298,18 +594,20 @@ void CompressedOutputStream::close() THROW
 
     setstate(ios::eofbit);
 
-    // Release resources
-    // Force error on any subsequent write attempt
-    delete[] _sa->_array;
-    _sa->_array = new byte[0];
-    _sa->_length = 0;
-    _sa->_index = -1;
+    // Release resources (the buffers can be reused by another stream)
+    for (int i = 0; i < 2 * _nbSlots; i++)
+        _bufferPool->release(*_buffers[i]);
 
-    for (int i = 0; i < 2 * _jobs; i++) {
-        delete[] _buffers[i]->_array;
-        _buffers[i]->_array = new byte[0];
-        _buffers[i]->_length = 0;
+    for (int i = 0; i < _nbSlots; i++) {
+        if (_bitstreams[i] != nullptr) {
+            delete _bitstreams[i];
+            _bitstreams[i] = nullptr;
+        }
     }
+
+    // A shared cache keeps the codecs for the next stream
+    if (_deallocateCodecs == true)
+        _codecs->clear();
 }
 
 streampos CompressedOutputStream::tellp()
@@ -323,126 +621,139 @@ ostream& CompressedOutputStream::seekp(streampos) THROW
     throw ios_base::failure("Not supported");
 }
 
-void CompressedOutputStream::processBlock(bool force) THROW
+// Dispatch the block being filled (or a borrowed block) and switch to the
+// next slot. With several jobs, the block is encoded asynchronously and up to
+// _maxBlocks blocks are in flight. The encoded blocks are committed in order.
+void CompressedOutputStream::processBlock(const byte* block, int blockLength) THROW
 {
-    if (force == false) { 
-        const int bufSize = min(_jobs, max(int(_nbInputBlocks), 1)) * _blockSize;
-
-        if (_sa->_length < bufSize) {
-            // Grow byte array until max allowed
-            byte* buf = new byte[bufSize];
-            memcpy(buf, _sa->_array, _sa->_length);
-            delete[] _sa->_array;
-            _sa->_array = buf;
-            _sa->_length = bufSize;
-            return;
-        }
-    }
+    // A borrowed block is encoded from its own memory, the input buffer of
+    // the slot only holds intermediate data
+    const int length = (block != nullptr) ? blockLength : _sa->_index;
 
-    if (_sa->_index == 0)
+    if (length == 0)
         return;
 
     if (!_initialized.exchange(true, memory_order_acquire))
         writeHeader();
 
-    vector<EncodingTask<EncodingTaskResult>*> tasks;
+    EncodingTask<EncodingTaskResult>* task = nullptr;
 
     try {
+#ifdef CONCURRENCY_ENABLED
+        // Bound the number of blocks in flight
+        if (_nbSlots > 1)
+            waitForBlocks(_maxBlocks - 1);
+
+        if ((_jobs > 1) && (_pool == nullptr)) {
+            // Lazy creation of a pool reused by all subsequent blocks (also
+            // used by the transforms of a block)
+            _pool = new ThreadPool(_jobs);
+            _deallocatePool = true;
+        }
+#endif
 
-        // Protect against future concurrent modification of the list of block listeners
-        vector<Listener*> blockListeners(_listeners);
-        const int dataLength = _sa->_index;
-        _sa->_index = 0;
-        int firstBlockId = _blockId.load();
-
-        // Create as many tasks as required
-        for (int jobId = 0; jobId < _jobs; jobId++) {
-            const int sz = (_sa->_index + _blockSize > dataLength) ? dataLength - _sa->_index : _blockSize;
-
-            if (sz == 0)
-                break;
-
-            Context copyCtx(_ctx);
-            _buffers[2 * jobId]->_index = 0;
-            _buffers[2 * jobId + 1]->_index = 0;
-
-            // Grow encoding buffer if required
-            if (_buffers[2 * jobId]->_length < sz) {
-                delete[] _buffers[2 * jobId]->_array;
-                _buffers[2 * jobId]->_array = new byte[sz];
-                _buffers[2 * jobId]->_length = sz;
-            }
+        const int blockId = _blockId.load() + 1;
+        const int slot = (blockId - 1) % _nbSlots;
 
-            memcpy(&_buffers[2 * jobId]->_array[0], &_sa->_array[_sa->_index], sz);
+        if (_bitstreams[slot] == nullptr)
+            _bitstreams[slot] = new MemoryOutputBitStream(MemoryOutputBitStream::DEFAULT_BUFFER_SIZE, _bufferPool);
 
-            EncodingTask<EncodingTaskResult>* task = new EncodingTask<EncodingTaskResult>(_buffers[2 * jobId],
-                _buffers[2 * jobId + 1], sz, _transformType,
-                _entropyType, firstBlockId + jobId + 1,
-                _obs, _hasher, &_blockId,
-                blockListeners, copyCtx);
-            tasks.push_back(task);
-            _sa->_index += sz;
-        }
+        Context copyCtx(_ctx);
+        copyCtx.setPool(_pool);
+        _sa->_index = 0;
+        _buffers[2 * slot + 1]->_index = 0;
 
-        if (tasks.size() == 1) {
+        // Protect against future concurrent modification of the list of block listeners
+        // (the task copies the list)
+        task = new EncodingTask<EncodingTaskResult>(_sa,
+            _buffers[2 * slot + 1], length, block, _transformType,
+            _entropyType, blockId, _dedup, &_dedupQueue,
+            _obs, _bitstreams[slot], _hasher32, _hasher64,
+            ((_hasher32 != nullptr) || (_hasher64 != nullptr)) ? &_digest : nullptr, &_commitQueue,
+            _blockIndex, _offset, _codecs, _listeners, copyCtx);
+        _blockId = blockId;
+        _offset += uint64(length);
+
+        // Next block (the task moves the index of its input buffer)
+        _sa = _buffers[2 * (blockId % _nbSlots)];
+
+        if (_nbSlots == 1) {
             // Synchronous call
-            EncodingTask<EncodingTaskResult>* task = tasks.back();
-            tasks.pop_back();
             EncodingTaskResult res = task->run();
+            delete task;
+            task = nullptr;
+            _commitQueue.check();
 
             if (res._error != 0)
-                throw IOException(res._msg, res._error); // deallocate in catch block
-
-            delete task;
+                throw IOException(res._msg, res._error);
         }
 #ifdef CONCURRENCY_ENABLED
         else {
-            vector<future<EncodingTaskResult> > futures;
-
-            // Register task futures and launch tasks in parallel
-            for (uint i = 0; i < tasks.size(); i++) {
-                futures.push_back(async(launch::async, &EncodingTask<EncodingTaskResult>::run, tasks[i]));
-            }
-
-            // Wait for tasks completion and check results
-            for (uint i = 0; i < tasks.size(); i++) {
-                EncodingTaskResult status = futures[i].get();
-
-                if (status._error != 0)
-                    throw IOException(status._msg, status._error); // deallocate in catch block
-            }
+            _futures.push_back(_pool->schedule(&EncodingTask<EncodingTaskResult>::run, task));
+            _tasks.push_back(task);
+            task = nullptr;
         }
-
-        for (vector<EncodingTask<EncodingTaskResult>*>::iterator it = tasks.begin(); it != tasks.end(); it++)
-            delete *it;
-
-        tasks.clear();
 #endif
+
         _sa->_index = 0;
     }
     catch (IOException& e) {
-        for (vector<EncodingTask<EncodingTaskResult>*>::iterator it = tasks.begin(); it != tasks.end(); it++)
-            delete *it;
+        if (task != nullptr)
+            delete task;
 
-        tasks.clear();
         throw e;
     }
     catch (BitStreamException& e) {
-        for (vector<EncodingTask<EncodingTaskResult>*>::iterator it = tasks.begin(); it != tasks.end(); it++)
-            delete *it;
+        if (task != nullptr)
+            delete task;
 
-        tasks.clear();
         throw IOException(e.what(), e.error());
     }
     catch (exception& e) {
-        for (vector<EncodingTask<EncodingTaskResult>*>::iterator it = tasks.begin(); it != tasks.end(); it++)
-            delete *it;
+        if (task != nullptr)
+            delete task;
 
-        tasks.clear();
         throw IOException(e.what(), Error::ERR_UNKNOWN);
     }
 }
 
+#ifdef CONCURRENCY_ENABLED
+// Wait until at most 'maxPending' blocks are in flight (oldest first).
+// On error, wait for all the blocks in flight before reporting it.
+void CompressedOutputStream::waitForBlocks(int maxPending) THROW
+{
+    int error = 0;
+    string msg;
+
+    while (_futures.empty() == false) {
+        if ((int(_futures.size()) <= maxPending) && (error == 0)
+            && (_commitQueue.next() != OrderedCommitQueue::CANCELLED))
+            break;
+
+        EncodingTaskResult res = _futures.front().get();
+        _futures.pop_front();
+        delete _tasks.front();
+        _tasks.pop_front();
+
+        if ((res._error != 0) && (error == 0)) {
+            error = res._error;
+            msg = res._msg;
+        }
+    }
+
+    try {
+        // Report a failure to write to the shared bitstream first
+        _commitQueue.check();
+    }
+    catch (BitStreamException& e) {
+        throw IOException(e.what(), e.error());
+    }
+
+    if (error != 0)
+        throw IOException(msg, error);
+}
+#endif
+
 // Return the number of bytes written so far
 uint64 CompressedOutputStream::getWritten()
 {
@@ -459,177 +770,218 @@ void CompressedOutputStream::notifyListeners(vector<Listener*>& listeners, const
 
 template <class T>
 EncodingTask<T>::EncodingTask(SliceArray<byte>* iBuffer, SliceArray<byte>* oBuffer, int length,
-    uint64 transformType, uint32 entropyType, int blockId,
-    OutputBitStream* obs, XXHash32* hasher,
-    atomic_int* processedBlockId, vector<Listener*>& listeners,
+    const byte* block, uint64 transformType, uint32 entropyType, int blockId,
+    DedupWindow* window, OrderedCommitQueue* windowQueue, OutputBitStream* obs, MemoryOutputBitStream* mobs,
+    XXHash32* hasher32, XXHash64* hasher64, StreamDigest* digest,
+    OrderedCommitQueue* commitQueue, vector<BlockIndexEntry>* index,
+    uint64 offset, CodecCache* codecs, vector<Listener*>& listeners,
     Context& ctx)
-    : _ctx(ctx)
+    : _view(const_cast<byte*>(block), length, 0)
+    , _ctx(ctx)
 {
-    _data = iBuffer;
+    if (block != nullptr) {
+        // The transforms only read the borrowed data
+        _data = &_view;
+        _scratch = iBuffer;
+    }
+    else {
+        _data = iBuffer;
+        _scratch = nullptr;
+    }
+
     _buffer = oBuffer;
     _blockLength = length;
     _transformType = transformType;
     _entropyType = entropyType;
     _blockId = blockId;
+    _window = window;
+    _windowQueue = windowQueue;
     _obs = obs;
-    _hasher = hasher;
+    _mobs = mobs;
+    _hasher32 = hasher32;
+    _hasher64 = hasher64;
+    _hashType = (hasher32 != nullptr) ? Event::SIZE_32 : ((hasher64 != nullptr) ? Event::SIZE_64 : Event::NO_HASH);
+    _digest = digest;
     _listeners = listeners;
-    _processedBlockId = processedBlockId;
+    _commitQueue = commitQueue;
+    _blockIndex = index;
+    _offset = offset;
+    _codecs = codecs;
 }
 
-// Encode mode + transformed entropy coded data
-// mode | 0b10000000 => copy block
-//      | 0b0yy00000 => size(size(block))-1
-//      | 0b000y0000 => 1 if more than 4 transforms
-//  case 4 transforms or less
-//      | 0b0000yyyy => transform sequence skip flags (1 means skip)
-//  case more than 4 transforms
-//      | 0b00000000
-//      then 0byyyyyyyy => transform sequence skip flags (1 means skip)
 template <class T>
 T EncodingTask<T>::run() THROW
 {
-    EntropyEncoder* ee = nullptr;
+    // Reuse the transforms and entropy models of a previous block
+    CodecSet* codecs = _codecs->acquire();
+    T res = encode(*codecs);
+    _codecs->release(codecs);
+    return res;
+}
 
+// Encode the block (see BlockCodec for the layout) to the block bitstream,
+// then commit it
+template <class T>
+T EncodingTask<T>::encode(CodecSet& codecs) THROW
+{
     try {
-        byte mode = byte(0);
-        int postTransformLength = _blockLength;
-        int checksum = 0;
+        uint64 checksum = 0;
 
         // Compute block checksum
-        if (_hasher != nullptr)
-            checksum = _hasher->hash(&_data->_array[_data->_index], _blockLength);
+        if (_hasher32 != nullptr)
+            checksum = uint64(uint32(_hasher32->hash(&_data->_array[_data->_index], _blockLength)));
+        else if (_hasher64 != nullptr)
+            checksum = _hasher64->hash(&_data->_array[_data->_index], _blockLength);
 
         if (_listeners.size() > 0) {
             // Notify before transform
             Event evt(Event::BEFORE_TRANSFORM, _blockId,
-                int64(_blockLength), checksum, _hasher != nullptr, clock());
+                int64(_blockLength), checksum, _hashType, Event::now());
 
             CompressedOutputStream::notifyListeners(_listeners, evt);
         }
 
-        if (_blockLength <= CompressedOutputStream::SMALL_BLOCK_SIZE) {
-            _transformType = FunctionFactory<byte>::NONE_TYPE;
-            _entropyType = EntropyCodecFactory::NONE_TYPE;
-            mode |= CompressedOutputStream::COPY_BLOCK_MASK;
-        }
-        else {
-            if (_ctx.has("skipBlocks")) {
-                string str = _ctx.getString("skipBlocks");
-                transform(str.begin(), str.end(), str.begin(), ::toupper);
-
-                if (str == STR_TRUE) {
-                   uint histo[256];
-                   const int entropy = EntropyUtils::computeFirstOrderEntropy1024(&_data->_array[_data->_index], _blockLength, histo);
-                   //_ctx.putString("histo0", toString(histo, 256));
-
-                   if (entropy >= EntropyUtils::INCOMPRESSIBLE_THRESHOLD) {
-                       _transformType = FunctionFactory<byte>::NONE_TYPE;
-                       _entropyType = EntropyCodecFactory::NONE_TYPE;
-                       mode |= CompressedOutputStream::COPY_BLOCK_MASK;
-                   }
-                }
-            }
-        }
+        const int checksumSize = (_hashType == Event::SIZE_32) ? 32 : ((_hashType == Event::SIZE_64) ? 64 : 0);
+        _mobs->reset();
 
-        _ctx.putInt("size", _blockLength);
-        TransformSequence<byte>* transform = FunctionFactory<byte>::newFunction(_ctx, _transformType);
-        int requiredSize = transform->getMaxEncodedLength(_blockLength);
+        const int reference = (_window != nullptr) ? findReference(checksum) : 0;
 
-        if (_buffer->_length < requiredSize) {
-            _buffer->_length = requiredSize;
-            delete[] _buffer->_array;
-            _buffer->_array = new byte[_buffer->_length];
+        if (reference < 0) {
+            // A previous block failed
+            _commitQueue->cancel();
+            return T(_blockId, Error::ERR_PROCESS_BLOCK, "Block deduplication cancelled");
         }
 
-        // Forward transform (ignore error, encode skipFlags)
-        _buffer->_index = 0;
-
-        // _data->_length is at least _blockLength
-        transform->forward(*_data, *_buffer, _blockLength);
-        const int nbFunctions = transform->getNbFunctions();
-        const byte skipFlags = transform->getSkipFlags();
-        delete transform;
-        postTransformLength = _buffer->_index;
-
-        if (postTransformLength < 0)
-            return T(_blockId, Error::ERR_WRITE_FILE, "Invalid transform size");
-
-        _ctx.putInt("size", postTransformLength);
-        int dataSize = 0;
+        if (reference != 0) {
+            // Duplicate block: no transform, no entropy coding
+            BlockCodec::encodeReference(*_mobs, _blockLength, reference, checksum, checksumSize);
+            return commit(checksum);
+        }
 
-        for (uint64 n = 0xFF; n < uint64(postTransformLength); n <<= 8)
-            dataSize++;
+        bool copy = _blockLength <= BlockCodec::SMALL_BLOCK_SIZE;
 
-        if (dataSize > 3)
-            return T(_blockId, Error::ERR_WRITE_FILE, "Invalid block data length");
+        if ((copy == false) && (_ctx.has("skipBlocks"))) {
+            string str = _ctx.getString("skipBlocks");
+            transform(str.begin(), str.end(), str.begin(), ::toupper);
 
-        // Record size of 'block size' - 1 in bytes
-        mode |= byte((dataSize & 0x03) << 5);
-        dataSize++;
+            if (str == STR_TRUE) {
+                uint histo[256];
+                const int entropy = EntropyUtils::computeFirstOrderEntropy1024(&_data->_array[_data->_index], _blockLength, histo);
+                //_ctx.putString("histo0", toString(histo, 256));
+                copy = entropy >= EntropyUtils::INCOMPRESSIBLE_THRESHOLD;
+            }
+        }
 
-        if (_listeners.size() > 0) {
-            // Notify after transform
-            Event evt(Event::AFTER_TRANSFORM, _blockId,
-                int64(postTransformLength), checksum, _hasher != nullptr, clock());
+        // The intermediate data goes to the input buffer of the slot if the
+        // data is borrowed (the borrowed input must not be written)
+        vector<Listener*>* listeners = (_listeners.size() > 0) ? &_listeners : nullptr;
+        BlockResult res = BlockCodec::encode(codecs, _ctx, *_data, *_buffer, _scratch, _blockLength,
+            _transformType, _entropyType, copy, checksum, checksumSize, *_mobs, _blockId, listeners);
 
-            CompressedOutputStream::notifyListeners(_listeners, evt);
+        if (res._error != 0) {
+            // The blocks after this one must not be committed
+            _commitQueue->cancel();
+            return T(_blockId, res._error, res._msg);
         }
 
-        // Lock free synchronization
-        while (_processedBlockId->load() != _blockId - 1) {
-            // Busy loop
-        }
+        return commit(checksum);
+    }
+    catch (exception& e) {
+        // The blocks after this one must not be committed
+        _commitQueue->cancel();
 
-        // Write block 'header' (mode + compressed length);
-        uint64 written = _obs->written();
+        if (_windowQueue != nullptr)
+            _windowQueue->cancel();
 
-        if (((mode & CompressedOutputStream::COPY_BLOCK_MASK) != byte(0)) || (nbFunctions <= 4)) {
-            mode |= byte(skipFlags >> 4);
-            _obs->writeBits(uint64(mode), 8);
-        }
-        else {
-            mode |= CompressedOutputStream::TRANSFORMS_MASK;
-            _obs->writeBits(uint64(mode), 8);
-            _obs->writeBits(uint64(skipFlags), 8);
-        }
+        return T(_blockId, Error::ERR_PROCESS_BLOCK, e.what());
+    }
+}
 
-        _obs->writeBits(postTransformLength, 8 * dataSize);
+// Look for a block of the window equal to this block and return its distance
+// (0 if none, -1 if cancelled). The block is hashed concurrently with the
+// other tasks, but the window is looked up and updated in block order (the
+// decoder updates its window in the same order). The hash is also the block
+// checksum, if any.
+template <class T>
+int EncodingTask<T>::findReference(uint64 checksum)
+{
+    const byte* data = &_data->_array[_data->_index];
+    uint32 hash;
 
-        // Write checksum
-        if (_hasher != nullptr)
-            _obs->writeBits(checksum, 32);
+    if ((_hasher32 != nullptr) || (_hasher64 != nullptr)) {
+        hash = uint32(checksum);
+    }
+    else {
+        XXHash32 hasher(CompressedOutputStream::BITSTREAM_TYPE);
+        hash = uint32(hasher.hash(const_cast<byte*>(data), _blockLength));
+    }
 
-        if (_listeners.size() > 0) {
-            // Notify before entropy
-            Event evt(Event::BEFORE_ENTROPY, _blockId,
-                int64(postTransformLength), checksum, _hasher != nullptr, clock());
+    if (_windowQueue->wait(_blockId) == false)
+        return -1;
 
-            CompressedOutputStream::notifyListeners(_listeners, evt);
-        }
+    int reference = 0;
 
-        // Each block is encoded separately
-        // Rebuild the entropy encoder to reset block statistics
-        ee = EntropyCodecFactory::newEncoder(*_obs, _ctx, _entropyType);
+    try {
+        const int refId = (_blockLength > BlockCodec::SMALL_BLOCK_SIZE) ? _window->find(data, _blockLength, hash) : -1;
 
-        // Entropy encode block
-        if (ee->encode(_buffer->_array, 0, postTransformLength) != postTransformLength)
-            return T(_blockId, Error::ERR_PROCESS_BLOCK, "Entropy coding failed");
+        if (refId > 0) {
+            reference = _blockId - refId;
+            _window->touch(refId);
+        }
+        else {
+            _window->add(_blockId, data, _blockLength, hash);
+        }
+    }
+    catch (exception&) {
+        _windowQueue->cancel();
+        throw;
+    }
 
-        // Dispose before processing statistics. Dispose may write to the bitstream
-        delete ee;
-        ee = nullptr;
+    _windowQueue->commit(_blockId);
+    return reference;
+}
 
-        // After completion of the entropy coding, increment the block id.
-        // It unfreezes the task processing the next block (if any)
-        (*_processedBlockId)++;
+// Append the encoded block to the shared bitstream (in block order)
+template <class T>
+T EncodingTask<T>::commit(uint64 checksum)
+{
+    try {
+        // Pad the block to a byte boundary
+        _mobs->close();
+        const uint64 written = _mobs->written() >> 3;
+
+        // Append the block length (in bytes) and the block to the shared
+        // bitstream in block order. The length lets the decoder read the
+        // block without entropy decoding it.
+        // If a previous block is still pending, the copy is queued and the
+        // task completes at once. The copy is then done by the task that
+        // commits the previous block.
+        // The block index and the stream digest (if any) are also updated
+        // in block order.
+        OutputBitStream* obs = _obs;
+        const MemoryOutputBitStream* mobs = _mobs;
+        vector<BlockIndexEntry>* index = _blockIndex;
+        StreamDigest* digest = _digest;
+        const uint64 offset = _offset;
+        const uint32 size = uint32(_blockLength);
+
+        _commitQueue->commit(_blockId, [obs, mobs, written, index, digest, checksum, offset, size]() {
+            if (index != nullptr)
+                index->push_back(BlockIndexEntry(offset, obs->written() >> 3, size, uint32(written)));
+
+            if (digest != nullptr)
+                digest->add(checksum);
+
+            obs->writeBits(written, 32);
+            mobs->copyTo(*obs, written << 3);
+        });
 
         if (_listeners.size() > 0) {
             // Notify after entropy
-            const int w = int((_obs->written() - written) / 8);
+            const int w = int(written);
 
             Event evt(Event::AFTER_ENTROPY,
-                int64(_blockId), w, checksum, _hasher != nullptr, clock());
+                int64(_blockId), w, checksum, _hashType, Event::now());
 
             CompressedOutputStream::notifyListeners(_listeners, evt);
         }
@@ -637,13 +989,8 @@ T EncodingTask<T>::run() THROW
         return T(_blockId, 0, "Success");
     }
     catch (exception& e) {
-        // Make sure to unfreeze next block
-        if (_processedBlockId->load() == _blockId - 1)
-            (*_processedBlockId)++;
-
-        if (ee != nullptr)
-            delete ee;
-
+        // The blocks after this one must not be committed
+        _commitQueue->cancel();
         return T(_blockId, Error::ERR_PROCESS_BLOCK, e.what());
     }
 }
@@ -16,15 +16,27 @@ limitations under the License.
 #ifndef _CompressedOutputStream_
 #define _CompressedOutputStream_
 
+#include <deque>
 #include <string>
 #include <vector>
+#include "../BufferPool.hpp"
 #include "../concurrent.hpp"
 #include "../Context.hpp"
 #include "../Listener.hpp"
 #include "../OutputStream.hpp"
 #include "../OutputBitStream.hpp"
 #include "../SliceArray.hpp"
+#include "../util.hpp"
+#include "../bitstream/DefaultOutputBitStream.hpp"
+#include "../bitstream/MemoryOutputBitStream.hpp"
 #include "../util/XXHash32.hpp"
+#include "../util/XXHash64.hpp"
+#include "BlockCodec.hpp"
+#include "BlockIndex.hpp"
+#include "CodecCache.hpp"
+#include "DedupWindow.hpp"
+#include "StreamDigest.hpp"
+#include "StreamHeader.hpp"
 
 namespace kanzi {
 
@@ -59,29 +71,54 @@ namespace kanzi {
    };
 
    // A task used to encode a block
-   // Several tasks may run in parallel. The transforms can be computed concurrently
-   // but the entropy encoding is sequential since all tasks share the same bitstream.
+   // Several tasks may run in parallel. Each task transforms and entropy codes its
+   // block to its own bitstream. The bytes are then appended to the shared bitstream
+   // in block order, prefixed with their length.
    template <class T>
    class EncodingTask : public Task<T> {
    private:
        SliceArray<byte>* _data;
        SliceArray<byte>* _buffer;
+       SliceArray<byte>* _scratch; // input buffer of the slot if the data is borrowed
+       SliceArray<byte> _view; // borrowed data
        int _blockLength;
        uint64 _transformType;
        uint32 _entropyType;
        int _blockId;
+       DedupWindow* _window; // null if no block deduplication
+       OrderedCommitQueue* _windowQueue; // window updates in block order
        OutputBitStream* _obs;
-       XXHash32* _hasher;
-       atomic_int* _processedBlockId;
+       MemoryOutputBitStream* _mobs;
+       XXHash32* _hasher32;
+       XXHash64* _hasher64;
+       Event::HashType _hashType;
+       StreamDigest* _digest; // null if no block checksum
+       OrderedCommitQueue* _commitQueue;
+       vector<BlockIndexEntry>* _blockIndex;
+       uint64 _offset;
+       CodecCache* _codecs;
        vector<Listener*> _listeners;
 	   Context _ctx;
 
+       T encode(CodecSet& codecs) THROW;
+
+       int findReference(uint64 checksum);
+
+       T commit(uint64 checksum);
+
    public:
+       // If block is not null, the data is read from it (without modifying it)
+       // instead of iBuffer, which only holds intermediate data.
+       // If window is not null, a block equal to a block of the window is
+       // encoded as a reference to it. The window is looked up and updated
+       // in block order (see windowQueue).
        EncodingTask(SliceArray<byte>* iBuffer, SliceArray<byte>* oBuffer, int length,
-           uint64 transformType, uint32 entropyType, int blockId,
-           OutputBitStream* obs, XXHash32* hasher,
-           atomic_int* processedBlockId, vector<Listener*>& listeners,
-		   Context& ctx);
+           const byte* block, uint64 transformType, uint32 entropyType, int blockId,
+           DedupWindow* window, OrderedCommitQueue* windowQueue, OutputBitStream* obs, MemoryOutputBitStream* mobs,
+           XXHash32* hasher32, XXHash64* hasher64, StreamDigest* digest,
+           OrderedCommitQueue* commitQueue, vector<BlockIndexEntry>* index,
+           uint64 offset, CodecCache* codecs, vector<Listener*>& listeners,
+           Context& ctx);
 
        ~EncodingTask(){};
 
@@ -92,41 +129,79 @@ namespace kanzi {
        friend class EncodingTask<EncodingTaskResult>;
 
    private:
-       static const int BITSTREAM_TYPE = 0x4B414E5A; // "KANZ"
-       static const int BITSTREAM_FORMAT_VERSION = 9;
+       static const int BITSTREAM_TYPE = StreamHeader::BITSTREAM_TYPE;
        static const int DEFAULT_BUFFER_SIZE = 256 * 1024;
-       static const byte COPY_BLOCK_MASK = byte(0x80);
-       static const byte TRANSFORMS_MASK = byte(0x10);
-       static const int MIN_BITSTREAM_BLOCK_SIZE = 1024;
-       static const int MAX_BITSTREAM_BLOCK_SIZE = 1024 * 1024 * 1024;
-       static const int SMALL_BLOCK_SIZE = 15;
+       static const int MIN_BITSTREAM_BLOCK_SIZE = StreamHeader::MIN_BITSTREAM_BLOCK_SIZE;
+       static const int MAX_BITSTREAM_BLOCK_SIZE = StreamHeader::MAX_BITSTREAM_BLOCK_SIZE;
        static const int MAX_CONCURRENCY = 64;
 
        int _blockSize;
        uint8 _nbInputBlocks;
-       XXHash32* _hasher;
-       SliceArray<byte>* _sa; // for all blocks
-       SliceArray<byte>** _buffers; // input & output per block
+       XXHash32* _hasher32;
+       XXHash64* _hasher64;
+       StreamDigest _digest; // block checksums in block order
+       SliceArray<byte>* _sa; // block being filled (one of the input buffers)
+       SliceArray<byte>** _buffers; // input & output per block slot
+       MemoryOutputBitStream** _bitstreams; // encoded bits per block slot
+       int _maxBlocks; // max number of blocks in flight
+       int _nbSlots; // blocks in flight + block being filled
        uint32 _entropyType;
        uint64 _transformType;
-       OutputBitStream* _obs;
+       DefaultOutputBitStream* _obs;
        OutputStream& _os;
        atomic_bool _initialized;
        atomic_bool _closed;
        atomic_int _blockId;
+       OrderedCommitQueue _commitQueue;
+       CodecCache* _codecs; // transforms and entropy models reused by the tasks
+       bool _deallocateCodecs; // cache created by the stream ?
        int _jobs;
+       ThreadPool* _pool;
+       bool _deallocatePool; // pool created by the stream ?
+       BufferPool* _bufferPool;
+       bool _deallocateBufferPool; // buffer pool created by the stream ?
+       vector<BlockIndexEntry>* _blockIndex; // null if no block index
+       DedupWindow* _dedup; // null if no block deduplication
+       OrderedCommitQueue _dedupQueue; // blocks looking up the window in turn
+       uint64 _offset; // uncompressed bytes dispatched so far
+       int _flushInterval; // auto flush period in ms (0 means no auto flush)
+       Clock _flushClock; // started when the first byte entered the empty block
        vector<Listener*> _listeners;
 	   Context _ctx;
+#ifdef CONCURRENCY_ENABLED
+       deque<EncodingTask<EncodingTaskResult>*> _tasks; // blocks in flight
+       deque<future<EncodingTaskResult> > _futures;
+#endif
 
        void writeHeader() THROW;
 
-       void processBlock(bool force) THROW;
+       void writeIndex() THROW;
+
+       void processBlock(const byte* block = nullptr, int length = 0) THROW;
+
+       void waitForBlocks(int maxPending) THROW;
+
 
        static void notifyListeners(vector<Listener*>& listeners, const Event& evt);
 
    public:
-       CompressedOutputStream(OutputStream& os, const string& codec, const string& transform, int blockSize, int jobs, bool checksum);
+       // The optional thread pool and buffer pool (not owned) may be shared by
+       // several streams. If no thread pool is provided, the stream creates its
+       // own pool when jobs > 1. If no buffer pool is provided, the stream
+       // creates its own pool.
+       // If checksum is true, the blocks have a 32 bit checksum.
+       CompressedOutputStream(OutputStream& os, const string& codec, const string& transform,
+           int blockSize, int jobs, bool checksum, ThreadPool* pool = nullptr,
+           BufferPool* buffers = nullptr);
+
+       // Same as above with the size of the block checksums: 0 (no checksum),
+       // 32 or 64 bits.
+       CompressedOutputStream(OutputStream& os, const string& codec, const string& transform,
+           int blockSize, int jobs, int checksumSize, ThreadPool* pool = nullptr,
+           BufferPool* buffers = nullptr);
        
+       // The thread pool, buffer pool and codec cache (if any) are provided
+       // by the context
        CompressedOutputStream(OutputStream& os, Context& ctx);
 
        ~CompressedOutputStream();
@@ -139,7 +214,35 @@ namespace kanzi {
 
        ostream& put(char c) THROW;
 
-       ostream& flush();
+       // Hand over a block of at most the block size without copying it.
+       // The array (allocated with new[] or acquired from the buffer pool of
+       // the stream) is encoded in place and owned by the stream, unless
+       // invalid_argument is thrown. Data written before and not encoded yet
+       // is encoded first, as a smaller block.
+       ostream& writeBlock(byte* data, int length) THROW;
+
+       // Encode data without copying it, for instance from a memory mapped
+       // file. The data is split into blocks of the block size. It is never
+       // modified and must remain valid until close() returns. Data written
+       // before and not encoded yet is encoded first, as a smaller block.
+       ostream& writeBorrowed(const byte* data, int64 length) THROW;
+
+       // Encode the data written so far as a complete block (even if smaller
+       // than the block size) and write all the encoded blocks to the output
+       // stream, which is flushed. The data is then decodable without waiting
+       // for the next blocks. Flushing often reduces the compression ratio.
+       // With the Context key "flushInterval" (in ms), the stream flushes
+       // itself on write() and poll() when the oldest pending data is older
+       // than the interval.
+       ostream& flush() THROW;
+
+       // Flush if the oldest pending data is older than the flush interval.
+       // write() only checks the interval when it is called: a producer that
+       // may stay idle should call poll() periodically (EX: from its event
+       // loop or a timer of the producer thread, the stream is not thread
+       // safe). Return the delay (in ms) before poll() must be called again,
+       // or -1 if no data is pending or there is no flush interval.
+       int poll() THROW;
 
        streampos tellp();
 
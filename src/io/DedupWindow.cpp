@@ -0,0 +1,90 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cstring>
+#include "DedupWindow.hpp"
+
+using namespace kanzi;
+
+DedupWindow::DedupWindow(int blockSize)
+{
+    _capacity = (blockSize < WINDOW_SIZE) ? WINDOW_SIZE / blockSize : 1;
+}
+
+int DedupWindow::find(const byte data[], int length, uint32 hash) const
+{
+    auto range = _hashes.equal_range(hash);
+
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry& e = *_ids.at(it->second);
+
+        // Compare the data, the hash only selects the candidates
+        if ((int(e._data.size()) == length) && (memcmp(e._data.data(), &data[0], size_t(length)) == 0))
+            return e._blockId;
+    }
+
+    return -1;
+}
+
+const byte* DedupWindow::get(int blockId, int& length) const
+{
+    unordered_map<int, list<Entry>::iterator>::const_iterator it = _ids.find(blockId);
+
+    if (it == _ids.end())
+        return nullptr;
+
+    length = int(it->second->_data.size());
+    return it->second->_data.data();
+}
+
+bool DedupWindow::touch(int blockId)
+{
+    unordered_map<int, list<Entry>::iterator>::iterator it = _ids.find(blockId);
+
+    if (it == _ids.end())
+        return false;
+
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return true;
+}
+
+void DedupWindow::add(int blockId, const byte data[], int length, uint32 hash)
+{
+    if (int(_entries.size()) >= _capacity) {
+        // Evict the least recently used block and reuse its memory
+        list<Entry>::iterator last = prev(_entries.end());
+        auto range = _hashes.equal_range(last->_hash);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == last->_blockId) {
+                _hashes.erase(it);
+                break;
+            }
+        }
+
+        _ids.erase(last->_blockId);
+        _entries.splice(_entries.begin(), _entries, last);
+    }
+    else {
+        _entries.push_front(Entry());
+    }
+
+    Entry& e = _entries.front();
+    e._blockId = blockId;
+    e._hash = hash;
+    e._data.assign(&data[0], &data[length]);
+    _ids[blockId] = _entries.begin();
+    _hashes.insert(pair<uint32, int>(hash, blockId));
+}
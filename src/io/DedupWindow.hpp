@@ -0,0 +1,74 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _DedupWindow_
+#define _DedupWindow_
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "../types.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+
+   // Copies of the last distinct blocks of a stream, to encode a block equal
+   // to one of them as a reference (block deduplication, Context key "dedup").
+   // The encoder and the decoder apply the same operations in block order:
+   // add() for each block encoded normally, touch() for each reference. So
+   // the window of the decoder holds every block referenced by the encoder.
+   // The window holds WINDOW_SIZE bytes of blocks (at least one block) and
+   // evicts the least recently used block first.
+   class DedupWindow
+   {
+   public:
+       static const int WINDOW_SIZE = 64 * 1024 * 1024;
+
+       DedupWindow(int blockSize);
+
+       ~DedupWindow() {}
+
+       // Return the id of a block of the window equal to 'data' (with the
+       // given hash), or -1 if there is none.
+       int find(const byte data[], int length, uint32 hash) const;
+
+       // Return the content of a block of the window, or null if it has been
+       // evicted. The window may be read concurrently while not modified.
+       const byte* get(int blockId, int& length) const;
+
+       // Make the block the most recently used one. Return false if it is
+       // not in the window.
+       bool touch(int blockId);
+
+       // Add a copy of a block (the most recently used one)
+       void add(int blockId, const byte data[], int length, uint32 hash);
+
+   private:
+       struct Entry
+       {
+           int _blockId;
+           uint32 _hash;
+           vector<byte> _data;
+       };
+
+       list<Entry> _entries; // most recently used first
+       unordered_map<int, list<Entry>::iterator> _ids;
+       unordered_multimap<uint32, int> _hashes;
+       int _capacity; // max number of blocks
+   };
+}
+#endif
@@ -30,6 +30,7 @@ limitations under the License.
 #endif
 
 using namespace std;
+using namespace kanzi;
 
 class FileData {
    public:
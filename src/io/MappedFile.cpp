@@ -0,0 +1,163 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "MappedFile.hpp"
+#include "IOException.hpp"
+#include "../Error.hpp"
+
+#if defined(WIN32) || defined(_WIN32)
+   #ifndef WIN32_LEAN_AND_MEAN
+      #define WIN32_LEAN_AND_MEAN
+   #endif
+   #ifndef NOMINMAX
+      #define NOMINMAX
+   #endif
+   #include <windows.h>
+#else
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+#endif
+
+using namespace kanzi;
+
+#if defined(WIN32) || defined(_WIN32)
+
+MappedFile::MappedFile(const string& fileName) THROW
+{
+    _data = nullptr;
+    _size = 0;
+    _mapping = nullptr;
+    _file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (_file == INVALID_HANDLE_VALUE)
+        throw IOException("Cannot open file '" + fileName + "'", Error::ERR_OPEN_FILE);
+
+    LARGE_INTEGER size;
+
+    if (GetFileSizeEx(_file, &size) == 0) {
+        CloseHandle(_file);
+        throw IOException("Cannot get size of file '" + fileName + "'", Error::ERR_OPEN_FILE);
+    }
+
+    _size = int64(size.QuadPart);
+
+    // An empty file cannot be mapped
+    if (_size == 0)
+        return;
+
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+
+    if (_mapping != nullptr)
+        _data = static_cast<std::byte*>(MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0));
+
+    if (_data == nullptr) {
+        if (_mapping != nullptr)
+            CloseHandle(_mapping);
+
+        CloseHandle(_file);
+        throw IOException("Cannot map file '" + fileName + "'", Error::ERR_READ_FILE);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (_data != nullptr)
+        UnmapViewOfFile(_data);
+
+    if (_mapping != nullptr)
+        CloseHandle(_mapping);
+
+    CloseHandle(_file);
+}
+
+void MappedFile::willNeed(int64 offset, int64 length)
+{
+#if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0602)
+    if ((_data == nullptr) || (offset >= _size))
+        return;
+
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = &_data[offset];
+    range.NumberOfBytes = SIZE_T((offset + length > _size) ? _size - offset : length);
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    (void) offset;
+    (void) length;
+#endif
+}
+
+#else
+
+MappedFile::MappedFile(const string& fileName) THROW
+{
+    _data = nullptr;
+    _size = 0;
+    _fd = open(fileName.c_str(), O_RDONLY);
+
+    if (_fd < 0)
+        throw IOException("Cannot open file '" + fileName + "'", Error::ERR_OPEN_FILE);
+
+    struct stat st;
+
+    if ((fstat(_fd, &st) != 0) || (S_ISREG(st.st_mode) == 0)) {
+        close(_fd);
+        throw IOException("Cannot map file '" + fileName + "' (not a regular file)", Error::ERR_OPEN_FILE);
+    }
+
+    _size = int64(st.st_size);
+
+    // An empty file cannot be mapped
+    if (_size == 0)
+        return;
+
+    // Private writable mapping: a write would only modify a copy of the page
+    void* p = mmap(nullptr, size_t(_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0);
+
+    if (p == MAP_FAILED) {
+        close(_fd);
+        throw IOException("Cannot map file '" + fileName + "'", Error::ERR_READ_FILE);
+    }
+
+    _data = static_cast<std::byte*>(p);
+
+    // The file is read once, from start to end: let the kernel read ahead
+    // aggressively and drop the pages behind
+    madvise(p, size_t(_size), MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile()
+{
+    if (_data != nullptr)
+        munmap(_data, size_t(_size));
+
+    close(_fd);
+}
+
+void MappedFile::willNeed(int64 offset, int64 length)
+{
+    if ((_data == nullptr) || (offset >= _size))
+        return;
+
+    // madvise requires a page aligned address
+    const int64 pageSize = int64(sysconf(_SC_PAGESIZE));
+    const int64 start = offset & -pageSize;
+    const int64 end = (offset + length > _size) ? _size : offset + length;
+    madvise(&_data[start], size_t(end - start), MADV_WILLNEED);
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MappedFile_
+#define _MappedFile_
+
+#include <string>
+#include "../types.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+
+   // Read only view of a whole file mapped in memory.
+   // The mapping is private (copy on write): the file is never modified.
+   // Accessing the data after the file has been truncated by another process
+   // may crash the process, so only local files should be mapped.
+   class MappedFile
+   {
+   public:
+       // Throw an IOException if the file cannot be mapped
+       MappedFile(const string& fileName) THROW;
+
+       ~MappedFile();
+
+       const byte* data() const { return _data; }
+
+       int64 size() const { return _size; }
+
+       // Hint that the range is about to be read
+       void willNeed(int64 offset, int64 length);
+
+   private:
+       byte* _data;
+       int64 _size;
+#if defined(WIN32) || defined(_WIN32)
+       void* _file;
+       void* _mapping;
+#else
+       int _fd;
+#endif
+   };
+}
+#endif
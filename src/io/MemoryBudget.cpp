@@ -0,0 +1,141 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "MemoryBudget.hpp"
+#include "DedupWindow.hpp"
+#include "../entropy/EntropyCodecFactory.hpp"
+#include "../function/FunctionFactory.hpp"
+
+using namespace kanzi;
+
+int64 MemoryBudget::blockFootprint(uint64 transformType, uint32 entropyType,
+    int blockSize, bool decoding)
+{
+    const int64 bsz = int64(blockSize);
+
+    // Input, output and bitstream buffers
+    int64 res = 3 * bsz;
+
+    // The transforms of a sequence are kept allocated (see CodecCache).
+    // 8 transforms of 6 bits each (see FunctionFactory).
+    for (int i = 0; i < 8; i++)
+        res += transformFootprint((transformType >> (42 - 6 * i)) & 0x3F, blockSize, decoding);
+
+    return res + entropyFootprint(entropyType, blockSize);
+}
+
+int64 MemoryBudget::transformFootprint(uint64 type, int blockSize, bool decoding)
+{
+    const int64 bsz = int64(blockSize);
+
+    switch (type) {
+    case FunctionFactory<byte>::BWT_TYPE:
+        // Suffix array or inverse links: 4 bytes per byte, also with
+        // "releaseBuffers" (the buffers are only freed between blocks).
+        return 4 * bsz;
+
+    case FunctionFactory<byte>::BWTS_TYPE:
+        return (decoding == true) ? 4 * bsz : 8 * bsz;
+
+    case FunctionFactory<byte>::DICT_TYPE:
+        // Dynamic dictionary, bounded by the block size
+        return bsz;
+
+    case FunctionFactory<byte>::LZ_TYPE:
+    case FunctionFactory<byte>::LZP_TYPE:
+        return 1024 * 1024;
+
+    case FunctionFactory<byte>::ROLZ_TYPE:
+    case FunctionFactory<byte>::ROLZX_TYPE:
+        // Match table and chunk buffers
+        return 8 * 1024 * 1024 + (bsz >> 2);
+
+    default:
+        return 0;
+    }
+}
+
+int64 MemoryBudget::entropyFootprint(uint32 type, int blockSize)
+{
+    switch (type) {
+    case EntropyCodecFactory::TPAQ_TYPE:
+    case EntropyCodecFactory::TPAQX_TYPE: {
+        // Same sizes as TPAQPredictor::reset()
+        const int extra = (type == EntropyCodecFactory::TPAQX_TYPE) ? 1 : 0;
+        int64 states;
+
+        if (blockSize >= 64 * 1024 * 1024)
+            states = int64(1) << 29;
+        else if (blockSize >= 16 * 1024 * 1024)
+            states = int64(1) << 28;
+        else
+            states = (blockSize >= 1024 * 1024) ? int64(1) << 27 : int64(1) << 26;
+
+        int64 mixers;
+
+        if (blockSize >= 32 * 1024 * 1024)
+            mixers = int64(1) << 17;
+        else if (blockSize >= 16 * 1024 * 1024)
+            mixers = int64(1) << 16;
+        else if (blockSize >= 8 * 1024 * 1024)
+            mixers = int64(1) << 14;
+        else if (blockSize >= 4 * 1024 * 1024)
+            mixers = int64(1) << 12;
+        else
+            mixers = (blockSize >= 1024 * 1024) ? int64(1) << 10 : int64(1) << 9;
+
+        const int64 buffer = 64 * 1024 * 1024;
+        const int64 smallStates = (1 << 24) + (1 << 16);
+        const int64 hashes = (int64(16 * 1024 * 1024) * 4) << (2 * extra);
+        return buffer + smallStates + (states << extra) + hashes + ((mixers * 76) << extra);
+    }
+
+    case EntropyCodecFactory::CM_TYPE:
+        return 4 * 1024 * 1024;
+
+    case EntropyCodecFactory::ANS1_TYPE:
+        return 8 * 1024 * 1024;
+
+    case EntropyCodecFactory::NONE_TYPE:
+        return 0;
+
+    default:
+        return 2 * 1024 * 1024;
+    }
+}
+
+int64 MemoryBudget::streamFootprint(int blockSize, bool dedup)
+{
+    if (dedup == false)
+        return BASE_FOOTPRINT;
+
+    // Same number of blocks as DedupWindow (at least one block)
+    const int64 bsz = int64(blockSize);
+    const int64 blocks = (bsz < DedupWindow::WINDOW_SIZE) ? DedupWindow::WINDOW_SIZE / bsz : 1;
+    return BASE_FOOTPRINT + blocks * bsz;
+}
+
+int MemoryBudget::maxJobs(int64 budget, int64 streamFootprint, int64 footprint, int jobs)
+{
+    if ((budget <= 0) || (footprint <= 0))
+        return jobs;
+
+    const int64 n = (budget - streamFootprint) / footprint;
+
+    if (n < 1)
+        return 1;
+
+    return (n < int64(jobs)) ? int(n) : jobs;
+}
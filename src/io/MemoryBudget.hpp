@@ -0,0 +1,55 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MemoryBudget_
+#define _MemoryBudget_
+
+#include "../types.hpp"
+
+namespace kanzi
+{
+
+   // Estimate the memory used by the compressed streams, in order to bound
+   // the number of blocks processed concurrently (Context key "maxMemory",
+   // in bytes). The estimates are upper bounds measured on the codecs of
+   // this version: stream buffers (about 3 block sizes per block in flight)
+   // plus the tables of each transform and of the entropy codec.
+   class MemoryBudget
+   {
+   public:
+       // Fixed cost of the process and of the stream (not per block)
+       static const int64 BASE_FOOTPRINT = 8 * 1024 * 1024;
+
+       // Memory used by a task to encode or decode one block
+       static int64 blockFootprint(uint64 transformType, uint32 entropyType,
+           int blockSize, bool decoding);
+
+       // Memory used by a stream whatever the number of blocks in flight:
+       // BASE_FOOTPRINT plus the block deduplication window (if dedup), which
+       // the encoder and the decoder both fill with copies of the blocks.
+       static int64 streamFootprint(int blockSize, bool dedup);
+
+       // Number of blocks (at most 'jobs', at least 1) that can be processed
+       // concurrently with 'budget' bytes, given the footprint of the stream
+       // and the footprint of a block. A budget of 0 or less means no limit.
+       static int maxJobs(int64 budget, int64 streamFootprint, int64 footprint, int jobs);
+
+   private:
+       static int64 transformFootprint(uint64 type, int blockSize, bool decoding);
+
+       static int64 entropyFootprint(uint32 type, int blockSize);
+   };
+}
+#endif
@@ -0,0 +1,437 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include "MemoryCodec.hpp"
+#include "BlockCodec.hpp"
+#include "CodecCache.hpp"
+#include "DedupWindow.hpp"
+#include "IOException.hpp"
+#include "StreamDigest.hpp"
+#include "StreamHeader.hpp"
+#include "../BitStreamException.hpp"
+#include "../BufferPool.hpp"
+#include "../Context.hpp"
+#include "../Dictionary.hpp"
+#include "../Error.hpp"
+#include "../Memory.hpp"
+#include "../SliceArray.hpp"
+#include "../bitstream/MemoryInputBitStream.hpp"
+#include "../bitstream/MemoryOutputBitStream.hpp"
+#include "../entropy/EntropyCodecFactory.hpp"
+#include "../function/FunctionFactory.hpp"
+#include "../util/XXHash32.hpp"
+#include "../util/XXHash64.hpp"
+
+using namespace kanzi;
+
+namespace {
+   // Codecs and buffers of a thread, reused by the successive calls
+   class MemoryCodecState
+   {
+   public:
+       BufferPool _buffers; // must outlive the bitstream and the slices
+       // Like the streams, never use the same transforms to encode and decode
+       CodecSet _encoders;
+       CodecSet _decoders;
+       MemoryOutputBitStream _mobs; // header or encoded block
+       SliceArray<byte> _buffer1;
+       SliceArray<byte> _buffer2;
+       Context _ctx;
+
+       MemoryCodecState()
+           : _mobs(MemoryOutputBitStream::DEFAULT_BUFFER_SIZE, &_buffers)
+           , _buffer1(nullptr, 0, 0)
+           , _buffer2(nullptr, 0, 0)
+       {
+           _transformType = 0;
+           _entropyType = 0;
+           _blockSize = 0;
+           _ctx.setBufferPool(&_buffers);
+       }
+
+       ~MemoryCodecState()
+       {
+           _buffers.release(_buffer1._array, _buffer1._length);
+           _buffers.release(_buffer2._array, _buffer2._length);
+       }
+
+       // The transforms and codecs read their parameters from the context.
+       // Provide the same values as the streams.
+       void setup(uint64 transformType, uint32 entropyType, int blockSize) THROW
+       {
+           if ((blockSize == _blockSize) && (transformType == _transformType) && (entropyType == _entropyType))
+               return;
+
+           _blockSize = 0;
+           _ctx.putString("codec", EntropyCodecFactory::getName(entropyType));
+           _ctx.putString("transform", FunctionFactory<byte>::getName(transformType));
+           _ctx.putString("extra", (entropyType == EntropyCodecFactory::TPAQX_TYPE) ? STR_TRUE : STR_FALSE);
+           _ctx.putInt("blockSize", blockSize);
+           _ctx.putInt("jobs", 1);
+           _transformType = transformType;
+           _entropyType = entropyType;
+           _blockSize = blockSize;
+       }
+
+   private:
+       uint64 _transformType;
+       uint32 _entropyType;
+       int _blockSize; // 0 if the context is not set
+   };
+
+   thread_local unique_ptr<MemoryCodecState> threadState;
+
+   MemoryCodecState& getThreadState()
+   {
+       if (threadState == nullptr)
+           threadState.reset(new MemoryCodecState());
+
+       return *threadState;
+   }
+
+   // Append the closed bitstream to the output buffer
+   size_t append(const MemoryOutputBitStream& mobs, byte* dst, size_t pos, size_t capacity) THROW
+   {
+       const size_t written = size_t(mobs.written() >> 3);
+
+       if (written > capacity - pos)
+           throw IOException("The output buffer is too small", Error::ERR_WRITE_FILE);
+
+       memcpy(&dst[pos], mobs.getBuffer(), written);
+       return pos + written;
+   }
+}
+
+CompressionParams::CompressionParams(const string& transform, const string& entropy,
+    int blockSize, int checksum) THROW
+{
+    if ((blockSize < 1024) || (blockSize > 1024 * 1024 * 1024) || ((blockSize & -16) != blockSize))
+        throw invalid_argument("The block size must be a multiple of 16 in [1024..1073741824]");
+
+    if ((checksum != 0) && (checksum != 32) && (checksum != 64))
+        throw invalid_argument("The checksum size must be 0, 32 or 64 bits");
+
+    _transformType = FunctionFactory<byte>::getType(transform.c_str());
+    _entropyType = EntropyCodecFactory::getType(entropy.c_str());
+    _blockSize = blockSize;
+    _checksum = checksum;
+    _dictionary = nullptr;
+}
+
+size_t MemoryCodec::getMaxEncodedLength(size_t length, const CompressionParams& params)
+{
+    // A block that does not compress is stored as a copy block
+    const size_t nbBlocks = (length + size_t(params._blockSize) - 1) / size_t(params._blockSize);
+    // Header, blocks, end block and stream digest (if checksum)
+    const size_t headerSize = HEADER_SIZE + ((params._dictionary != nullptr) ? 4 : 0) + ((params._checksum != 0) ? 1 : 0);
+    return headerSize + 4 + nbBlocks * BLOCK_OVERHEAD + length + ((params._checksum != 0) ? 8 : 0);
+}
+
+size_t MemoryCodec::compress(const byte* src, size_t length, byte* dst, size_t capacity) THROW
+{
+    static const CompressionParams defaultParams;
+    return compress(src, length, dst, capacity, defaultParams);
+}
+
+// Write the same bitstream as CompressedOutputStream (header, length
+// prefixed blocks, end block and digest), without block index. The header
+// and the blocks are encoded by StreamHeader and BlockCodec, like in the
+// stream. Unlike the stream, a block that does not compress is stored, so
+// that getMaxEncodedLength() is a tight bound.
+size_t MemoryCodec::compress(const byte* src, size_t length, byte* dst, size_t capacity,
+    const CompressionParams& params) THROW
+{
+    if ((src == nullptr) && (length != 0))
+        throw IOException("Invalid null input buffer", Error::ERR_INVALID_PARAM);
+
+    if (dst == nullptr)
+        throw IOException("Invalid null output buffer", Error::ERR_INVALID_PARAM);
+
+    // Smallest valid block size for the input (fewer allocations for small inputs)
+    int blockSize = params._blockSize;
+
+    if (length < size_t(blockSize))
+        blockSize = (length < size_t(MIN_BITSTREAM_BLOCK_SIZE)) ? MIN_BITSTREAM_BLOCK_SIZE : int((length + 15) & ~size_t(15));
+
+    const size_t nbBlocks = (length + size_t(blockSize) - 1) / size_t(blockSize);
+    // Do not require the dictionary to decode if no transform uses it
+    const Dictionary* dict = ((params._dictionary != nullptr) && (FunctionFactory<byte>::usesDictionary(params._transformType) == true))
+        ? params._dictionary : nullptr;
+    MemoryCodecState& state = getThreadState();
+    MemoryOutputBitStream& mobs = state._mobs;
+    XXHash32 hasher32(StreamHeader::BITSTREAM_TYPE);
+    XXHash64 hasher64(StreamHeader::BITSTREAM_TYPE);
+    StreamDigest digest;
+    size_t pos = 0;
+    size_t offset = 0;
+
+    try {
+        StreamHeader header;
+        header._checksum = params._checksum;
+        header._entropyType = params._entropyType;
+        header._transformType = params._transformType;
+        header._blockSize = blockSize;
+        header._nbInputBlocks = (nbBlocks > 63) ? 63 : int(nbBlocks);
+        header._dictionary = dict != nullptr;
+        header._dictionaryId = (dict != nullptr) ? dict->getId() : 0;
+        mobs.reset();
+        header.write(mobs);
+        mobs.close();
+        pos = append(mobs, dst, pos, capacity);
+
+        state.setup(params._transformType, params._entropyType, blockSize);
+        state._ctx.setDictionary(dict);
+        int blockId = 0;
+
+        while (offset < length) {
+            const int blockLength = (length - offset < size_t(blockSize)) ? int(length - offset) : blockSize;
+            byte* data = const_cast<byte*>(&src[offset]);
+            uint64 checksum = 0;
+
+            if (params._checksum == 32)
+                checksum = uint64(uint32(hasher32.hash(data, blockLength)));
+            else if (params._checksum == 64)
+                checksum = hasher64.hash(data, blockLength);
+
+            // The input is only read (the intermediate data goes to buffer1)
+            SliceArray<byte> view(data, blockLength, 0);
+            const bool copy = blockLength <= BlockCodec::SMALL_BLOCK_SIZE;
+            mobs.reset();
+            BlockResult res = BlockCodec::encode(state._encoders, state._ctx, view, state._buffer2,
+                &state._buffer1, blockLength, params._transformType, params._entropyType, copy,
+                checksum, params._checksum, mobs, ++blockId);
+
+            if ((res._error == 0) && (copy == false)) {
+                int dataSize = 1;
+
+                for (uint64 n = 0xFF; n < uint64(blockLength); n <<= 8)
+                    dataSize++;
+
+                const uint64 copyLength = uint64(1 + dataSize + (params._checksum >> 3) + blockLength);
+
+                if (((mobs.written() + 7) >> 3) > copyLength) {
+                    // The block does not compress: store it
+                    view._index = 0;
+                    mobs.reset();
+                    res = BlockCodec::encode(state._encoders, state._ctx, view, state._buffer2,
+                        &state._buffer1, blockLength, params._transformType, params._entropyType, true,
+                        checksum, params._checksum, mobs, blockId);
+                }
+            }
+
+            if (res._error != 0)
+                throw IOException(res._msg, res._error);
+
+            // Pad the block to a byte boundary, prefix it with its length
+            mobs.close();
+
+            if (capacity - pos < 4)
+                throw IOException("The output buffer is too small", Error::ERR_WRITE_FILE);
+
+            BigEndian::writeInt32(&dst[pos], int32(mobs.written() >> 3));
+            pos = append(mobs, dst, pos + 4, capacity);
+
+            if (params._checksum != 0)
+                digest.add(checksum);
+
+            offset += size_t(blockLength);
+        }
+    }
+    catch (IOException&) {
+        throw;
+    }
+    catch (exception& e) {
+        throw IOException(e.what(), Error::ERR_PROCESS_BLOCK);
+    }
+
+    // End block (block length of 0), then the digest of the block checksums (if any)
+    const size_t trailer = (params._checksum != 0) ? 12 : 4;
+
+    if (capacity - pos < trailer)
+        throw IOException("The output buffer is too small", Error::ERR_WRITE_FILE);
+
+    BigEndian::writeInt32(&dst[pos], 0);
+
+    if (params._checksum != 0)
+        BigEndian::writeLong64(&dst[pos + 4], int64(digest.value()));
+
+    return pos + trailer;
+}
+
+size_t MemoryCodec::decompress(const byte* src, size_t length, byte* dst, size_t capacity) THROW
+{
+    return decompress(src, length, dst, capacity, nullptr);
+}
+
+// Read the bitstream of CompressedOutputStream: the header and the blocks are
+// decoded by StreamHeader and BlockCodec, like in the stream. The block index
+// (if any) is ignored.
+size_t MemoryCodec::decompress(const byte* src, size_t length, byte* dst, size_t capacity,
+    const Dictionary* dictionary) THROW
+{
+    if ((src == nullptr) || ((dst == nullptr) && (capacity != 0)))
+        throw IOException("Invalid null buffer", Error::ERR_INVALID_PARAM);
+
+    if (length < size_t(HEADER_SIZE + 4))
+        throw IOException("Invalid bitstream, the data is too short", Error::ERR_INVALID_FILE);
+
+    if (length > size_t(0x7FFFFFFF))
+        throw IOException("Invalid bitstream, the data is too long", Error::ERR_INVALID_PARAM);
+
+    MemoryInputBitStream ibs(src, int(length));
+    StreamHeader header;
+
+    try {
+        header.read(ibs);
+    }
+    catch (BitStreamException& e) {
+        throw IOException(e.what(), Error::ERR_INVALID_FILE);
+    }
+
+    if (header._dictionary == true) {
+        if (dictionary == nullptr) {
+            stringstream ss;
+            ss << "The bitstream requires a dictionary (id " << std::hex << header._dictionaryId << ")";
+            throw IOException(ss.str(), Error::ERR_MISSING_PARAM);
+        }
+
+        if (dictionary->getId() != header._dictionaryId) {
+            stringstream ss;
+            ss << "Invalid dictionary: the bitstream requires id " << std::hex << header._dictionaryId << ", got " << dictionary->getId();
+            throw IOException(ss.str(), Error::ERR_INVALID_PARAM);
+        }
+    }
+
+    MemoryCodecState& state = getThreadState();
+
+    try {
+        state.setup(header._transformType, header._entropyType, header._blockSize);
+    }
+    catch (invalid_argument& e) {
+        stringstream ss;
+        ss << "Invalid bitstream, unknown entropy codec or transform: " << e.what();
+        throw IOException(ss.str(), Error::ERR_INVALID_CODEC);
+    }
+
+    // The transforms must not use a dictionary the encoder did not use
+    state._ctx.setDictionary((header._dictionary == true) ? dictionary : nullptr);
+    XXHash32 hasher32(StreamHeader::BITSTREAM_TYPE);
+    XXHash64 hasher64(StreamHeader::BITSTREAM_TYPE);
+    XXHash32* h32 = (header._checksum == 32) ? &hasher32 : nullptr;
+    XXHash64* h64 = (header._checksum == 64) ? &hasher64 : nullptr;
+    unique_ptr<DedupWindow> window((header._dedup == true) ? new DedupWindow(header._blockSize) : nullptr);
+    StreamDigest digest;
+    // Same padding as the stream for temporarily expanded blocks
+    const int blkSize = max(header._blockSize + BlockCodec::EXTRA_BUFFER_SIZE, header._blockSize + (header._blockSize >> 4));
+    size_t pos = size_t(ibs.read() >> 3);
+    size_t decoded = 0;
+    int blockId = 0;
+
+    try {
+        state._buffers.reserve(state._buffer2, blkSize);
+
+        while (true) {
+            BlockResult res;
+            blockId++;
+
+            if (header._version >= 10) {
+                if (length - pos < 4)
+                    throw IOException("Invalid bitstream, missing end block", Error::ERR_INVALID_FILE);
+
+                const size_t blockBytes = size_t(uint32(BigEndian::readInt32(&src[pos])));
+                pos += 4;
+
+                // End block, followed by the stream digest (if block checksums)
+                if (blockBytes == 0) {
+                    if (header._checksum != 0) {
+                        if (length - pos < 8)
+                            throw IOException("Invalid bitstream, missing stream digest", Error::ERR_INVALID_FILE);
+
+                        const uint64 expected = uint64(BigEndian::readLong64(&src[pos]));
+
+                        if (digest.value() != expected) {
+                            stringstream ss;
+                            ss << "Corrupted bitstream: expected stream digest " << std::hex << expected
+                               << ", found " << digest.value() << std::dec;
+                            throw IOException(ss.str(), Error::ERR_CRC_CHECK);
+                        }
+                    }
+
+                    break;
+                }
+
+                if (blockBytes > length - pos)
+                    throw IOException("Invalid bitstream, truncated block", Error::ERR_INVALID_FILE);
+
+                // Each block is read from its own bitstream
+                MemoryInputBitStream bbs(&src[pos], int(blockBytes));
+                state._buffer2._index = 0;
+                res = BlockCodec::decode(state._decoders, state._ctx, bbs, state._buffer1, state._buffer2,
+                    blkSize, header._transformType, header._entropyType, h32, h64, window.get(), nullptr, blockId);
+                pos += blockBytes;
+            }
+            else {
+                // Version 9: the blocks follow each other in the bitstream,
+                // the last one is empty
+                state._buffer2._index = 0;
+                res = BlockCodec::decode(state._decoders, state._ctx, ibs, state._buffer1, state._buffer2,
+                    blkSize, header._transformType, header._entropyType, h32, h64, nullptr, nullptr, blockId);
+
+                if ((res._error == 0) && (res._decoded == 0))
+                    break;
+            }
+
+            if (res._error != 0)
+                throw IOException(res._msg, res._error);
+
+            if (size_t(res._decoded) > capacity - decoded)
+                throw IOException("The output buffer is too small", Error::ERR_WRITE_FILE);
+
+            memcpy(&dst[decoded], &state._buffer2._array[0], size_t(res._decoded));
+            decoded += size_t(res._decoded);
+
+            if (header._checksum != 0)
+                digest.add(res._checksum);
+
+            // Apply the operations of the encoder to the window, in block order
+            if (window != nullptr) {
+                if (res._reference != 0)
+                    window->touch(res._reference);
+                else
+                    window->add(blockId, &state._buffer2._array[0], res._decoded, 0);
+            }
+        }
+    }
+    catch (IOException&) {
+        throw;
+    }
+    catch (BitStreamException& e) {
+        // EX: truncated data
+        throw IOException(e.what(), Error::ERR_INVALID_FILE);
+    }
+    catch (exception& e) {
+        throw IOException(e.what(), Error::ERR_PROCESS_BLOCK);
+    }
+
+    return decoded;
+}
+
+void MemoryCodec::releaseThreadResources()
+{
+    threadState.reset();
+}
@@ -0,0 +1,89 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MemoryCodec_
+#define _MemoryCodec_
+
+#include <string>
+#include "../types.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+   class Dictionary;
+
+   // Parameters of MemoryCodec::compress(). The transform and entropy codec
+   // names are resolved once, when the parameters are created.
+   class CompressionParams
+   {
+   public:
+       static const int DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+       uint64 _transformType;
+       uint32 _entropyType;
+       int _blockSize; // maximum size of a block
+       int _checksum; // size of the block checksums: 0 (none), 32 or 64 bits
+       const Dictionary* _dictionary; // optional, not owned (null by default)
+
+       // Throw invalid_argument if a name, the block size or the checksum
+       // size is invalid
+       CompressionParams(const string& transform = "BWT+RANK+ZRLT", const string& entropy = "ANS0",
+           int blockSize = DEFAULT_BLOCK_SIZE, int checksum = 0) THROW;
+   };
+
+   // Single shot compression and decompression of memory buffers (EX: small
+   // messages). The blocks are encoded and decoded directly, by the same code
+   // as the streams (BlockCodec): the compressed data is a bitstream readable
+   // by CompressedInputStream and any bitstream readable by
+   // CompressedInputStream can be decompressed here.
+   // The calls are independent and thread safe. The transforms, entropy
+   // models and buffers are kept per thread and reused from one call to the
+   // next.
+   class MemoryCodec
+   {
+   public:
+       // Maximum size of the compressed data for an input of 'length' bytes
+       static size_t getMaxEncodedLength(size_t length, const CompressionParams& params);
+
+       // Compress 'length' bytes of 'src' into 'dst' and return the compressed
+       // size. Throw an IOException on failure (EX: 'capacity' is too small).
+       static size_t compress(const byte* src, size_t length, byte* dst, size_t capacity,
+           const CompressionParams& params) THROW;
+
+       // Same as above with the default parameters
+       static size_t compress(const byte* src, size_t length, byte* dst, size_t capacity) THROW;
+
+       // Decompress the 'length' bytes of 'src' into 'dst' and return the
+       // decompressed size. Throw an IOException on failure (EX: invalid
+       // data or 'capacity' is too small).
+       static size_t decompress(const byte* src, size_t length, byte* dst, size_t capacity) THROW;
+
+       // Same as above for data compressed with a dictionary ('dictionary'
+       // may be null if the data was compressed without one)
+       static size_t decompress(const byte* src, size_t length, byte* dst, size_t capacity,
+           const Dictionary* dictionary) THROW;
+
+       // Free the transforms, models and buffers kept for the calling thread
+       // (done anyway when the thread exits).
+       static void releaseThreadResources();
+
+   private:
+       static const int HEADER_SIZE = 16; // plus dictionary id (4 bytes) and checksum size (1 byte), if any
+       static const int BLOCK_OVERHEAD = 17; // length, mode, size and checksum of a copy block
+       static const int MIN_BITSTREAM_BLOCK_SIZE = 1024;
+   };
+}
+#endif
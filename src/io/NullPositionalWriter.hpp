@@ -0,0 +1,41 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _NullPositionalWriter_
+#define _NullPositionalWriter_
+
+#include "PositionalWriter.hpp"
+
+namespace kanzi
+{
+
+   // Positional writer discarding the data. Used to decode (and verify) a
+   // stream in parallel with CompressedInputStream::decodeTo() without
+   // copying the decoded blocks anywhere.
+   class NullPositionalWriter : public PositionalWriter
+   {
+   public:
+       NullPositionalWriter() : PositionalWriter() {}
+
+       ~NullPositionalWriter() {}
+
+       void preallocate(int64) {}
+
+       void write(const byte*, int, int64) THROW {}
+
+       void close(int64) THROW {}
+   };
+}
+#endif
@@ -0,0 +1,169 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "PositionalWriter.hpp"
+#include "IOException.hpp"
+#include "../Error.hpp"
+
+#if defined(WIN32) || defined(_WIN32)
+   #ifndef WIN32_LEAN_AND_MEAN
+      #define WIN32_LEAN_AND_MEAN
+   #endif
+   #ifndef NOMINMAX
+      #define NOMINMAX
+   #endif
+   #include <windows.h>
+#else
+   #include <cerrno>
+   #include <fcntl.h>
+   #include <unistd.h>
+#endif
+
+using namespace kanzi;
+
+#if defined(WIN32) || defined(_WIN32)
+
+PositionalWriter::PositionalWriter(const string& fileName) THROW
+    : _name(fileName)
+{
+    _file = CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (_file == INVALID_HANDLE_VALUE)
+        throw IOException("Cannot open output file '" + fileName + "' for writing", Error::ERR_CREATE_FILE);
+}
+
+PositionalWriter::PositionalWriter()
+    : _name("")
+{
+    _file = INVALID_HANDLE_VALUE;
+}
+
+PositionalWriter::~PositionalWriter()
+{
+    if (_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+}
+
+void PositionalWriter::preallocate(int64 size)
+{
+    LARGE_INTEGER pos;
+    pos.QuadPart = LONGLONG(size);
+
+    if (SetFilePointerEx(_file, pos, nullptr, FILE_BEGIN) != 0)
+        SetEndOfFile(_file);
+}
+
+void PositionalWriter::write(const std::byte* data, int length, int64 offset) THROW
+{
+    while (length > 0) {
+        // With a synchronous handle, the offset in OVERLAPPED makes the write positional
+        OVERLAPPED ov = {};
+        ov.Offset = DWORD(offset);
+        ov.OffsetHigh = DWORD(offset >> 32);
+        DWORD written = 0;
+
+        if ((WriteFile(_file, data, DWORD(length), &written, &ov) == 0) || (written == 0))
+            throw IOException("Cannot write to file '" + _name + "'", Error::ERR_WRITE_FILE);
+
+        data += written;
+        length -= int(written);
+        offset += int64(written);
+    }
+}
+
+void PositionalWriter::close(int64 size) THROW
+{
+    if (_file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER pos;
+    pos.QuadPart = LONGLONG(size);
+    const bool ok = (SetFilePointerEx(_file, pos, nullptr, FILE_BEGIN) != 0) && (SetEndOfFile(_file) != 0);
+    const bool closed = CloseHandle(_file) != 0;
+    _file = INVALID_HANDLE_VALUE;
+
+    if ((ok == false) || (closed == false))
+        throw IOException("Cannot close file '" + _name + "'", Error::ERR_WRITE_FILE);
+}
+
+#else
+
+PositionalWriter::PositionalWriter(const string& fileName) THROW
+    : _name(fileName)
+{
+    _fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (_fd < 0)
+        throw IOException("Cannot open output file '" + fileName + "' for writing", Error::ERR_CREATE_FILE);
+}
+
+PositionalWriter::PositionalWriter()
+    : _name("")
+{
+    _fd = -1;
+}
+
+PositionalWriter::~PositionalWriter()
+{
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+void PositionalWriter::preallocate(int64 size)
+{
+#if defined(__linux__)
+    // Allocate the blocks up front: no file extension by the concurrent writes
+    if (posix_fallocate(_fd, 0, off_t(size)) == 0)
+        return;
+#endif
+
+    if (ftruncate(_fd, off_t(size)) != 0) {
+        // Ignore, the file grows with the writes
+    }
+}
+
+void PositionalWriter::write(const byte* data, int length, int64 offset) THROW
+{
+    while (length > 0) {
+        const ssize_t written = pwrite(_fd, data, size_t(length), off_t(offset));
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            throw IOException("Cannot write to file '" + _name + "'", Error::ERR_WRITE_FILE);
+        }
+
+        data += written;
+        length -= int(written);
+        offset += int64(written);
+    }
+}
+
+void PositionalWriter::close(int64 size) THROW
+{
+    if (_fd < 0)
+        return;
+
+    const bool ok = ftruncate(_fd, off_t(size)) == 0;
+    const bool closed = ::close(_fd) == 0;
+    _fd = -1;
+
+    if ((ok == false) || (closed == false))
+        throw IOException("Cannot close file '" + _name + "'", Error::ERR_WRITE_FILE);
+}
+
+#endif
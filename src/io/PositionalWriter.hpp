@@ -0,0 +1,61 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _PositionalWriter_
+#define _PositionalWriter_
+
+#include <string>
+#include "../types.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+
+   // Output file written at explicit offsets (pwrite). Several threads may
+   // write at the same time as long as the ranges they write do not overlap.
+   // Only regular (local) files are supported.
+   class PositionalWriter
+   {
+   public:
+       // Create or truncate the file. Throw an IOException on failure
+       PositionalWriter(const string& fileName) THROW;
+
+       virtual ~PositionalWriter();
+
+       // Reserve the disk space for 'size' bytes. This is only a hint.
+       virtual void preallocate(int64 size);
+
+       // Write 'length' bytes at 'offset'. Thread safe.
+       virtual void write(const byte* data, int length, int64 offset) THROW;
+
+       // Set the final size of the file (dropping any extra preallocated
+       // space) and close it. Idempotent.
+       virtual void close(int64 size) THROW;
+
+   protected:
+       // No file (see NullPositionalWriter)
+       PositionalWriter();
+
+   private:
+       string _name;
+#if defined(WIN32) || defined(_WIN32)
+       void* _file;
+#else
+       int _fd;
+#endif
+   };
+}
+#endif
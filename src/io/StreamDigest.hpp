@@ -0,0 +1,55 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _StreamDigest_
+#define _StreamDigest_
+
+#include "../types.hpp"
+#include "../Memory.hpp"
+#include "../util/XXHash64.hpp"
+
+namespace kanzi
+{
+
+   // Whole stream digest (version 10+, streams with block checksums): the
+   // block checksums chained with XXHash64 in block order. It is written
+   // after the end block (64 bits). Since each block is verified against its
+   // own checksum, the digest detects missing, duplicated or reordered blocks
+   // without hashing the data again.
+   class StreamDigest
+   {
+   public:
+       StreamDigest() { _value = SEED; }
+
+       void reset() { _value = SEED; }
+
+       // Must be called in block order
+       void add(uint64 checksum)
+       {
+           byte buf[8];
+           LittleEndian::writeLong64(&buf[0], int64(checksum));
+           XXHash64 hasher(_value);
+           _value = hasher.hash(buf, 8);
+       }
+
+       uint64 value() const { return _value; }
+
+   private:
+       static const uint64 SEED = 0x4B414E5A; // "KANZ"
+
+       uint64 _value;
+   };
+}
+#endif
@@ -0,0 +1,135 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include "StreamHeader.hpp"
+#include "IOException.hpp"
+#include "../Error.hpp"
+
+using namespace kanzi;
+
+StreamHeader::StreamHeader()
+{
+    _version = BITSTREAM_FORMAT_VERSION;
+    _checksum = 0;
+    _entropyType = 0;
+    _transformType = 0;
+    _blockSize = 0;
+    _nbInputBlocks = 0;
+    _index = false;
+    _dedup = false;
+    _dictionary = false;
+    _dictionaryId = 0;
+}
+
+void StreamHeader::write(OutputBitStream& obs) const THROW
+{
+    if (obs.writeBits(BITSTREAM_TYPE, 32) != 32)
+        throw IOException("Cannot write bitstream type to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits(BITSTREAM_FORMAT_VERSION, 5) != 5)
+        throw IOException("Cannot write bitstream version to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits((_checksum != 0) ? 1 : 0, 1) != 1)
+        throw IOException("Cannot write checksum to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits(_entropyType, 5) != 5)
+        throw IOException("Cannot write entropy type to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits(_transformType, 48) != 48)
+        throw IOException("Cannot write transform types to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits(_blockSize >> 4, 28) != 28)
+        throw IOException("Cannot write block size to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits(_nbInputBlocks, 6) != 6)
+        throw IOException("Cannot write number of blocks to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits((_index == true) ? 1 : 0, 1) != 1)
+        throw IOException("Cannot write block index flag to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits((_dedup == true) ? 1 : 0, 1) != 1)
+        throw IOException("Cannot write block deduplication flag to header", Error::ERR_WRITE_FILE);
+
+    if (obs.writeBits((_dictionary == true) ? 1 : 0, 1) != 1)
+        throw IOException("Cannot write dictionary flag to header", Error::ERR_WRITE_FILE);
+
+    if ((_dictionary == true) && (obs.writeBits(_dictionaryId, 32) != 32))
+        throw IOException("Cannot write dictionary id to header", Error::ERR_WRITE_FILE);
+
+    // Size of the block checksums (since version 10)
+    if ((_checksum != 0) && (obs.writeBits(_checksum, 8) != 8))
+        throw IOException("Cannot write checksum size to header", Error::ERR_WRITE_FILE);
+}
+
+void StreamHeader::read(InputBitStream& ibs) THROW
+{
+    // Read stream type
+    const int32 type = int32(ibs.readBits(32));
+
+    // Sanity check
+    if (type != BITSTREAM_TYPE)
+        throw IOException("Invalid stream type", Error::ERR_INVALID_FILE);
+
+    // Read stream version
+    _version = int(ibs.readBits(5));
+
+    // Sanity check
+    if ((_version < MIN_BITSTREAM_FORMAT_VERSION) || (_version > BITSTREAM_FORMAT_VERSION)) {
+        stringstream ss;
+        ss << "Invalid bitstream, cannot read this version of the stream: " << _version;
+        throw IOException(ss.str(), Error::ERR_STREAM_VERSION);
+    }
+
+    // Read block checksum flag (the size follows the dictionary since version 10)
+    const bool checksum = ibs.readBit() == 1;
+
+    // Read entropy codec
+    _entropyType = uint32(ibs.readBits(5));
+
+    // Read transform: 8*6 bits
+    _transformType = ibs.readBits(48);
+
+    // Read block size
+    _blockSize = int(ibs.readBits(28)) << 4;
+
+    if ((_blockSize < MIN_BITSTREAM_BLOCK_SIZE) || (_blockSize > MAX_BITSTREAM_BLOCK_SIZE)) {
+        stringstream ss;
+        ss << "Invalid bitstream, incorrect block size: " << _blockSize;
+        throw IOException(ss.str(), Error::ERR_BLOCK_SIZE);
+    }
+
+    // Read number of blocks in input. 0 means 'unknown' and 63 means 63 or more.
+    _nbInputBlocks = int(ibs.readBits(6));
+
+    // Read block index, block deduplication and dictionary flags (reserved
+    // bits before version 10)
+    _index = (ibs.readBit() == 1) && (_version >= 10);
+    _dedup = (ibs.readBit() == 1) && (_version >= 10);
+    _dictionary = (ibs.readBit() == 1) && (_version >= 10);
+    _dictionaryId = (_dictionary == true) ? uint32(ibs.readBits(32)) : 0;
+    _checksum = 0;
+
+    if (checksum == true) {
+        // Read block checksum size (32 bits before version 10)
+        _checksum = (_version >= 10) ? int(ibs.readBits(8)) : 32;
+
+        if ((_checksum != 32) && (_checksum != 64)) {
+            stringstream ss;
+            ss << "Invalid bitstream, incorrect checksum size: " << _checksum;
+            throw IOException(ss.str(), Error::ERR_INVALID_FILE);
+        }
+    }
+}
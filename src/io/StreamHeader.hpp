@@ -0,0 +1,64 @@
+/*
+Copyright 2011-2019 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _StreamHeader_
+#define _StreamHeader_
+
+#include "../InputBitStream.hpp"
+#include "../OutputBitStream.hpp"
+#include "../types.hpp"
+
+namespace kanzi
+{
+
+   // Header of a bitstream, written by CompressedOutputStream and MemoryCodec:
+   // type (32 bits), version (5), checksum flag (1), entropy codec (5),
+   // transforms (48), block size / 16 (28), number of blocks (6), then
+   // (reserved bits before version 10) block index flag (1), block
+   // deduplication flag (1) and dictionary flag (1), followed by the
+   // dictionary id (32) and the checksum size (8) if the flags are set.
+   class StreamHeader
+   {
+   public:
+       static const int BITSTREAM_TYPE = 0x4B414E5A; // "KANZ"
+       static const int BITSTREAM_FORMAT_VERSION = 10;
+       static const int MIN_BITSTREAM_FORMAT_VERSION = 9;
+       static const int MIN_BITSTREAM_BLOCK_SIZE = 1024;
+       static const int MAX_BITSTREAM_BLOCK_SIZE = 1024 * 1024 * 1024;
+
+       int _version;
+       int _checksum; // size of the block checksums: 0 (none), 32 or 64 bits
+       uint32 _entropyType;
+       uint64 _transformType;
+       int _blockSize;
+       int _nbInputBlocks; // 0 means 'unknown' and 63 means '63 or more'
+       bool _index;
+       bool _dedup;
+       bool _dictionary;
+       uint32 _dictionaryId; // if _dictionary is true
+
+       StreamHeader();
+
+       ~StreamHeader() {}
+
+       // Throw an IOException if the bitstream cannot be written
+       void write(OutputBitStream& obs) const THROW;
+
+       // Throw an IOException if the type, the version, the block size or
+       // the checksum size is invalid
+       void read(InputBitStream& ibs) THROW;
+   };
+}
+#endif
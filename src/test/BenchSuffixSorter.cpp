@@ -0,0 +1,250 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../transform/SuffixSorter.hpp"
+
+using namespace kanzi;
+using namespace std;
+
+// Suffix array construction time of the engines of SuffixSorter (DivSufSort,
+// SAIS and SAIS_LOWMEM) on generated corpora: typical data (text, genome
+// like, random) and pathological data for DivSufSort (long repeats, short
+// periods, Fibonacci string). The arrays of all engines must be identical.
+// Usage: BenchSuffixSorter [size in KB] [files...]
+// The files (if any) are benchmarked instead of the generated corpora.
+
+struct Corpus
+{
+    string _name;
+    vector<byte> _data;
+};
+
+static uint32 nextRandom(uint32& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void fillRandom(vector<byte>& buf, int size, uint32 seed)
+{
+    buf.resize(size_t(size));
+
+    for (int i = 0; i < size; i++)
+        buf[i] = byte(nextRandom(seed));
+}
+
+// Words drawn from a small vocabulary, with spaces and new lines
+static void fillText(vector<byte>& buf, int size, uint32 seed)
+{
+    static const char* words[] = { "the", "block", "of", "data", "is", "encoded", "and",
+        "a", "stream", "transform", "with", "entropy", "codec", "to", "compress", "in", "order" };
+    const int nbWords = int(sizeof(words) / sizeof(words[0]));
+    buf.clear();
+
+    while (int(buf.size()) < size) {
+        const char* w = words[nextRandom(seed) % nbWords];
+
+        for (int i = 0; w[i] != 0; i++)
+            buf.push_back(byte(w[i]));
+
+        buf.push_back(byte(((nextRandom(seed) & 15) == 0) ? '\n' : ' '));
+    }
+
+    buf.resize(size_t(size));
+}
+
+// 4 symbols, with mutated copies of previous segments
+static void fillGenome(vector<byte>& buf, int size, uint32 seed)
+{
+    static const char bases[] = { 'A', 'C', 'G', 'T' };
+    buf.resize(size_t(size));
+    int i = 0;
+
+    while (i < size) {
+        const int len = 100 + int(nextRandom(seed) % 2000);
+
+        if ((i > 10000) && ((nextRandom(seed) & 1) == 0)) {
+            const int src = int(nextRandom(seed) % uint32(i - len));
+
+            for (int j = 0; (j < len) && (i < size); j++, i++)
+                buf[i] = ((nextRandom(seed) & 63) == 0) ? byte(bases[nextRandom(seed) & 3]) : buf[src + j];
+        }
+        else {
+            for (int j = 0; (j < len) && (i < size); j++, i++)
+                buf[i] = byte(bases[nextRandom(seed) & 3]);
+        }
+    }
+}
+
+// Copies of a random chunk
+static void fillRepeats(vector<byte>& buf, int size, int chunk, uint32 seed)
+{
+    vector<byte> c;
+    fillRandom(c, chunk, seed);
+    buf.resize(size_t(size));
+
+    for (int i = 0; i < size; i++)
+        buf[i] = c[i % chunk];
+}
+
+// Fibonacci string: a, ab, aba, abaab, ...
+static void fillFibonacci(vector<byte>& buf, int size)
+{
+    string a = "a";
+    string b = "ab";
+
+    while (int(b.size()) < size) {
+        string c = b + a;
+        a.swap(b);
+        b.swap(c);
+    }
+
+    buf.resize(size_t(size));
+    memcpy(&buf[0], b.data(), size_t(size));
+}
+
+static void generate(vector<Corpus>& corpora, int size)
+{
+    corpora.resize(9);
+    corpora[0]._name = "text";
+    fillText(corpora[0]._data, size, 1);
+    corpora[1]._name = "genome-like";
+    fillGenome(corpora[1]._data, size, 2);
+    corpora[2]._name = "random";
+    fillRandom(corpora[2]._data, size, 3);
+    corpora[3]._name = "zeros";
+    corpora[3]._data.assign(size_t(size), byte(0));
+    corpora[4]._name = "period 10";
+    fillRepeats(corpora[4]._data, size, 10, 4);
+    corpora[5]._name = "64 KB random repeated";
+    fillRepeats(corpora[5]._data, size, 64 * 1024, 5);
+    corpora[6]._name = "size/8 random repeated";
+    fillRepeats(corpora[6]._data, size, (size >= 64) ? size / 8 : size, 6);
+    corpora[7]._name = "Fibonacci";
+    fillFibonacci(corpora[7]._data, size);
+
+    // Text with a long repeated tail (DivSufSort compares long suffixes)
+    corpora[8]._name = "text, second half repeated";
+    fillText(corpora[8]._data, size, 7);
+    memcpy(&corpora[8]._data[size / 2], &corpora[8]._data[0], size_t(size - size / 2));
+}
+
+static bool load(const char* fileName, Corpus& corpus)
+{
+    ifstream is(fileName, ios::in | ios::binary);
+
+    if (!is.is_open())
+        return false;
+
+    is.seekg(0, ios::end);
+    const streamoff len = is.tellg();
+
+    if ((len <= 0) || (len >= streamoff(1) << 30))
+        return false;
+
+    is.seekg(0, ios::beg);
+    corpus._name = fileName;
+    corpus._data.resize(size_t(len));
+    is.read(reinterpret_cast<char*>(&corpus._data[0]), len);
+    return bool(is);
+}
+
+// Return the time of the fastest of 'runs' suffix array constructions (in ms)
+static double measure(int type, vector<byte>& data, vector<int>& sa, int runs)
+{
+    SuffixSorter sorter(1, type);
+    double best = -1;
+
+    for (int r = 0; r < runs; r++) {
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        sorter.computeSuffixArray(&data[0], &sa[0], 0, int(data.size()));
+        const chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+        const double elapsed = chrono::duration<double, milli>(stop - start).count();
+
+        if ((best < 0) || (elapsed < best))
+            best = elapsed;
+    }
+
+    return best;
+}
+
+int main(int argc, const char* argv[])
+{
+    const int size = (argc > 1) ? atoi(argv[1]) * 1024 : 4 * 1024 * 1024;
+
+    if ((size < 1024) || (size > 256 * 1024 * 1024)) {
+        cerr << "Usage: BenchSuffixSorter [size in KB (1..262144)] [files...]" << endl;
+        return 1;
+    }
+
+    vector<Corpus> corpora;
+
+    if (argc > 2) {
+        corpora.resize(size_t(argc - 2));
+
+        for (int i = 2; i < argc; i++) {
+            if (load(argv[i], corpora[i - 2]) == false) {
+                cerr << "Cannot read file " << argv[i] << endl;
+                return 1;
+            }
+        }
+    }
+    else {
+        generate(corpora, size);
+    }
+
+    const int types[] = { SuffixSorter::DIVSUFSORT_TYPE, SuffixSorter::SAIS_TYPE, SuffixSorter::SAIS_LOWMEM_TYPE };
+    const int nbTypes = int(sizeof(types) / sizeof(types[0]));
+    cout << "Suffix array time in ms (best of 3 runs, 1 job)" << endl;
+    cout << setw(28) << left << "corpus" << right;
+
+    for (int t = 0; t < nbTypes; t++)
+        cout << setw(14) << SuffixSorter::getName(types[t]);
+
+    cout << endl;
+    int res = 0;
+
+    for (size_t i = 0; i < corpora.size(); i++) {
+        vector<byte>& data = corpora[i]._data;
+        vector<int> expected(data.size());
+        vector<int> sa(data.size());
+        cout << setw(28) << left << corpora[i]._name << right << fixed << setprecision(1);
+
+        for (int t = 0; t < nbTypes; t++) {
+            const double elapsed = measure(types[t], data, (t == 0) ? expected : sa, 3);
+            cout << setw(14) << elapsed;
+
+            if ((t > 0) && (sa != expected)) {
+                cout << endl;
+                cerr << corpora[i]._name << ": the suffix array of " << SuffixSorter::getName(types[t])
+                     << " differs from the one of " << SuffixSorter::getName(types[0]) << endl;
+                res = 1;
+                break;
+            }
+        }
+
+        cout << endl;
+    }
+
+    return res;
+}
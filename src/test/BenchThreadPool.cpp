@@ -0,0 +1,100 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <vector>
+#include "../concurrent.hpp"
+#include "../types.hpp"
+
+using namespace std;
+
+// Per batch latency of the block tasks: a batch of small tasks is
+// scheduled, then all the results are waited for (like the blocks in flight
+// of a stream). ThreadPool (persistent workers) is compared with std::async
+// (one thread per task). Usage: BenchThreadPool [batches] [tasks per batch]
+
+// A small task, about the cost of the bookkeeping of a tiny block
+static uint64 smallTask(uint64 seed)
+{
+    uint64 h = seed;
+
+    for (int i = 0; i < 256; i++)
+        h = (h ^ uint64(i)) * 0x9E3779B97F4A7C15ULL;
+
+    return h;
+}
+
+// Return the mean latency of a batch in microseconds
+template <class Schedule>
+static double runBatches(int batches, int tasks, Schedule schedule, uint64& checksum)
+{
+    vector<future<uint64> > futures;
+    futures.reserve(size_t(tasks));
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int b = 0; b < batches; b++) {
+        for (int t = 0; t < tasks; t++)
+            futures.push_back(schedule(uint64(b * tasks + t)));
+
+        for (size_t t = 0; t < futures.size(); t++)
+            checksum += futures[t].get();
+
+        futures.clear();
+    }
+
+    const chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(stop - start).count() / double(batches);
+}
+
+int main(int argc, const char* argv[])
+{
+#ifdef CONCURRENCY_ENABLED
+    const int batches = (argc > 1) ? atoi(argv[1]) : 20000;
+    const int tasks = (argc > 2) ? atoi(argv[2]) : 4;
+
+    if ((batches <= 0) || (tasks <= 0) || (tasks > 1024)) {
+        cerr << "Usage: BenchThreadPool [batches] [tasks per batch (1..1024)]" << endl;
+        return 1;
+    }
+
+    uint64 checksum1 = 0;
+    uint64 checksum2 = 0;
+
+    const double asyncLatency = runBatches(batches, tasks,
+        [](uint64 seed) { return async(launch::async, smallTask, seed); }, checksum1);
+
+    ThreadPool pool(tasks);
+    const double poolLatency = runBatches(batches, tasks,
+        [&pool](uint64 seed) { return pool.schedule(smallTask, seed); }, checksum2);
+
+    if (checksum1 != checksum2) {
+        cerr << "ThreadPool: the results differ from std::async" << endl;
+        return 1;
+    }
+
+    cout << batches << " batches of " << tasks << " tasks" << endl;
+    cout << "std::async : " << asyncLatency << " us per batch" << endl;
+    cout << "ThreadPool : " << poolLatency << " us per batch" << endl;
+    return 0;
+#else
+    (void) argc;
+    (void) argv;
+    cout << "ThreadPool: no concurrency in this build" << endl;
+    return 0;
+#endif
+}
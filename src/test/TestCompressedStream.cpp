@@ -0,0 +1,217 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "../Context.hpp"
+#include "../Listener.hpp"
+#include "../io/CompressedOutputStream.hpp"
+
+using namespace kanzi;
+using namespace std;
+
+// Count the blocks encoded by a stream
+class BlockCounter : public Listener
+{
+public:
+    int _blocks;
+
+    BlockCounter() { _blocks = 0; }
+
+    void processEvent(const Event& evt)
+    {
+        if (evt.getType() == Event::BEFORE_TRANSFORM)
+            _blocks++;
+    }
+};
+
+// Record the hash type of the blocks encoded by a stream
+class HashTypeRecorder : public Listener
+{
+public:
+    Event::HashType _hashType;
+
+    HashTypeRecorder() { _hashType = Event::NO_HASH; }
+
+    void processEvent(const Event& evt)
+    {
+        if (evt.getType() == Event::BEFORE_TRANSFORM)
+            _hashType = evt.getHashType();
+    }
+};
+
+static Event::HashType encodeWithChecksum(bool checksum)
+{
+    stringstream os;
+    HashTypeRecorder recorder;
+    CompressedOutputStream cos(os, "NONE", "NONE", 65536, 1, checksum);
+    cos.addListener(recorder);
+    cos.write("some data", 9);
+    cos.close();
+    return recorder._hashType;
+}
+
+static Event::HashType encodeWithChecksumSize(int checksumSize)
+{
+    stringstream os;
+    HashTypeRecorder recorder;
+    CompressedOutputStream cos(os, "NONE", "NONE", 65536, 1, checksumSize);
+    cos.addListener(recorder);
+    cos.write("some data", 9);
+    cos.close();
+    return recorder._hashType;
+}
+
+// The boolean checksum constructor selects 32 bit checksums, the other one
+// takes the checksum size in bits
+static int testChecksumConstructors()
+{
+    if ((encodeWithChecksum(true) != Event::SIZE_32) || (encodeWithChecksum(false) != Event::NO_HASH)) {
+        cerr << "Checksum constructors: unexpected hash type with a boolean checksum" << endl;
+        return 1;
+    }
+
+    if ((encodeWithChecksumSize(64) != Event::SIZE_64) || (encodeWithChecksumSize(0) != Event::NO_HASH)) {
+        cerr << "Checksum constructors: unexpected hash type with a checksum size" << endl;
+        return 1;
+    }
+
+    try {
+        encodeWithChecksumSize(16);
+        cerr << "Checksum constructors: no error with an invalid checksum size" << endl;
+        return 1;
+    }
+    catch (invalid_argument&) {
+    }
+
+    cout << "Checksum constructors: OK" << endl;
+    return 0;
+}
+
+// A writer pausing for longer than the flush interval, then writing twice:
+// the pause alone must not trigger a flush (the delay starts with the first
+// pending byte), so both writes end up in one block.
+static int testAutoFlushAfterPause()
+{
+    const int interval = 50;
+    stringstream os;
+    Context ctx;
+    ctx.putString("codec", "NONE");
+    ctx.putString("transform", "NONE");
+    ctx.putInt("blockSize", 65536);
+    ctx.putInt("jobs", 1);
+    ctx.putInt("flushInterval", interval);
+    BlockCounter counter;
+    CompressedOutputStream cos(os, ctx);
+    cos.addListener(counter);
+
+    // One block, then idle
+    cos.write("first block", 11);
+    cos.flush();
+    const int before = counter._blocks;
+    this_thread::sleep_for(chrono::milliseconds(3 * interval));
+
+    cos.write("second", 6);
+    cos.write(" write", 6);
+    cos.close();
+    const int after = counter._blocks - before;
+
+    if ((before != 1) || (after != 1)) {
+        cerr << "Auto flush after a pause: expected 1 + 1 blocks, got "
+             << before << " + " << after << endl;
+        return 1;
+    }
+
+    cout << "Auto flush after a pause: OK" << endl;
+    return 0;
+}
+
+// Pending data older than the interval is flushed by the next write
+static int testAutoFlushOldData()
+{
+    const int interval = 50;
+    stringstream os;
+    Context ctx;
+    ctx.putString("codec", "NONE");
+    ctx.putString("transform", "NONE");
+    ctx.putInt("blockSize", 65536);
+    ctx.putInt("jobs", 1);
+    ctx.putInt("flushInterval", interval);
+    BlockCounter counter;
+    CompressedOutputStream cos(os, ctx);
+    cos.addListener(counter);
+
+    cos.write("pending", 7);
+    this_thread::sleep_for(chrono::milliseconds(3 * interval));
+    cos.write(" data", 5);
+    const int flushed = counter._blocks;
+    cos.close();
+
+    if ((flushed != 1) || (counter._blocks != 1)) {
+        cerr << "Auto flush of old data: expected 1 block flushed by write, got "
+             << flushed << " (" << counter._blocks << " in total)" << endl;
+        return 1;
+    }
+
+    cout << "Auto flush of old data: OK" << endl;
+    return 0;
+}
+
+// An idle producer polling the stream: the pending data is flushed by poll()
+// once older than the interval, without any further write
+static int testAutoFlushOnPoll()
+{
+    const int interval = 50;
+    stringstream os;
+    Context ctx;
+    ctx.putString("codec", "NONE");
+    ctx.putString("transform", "NONE");
+    ctx.putInt("blockSize", 65536);
+    ctx.putInt("jobs", 1);
+    ctx.putInt("flushInterval", interval);
+    BlockCounter counter;
+    CompressedOutputStream cos(os, ctx);
+    cos.addListener(counter);
+
+    const int idle = cos.poll();
+    cos.write("pending", 7);
+    const int delay = cos.poll();
+    this_thread::sleep_for(chrono::milliseconds(3 * interval));
+    const int next = cos.poll();
+    const int flushed = counter._blocks;
+    cos.close();
+
+    if ((idle != -1) || (delay <= 0) || (delay > interval) || (next != -1) || (flushed != 1)) {
+        cerr << "Auto flush on poll: expected delays -1, (0.." << interval << "], -1 and 1 block flushed, got "
+             << idle << ", " << delay << ", " << next << " and " << flushed << endl;
+        return 1;
+    }
+
+    cout << "Auto flush on poll: OK" << endl;
+    return 0;
+}
+
+int main(int, const char*[])
+{
+    int res = 0;
+    res |= testAutoFlushAfterPause();
+    res |= testAutoFlushOldData();
+    res |= testAutoFlushOnPoll();
+    res |= testChecksumConstructors();
+    return res;
+}
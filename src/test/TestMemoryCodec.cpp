@@ -0,0 +1,156 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Context.hpp"
+#include "../io/CompressedOutputStream.hpp"
+#include "../io/IOException.hpp"
+#include "../io/MemoryCodec.hpp"
+
+using namespace kanzi;
+using namespace std;
+
+static void fillRandom(vector<byte>& buf, uint32 seed)
+{
+    for (size_t i = 0; i < buf.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = byte(seed >> 16);
+    }
+}
+
+// Compress with CompressedOutputStream (same parameters as MemoryCodec)
+static string compressWithStream(const vector<byte>& input, const string& transform,
+    const string& entropy, int blockSize, int checksum, bool skipBlocks)
+{
+    stringstream os;
+    Context ctx;
+    ctx.putString("codec", entropy);
+    ctx.putString("transform", transform);
+    ctx.putInt("blockSize", blockSize);
+    ctx.putInt("jobs", 1);
+    ctx.putLong("fileSize", int64(input.size()));
+
+    if (checksum != 0)
+        ctx.putString("checksum", to_string(checksum));
+
+    if (skipBlocks == true)
+        ctx.putString("skipBlocks", STR_TRUE);
+
+    CompressedOutputStream cos(os, ctx);
+    cos.write(reinterpret_cast<const char*>(&input[0]), streamsize(input.size()));
+    cos.close();
+    return os.str();
+}
+
+// The blocks of random data do not compress and are stored (copy blocks) by
+// MemoryCodec and by the stream skipping incompressible blocks: MemoryCodec
+// must output the same bitstream as the stream and decode it. It must also
+// decode the expanded blocks of the stream (without block skipping).
+static int testSameAsStream(const string& transform, const string& entropy, int checksum)
+{
+    const int blockSize = 64 * 1024;
+    vector<byte> input(3 * blockSize + 1000);
+    fillRandom(input, 0x12345678);
+
+    CompressionParams params(transform, entropy, blockSize, checksum);
+    vector<byte> compressed(MemoryCodec::getMaxEncodedLength(input.size(), params));
+    const size_t size = MemoryCodec::compress(&input[0], input.size(), &compressed[0], compressed.size(), params);
+    // NONE+NONE blocks are not larger than copy blocks, never stored
+    const bool skip = (transform != "NONE") || (entropy != "NONE");
+    const string expected = compressWithStream(input, transform, entropy, blockSize, checksum, skip);
+    const string name = transform + "/" + entropy + "/" + to_string(checksum);
+
+    if ((size != expected.size()) || (memcmp(&compressed[0], expected.data(), size) != 0)) {
+        cerr << name << ": MemoryCodec output differs from the stream output ("
+             << size << " vs " << expected.size() << " bytes)" << endl;
+        return 1;
+    }
+
+    vector<byte> output(input.size());
+    size_t decoded = MemoryCodec::decompress(&compressed[0], size, &output[0], output.size());
+
+    if ((decoded != input.size()) || (memcmp(&output[0], &input[0], decoded) != 0)) {
+        cerr << name << ": round trip failed" << endl;
+        return 1;
+    }
+
+    const string expanded = compressWithStream(input, transform, entropy, blockSize, checksum, false);
+    memset(&output[0], 0, output.size());
+    decoded = MemoryCodec::decompress(reinterpret_cast<const byte*>(expanded.data()), expanded.size(),
+        &output[0], output.size());
+
+    if ((decoded != input.size()) || (memcmp(&output[0], &input[0], decoded) != 0)) {
+        cerr << name << ": decoding of the stream output failed" << endl;
+        return 1;
+    }
+
+    cout << name << ": same as stream (" << size << " bytes), round trip OK" << endl;
+    return 0;
+}
+
+// The output buffer of getMaxEncodedLength() bytes is large enough, a
+// smaller one is reported
+static int testOutputTooSmall()
+{
+    vector<byte> input(10000);
+    fillRandom(input, 42);
+    CompressionParams params;
+    vector<byte> compressed(MemoryCodec::getMaxEncodedLength(input.size(), params));
+    const size_t size = MemoryCodec::compress(&input[0], input.size(), &compressed[0], compressed.size());
+
+    try {
+        MemoryCodec::compress(&input[0], input.size(), &compressed[0], size - 1);
+        cerr << "Output too small: no error on compression" << endl;
+        return 1;
+    }
+    catch (IOException& e) {
+        if (e.error() != Error::ERR_WRITE_FILE) {
+            cerr << "Output too small: unexpected error " << e.error() << " on compression" << endl;
+            return 1;
+        }
+    }
+
+    vector<byte> output(input.size() - 1);
+
+    try {
+        MemoryCodec::decompress(&compressed[0], size, &output[0], output.size());
+        cerr << "Output too small: no error on decompression" << endl;
+        return 1;
+    }
+    catch (IOException& e) {
+        if (e.error() != Error::ERR_WRITE_FILE) {
+            cerr << "Output too small: unexpected error " << e.error() << " on decompression" << endl;
+            return 1;
+        }
+    }
+
+    cout << "Output too small: OK" << endl;
+    return 0;
+}
+
+int main(int, const char*[])
+{
+    int res = 0;
+    res |= testSameAsStream("BWT+RANK+ZRLT", "ANS0", 0);
+    res |= testSameAsStream("LZ", "HUFFMAN", 32);
+    res |= testSameAsStream("TEXT+RLT", "FPAQ", 64);
+    res |= testSameAsStream("NONE", "NONE", 0);
+    res |= testOutputTooSmall();
+    return res;
+}
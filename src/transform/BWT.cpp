@@ -13,18 +13,86 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <cstdlib>
 #include <map>
+#include <new>
 #include <vector>
 #include "BWT.hpp"
 #include "../Global.hpp"
+#include "../util.hpp"
 
 #ifdef CONCURRENCY_ENABLED
 #include <future>
 #endif
 
+#if !defined(WIN32) && !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
 using namespace kanzi;
 
+// Size of a transparent huge page (x86-64 and most arm64 kernels)
+static const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+// The inverse of big blocks follows the LF mapping with random accesses over
+// the whole table (one cache line and, with 4 KB pages, one TLB miss per
+// decoded symbol pair). Huge pages remove most of the TLB misses and of the
+// page faults on the first access. Where not available, plain allocation.
+static uint* allocateLF(int size)
+{
+#if !defined(WIN32) && !defined(_WIN32)
+    size_t length = size_t(size) * sizeof(uint);
+    void* p = nullptr;
+
+    // Small tables mostly fit in the caches: no rounding to a huge page
+    if (length < HUGE_PAGE_SIZE) {
+        p = malloc(length);
+
+        if (p == nullptr)
+            throw bad_alloc();
+
+        return static_cast<uint*>(p);
+    }
+
+    length = (length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    if (posix_memalign(&p, HUGE_PAGE_SIZE, length) != 0)
+        throw bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    // Only a hint, ignored if transparent huge pages are disabled
+    madvise(p, length, MADV_HUGEPAGE);
+#endif
+
+    return static_cast<uint*>(p);
+#else
+    return new uint[size];
+#endif
+}
+
+static void freeLF(uint* p)
+{
+#if !defined(WIN32) && !defined(_WIN32)
+    free(p);
+#else
+    delete[] p;
+#endif
+}
+
 BWT::BWT(int jobs) THROW
+    : _saAlgo(jobs)
+{
+    init(jobs);
+}
+
+BWT::BWT(Context& ctx) THROW
+    : _saAlgo(ctx, ctx.getInt("jobs", 1))
+{
+    init(ctx.getInt("jobs", 1));
+    _releaseBuffers = string(ctx.getString("releaseBuffers")) == STR_TRUE;
+}
+
+void BWT::init(int jobs) THROW
 {
     _buffer = nullptr;
     _sa = nullptr;
@@ -36,16 +104,26 @@ BWT::BWT(int jobs) THROW
 #endif
 
     _jobs = jobs;
+    _releaseBuffers = false;
     memset(_primaryIndexes, 0, sizeof(int) * 8);
 }
 
 BWT::~BWT()
+{
+    freeBuffers();
+}
+
+void BWT::freeBuffers()
 {
     if (_buffer != nullptr)
-        delete[] _buffer;
+        freeLF(_buffer);
 
     if (_sa != nullptr)
         delete[] _sa;
+
+    _buffer = nullptr;
+    _sa = nullptr;
+    _bufferSize = 0;
 }
 
 bool BWT::setPrimaryIndex(int n, int primaryIndex)
@@ -145,6 +223,10 @@ bool BWT::forward(SliceArray<byte>& input, SliceArray<byte>& output, int count)
 
     input._index += count;
     output._index += count;
+
+    if (_releaseBuffers == true)
+        freeBuffers();
+
     return res;
 }
 
@@ -175,10 +257,13 @@ bool BWT::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int count)
     }
 
     // Find the fastest way to implement inverse based on block size
-    if (count < 4 * 1024 * 1024)
-        return inverseSmallBlock(input, output, count);
+    const bool res = (count < 4 * 1024 * 1024) ? inverseSmallBlock(input, output, count)
+        : inverseBigBlock(input, output, count);
 
-    return inverseBigBlock(input, output, count);
+    if (_releaseBuffers == true)
+        freeBuffers();
+
+    return res;
 }
 
 // When count < 4M, mergeTPSI algo, always one chunk
@@ -187,15 +272,15 @@ bool BWT::inverseSmallBlock(SliceArray<byte>& input, SliceArray<byte>& output, i
     // Lazy dynamic memory allocation
     if ((_buffer == nullptr) || (_bufferSize < count)) {
         if (_buffer != nullptr)
-            delete[] _buffer;
+            freeLF(_buffer);
 
         _bufferSize = count;
-        _buffer = new uint[_bufferSize];
+        _buffer = allocateLF(_bufferSize);
     }
 
     const int pIdx = getPrimaryIndex(0);
 
-    if ((pIdx < 0) || (pIdx > count))
+    if ((pIdx <= 0) || (pIdx > count))
         return false;
 
     // Build array of packed index + value (assumes block size < 2^24)
@@ -212,7 +297,12 @@ bool BWT::inverseSmallBlock(SliceArray<byte>& input, SliceArray<byte>& output, i
     byte* dst = &output._array[output._index];
     uint* data = _buffer;
 
-    for (int i = 0; i < pIdx; i++) {
+    // The entry of the first symbol is the last one visited: its index is
+    // never used. Keep it in range so that a corrupted block cannot make
+    // the inverse read out of the buffer.
+    data[buckets[uint8(src[0])]++] = uint(uint8(src[0]));
+
+    for (int i = 1; i < pIdx; i++) {
         const uint8 val = uint8(src[i]);
         data[buckets[val]] = ((i - 1) << 8) | val;
         buckets[val]++;
@@ -242,10 +332,10 @@ bool BWT::inverseBigBlock(SliceArray<byte>& input, SliceArray<byte>& output, int
     // Lazy dynamic memory allocations
     if ((_buffer == nullptr) || (_bufferSize < count + 1)) {
         if (_buffer != nullptr)
-            delete[] _buffer;
+            freeLF(_buffer);
 
         _bufferSize = count + 1;
-        _buffer = new uint[_bufferSize];
+        _buffer = allocateLF(_bufferSize);
     }
 
     byte* src = &input._array[input._index];
@@ -357,42 +447,50 @@ bool BWT::inverseBigBlock(SliceArray<byte>& input, SliceArray<byte>& output, int
             p = data[p];
         }
     }
-#ifdef CONCURRENCY_ENABLED
     else {
-        // Several chunks may be decoded concurrently (depending on the availability
-        // of jobs per block).
         const int st = count / chunks;
         const int ckSize = (chunks * st == count) ? st : st + 1;
-        const int nbTasks = (_jobs < chunks) ? _jobs : chunks;
-        int* jobsPerTask = new int[nbTasks];
-        Global::computeJobsPerTask(jobsPerTask, chunks, nbTasks);
-        vector<future<int> > futures;
-        vector<InverseBigChunkTask<int>*> tasks;
-
-        // Create one task per job
-        for (int j = 0, c = 0; j < nbTasks; j++) {
-            // Each task decodes jobsPerTask[j] chunks
-            const int start = c * ckSize;
-
-            InverseBigChunkTask<int>* task = new InverseBigChunkTask<int>(data, buckets, fastBits, dst, _primaryIndexes,
-                count, start, ckSize, c, c + jobsPerTask[j]);
-            tasks.push_back(task);
-            futures.push_back(async(launch::async, &InverseBigChunkTask<int>::run, task));
-            c += jobsPerTask[j];
-        }
-
-        // Wait for completion of all concurrent tasks
-        for (int j = 0; j < nbTasks; j++)
-            futures[j].get();
+        int nbTasks = 1;
 
-        // Cleanup
-        for (InverseBigChunkTask<int>* task : tasks)
-            delete task;
+#ifdef CONCURRENCY_ENABLED
+        nbTasks = (_jobs < chunks) ? _jobs : chunks;
+#endif
 
-        tasks.clear();
-        delete[] jobsPerTask;
-    }
+        if (nbTasks == 1) {
+            inverseChunks(data, buckets, fastBits, _primaryIndexes, dst, count, ckSize, 0, chunks);
+        }
+#ifdef CONCURRENCY_ENABLED
+        else {
+            // Several chunks may be decoded concurrently (depending on the availability
+            // of jobs per block).
+            int* jobsPerTask = new int[nbTasks];
+            Global::computeJobsPerTask(jobsPerTask, chunks, nbTasks);
+            vector<future<int> > futures;
+            vector<InverseBigChunkTask<int>*> tasks;
+
+            // Create one task per job
+            for (int j = 0, c = 0; j < nbTasks; j++) {
+                // Each task decodes jobsPerTask[j] chunks
+                InverseBigChunkTask<int>* task = new InverseBigChunkTask<int>(data, buckets, fastBits, dst, _primaryIndexes,
+                    count, ckSize, c, c + jobsPerTask[j]);
+                tasks.push_back(task);
+                futures.push_back(async(launch::async, &InverseBigChunkTask<int>::run, task));
+                c += jobsPerTask[j];
+            }
+
+            // Wait for completion of all concurrent tasks
+            for (int j = 0; j < nbTasks; j++)
+                futures[j].get();
+
+            // Cleanup
+            for (InverseBigChunkTask<int>* task : tasks)
+                delete task;
+
+            tasks.clear();
+            delete[] jobsPerTask;
+        }
 #endif
+    }
 
     dst[count - 1] = byte(lastc);
     delete[] fastBits;
@@ -402,9 +500,68 @@ bool BWT::inverseBigBlock(SliceArray<byte>& input, SliceArray<byte>& output, int
     return true;
 }
 
+// The LF walks of the chunks are independent: they are interleaved so that
+// the cache misses of one chunk overlap with the work on the other chunks,
+// and the next entries of each walk are prefetched.
+void BWT::inverseChunks(const uint data[], const uint buckets[], const uint16 fastBits[],
+    const int primaryIndexes[], byte dst[], int total, int ckSize, int firstChunk, int lastChunk)
+{
+    int shift = 0;
+
+    while ((total >> shift) > MASK_FASTBITS)
+        shift++;
+
+    const int nbChunks = lastChunk - firstChunk;
+    uint p[BWT_MAX_CHUNKS];
+    int idx[BWT_MAX_CHUNKS]; // next position to decode (2 symbols per step)
+    int end[BWT_MAX_CHUNKS];
+    int steps = total;
+
+    for (int c = 0, start = firstChunk * ckSize; c < nbChunks; c++) {
+        end[c] = min(start + ckSize, total - 1);
+        idx[c] = start + 1;
+        p[c] = primaryIndexes[firstChunk + c];
+        steps = min(steps, max(end[c] - start + 1, 0) >> 1);
+        start = end[c];
+    }
+
+    // All chunks in lockstep
+    for (int s = 0; s < steps; s++) {
+        for (int c = 0; c < nbChunks; c++) {
+            uint16 sym = fastBits[p[c] >> shift];
+
+            while (buckets[sym] <= p[c])
+                sym++;
+
+            dst[idx[c] - 1] = byte(sym >> 8);
+            dst[idx[c]] = byte(sym);
+            idx[c] += 2;
+            p[c] = data[p[c]];
+            prefetchRead(&data[p[c]]);
+            prefetchRead(&fastBits[p[c] >> shift]);
+        }
+    }
+
+    // Tail of the longer chunks
+    for (int c = 0; c < nbChunks; c++) {
+        uint pc = p[c];
+
+        for (int i = idx[c]; i <= end[c]; i += 2) {
+            uint16 sym = fastBits[pc >> shift];
+
+            while (buckets[sym] <= pc)
+                sym++;
+
+            dst[i - 1] = byte(sym >> 8);
+            dst[i] = byte(sym);
+            pc = data[pc];
+        }
+    }
+}
+
 template <class T>
 InverseBigChunkTask<T>::InverseBigChunkTask(uint* buf, uint* buckets, uint16* fastBits, byte* output,
-    int* primaryIndexes, int total, int start, int ckSize, int firstChunk, int lastChunk)
+    int* primaryIndexes, int total, int ckSize, int firstChunk, int lastChunk)
 {
     _data = buf;
     _fastBits = fastBits;
@@ -412,7 +569,6 @@ InverseBigChunkTask<T>::InverseBigChunkTask(uint* buf, uint* buckets, uint16* fa
     _primaryIndexes = primaryIndexes;
     _dst = output;
     _total = total;
-    _start = start;
     _ckSize = ckSize;
     _firstChunk = firstChunk;
     _lastChunk = lastChunk;
@@ -421,29 +577,8 @@ InverseBigChunkTask<T>::InverseBigChunkTask(uint* buf, uint* buckets, uint16* fa
 template <class T>
 T InverseBigChunkTask<T>::run() THROW
 {
-    int shift = 0;
-
-    while ((_total >> shift) > BWT::MASK_FASTBITS)
-        shift++;
-
-    for (int c = _firstChunk; c < _lastChunk; c++) {
-        const int end = min(_start + _ckSize, _total - 1);
-        uint p = _primaryIndexes[c];
-
-        for (int i = _start + 1; i <= end; i += 2) {
-            uint16 s = _fastBits[p >> shift];
-
-            while (_buckets[s] <= (const uint) p)
-                s++;
-
-            _dst[i - 1] = byte(s >> 8);
-            _dst[i] = byte(s);
-            p = _data[p];
-        }
-
-        _start = end;
-    }
-
+    BWT::inverseChunks(_data, _buckets, _fastBits, _primaryIndexes, _dst, _total, _ckSize,
+        _firstChunk, _lastChunk);
     return T(0);
 }
 
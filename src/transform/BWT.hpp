@@ -18,7 +18,8 @@ limitations under the License.
 
 #include "../Transform.hpp"
 #include "../concurrent.hpp"
-#include "DivSufSort.hpp"
+#include "../Context.hpp"
+#include "SuffixSorter.hpp"
 
 using namespace std;
 
@@ -67,14 +68,13 @@ namespace kanzi {
        int* _primaryIndexes;
        byte* _dst;
        int _total;
-       int _start;
        int _ckSize;
        int _firstChunk;
        int _lastChunk;
 
    public:
        InverseBigChunkTask(uint* buf, uint* buckets, uint16* fastBits, byte* output,
-           int* primaryIndexes, int total, int start, int ckSize, int firstChunk, int lastChunk);
+           int* primaryIndexes, int total, int ckSize, int firstChunk, int lastChunk);
        ~InverseBigChunkTask() {}
 
        T run() THROW;
@@ -91,8 +91,13 @@ namespace kanzi {
        int* _sa; 
        int _bufferSize;
        int _primaryIndexes[8];
-       DivSufSort _saAlgo;
+       SuffixSorter _saAlgo;
        int _jobs;
+       bool _releaseBuffers; // release the work buffers after each block
+
+       void init(int jobs) THROW;
+
+       void freeBuffers();
 
        bool inverseBigBlock(SliceArray<byte>& input, SliceArray<byte>& output, int count);
 
@@ -103,6 +108,13 @@ namespace kanzi {
 
        BWT(int jobs = 1);
 
+       // The suffix sorting engine is selected by 'suffixSorter' (see SuffixSorter).
+       // If 'releaseBuffers' is true, the suffix array (forward) or the inverse
+       // links (inverse) are freed after each block instead of being kept
+       // for the next block. This does not lower the peak memory of a block
+       // (4 bytes per byte), only the memory held between blocks.
+       BWT(Context& ctx);
+
        ~BWT();
 
        bool forward(SliceArray<byte>& input, SliceArray<byte>& output, int length) THROW;
@@ -116,6 +128,10 @@ namespace kanzi {
        static int maxBlockSize() { return MAX_BLOCK_SIZE; }
 
        static int getBWTChunks(int size);
+
+       // Decode the chunks [firstChunk, lastChunk) of a big block
+       static void inverseChunks(const uint data[], const uint buckets[], const uint16 fastBits[],
+           const int primaryIndexes[], byte dst[], int total, int ckSize, int firstChunk, int lastChunk);
    };
 }
 #endif
@@ -121,6 +121,10 @@ bool BWTS::forward(SliceArray<byte>& input, SliceArray<byte>& output, int count)
     dst[0] = src[count - 1];
     input._index += count;
     output._index += count;
+
+    if (_releaseBuffers == true)
+        freeBuffers();
+
     return true;
 }
 
@@ -227,5 +231,9 @@ bool BWTS::inverse(SliceArray<byte>& input, SliceArray<byte>& output, int count)
 
     input._index += count;
     output._index += count;
+
+    if (_releaseBuffers == true)
+        freeBuffers();
+
     return true;
 }
@@ -18,7 +18,7 @@ limitations under the License.
 
 #include "../Context.hpp"
 #include "../Transform.hpp"
-#include "DivSufSort.hpp"
+#include "SuffixSorter.hpp"
 
 using namespace std;
 
@@ -39,7 +39,17 @@ namespace kanzi
        int* _buffer1;
        int* _buffer2;
        int _bufferSize;
-       DivSufSort _saAlgo;
+       SuffixSorter _saAlgo;
+       bool _releaseBuffers; // release the work buffers after each block
+
+       void freeBuffers()
+       {
+           delete[] _buffer1;
+           delete[] _buffer2;
+           _buffer1 = new int[0];
+           _buffer2 = new int[0];
+           _bufferSize = 0;
+       }
 
        int moveLyndonWordHead(int sa[], int isa[], byte data[], int count, int start, int size, int rank);
 
@@ -49,13 +59,19 @@ namespace kanzi
            _buffer1 = new int[0];
            _buffer2 = new int[0];
            _bufferSize = 0;
+           _releaseBuffers = false;
        }
 
-       BWTS(Context&)
+       // The suffix sorting engine is selected by 'suffixSorter' (see SuffixSorter).
+       // If 'releaseBuffers' is true, the work buffers are freed after each
+       // block (the peak memory of a block is unchanged).
+       BWTS(Context& ctx)
+           : _saAlgo(ctx)
        {
            _buffer1 = new int[0];
            _buffer2 = new int[0];
            _bufferSize = 0;
+           _releaseBuffers = string(ctx.getString("releaseBuffers")) == STR_TRUE;
        }
 
        ~BWTS() 
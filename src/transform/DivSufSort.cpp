@@ -19,6 +19,11 @@ limitations under the License.
 #include <stddef.h>
 #include "DivSufSort.hpp"
 
+#ifdef CONCURRENCY_ENABLED
+#include <memory>
+#include <vector>
+#endif
+
 using namespace kanzi;
 
 const int DivSufSort::SQQ_TABLE[] = {
@@ -53,9 +58,11 @@ const int DivSufSort::LOG_TABLE[] = {
     7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
 };
 
-DivSufSort::DivSufSort()
+DivSufSort::DivSufSort(int jobs, ThreadPool* pool)
 {
     _length = 0;
+    _jobs = (jobs < 1) ? 1 : jobs;
+    _pool = pool;
     _ssStack = new Stack(SS_MISORT_STACKSIZE);
     _trStack = new Stack(TR_STACKSIZE);
     _mergeStack = new Stack(SS_SMERGE_STACKSIZE);
@@ -315,21 +322,7 @@ int DivSufSort::sortTypeBstar(int bucketA[], int bucketB[], int n)
         _sa[bucketB[c0]] = m - 1;
 
         // Sort the type B* substrings using ssSort.
-        const int bufSize = n - m - m;
-        c0 = 254;
-
-        for (int j = m; j > 0; c0--) {
-            const int idx = c0 << 8;
-
-            for (int c1 = 255; c1 > c0; c1--) {
-                const int i = bucketB[idx + c1];
-
-                if (j > i + 1)
-                    ssSort(pab, i, j, m, bufSize, 2, n, _sa[i] == m - 1);
-
-                j = i;
-            }
-        }
+        ssSortBuckets(bucketB, pab, m, n - m - m, n);
 
         // Compute ranks of type B* substrings.
         for (int i = m - 1; i >= 0; i--) {
@@ -411,6 +404,85 @@ int DivSufSort::sortTypeBstar(int bucketA[], int bucketB[], int n)
     return m;
 }
 
+#ifdef CONCURRENCY_ENABLED
+static bool isLargerRange(const pair<int, int>& r1, const pair<int, int>& r2)
+{
+    return r1.second - r1.first > r2.second - r2.first;
+}
+#endif
+
+// Sort the type B* substrings of each bucket using ssSort. The buckets are
+// independent: with several jobs, they are sorted concurrently, each job
+// using its own part of the work buffer (as the OpenMP version of
+// libdivsufsort). The tasks run on the thread pool and the calling thread
+// sorts buckets as well. Since the caller may itself be a worker of the pool
+// (EX: a block encoding task), it only waits for the tasks that have started:
+// the others find the batch closed. Without pool, the buckets are sorted
+// by the calling thread.
+void DivSufSort::ssSortBuckets(int bucketB[], int pab, int m, int bufSize, int n)
+{
+#ifdef CONCURRENCY_ENABLED
+    if ((_jobs > 1) && (_pool != nullptr) && (n >= PARALLEL_MIN_LENGTH)) {
+        shared_ptr<SubStringSortBatch> batch = make_shared<SubStringSortBatch>();
+        vector<pair<int, int> >& ranges = batch->_ranges;
+
+        for (int j = m, c0 = 254; j > 0; c0--) {
+            const int idx = c0 << 8;
+
+            for (int c1 = 255; c1 > c0; c1--) {
+                const int i = bucketB[idx + c1];
+
+                if (j > i + 1)
+                    ranges.push_back(pair<int, int>(i, j));
+
+                j = i;
+            }
+        }
+
+        const int nbRanges = int(ranges.size());
+
+        if (nbRanges > 1) {
+            // Largest buckets first, for a better balance of the jobs
+            sort(ranges.begin(), ranges.end(), isLargerRange);
+            const int nbTasks = (_jobs < nbRanges) ? _jobs : nbRanges;
+            const int size = bufSize / nbTasks;
+
+            // The task of the calling thread uses the first part of the buffer
+            for (int t = 1; t < nbTasks; t++) {
+                shared_ptr<SubStringSortTask<int> > task = make_shared<SubStringSortTask<int> >(batch,
+                    _sa, _buffer, pab, m, m + t * size, size, n);
+                _pool->schedule(&SubStringSortTask<int>::run, task);
+            }
+
+            SubStringSortTask<int> task(batch, _sa, _buffer, pab, m, m, size, n);
+            task.run();
+
+            // All the buckets are taken: wait for the tasks still sorting
+            unique_lock<mutex> lock(batch->_mutex);
+            batch->_closed = true;
+
+            while (batch->_running > 0)
+                batch->_cond.wait(lock);
+
+            return;
+        }
+    }
+#endif
+
+    for (int j = m, c0 = 254; j > 0; c0--) {
+        const int idx = c0 << 8;
+
+        for (int c1 = 255; c1 > c0; c1--) {
+            const int i = bucketB[idx + c1];
+
+            if (j > i + 1)
+                ssSort(pab, i, j, m, bufSize, 2, n, _sa[i] == m - 1);
+
+            j = i;
+        }
+    }
+}
+
 // Sub String Sort
 void DivSufSort::ssSort(const int pa, int first, int last, int buf, int bufSize,
     int depth, int n, bool lastSuffix)
@@ -2207,3 +2279,57 @@ TRBudget::TRBudget(int chance, int incval)
     _incVal = incval;
     _count = 0;
 }
+
+
+#ifdef CONCURRENCY_ENABLED
+template <class T>
+SubStringSortTask<T>::SubStringSortTask(shared_ptr<SubStringSortBatch> batch, int sa[], uint8 buffer[],
+    int pab, int m, int buf, int bufSize, int n)
+    : _batch(batch)
+{
+    _sa = sa;
+    _buffer = buffer;
+    _pab = pab;
+    _m = m;
+    _buf = buf;
+    _bufSize = bufSize;
+    _n = n;
+}
+
+template <class T>
+T SubStringSortTask<T>::run() THROW
+{
+    SubStringSortBatch& batch = *_batch;
+
+    {
+        unique_lock<mutex> lock(batch._mutex);
+
+        if (batch._closed == true)
+            return T(0);
+
+        batch._running++;
+    }
+
+    // Private stacks
+    DivSufSort ds;
+    ds._sa = _sa;
+    ds._buffer = _buffer;
+    const int nbRanges = int(batch._ranges.size());
+
+    while (true) {
+        const int r = batch._next.fetch_add(1);
+
+        if (r >= nbRanges)
+            break;
+
+        const int first = batch._ranges[r].first;
+        const int last = batch._ranges[r].second;
+        ds.ssSort(_pab, first, last, _buf, _bufSize, 2, _n, _sa[first] == _m - 1);
+    }
+
+    unique_lock<mutex> lock(batch._mutex);
+    batch._running--;
+    batch._cond.notify_all();
+    return T(0);
+}
+#endif
@@ -17,6 +17,7 @@ limitations under the License.
 #define _DivSufSort_
 
 #include "../types.hpp"
+#include "../concurrent.hpp"
 
 #if __cplusplus >= 201103L
 #include <utility>
@@ -120,8 +121,31 @@ namespace kanzi
 
 
 
+#ifdef CONCURRENCY_ENABLED
+    template <class T>
+    class SubStringSortTask;
+
+    // Buckets of type B* substrings shared by the tasks sorting them
+    class SubStringSortBatch
+    {
+    public:
+        vector<pair<int, int> > _ranges; // first and last index of each bucket
+        atomic_int _next; // next bucket to sort
+        mutex _mutex;
+        condition_variable _cond;
+        int _running; // tasks sorting buckets
+        bool _closed; // no more task may start
+
+        SubStringSortBatch() : _next(0) { _running = 0; _closed = false; }
+    };
+#endif
+
     class DivSufSort
     {
+#ifdef CONCURRENCY_ENABLED
+        friend class SubStringSortTask<int>;
+#endif
+
     private:
         static const int SS_INSERTIONSORT_THRESHOLD = 8;
         static const int SS_BLOCKSIZE = 1024;
@@ -129,10 +153,13 @@ namespace kanzi
         static const int SS_SMERGE_STACKSIZE = 32;
         static const int TR_STACKSIZE = 64;
         static const int TR_INSERTIONSORT_THRESHOLD = 8;
+        static const int PARALLEL_MIN_LENGTH = 1 << 20;
         static const int SQQ_TABLE[];
         static const int LOG_TABLE[];
 
         int _length;
+        int _jobs;
+        ThreadPool* _pool; // not owned, may be null
         int* _sa;
         uint8* _buffer;
         Stack* _ssStack;
@@ -145,6 +172,8 @@ namespace kanzi
 
         int sortTypeBstar(int32 bucketA[], int32 bucketB[], int n);
 
+        void ssSortBuckets(int32 bucketB[], int pab, int m, int bufSize, int n);
+
         void ssSort(int pa, int first, int last, int buf, int bufSize,
             int depth, int n, bool lastSuffix);
 
@@ -216,7 +245,11 @@ namespace kanzi
         int trIlg(int n);
 
     public:
-        DivSufSort();
+        // With several jobs and a thread pool, the type B* substrings of
+        // different buckets are sorted concurrently by the workers of the pool
+        // and the calling thread. The suffix array does not depend on the
+        // number of jobs.
+        DivSufSort(int jobs = 1, ThreadPool* pool = nullptr);
 
         ~DivSufSort();
 
@@ -324,5 +357,31 @@ namespace kanzi
         return (x < y* y) ? y - 1 : y;
     }
 
+
+#ifdef CONCURRENCY_ENABLED
+    // Sort the type B* substrings of buckets taken from a shared batch, using
+    // a private part of the work buffer and private stacks. A task started
+    // after the batch is closed does nothing.
+    template <class T>
+    class SubStringSortTask : public Task<T> {
+    private:
+        shared_ptr<SubStringSortBatch> _batch;
+        int* _sa;
+        uint8* _buffer;
+        int _pab;
+        int _m;
+        int _buf;
+        int _bufSize;
+        int _n;
+
+    public:
+        SubStringSortTask(shared_ptr<SubStringSortBatch> batch, int sa[], uint8 buffer[],
+            int pab, int m, int buf, int bufSize, int n);
+
+        ~SubStringSortTask() {}
+
+        T run() THROW;
+    };
+#endif
 }
 #endif
\ No newline at end of file
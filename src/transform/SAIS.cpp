@@ -0,0 +1,236 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <cstring>
+#include "SAIS.hpp"
+
+using namespace kanzi;
+
+// Suffix types: bit set for a S type suffix (smaller than the next suffix)
+static inline bool isTypeS(const uint8 types[], int i)
+{
+    return (types[i >> 3] & (1 << (i & 7))) != 0;
+}
+
+// Left most S type suffix (S type suffix following a L type suffix)
+static inline bool isLMS(const uint8 types[], int i)
+{
+    return (i > 0) && (isTypeS(types, i) == true) && (isTypeS(types, i - 1) == false);
+}
+
+template <class T>
+static void countSymbols(const T text[], int counts[], int n, int k)
+{
+    memset(&counts[0], 0, sizeof(int) * k);
+
+    for (int i = 0; i < n; i++)
+        counts[text[i]]++;
+}
+
+void SAIS::computeSuffixArray(byte input[], int sa[], int start, int length)
+{
+    if (length <= 0)
+        return;
+
+    const uint8* text = reinterpret_cast<uint8*>(&input[start]);
+    sortSuffixes(text, sa, 0, length, 256, _lowMemory);
+}
+
+// Compute the start (or end) of each bucket
+template <class T>
+void SAIS::getBuckets(const T text[], int counts[], int buckets[], int n, int k, bool end)
+{
+    // In low memory mode, the counts are overwritten by the buckets
+    if (counts == buckets)
+        countSymbols(text, counts, n, k);
+
+    int sum = 0;
+
+    if (end == true) {
+        for (int i = 0; i < k; i++) {
+            sum += counts[i];
+            buckets[i] = sum;
+        }
+    }
+    else {
+        for (int i = 0; i < k; i++) {
+            const int c = counts[i];
+            buckets[i] = sum;
+            sum += c;
+        }
+    }
+}
+
+// Sort all suffixes from the LMS suffixes in 'sa' (the other slots set to -1):
+// the L type suffixes from the start of the buckets, then the S type suffixes
+// from the end of the buckets.
+template <class T>
+void SAIS::induceSA(const T text[], int sa[], const uint8 types[], int counts[], int buckets[], int n, int k)
+{
+    getBuckets(text, counts, buckets, n, k, false);
+
+    // The last suffix is L type since the virtual sentinel is the smallest suffix
+    sa[buckets[text[n - 1]]++] = n - 1;
+
+    for (int i = 0; i < n; i++) {
+        const int j = sa[i] - 1;
+
+        if ((j >= 0) && (isTypeS(types, j) == false))
+            sa[buckets[text[j]]++] = j;
+    }
+
+    getBuckets(text, counts, buckets, n, k, true);
+
+    for (int i = n - 1; i >= 0; i--) {
+        const int j = sa[i] - 1;
+
+        if ((j >= 0) && (isTypeS(types, j) == true))
+            sa[--buckets[text[j]]] = j;
+    }
+}
+
+// Suffix array of text[0..n-1] with symbols in [0..k-1]. 'sa' has n + fs
+// slots, the fs last ones being free for the bucket arrays and the reduced
+// problem.
+template <class T>
+void SAIS::sortSuffixes(const T text[], int sa[], int fs, int n, int k, bool lowMemory)
+{
+    const int typesSize = (n >> 3) + 1;
+    uint8* types = new uint8[typesSize];
+    memset(&types[0], 0, typesSize);
+
+    // The suffix n-1 is L type (the virtual sentinel is smaller)
+    for (int i = n - 2; i >= 0; i--) {
+        if ((text[i] < text[i + 1]) || ((text[i] == text[i + 1]) && (isTypeS(types, i + 1) == true)))
+            types[i >> 3] |= uint8(1 << (i & 7));
+    }
+
+    // Bucket arrays in the free space if possible
+    const int nbArrays = (lowMemory == true) ? 1 : 2;
+    int* allocated = nullptr;
+    int* counts;
+
+    if (nbArrays * k <= fs) {
+        fs -= nbArrays * k;
+        counts = &sa[n + fs];
+    }
+    else {
+        allocated = new int[nbArrays * k];
+        counts = allocated;
+    }
+
+    int* buckets = (lowMemory == true) ? counts : &counts[k];
+
+    if (lowMemory == false)
+        countSymbols(text, counts, n, k);
+
+    // Stage 1: sort the LMS substrings
+    getBuckets(text, counts, buckets, n, k, true);
+
+    for (int i = 0; i < n; i++)
+        sa[i] = -1;
+
+    for (int i = 1; i < n; i++) {
+        if (isLMS(types, i) == true)
+            sa[--buckets[text[i]]] = i;
+    }
+
+    induceSA(text, sa, types, counts, buckets, n, k);
+
+    // Move the sorted LMS substrings to the first m slots
+    int m = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (isLMS(types, sa[i]) == true)
+            sa[m++] = sa[i];
+    }
+
+    // Name the LMS substrings (LMS positions are at least 2 apart, so the
+    // names fit in sa[m..n-1])
+    for (int i = m; i < n; i++)
+        sa[i] = -1;
+
+    int name = 0;
+    int prev = -1;
+
+    for (int i = 0; i < m; i++) {
+        const int pos = sa[i];
+        bool diff = false;
+
+        for (int d = 0; ; d++) {
+            // A substring reaching the virtual sentinel is unique
+            if ((prev == -1) || (pos + d == n) || (prev + d == n)
+                || (text[pos + d] != text[prev + d])
+                || (isTypeS(types, pos + d) != isTypeS(types, prev + d))) {
+                diff = true;
+                break;
+            }
+
+            if ((d > 0) && ((isLMS(types, pos + d) == true) || (isLMS(types, prev + d) == true)))
+                break;
+        }
+
+        if (diff == true) {
+            name++;
+            prev = pos;
+        }
+
+        sa[m + (pos >> 1)] = name - 1;
+    }
+
+    // Reduced problem at the end of the work space, in text order
+    int* s1 = &sa[n + fs - m];
+
+    for (int i = n - 1, j = m - 1; i >= m; i--) {
+        if (sa[i] >= 0)
+            s1[j--] = sa[i];
+    }
+
+    // Stage 2: sort the LMS suffixes, recursively if the names are not unique
+    if (name < m) {
+        sortSuffixes(static_cast<const int*>(s1), sa, n + fs - m - m, m, name, lowMemory);
+    }
+    else {
+        for (int i = 0; i < m; i++)
+            sa[s1[i]] = i;
+    }
+
+    // Stage 3: induce the suffix array from the sorted LMS suffixes
+    for (int i = 1, j = 0; i < n; i++) {
+        if (isLMS(types, i) == true)
+            s1[j++] = i;
+    }
+
+    for (int i = 0; i < m; i++)
+        sa[i] = s1[sa[i]];
+
+    for (int i = m; i < n; i++)
+        sa[i] = -1;
+
+    getBuckets(text, counts, buckets, n, k, true);
+
+    for (int i = m - 1; i >= 0; i--) {
+        const int j = sa[i];
+        sa[i] = -1;
+        sa[--buckets[text[j]]] = j;
+    }
+
+    induceSA(text, sa, types, counts, buckets, n, k);
+
+    if (allocated != nullptr)
+        delete[] allocated;
+
+    delete[] types;
+}
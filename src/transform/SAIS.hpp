@@ -0,0 +1,57 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _SAIS_
+#define _SAIS_
+
+#include "../types.hpp"
+
+using namespace std; // for C++17
+
+namespace kanzi
+{
+
+    // Suffix array construction by induced sorting (SA-IS), after
+    // Ge Nong, Sen Zhang and Wai Hong Chan, [Two Efficient Algorithms for
+    // Linear Time Suffix Array Construction], IEEE Transactions on Computers, 2011.
+    // Linear in the worst case, whereas DivSufSort can be much slower than its
+    // average on highly repetitive data. The suffix array is the same as the
+    // one computed by DivSufSort.
+    // The recursion works in the space left in the suffix array. In low memory
+    // mode, a single bucket array is used per level (the bucket sizes are
+    // counted again before each pass), at the cost of some speed.
+    class SAIS
+    {
+    private:
+        bool _lowMemory;
+
+        template <class T>
+        static void sortSuffixes(const T text[], int sa[], int fs, int n, int k, bool lowMemory);
+
+        template <class T>
+        static void induceSA(const T text[], int sa[], const uint8 types[], int counts[], int buckets[], int n, int k);
+
+        template <class T>
+        static void getBuckets(const T text[], int counts[], int buckets[], int n, int k, bool end);
+
+    public:
+        SAIS(bool lowMemory = false) { _lowMemory = lowMemory; }
+
+        ~SAIS() {}
+
+        void computeSuffixArray(byte input[], int sa[], int start, int length);
+    };
+}
+#endif
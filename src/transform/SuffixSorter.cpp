@@ -0,0 +1,82 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include "SuffixSorter.hpp"
+
+using namespace kanzi;
+
+SuffixSorter::SuffixSorter(int jobs, int type)
+    : _divSufSort(jobs)
+    , _sais(type == SAIS_LOWMEM_TYPE)
+{
+    _type = type;
+}
+
+SuffixSorter::SuffixSorter(Context& ctx, int jobs) THROW
+    : _divSufSort(jobs, ctx.getPool())
+    , _sais(false)
+{
+    _type = getType(ctx.getString("suffixSorter", "DIVSUFSORT"));
+    _sais = SAIS(_type == SAIS_LOWMEM_TYPE);
+}
+
+void SuffixSorter::computeSuffixArray(byte input[], int sa[], int start, int length)
+{
+    if (_type == DIVSUFSORT_TYPE)
+        _divSufSort.computeSuffixArray(input, sa, start, length);
+    else
+        _sais.computeSuffixArray(input, sa, start, length);
+}
+
+int SuffixSorter::getType(const char* cname) THROW
+{
+    string name(cname);
+    transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+    if (name == "DIVSUFSORT")
+        return DIVSUFSORT_TYPE;
+
+    if (name == "SAIS")
+        return SAIS_TYPE;
+
+    if (name == "SAIS_LOWMEM")
+        return SAIS_LOWMEM_TYPE;
+
+    stringstream ss;
+    ss << "Unknown suffix sorter: '" << name << "'";
+    throw invalid_argument(ss.str());
+}
+
+const char* SuffixSorter::getName(int type) THROW
+{
+    switch (type) {
+    case DIVSUFSORT_TYPE:
+        return "DIVSUFSORT";
+
+    case SAIS_TYPE:
+        return "SAIS";
+
+    case SAIS_LOWMEM_TYPE:
+        return "SAIS_LOWMEM";
+
+    default:
+        stringstream ss;
+        ss << "Unknown suffix sorter type: '" << type << "'";
+        throw invalid_argument(ss.str());
+    }
+}
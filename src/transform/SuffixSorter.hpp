@@ -0,0 +1,62 @@
+/*
+Copyright 2011-2020 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _SuffixSorter_
+#define _SuffixSorter_
+
+#include <string>
+#include "../Context.hpp"
+#include "DivSufSort.hpp"
+#include "SAIS.hpp"
+
+using namespace std;
+
+namespace kanzi
+{
+
+    // Suffix array construction for BWT and BWTS with the engine selected by
+    // the 'suffixSorter' entry of the context: DIVSUFSORT (default, fastest
+    // on most data), SAIS (linear worst case) or SAIS_LOWMEM (SAIS with less
+    // memory). All engines produce the same suffix array, so the choice has
+    // no impact on the bitstream.
+    class SuffixSorter
+    {
+    public:
+        static const int DIVSUFSORT_TYPE = 0;
+        static const int SAIS_TYPE = 1;
+        static const int SAIS_LOWMEM_TYPE = 2;
+
+        SuffixSorter(int jobs = 1, int type = DIVSUFSORT_TYPE);
+
+        // Throw an invalid_argument if the engine name is unknown
+        SuffixSorter(Context& ctx, int jobs = 1) THROW;
+
+        ~SuffixSorter() {}
+
+        void computeSuffixArray(byte input[], int sa[], int start, int length);
+
+        int getType() const { return _type; }
+
+        static int getType(const char* name) THROW;
+
+        static const char* getName(int type) THROW;
+
+    private:
+        int _type;
+        DivSufSort _divSufSort;
+        SAIS _sais;
+    };
+}
+#endif
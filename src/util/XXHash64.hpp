@@ -0,0 +1,130 @@
+/*
+Copyright 2011-2017 Frederic Langlet
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+you may obtain a copy of the License at
+
+                http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _XXHash64_
+#define _XXHash64_
+
+#include <ctime>
+#include "../Memory.hpp"
+
+using namespace kanzi;
+
+namespace kanzi
+{
+
+   // XXHash is an extremely fast hash algorithm. It was written by Yann Collet.
+   // Original source code: https://github.com/Cyan4973/xxHash
+   // The 64 bit variant reads 32 bytes per iteration (4 independent lanes).
+
+   class XXHash64 {
+   private:
+       static const uint64 PRIME64_1 = uint64(0x9E3779B185EBCA87);
+       static const uint64 PRIME64_2 = uint64(0xC2B2AE3D27D4EB4F);
+       static const uint64 PRIME64_3 = uint64(0x165667B19E3779F9);
+       static const uint64 PRIME64_4 = uint64(0x85EBCA77C2B2AE63);
+       static const uint64 PRIME64_5 = uint64(0x27D4EB2F165667C5);
+
+       uint64 _seed;
+
+       static uint64 round(uint64 acc, uint64 val);
+
+       static uint64 mergeRound(uint64 acc, uint64 val);
+
+   public:
+       XXHash64() { _seed = uint64(time(nullptr)); }
+
+       XXHash64(uint64 seed) { _seed = seed; }
+
+       ~XXHash64(){}
+
+       void setSeed(uint64 seed) { _seed = seed; }
+
+       uint64 hash(byte data[], int length);
+   };
+
+   inline uint64 XXHash64::hash(byte data[], int length)
+   {
+       uint64 h64;
+       int idx = 0;
+
+       if (length >= 32) {
+           const int end32 = length - 32;
+           uint64 v1 = _seed + PRIME64_1 + PRIME64_2;
+           uint64 v2 = _seed + PRIME64_2;
+           uint64 v3 = _seed;
+           uint64 v4 = _seed - PRIME64_1;
+
+           do {
+               v1 = round(v1, LittleEndian::readLong64(&data[idx]));
+               v2 = round(v2, LittleEndian::readLong64(&data[idx + 8]));
+               v3 = round(v3, LittleEndian::readLong64(&data[idx + 16]));
+               v4 = round(v4, LittleEndian::readLong64(&data[idx + 24]));
+               idx += 32;
+           } while (idx <= end32);
+
+           h64 = ((v1 << 1) | (v1 >> 63));
+           h64 += ((v2 << 7) | (v2 >> 57));
+           h64 += ((v3 << 12) | (v3 >> 52));
+           h64 += ((v4 << 18) | (v4 >> 46));
+           h64 = mergeRound(h64, v1);
+           h64 = mergeRound(h64, v2);
+           h64 = mergeRound(h64, v3);
+           h64 = mergeRound(h64, v4);
+       }
+       else {
+           h64 = _seed + PRIME64_5;
+       }
+
+       h64 += uint64(length);
+
+       while (idx <= length - 8) {
+           h64 ^= round(0, LittleEndian::readLong64(&data[idx]));
+           h64 = ((h64 << 27) | (h64 >> 37)) * PRIME64_1 + PRIME64_4;
+           idx += 8;
+       }
+
+       if (idx <= length - 4) {
+           h64 ^= (uint64(uint32(LittleEndian::readInt32(&data[idx]))) * PRIME64_1);
+           h64 = ((h64 << 23) | (h64 >> 41)) * PRIME64_2 + PRIME64_3;
+           idx += 4;
+       }
+
+       while (idx < length) {
+           h64 ^= ((uint64(data[idx]) & 0xFF) * PRIME64_5);
+           h64 = ((h64 << 11) | (h64 >> 53)) * PRIME64_1;
+           idx++;
+       }
+
+       h64 ^= (h64 >> 33);
+       h64 *= PRIME64_2;
+       h64 ^= (h64 >> 29);
+       h64 *= PRIME64_3;
+       return h64 ^ (h64 >> 32);
+   }
+
+   inline uint64 XXHash64::round(uint64 acc, uint64 val)
+   {
+       acc += (val * PRIME64_2);
+       return ((acc << 31) | (acc >> 33)) * PRIME64_1;
+   }
+
+   inline uint64 XXHash64::mergeRound(uint64 acc, uint64 val)
+   {
+       acc ^= round(0, val);
+       return acc * PRIME64_1 + PRIME64_4;
+   }
+
+}
+#endif